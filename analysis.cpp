@@ -0,0 +1,306 @@
+#include "analysis.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mips.h"
+
+struct Worklist {
+  uint32_t* items;
+  size_t size;
+  size_t capacity;
+};
+
+static bool worklist_push(Worklist* list, const uint32_t item) {
+  if (list->size == list->capacity) {
+    const size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+    uint32_t* items = (uint32_t*) realloc(list->items, capacity * sizeof(uint32_t));
+    if (items == NULL) return false;
+    list->items = items;
+    list->capacity = capacity;
+  }
+  list->items[list->size++] = item;
+  return true;
+}
+
+static inline uint32_t read_word(const byte* at) {
+  return at[0] << 24 | at[1] << 16 | at[2] << 8 | at[3];
+}
+
+static bool edges_push(XrefEdges* edges, const DecodedInstruction& inst) {
+  if (edges->size == edges->capacity) {
+    const size_t capacity = edges->capacity ? edges->capacity * 2 : 1024;
+    XrefEdge* items = (XrefEdge*) realloc(edges->items, capacity * sizeof(XrefEdge));
+    if (items == NULL) return false;
+    edges->items = items;
+    edges->capacity = capacity;
+  }
+  XrefEdge* edge = &edges->items[edges->size++];
+  edge->from = inst.pc;
+  edge->to = inst.target;
+  if (inst.flags & MIPS_LINK) edge->kind = XREF_CALL;
+  else if (inst.flags & MIPS_JUMP) edge->kind = XREF_JUMP;
+  else edge->kind = XREF_BRANCH;
+  return true;
+}
+
+void xref_edges_free(XrefEdges* edges) {
+  free(edges->items);
+  edges->items = NULL;
+  edges->size = 0;
+  edges->capacity = 0;
+}
+
+// index of the word at address pc, words if it's outside of the area
+static inline uint32_t word_index(const CodeMap& map, const uint32_t pc) {
+  const uint32_t offset = pc - map.base_pc;
+  if (offset % 4 != 0 || offset / 4 >= map.words) return map.words;
+  return offset / 4;
+}
+
+// the flow doesn't go past the delay slot of this instruction
+static inline bool ends_flow(const DecodedInstruction& inst) {
+  switch (inst.mnemonic) {
+    case MN_J:
+    case MN_JR:
+      return true;
+    // beq $zero, $zero is b
+    case MN_BEQ:
+    case MN_BEQL:
+      return inst.rs == inst.rt;
+    // bgez $zero is b too
+    case MN_BGEZ:
+    case MN_BGEZL:
+      return inst.rs == 0;
+    default:
+      return false;
+  }
+}
+
+bool code_map_build(CodeMap* map, const byte* data, const uint32_t start, const uint32_t end,
+                    const uint32_t base_pc, const uint32_t entry, const int options,
+                    XrefEdges* edges) {
+  bool ok = false;
+  Worklist list = {NULL, 0, 0};
+
+  map->start = start;
+  map->base_pc = base_pc;
+  map->words = (end - start) / 4;
+  map->reachable = 0;
+  map->visited = (uint32_t*) calloc(map->words / 32 + 1, sizeof(uint32_t));
+  if (map->visited == NULL) goto cleanup;
+
+  if (!worklist_push(&list, word_index(*map, entry))) goto cleanup;
+
+  while (list.size > 0) {
+    uint32_t index = list.items[--list.size];
+    // the walk stops after this index, set on the delay slot
+    uint32_t last = map->words;
+    for (; index < map->words && index <= last; ++index) {
+      if (code_map_reachable(*map, index)) break;
+      DecodedInstruction inst;
+      const uint32_t pc = base_pc + index * 4;
+      if (!mips_decode(pc, read_word(&data[start + index * 4]), &inst, options)) break;
+      map->visited[index / 32] |= 1u << (index % 32);
+      ++map->reachable;
+
+      if (inst.mnemonic == MN_ERET) break;
+      if (inst.target != 0) {
+        if (edges != NULL && !edges_push(edges, inst)) goto cleanup;
+        const uint32_t target = word_index(*map, inst.target);
+        if (target < map->words && !code_map_reachable(*map, target)) {
+          if (!worklist_push(&list, target)) goto cleanup;
+        }
+      }
+      if (ends_flow(inst)) last = index + 1;
+    }
+  }
+  ok = true;
+
+cleanup:
+  free(list.items);
+  if (!ok) code_map_free(map);
+  return ok;
+}
+
+void code_map_free(CodeMap* map) {
+  free(map->visited);
+  map->visited = NULL;
+  map->words = 0;
+  map->reachable = 0;
+}
+
+static const uint32_t REG_SP = 29;
+static const uint32_t REG_RA = 31;
+
+struct Candidate {
+  uint32_t pc;
+  uint8_t flags;
+};
+
+struct Candidates {
+  Candidate* items;
+  size_t size;
+  size_t capacity;
+};
+
+static bool candidates_push(Candidates* list, const uint32_t pc, const uint8_t flags) {
+  if (list->size == list->capacity) {
+    const size_t capacity = list->capacity ? list->capacity * 2 : 256;
+    Candidate* items = (Candidate*) realloc(list->items, capacity * sizeof(Candidate));
+    if (items == NULL) return false;
+    list->items = items;
+    list->capacity = capacity;
+  }
+  list->items[list->size].pc = pc;
+  list->items[list->size].flags = flags;
+  ++list->size;
+  return true;
+}
+
+static int compare_candidates(const void* a, const void* b) {
+  const uint32_t pc_a = ((const Candidate*) a)->pc;
+  const uint32_t pc_b = ((const Candidate*) b)->pc;
+  return pc_a < pc_b ? -1 : pc_a > pc_b;
+}
+
+static inline bool is_return(const DecodedInstruction& inst) {
+  return inst.mnemonic == MN_JR && inst.rs == REG_RA;
+}
+
+static inline bool is_prologue(const DecodedInstruction& inst) {
+  return inst.mnemonic == MN_ADDIU && inst.rs == REG_SP && inst.rt == REG_SP && inst.imm < 0;
+}
+
+static inline void decode_at(const CodeMap& map, const byte* data, const uint32_t index,
+                             const int options, DecodedInstruction* inst) {
+  mips_decode(map.base_pc + index * 4, read_word(&data[map.start + index * 4]), inst, options);
+}
+
+bool function_index_build(FunctionIndex* index, const byte* data, const CodeMap& map,
+                          const uint32_t entry, const int options) {
+  bool ok = false;
+  Candidates list = {NULL, 0, 0};
+  size_t count = 0;
+
+  index->count = 0;
+  index->start = NULL;
+  index->end = NULL;
+  index->flags = NULL;
+
+  if (word_index(map, entry) < map.words && !candidates_push(&list, entry, FUNC_ENTRY)) goto cleanup;
+
+  // starts, in any order and with duplicates
+  {
+    // the previous word ends code, so a prologue here starts a function
+    bool after_end = true;
+    for (uint32_t i = 0; i < map.words; ++i) {
+      if (!code_map_reachable(map, i)) {
+        after_end = true;
+        continue;
+      }
+      DecodedInstruction inst;
+      decode_at(map, data, i, options, &inst);
+      if (inst.mnemonic == MN_JAL && word_index(map, inst.target) < map.words) {
+        if (!candidates_push(&list, inst.target, FUNC_CALLED)) goto cleanup;
+      }
+      if (after_end && is_prologue(inst)) {
+        if (!candidates_push(&list, inst.pc, FUNC_PROLOGUE)) goto cleanup;
+      }
+      // the word after a return is its delay slot, the one after that is new code
+      if (is_return(inst) && i + 1 < map.words && code_map_reachable(map, i + 1)) {
+        decode_at(map, data, ++i, options, &inst);
+        if (inst.mnemonic == MN_JAL && word_index(map, inst.target) < map.words) {
+          if (!candidates_push(&list, inst.target, FUNC_CALLED)) goto cleanup;
+        }
+        after_end = true;
+        continue;
+      }
+      after_end = false;
+    }
+  }
+
+  qsort(list.items, list.size, sizeof(Candidate), compare_candidates);
+
+  {
+    // at least one so an empty index isn't taken as a failed malloc
+    const size_t slots = list.size > 0 ? list.size : 1;
+    index->start = (uint32_t*) malloc(slots * sizeof(uint32_t));
+    index->end = (uint32_t*) malloc(slots * sizeof(uint32_t));
+    index->flags = (uint8_t*) malloc(slots);
+  }
+  if (index->start == NULL || index->end == NULL || index->flags == NULL) goto cleanup;
+
+  for (size_t i = 0; i < list.size; ++i) {
+    if (count > 0 && index->start[count - 1] == list.items[i].pc) {
+      index->flags[count - 1] |= list.items[i].flags;
+      continue;
+    }
+    index->start[count] = list.items[i].pc;
+    index->flags[count] = list.items[i].flags;
+    ++count;
+  }
+
+  // ends, the function is scanned up to the next one or to a gap
+  for (size_t f = 0; f < count; ++f) {
+    const uint32_t first = word_index(map, index->start[f]);
+    const uint32_t limit = f + 1 < count ? word_index(map, index->start[f + 1]) : map.words;
+    uint32_t i = first;
+    uint32_t end = 0;
+    for (; i < limit && code_map_reachable(map, i); ++i) {
+      DecodedInstruction inst;
+      decode_at(map, data, i, options, &inst);
+      if (is_return(inst)) end = i + 2 < limit ? i + 2 : limit;
+    }
+    if (end != 0) index->flags[f] |= FUNC_RETURNS;
+    else end = i;
+    index->end[f] = map.base_pc + end * 4;
+  }
+
+  index->count = count;
+  ok = true;
+
+cleanup:
+  free(list.items);
+  if (!ok) function_index_free(index);
+  return ok;
+}
+
+void function_index_free(FunctionIndex* index) {
+  free(index->start);
+  free(index->end);
+  free(index->flags);
+  index->start = NULL;
+  index->end = NULL;
+  index->flags = NULL;
+  index->count = 0;
+}
+
+long function_index_find(const FunctionIndex& index, const uint32_t pc) {
+  // last function starting at or before pc
+  size_t low = 0;
+  size_t high = index.count;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    if (index.start[mid] <= pc) low = mid + 1;
+    else high = mid;
+  }
+  if (low == 0 || pc >= index.end[low - 1]) return -1;
+  return low - 1;
+}
+
+bool function_index_write(const FunctionIndex& index, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) return false;
+  for (size_t f = 0; f < index.count; ++f) {
+    fprintf(file, "0x%08X 0x%05X func_%08X%s%s%s%s\n", index.start[f],
+            index.end[f] - index.start[f], index.start[f],
+            (index.flags[f] & FUNC_ENTRY) ? " entry" : "",
+            (index.flags[f] & FUNC_CALLED) ? " called" : "",
+            (index.flags[f] & FUNC_PROLOGUE) ? " prologue" : "",
+            (index.flags[f] & FUNC_RETURNS) ? " returns" : "");
+  }
+  const bool written = ferror(file) == 0;
+  return fclose(file) == 0 && written;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defs.h"
+
+/*
+  Recursive descent from the entry point: only the words the CPU can
+  reach by following the control flow are taken as code.
+
+  A worklist holds the targets still to walk. Each walk goes forward
+  from its target, queuing branch and jump targets, until it ends on
+  an unconditional jump or branch (after its delay slot), an eret, an
+  invalid word or a word already visited. A visited bitmap, one bit per
+  word, makes sure every word is walked once.
+  Targets outside of the area (other segments loaded at run time,
+  register jumps) are not followed.
+*/
+
+// XrefEdge kinds
+static const uint8_t XREF_CALL   = 0;
+static const uint8_t XREF_JUMP   = 1;
+static const uint8_t XREF_BRANCH = 2;
+
+// A jal/j/branch from one instruction to its target address
+struct XrefEdge {
+  uint32_t from;
+  uint32_t to;
+  uint8_t kind;
+};
+
+struct XrefEdges {
+  XrefEdge* items;
+  size_t size;
+  size_t capacity;
+};
+
+void xref_edges_free(XrefEdges* edges);
+
+struct CodeMap {
+  // ROM offset of the first word of the area, and its address
+  uint32_t start;
+  uint32_t base_pc;
+  uint32_t words;
+  // reachable words
+  uint32_t* visited;
+  uint32_t reachable;
+};
+
+// Walk the big endian words of data in [start, end), the first one
+// is at base_pc, from the instruction at entry.
+// The control flow edges met on the way are added to edges if not NULL,
+// including the ones leaving the area.
+bool code_map_build(CodeMap* map, const byte* data, const uint32_t start, const uint32_t end,
+                    const uint32_t base_pc, const uint32_t entry, const int options,
+                    XrefEdges* edges = NULL);
+void code_map_free(CodeMap* map);
+
+inline bool code_map_reachable(const CodeMap& map, const uint32_t index) {
+  return (map.visited[index / 32] >> (index % 32)) & 1;
+}
+
+/*
+  Functions found in the reachable code, sorted by address.
+  A function starts at the entry point, at a jal target or at an
+  `addiu $sp, $sp, -N` prologue following the end of other code. It
+  ends after the delay slot of its last `jr $ra` before the next
+  function, or where the reachable code or the next function starts.
+  The fields are in separate arrays so the lookup only touches start.
+*/
+
+// FunctionIndex flags
+static const uint8_t FUNC_ENTRY    = 1 << 0;
+static const uint8_t FUNC_CALLED   = 1 << 1;
+static const uint8_t FUNC_PROLOGUE = 1 << 2;
+static const uint8_t FUNC_RETURNS  = 1 << 3;
+
+struct FunctionIndex {
+  size_t count;
+  // addresses, end is exclusive
+  uint32_t* start;
+  uint32_t* end;
+  uint8_t* flags;
+};
+
+bool function_index_build(FunctionIndex* index, const byte* data, const CodeMap& map,
+                          const uint32_t entry, const int options);
+void function_index_free(FunctionIndex* index);
+// Function containing pc, -1 if there is none
+long function_index_find(const FunctionIndex& index, const uint32_t pc);
+// Symbol listing, one function per line: start, size, name and flags
+bool function_index_write(const FunctionIndex& index, const char* path);
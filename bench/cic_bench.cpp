@@ -0,0 +1,58 @@
+// Compare the scalar and SIMD CIC checksum loops over the 1MB area.
+// make bench && ./bench/cic_bench [runs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "cic.h"
+
+typedef void (*UpdateFn)(CicState*, const byte*, const uint32_t, const uint32_t, const int32_t);
+
+static const uint32_t CHECKSUM_END = CHECKSUM_START + CHECKSUM_LENGTH;
+
+static double time_once(const UpdateFn fn, const byte* rom, const int32_t bootcode,
+                        uint32_t* out_crc) {
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  CicState state;
+  cic_init(&state, bootcode);
+  fn(&state, rom, CHECKSUM_START, CHECKSUM_END, bootcode);
+  cic_final(state, bootcode, out_crc);
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char **argv) {
+  const int runs = argc > 1 ? atoi(argv[1]) : 50;
+
+  byte* rom = (byte*) malloc(CHECKSUM_END);
+  srand(64);
+  for (uint32_t i = 0; i < CHECKSUM_END; ++i) rom[i] = rand();
+
+  const int32_t bootcodes[] = {6102, 6103, 6105, 6106};
+  for (size_t b = 0; b < sizeof(bootcodes) / sizeof(bootcodes[0]); ++b) {
+    uint32_t scalar_crc[2];
+    uint32_t simd_crc[2];
+    // best time of several runs, alternated so both loops see the same
+    // clock, the machine is rarely quiet
+    double scalar = 1e9;
+    double simd = 1e9;
+    for (int i = 0; i < runs; ++i) {
+      scalar = std::min(scalar, time_once(cic_update_scalar, rom, bootcodes[b], scalar_crc));
+      simd = std::min(simd, time_once(cic_update, rom, bootcodes[b], simd_crc));
+    }
+    printf("CIC %i  scalar %6.3f ms  simd %6.3f ms  x%.2f\n", bootcodes[b],
+           scalar * 1e3, simd * 1e3, scalar / simd);
+    if (memcmp(scalar_crc, simd_crc, sizeof(scalar_crc)) != 0) {
+      printf("CRC mismatch: %08x %08x / %08x %08x\n",
+             scalar_crc[0], scalar_crc[1], simd_crc[0], simd_crc[1]);
+      return -1;
+    }
+  }
+
+  free(rom);
+  return 0;
+}
@@ -0,0 +1,44 @@
+// Compare the CRC32 paths on the IPL3 bootcode size.
+// make bench && ./bench/crc32_bench [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+#include "crc32.h"
+
+// HEADER_SIZE to BOOTCODE_ENDS
+static const size_t BOOTCODE_SIZE = 0x1000 - 0x40;
+
+typedef uint32_t (*Crc32Fn)(const byte*, const size_t);
+
+static uint32_t run(const char* name, const Crc32Fn fn, const byte* data, const long iterations) {
+  uint32_t crc = 0;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; ++i) crc ^= fn(data, BOOTCODE_SIZE);
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  const double mb = (double) BOOTCODE_SIZE * iterations / 1024 / 1024;
+  printf("%-10s %8.1f MB/s  %8.0f ns/bootcode\n", name, mb / elapsed.count(),
+         elapsed.count() * 1e9 / iterations);
+  return crc;
+}
+
+int main(int argc, char **argv) {
+  const long iterations = argc > 1 ? atol(argv[1]) : 100000;
+
+  byte data[BOOTCODE_SIZE];
+  srand(64);
+  for (size_t i = 0; i < BOOTCODE_SIZE; ++i) data[i] = rand();
+
+  const uint32_t bytewise = run("bytewise", crc32_bytewise, data, iterations);
+  const uint32_t slice8 = run("slice8", crc32_slice8, data, iterations);
+  const uint32_t clmul = run("clmul", crc32_clmul, data, iterations);
+
+  if (slice8 != bytewise || clmul != bytewise) {
+    printf("CRC mismatch: %08x %08x %08x\n", bytewise, slice8, clmul);
+    return -1;
+  }
+  return 0;
+}
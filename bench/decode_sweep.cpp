@@ -0,0 +1,137 @@
+// Decode every 32 bits word, on several threads, and report the words/s
+// of each thread. The accepted words make a bitmap (bit n of byte n / 8
+// for word n) whose CRC32 is printed, with the count of each mnemonic.
+// With a name, name.bits and name.hist are written so the decoders of
+// two builds can be compared with cmp and diff.
+// make bench && ./bench/decode_sweep [threads] [name] [log2 words]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "crc32.h"
+#include "disasm.h"
+
+// words per claim, a multiple of 8 so the threads never share a byte
+static const uint64_t BLOCK_WORDS = 1 << 20;
+// histogram slots, the rejected words are split in invalid and reserved
+static const size_t SLOT_RESERVED = MN_COUNT;
+static const size_t SLOTS = MN_COUNT + 1;
+
+static const char* const slot_names[SLOTS] = {
+#define X(id, text, flags) #id,
+  MIPS_MNEMONICS(X)
+#undef X
+  "RESERVED"
+};
+
+struct Worker {
+  uint64_t words;
+  double seconds;
+  uint64_t histogram[SLOTS];
+};
+
+struct Sweep {
+  uint64_t words;
+  byte* bitmap;
+  std::atomic<uint64_t> next;
+};
+
+static void sweep_worker(Sweep* sweep, Worker* worker) {
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (;;) {
+    const uint64_t from = sweep->next.fetch_add(BLOCK_WORDS);
+    if (from >= sweep->words) break;
+    uint64_t to = from + BLOCK_WORDS;
+    if (to > sweep->words) to = sweep->words;
+
+    for (uint64_t word = from; word < to; word += 8) {
+      byte bits = 0;
+      for (uint32_t i = 0; i < 8; ++i) {
+        DecodedInstruction inst;
+        if (mips_decode(0x80000000, (uint32_t) (word + i), &inst)) {
+          bits |= 1 << i;
+          ++worker->histogram[inst.mnemonic];
+        } else if (inst.format == FMT_RESERVED) {
+          ++worker->histogram[SLOT_RESERVED];
+        } else {
+          ++worker->histogram[MN_INVALID];
+        }
+      }
+      sweep->bitmap[word / 8] = bits;
+    }
+    worker->words += to - from;
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  worker->seconds = elapsed.count();
+}
+
+static bool write_file(const char* name, const char* ext, const void* data, const size_t size) {
+  char file_name[128];
+  snprintf(file_name, sizeof(file_name), "%s.%s", name, ext);
+  FILE* file = fopen(file_name, "wb");
+  if (file == NULL) return false;
+  const bool ok = fwrite(data, 1, size, file) == size;
+  return fclose(file) == 0 && ok;
+}
+
+int main(int argc, char **argv) {
+  const unsigned threads = argc > 1 ? atoi(argv[1]) : disasm_default_threads();
+  const char* name = argc > 2 ? argv[2] : NULL;
+  const unsigned bits = argc > 3 ? atoi(argv[3]) : 32;
+  if (threads == 0 || bits < 3 || bits > 32) {
+    printf("usage: %s [threads] [name] [log2 words, 3 to 32]\n", argv[0]);
+    return -1;
+  }
+
+  Sweep sweep;
+  sweep.words = (uint64_t) 1 << bits;
+  sweep.bitmap = (byte*) malloc(sweep.words / 8);
+  sweep.next = 0;
+  std::vector<Worker> workers(threads);
+  if (sweep.bitmap == NULL) return -1;
+  memset(&workers[0], 0, threads * sizeof(Worker));
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; ++t) pool.push_back(std::thread(sweep_worker, &sweep, &workers[t]));
+  for (unsigned t = 0; t < threads; ++t) pool[t].join();
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  uint64_t histogram[SLOTS] = {0};
+  for (unsigned t = 0; t < threads; ++t) {
+    printf("thread %2u  %12llu words  %8.3f s  %12.0f words/s\n", t,
+           (unsigned long long) workers[t].words, workers[t].seconds,
+           workers[t].seconds > 0 ? workers[t].words / workers[t].seconds : 0.0);
+    for (size_t slot = 0; slot < SLOTS; ++slot) histogram[slot] += workers[t].histogram[slot];
+  }
+  const uint64_t accepted = sweep.words - histogram[MN_INVALID] - histogram[SLOT_RESERVED];
+  printf("total      %12llu words  %8.3f s  %12.0f words/s\n", (unsigned long long) sweep.words,
+         elapsed.count(), sweep.words / elapsed.count());
+  printf("accepted   %12llu  reserved %llu  bitmap crc32 %08X\n", (unsigned long long) accepted,
+         (unsigned long long) histogram[SLOT_RESERVED], crc32(sweep.bitmap, sweep.words / 8));
+
+  if (name != NULL) {
+    // one "NAME count" line per slot, in enum order
+    std::vector<char> text(SLOTS * 40);
+    size_t size = 0;
+    for (size_t slot = 0; slot < SLOTS; ++slot) {
+      size += snprintf(&text[size], text.size() - size, "%s %llu\n", slot_names[slot],
+                       (unsigned long long) histogram[slot]);
+    }
+    if (!write_file(name, "bits", sweep.bitmap, sweep.words / 8) ||
+        !write_file(name, "hist", &text[0], size)) {
+      printf("Couldn't write %s.bits and %s.hist\n", name, name);
+      free(sweep.bitmap);
+      return -1;
+    }
+  }
+
+  free(sweep.bitmap);
+  return 0;
+}
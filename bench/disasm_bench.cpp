@@ -0,0 +1,60 @@
+// Linear sweep throughput, serial and with 2..N worker threads.
+// make bench && ./bench/disasm_bench [MB] [max threads]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "disasm.h"
+
+static const char* BENCH_FILE = "disasm_bench";
+
+static double run(const std::vector<byte>& data, const unsigned threads, uint32_t* out_end) {
+  static MipsContext ctx;
+  mips_context_init(&ctx);
+  mips_context_open(&ctx, BENCH_FILE);
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  *out_end = disasm_linear(&ctx, &data[0], 0, data.size(), 0x80000400, threads);
+  mips_context_close(&ctx);
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char **argv) {
+  const size_t size = (argc > 1 ? atol(argv[1]) : 16) << 20;
+  const unsigned max_threads = argc > 2 ? atoi(argv[2]) : disasm_default_threads();
+
+  // valid words only, so the whole area is swept
+  std::vector<byte> data(size);
+  srand(64);
+  for (size_t at = 0; at < size; ) {
+    const uint32_t word = (uint32_t) rand() << 16 ^ (uint32_t) rand();
+    DecodedInstruction inst;
+    if (!mips_decode(0, word, &inst)) continue;
+    data[at++] = word >> 24;
+    data[at++] = word >> 16;
+    data[at++] = word >> 8;
+    data[at++] = word;
+  }
+
+  uint32_t serial_end;
+  const double serial = run(data, 1, &serial_end);
+  printf("threads  1  %8.3f s  %8.1f MB/s\n", serial, size / serial / 1024 / 1024);
+  for (unsigned threads = 2; threads <= max_threads; ++threads) {
+    uint32_t end;
+    const double elapsed = run(data, threads, &end);
+    printf("threads %2u  %8.3f s  %8.1f MB/s  x%.2f\n", threads, elapsed,
+           size / elapsed / 1024 / 1024, serial / elapsed);
+    if (end != serial_end) {
+      printf("end mismatch: 0x%x 0x%x\n", serial_end, end);
+      return -1;
+    }
+  }
+
+  char file_name[64];
+  snprintf(file_name, sizeof(file_name), "%s.asm", BENCH_FILE);
+  remove(file_name);
+  return 0;
+}
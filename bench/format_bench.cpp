@@ -0,0 +1,68 @@
+// Throughput of the assembly text output, decode and format of valid words,
+// without and with the text cache. hot is the share of the lines taken
+// from 256 repeated encodings, like the common instructions of a ROM.
+// make bench && ./bench/format_bench [lines] [hot%]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "mips.h"
+
+static const char* BENCH_FILE = "format_bench";
+static const int RUNS = 5;
+
+int main(int argc, char **argv) {
+  const size_t lines = argc > 1 ? atol(argv[1]) : 2000000;
+  const int hot = argc > 2 ? atoi(argv[2]) : 50;
+
+  // random words, keep the ones that decode so every one is a line
+  std::vector<DecodedInstruction> insts;
+  insts.reserve(lines);
+  srand(64);
+  uint32_t pool[256];
+  for (size_t i = 0; i < 256; ) {
+    const uint32_t word = (uint32_t) rand() << 16 ^ (uint32_t) rand();
+    DecodedInstruction inst;
+    if (mips_decode(0, word, &inst)) pool[i++] = word;
+  }
+  uint32_t pc = 0x80000400;
+  while (insts.size() < lines) {
+    uint32_t word = (uint32_t) rand() << 16 ^ (uint32_t) rand();
+    if (rand() % 100 < hot) word = pool[word % 256];
+    DecodedInstruction inst;
+    if (!mips_decode(pc, word, &inst)) continue;
+    insts.push_back(inst);
+    pc += 4;
+  }
+
+  // best of several runs, alternating so both see the same machine
+  double best[2] = {1e9, 1e9};
+  double hits = 0;
+  for (int run = 0; run < RUNS * 2; ++run) {
+    const int cached = run % 2;
+    static MipsContext ctx;
+    mips_context_init(&ctx);
+    mips_context_open(&ctx, BENCH_FILE);
+    if (cached && !mips_context_enable_cache(&ctx)) return 1;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < insts.size(); ++i) mips_print(&ctx, insts[i]);
+    mips_context_close(&ctx);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (elapsed.count() < best[cached]) best[cached] = elapsed.count();
+    if (cached) hits = 100.0 * ctx.counters.cache_hits / insts.size();
+  }
+  for (int cached = 0; cached < 2; ++cached) {
+    printf("%-8s %zu lines  %8.3f s  %10.0f lines/s", cached ? "cached" : "plain", insts.size(),
+           best[cached], insts.size() / best[cached]);
+    if (cached) printf("  %.1f%% hits", hits);
+    printf("\n");
+  }
+
+  char file_name[64];
+  snprintf(file_name, sizeof(file_name), "%s.asm", BENCH_FILE);
+  remove(file_name);
+  return 0;
+}
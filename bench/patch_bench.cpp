@@ -0,0 +1,85 @@
+// Patch a random ROM image with Rom::patch and check the header CRCs
+// against a full calc_crc after each patch. Some patches rewrite the
+// bytes already there (the update stops at the next checkpoint), some
+// land in the bootcode (the checkpoints are rebuilt).
+// make bench && ./bench/patch_bench [patches]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "crc_check.h"
+#include "rom.h"
+
+static const long ROM_SIZE = 8 << 20;
+static const uint32_t MAX_PATCH = 256;
+
+// Patch kinds
+static const int PATCH_CODE = 0;
+static const int PATCH_UNCHANGED = 1;
+static const int PATCH_BOOTCODE = 2;
+static const int PATCH_KINDS = 3;
+
+static const char* const kind_names[PATCH_KINDS] = {"code", "unchanged", "bootcode"};
+
+int main(int argc, char **argv) {
+  const int patches = argc > 1 ? atoi(argv[1]) : 1000;
+
+  Rom rom;
+  memset(&rom, 0, sizeof(Rom));
+  rom.data = (byte*) malloc(ROM_SIZE);
+  if (rom.data == NULL) return -1;
+  rom.data_size = ROM_SIZE;
+  srand(64);
+  for (long i = 0; i < ROM_SIZE; ++i) rom.data[i] = rand();
+
+  double seconds[PATCH_KINDS] = {0};
+  int counts[PATCH_KINDS] = {0};
+  double full = 0;
+  byte bytes[MAX_PATCH];
+  for (int i = 0; i < patches; ++i) {
+    const int kind = rand() % 8 == 0 ? PATCH_BOOTCODE : rand() % 4 == 0 ? PATCH_UNCHANGED
+                                                                      : PATCH_CODE;
+    const uint32_t size = 1 + rand() % MAX_PATCH;
+    uint32_t offset;
+    if (kind == PATCH_BOOTCODE) {
+      offset = HEADER_SIZE + rand() % (BOOTCODE_SIZE - size);
+    } else {
+      // mostly in the checksum area, a few after it
+      offset = CHECKSUM_START + rand() % (CHECKSUM_LENGTH + CHECKSUM_LENGTH / 8);
+    }
+    for (uint32_t b = 0; b < size; ++b) {
+      bytes[b] = kind == PATCH_UNCHANGED ? rom.data[offset + b] : (byte) rand();
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!rom.patch(offset, bytes, size)) {
+      printf("patch %d at 0x%x failed\n", i, offset);
+      return -1;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    seconds[kind] += elapsed.count();
+    ++counts[kind];
+
+    start = std::chrono::steady_clock::now();
+    uint32_t crc[2];
+    const int32_t bootcode = calc_crc(crc, rom.data);
+    elapsed = std::chrono::steady_clock::now() - start;
+    full += elapsed.count();
+    if (crc[0] != rom.crc1 || crc[1] != rom.crc2 || bootcode != rom.bootcode) {
+      printf("patch %d (%s, 0x%x+0x%x): %08x %08x, calc_crc gives %08x %08x\n", i,
+             kind_names[kind], offset, size, rom.crc1, rom.crc2, crc[0], crc[1]);
+      return -1;
+    }
+  }
+
+  for (int kind = 0; kind < PATCH_KINDS; ++kind) {
+    printf("%-10s %5d patches  %8.3f ms/patch\n", kind_names[kind], counts[kind],
+           counts[kind] ? seconds[kind] * 1e3 / counts[kind] : 0.0);
+  }
+  printf("calc_crc   %5d runs     %8.3f ms/run\n", patches, full * 1e3 / patches);
+  rom.unload();
+  return 0;
+}
@@ -0,0 +1,59 @@
+// Compare the invalid word pre-filter paths with the full decoder on
+// words that all pass, so each one scans the whole area.
+// make bench && ./bench/scan_bench [MB]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "mips.h"
+
+typedef size_t (*ScanFn)(const byte*, const size_t);
+
+static size_t decode_all(const byte* words, const size_t count) {
+  DecodedInstruction block[1024];
+  size_t done = 0;
+  while (done < count) {
+    const size_t n = count - done < 1024 ? count - done : 1024;
+    const size_t valid = mips_decode_block(&words[done * 4], n, 0, block);
+    done += valid;
+    if (valid < n) break;
+  }
+  return done;
+}
+
+static size_t run(const char* name, const ScanFn fn, const std::vector<byte>& data) {
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  const size_t end = fn(&data[0], data.size() / 4);
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  printf("%-8s %8.3f s  %10.1f MB/s\n", name, elapsed.count(),
+         data.size() / elapsed.count() / 1024 / 1024);
+  return end;
+}
+
+int main(int argc, char **argv) {
+  const size_t size = (argc > 1 ? atol(argv[1]) : 64) << 20;
+
+  std::vector<byte> data(size);
+  srand(64);
+  for (size_t at = 0; at < size; ) {
+    const uint32_t word = (uint32_t) rand() << 16 ^ (uint32_t) rand();
+    DecodedInstruction inst;
+    if (!mips_decode(0, word, &inst)) continue;
+    data[at++] = word >> 24;
+    data[at++] = word >> 16;
+    data[at++] = word >> 8;
+    data[at++] = word;
+  }
+
+  const size_t decoded = run("decode", decode_all, data);
+  const size_t scalar = run("scalar", mips_find_invalid_scalar, data);
+  const size_t best = run("filter", mips_find_invalid, data);
+  if (scalar != decoded || best != decoded) {
+    printf("end mismatch: %zu %zu %zu\n", decoded, scalar, best);
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,54 @@
+// Locate the text runs of an image made of random bytes, zeroed areas
+// and Japanese strings planted every 64 KB, which must all be found.
+// make bench && ./bench/text_bench [MB]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "text.h"
+
+// "こんにちは、世界" in Shift JIS
+static const byte PLANTED[] = {
+  0x82, 0xB1, 0x82, 0xF1, 0x82, 0xC9, 0x82, 0xBF, 0x82, 0xCD, 0x81, 0x41, 0x90, 0xA2, 0x8A, 0x45
+};
+static const size_t STRIDE = 1 << 16;
+
+int main(int argc, char **argv) {
+  const size_t size = (argc > 1 ? atol(argv[1]) : 64) << 20;
+
+  std::vector<byte> data(size);
+  srand(64);
+  for (size_t at = 0; at < size; ++at) {
+    // half of each stride is zeroed like the padding of the banks
+    data[at] = (at / 4096) % 2 ? rand() : 0;
+  }
+  size_t planted = 0;
+  for (size_t at = STRIDE / 2; at + sizeof(PLANTED) + 1 < size; at += STRIDE, ++planted) {
+    data[at - 1] = 0;
+    memcpy(&data[at], PLANTED, sizeof(PLANTED));
+    data[at + sizeof(PLANTED)] = 0;
+  }
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  size_t runs = 0;
+  size_t found = 0;
+  float score = 0;
+  TextRun run;
+  for (uint32_t at = 0; text_find_run(&data[0], at, size, &run); at = run.start + run.size) {
+    ++runs;
+    score += run.score;
+    if (run.start % STRIDE == STRIDE / 2 && run.size == sizeof(PLANTED)) ++found;
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  printf("%zu MB  %8.3f s  %10.1f MB/s  %zu runs  mean score %.2f\n", size >> 20, elapsed.count(),
+         size / elapsed.count() / 1024 / 1024, runs, runs ? score / runs : 0.0f);
+  if (found != planted) {
+    printf("found %zu of the %zu planted strings\n", found, planted);
+    return -1;
+  }
+  return 0;
+}
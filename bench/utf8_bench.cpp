@@ -0,0 +1,129 @@
+// Compare sj2utf8 with the code point lookup and encoding it replaced,
+// on game like text (kana and kanji with some ASCII) and on mostly ASCII
+// text like the titles, every two bytes sequence is also checked to
+// convert the same.
+// make bench && ./bench/utf8_bench [MB]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "defs.h"
+#include "shift_js.h"
+#include "shift_js_table.h"
+
+typedef bool (*ConvertFn)(const uint8_t*, const size_t, char*);
+
+// sj2utf8 before the UTF-8 table
+static bool sj2utf8_encode(const uint8_t* input, const size_t input_size, char* out) {
+  const size_t size = 3 * input_size;
+  memset(out, '\0', size);
+
+  size_t i = 0;
+  size_t j = 0;
+  while(i < input_size) {
+    const char section = (input[i]) >> 4;
+
+    size_t offset;
+    if (section == 0x8) offset = 0x100;
+    else if (section == 0x9) offset = 0x1100;
+    else if (section == 0xE) offset = 0x2100;
+    else offset = 0;
+
+    if (offset) {
+      offset += ((input[i]) & 0xf) << 8;
+      ++i;
+      if (i >= input_size) break;
+    }
+    offset += input[i++];
+    offset <<= 1;
+
+    const uint16_t unicode = (shiftJIS_convTable[offset] << 8) | shiftJIS_convTable[offset + 1];
+
+    if (unicode < 0x80) {
+      out[j++] = unicode;
+    } else if (unicode < 0x800) {
+      out[j++] = 0xC0 | (unicode >> 6);
+      out[j++] = 0x80 | (unicode & 0x3f);
+    } else {
+      out[j++] = 0xE0 | (unicode >> 12);
+      out[j++] = 0x80 | ((unicode & 0xfff) >> 6);
+      out[j++] = 0x80 | (unicode & 0x3f);
+    }
+  }
+  j = size;
+  while (j != 0) {
+    if (out[j] == ' ') out[j] = '\0';
+    else if (out[j] != '\0') break;
+    --j;
+  }
+  return true;
+}
+
+// strings of 32 bytes like the ones of the text banks
+static const size_t STRING = 32;
+
+static double run(const char* name, const ConvertFn fn, const std::vector<byte>& text,
+                  std::vector<char>* out) {
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t at = 0; at + STRING <= text.size(); at += STRING) {
+    fn(&text[at], STRING, &(*out)[at * 3]);
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  printf("%-8s %8.3f s  %10.1f MB/s\n", name, elapsed.count(),
+         text.size() / elapsed.count() / 1024 / 1024);
+  return elapsed.count();
+}
+
+// text where ascii characters out of 8 are ASCII, the rest kana and kanji
+static bool compare(const char* name, const size_t size, const int ascii) {
+  std::vector<byte> text(size);
+  srand(64);
+  for (size_t at = 0; at < size; ) {
+    const int kind = rand() % 8;
+    if (kind < ascii || at + 1 == size) {
+      text[at++] = 0x20 + rand() % 0x5F;
+    } else {
+      // hiragana, katakana and level 1 kanji
+      const byte lead = kind < 4 ? 0x82 : kind < 6 ? 0x83 : 0x88 + rand() % 0x10;
+      text[at++] = lead;
+      text[at++] = 0x9F + rand() % 0x50;
+    }
+  }
+  std::vector<char> expected(size * 3 + 1);
+  std::vector<char> actual(size * 3 + 1);
+  printf("%s text\n", name);
+  const double before = run("encode", sj2utf8_encode, text, &expected);
+  const double after = run("table", sj2utf8, text, &actual);
+  printf("speedup  %8.2fx\n", before / after);
+  if (expected != actual) {
+    printf("output mismatch\n");
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const size_t size = (argc > 1 ? atol(argv[1]) : 64) << 20;
+
+  // every lead and trail byte, then every single byte
+  for (int first = 0; first < 256; ++first) {
+    for (int second = 0; second < 256; ++second) {
+      const uint8_t input[2] = {(uint8_t) first, (uint8_t) second};
+      char expected[7];
+      char actual[7];
+      sj2utf8_encode(input, 2, expected);
+      sj2utf8(input, 2, actual);
+      if (memcmp(expected, actual, 6) != 0) {
+        printf("mismatch on %02X %02X\n", first, second);
+        return -1;
+      }
+    }
+  }
+
+  return compare("kana", size, 1) && compare("ascii", size, 7) ? 0 : -1;
+}
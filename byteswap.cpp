@@ -0,0 +1,95 @@
+#include "byteswap.h"
+
+#include "simd.h"
+
+static void swap16_scalar(byte* data, const size_t size) {
+  for (size_t i = 0; i + 2 <= size; i += 2) {
+    const byte b = data[i];
+    data[i] = data[i+1];
+    data[i+1] = b;
+  }
+}
+
+static void swap32_scalar(byte* data, const size_t size) {
+  for (size_t i = 0; i + 4 <= size; i += 4) {
+    byte b = data[i];
+    data[i] = data[i+3];
+    data[i+3] = b;
+    b = data[i+1];
+    data[i+1] = data[i+2];
+    data[i+2] = b;
+  }
+}
+
+#ifdef HAS_X86_SIMD
+// SSE2 has no byte shuffle, so bytes are swapped with 16 bits shifts
+// and the 16 bits halves of each 32 bits word with word shuffles.
+TARGET_SSE2 static size_t swap16_sse2(byte* data, const size_t size) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i* p = (__m128i*) &data[i];
+    const __m128i v = _mm_loadu_si128(p);
+    _mm_storeu_si128(p, _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+  }
+  return i;
+}
+
+TARGET_SSE2 static size_t swap32_sse2(byte* data, const size_t size) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i* p = (__m128i*) &data[i];
+    __m128i v = _mm_loadu_si128(p);
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    _mm_storeu_si128(p, _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+  }
+  return i;
+}
+
+TARGET_AVX2 static size_t shuffle_avx2(byte* data, const size_t size, const __m256i mask) {
+  size_t i = 0;
+  // two registers per iteration to keep both load ports busy
+  for (; i + 64 <= size; i += 64) {
+    __m256i* p = (__m256i*) &data[i];
+    const __m256i a = _mm256_loadu_si256(p);
+    const __m256i b = _mm256_loadu_si256(p + 1);
+    _mm256_storeu_si256(p, _mm256_shuffle_epi8(a, mask));
+    _mm256_storeu_si256(p + 1, _mm256_shuffle_epi8(b, mask));
+  }
+  for (; i + 32 <= size; i += 32) {
+    __m256i* p = (__m256i*) &data[i];
+    _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), mask));
+  }
+  return i;
+}
+
+TARGET_AVX2 static size_t swap16_avx2(byte* data, const size_t size) {
+  const __m256i mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  return shuffle_avx2(data, size, mask);
+}
+
+TARGET_AVX2 static size_t swap32_avx2(byte* data, const size_t size) {
+  const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  return shuffle_avx2(data, size, mask);
+}
+#endif
+
+void swap16(byte* data, const size_t size) {
+  size_t done = 0;
+#ifdef HAS_X86_SIMD
+  if (cpu_has_avx2()) done = swap16_avx2(data, size);
+  else if (cpu_has_sse2()) done = swap16_sse2(data, size);
+#endif
+  swap16_scalar(&data[done], size - done);
+}
+
+void swap32(byte* data, const size_t size) {
+  size_t done = 0;
+#ifdef HAS_X86_SIMD
+  if (cpu_has_avx2()) done = swap32_avx2(data, size);
+  else if (cpu_has_sse2()) done = swap32_sse2(data, size);
+#endif
+  swap32_scalar(&data[done], size - done);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "defs.h"
+
+/*
+  In place byte order normalization of the ROM dumps to Z64 (big endian).
+  V64 dumps have every 16 bits word byte swapped.
+  N64 dumps have every 32 bits word byte swapped (little endian).
+  A trailing partial word is left untouched.
+*/
+
+void swap16(byte* data, const size_t size);
+void swap32(byte* data, const size_t size);
@@ -0,0 +1,259 @@
+/* Copyright notice for this file:
+ * Copyright (C) 2005 Parasyte
+ *
+ * Based on uCON64's N64 checksum algorithm by Andreas Sterbenz
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "cic.h"
+
+#include <string.h>
+
+#include "simd.h"
+
+// the 6105 checksum mixes in 64 words of the bootcode, cycling every 256 bytes
+static const uint32_t CIC6105_WORDS = HEADER_SIZE + 0x0710;
+
+#define ROL(i, b) (((i) << (b)) | ((i) >> ((32 - (b)) & 0x1F)))
+#define BYTES2LONG(b) ( (uint32_t)(b)[0] << 24 | \
+                        (b)[1] << 16 | \
+                        (b)[2] <<  8 | \
+                        (b)[3] )
+
+// t2 ^= (t2 > d) ? r : x
+// The comparison is random and would mispredict half the time as a branch.
+static inline uint32_t next_t2(const uint32_t t2, const uint32_t d, const uint32_t r, const uint32_t x) {
+#ifdef HAS_X86_SIMD
+  // GCC turns a ternary back into a branch here, force a conditional move.
+  // d < t2 only reads the carry flag, cmovb is a single uop where cmovbe
+  // (t2 <= d) needs two.
+  uint32_t next = t2 ^ x;
+  const uint32_t greater = t2 ^ r;
+  __asm__("cmpl %2, %3\n\tcmovb %1, %0" : "+r"(next) : "r"(greater), "r"(t2), "r"(d) : "cc");
+  return next;
+#else
+  const uint32_t greater = 0U - (uint32_t)(t2 > d);
+  return t2 ^ x ^ ((r ^ x) & greater);
+#endif
+}
+
+bool cic_init(CicState* state, const int32_t bootcode) {
+  uint32_t seed;
+  switch (bootcode) {
+      case 6101: // fallthrough
+      case 6102: seed = CHECKSUM_CIC6102; break;
+      case 6103: seed = CHECKSUM_CIC6103; break;
+      case 6105: seed = CHECKSUM_CIC6105; break;
+      case 6106: seed = CHECKSUM_CIC6106; break;
+      default:   return false;
+  }
+  state->t1 = state->t2 = state->t3 = state->t4 = state->t5 = state->t6 = seed;
+  return true;
+}
+
+void cic_update_scalar(CicState* state, const byte* rom, const uint32_t from, const uint32_t to,
+                       const int32_t bootcode) {
+  uint32_t t1 = state->t1, t2 = state->t2, t3 = state->t3;
+  uint32_t t4 = state->t4, t5 = state->t5, t6 = state->t6;
+
+  for (uint32_t i = from; i < to; i += 4) {
+    const uint32_t d = BYTES2LONG(&rom[i]);
+    const uint64_t sum = (uint64_t) t6 + d;
+    t4 += sum >> 32;
+    t6 = (uint32_t) sum;
+    t3 ^= d;
+    const uint32_t r = ROL(d, (d & 0x1F));
+    t5 += r;
+    t2 = next_t2(t2, d, r, t6 ^ d);
+
+    if (bootcode == 6105) t1 += BYTES2LONG(&rom[CIC6105_WORDS + (i & 0xFF)]) ^ d;
+    else t1 += t5 ^ d;
+  }
+
+  state->t1 = t1; state->t2 = t2; state->t3 = t3;
+  state->t4 = t4; state->t5 = t5; state->t6 = t6;
+}
+
+#ifdef HAS_X86_SIMD
+// inclusive prefix sum of the 8 lanes
+TARGET_AVX2 static inline __m256i prefix_sum(__m256i x) {
+  x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+  x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+  // carry the total of the low 128 bits into the high half
+  const __m256i low_total = _mm256_permutevar8x32_epi32(x, _mm256_set1_epi32(3));
+  return _mm256_add_epi32(x, _mm256_blend_epi32(_mm256_setzero_si256(), low_total, 0xF0));
+}
+
+TARGET_AVX2 static inline uint32_t sum_lanes(const __m256i x) {
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return (uint32_t) _mm_cvtsi128_si32(s);
+}
+
+TARGET_AVX2 static inline uint32_t xor_lanes(const __m256i x) {
+  __m128i s = _mm_xor_si128(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+  s = _mm_xor_si128(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_xor_si128(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return (uint32_t) _mm_cvtsi128_si32(s);
+}
+
+// next_t2() over the 8 lanes of d, r and x, read straight from memory.
+// The steps alternate between two registers so none needs a copy back.
+#define T2_STEP(k, t, next) \
+  "movl " t ", " next "\n\tmovl " t ", %2\n\t" \
+  "xorl 4*" #k "(%5), " next "\n\txorl 4*" #k "(%4), %2\n\t" \
+  "cmpl " t ", 4*" #k "(%3)\n\tcmovb %2, " next "\n\t"
+static inline uint32_t next_t2_lanes(uint32_t t2, const uint32_t* d, const uint32_t* r,
+                                     const uint32_t* x) {
+  uint32_t next;
+  uint32_t otherwise;
+  __asm__(T2_STEP(0, "%0", "%1") T2_STEP(1, "%1", "%0") T2_STEP(2, "%0", "%1")
+          T2_STEP(3, "%1", "%0") T2_STEP(4, "%0", "%1") T2_STEP(5, "%1", "%0")
+          T2_STEP(6, "%0", "%1") T2_STEP(7, "%1", "%0")
+          : "+&r"(t2), "=&r"(next), "=&r"(otherwise)
+          : "r"(d), "r"(r), "r"(x), "m"(*(const uint32_t(*)[8]) d),
+            "m"(*(const uint32_t(*)[8]) r), "m"(*(const uint32_t(*)[8]) x)
+          : "cc");
+  return t2;
+}
+#undef T2_STEP
+
+// 8 words per iteration, from must be 32 bytes aligned.
+// Returns where it stopped, the rest is left to the scalar loop.
+TARGET_AVX2 static uint32_t update_avx2(CicState* state, const byte* rom, const uint32_t from,
+                                        const uint32_t to, const int32_t bootcode) {
+  const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                         3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  const __m256i last_lane = _mm256_set1_epi32(7);
+  const __m256i low_half = _mm256_set1_epi64x(0xFFFFFFFF);
+  const __m256i rol_mask = _mm256_set1_epi32(0x1F);
+  const __m256i thirty_two = _mm256_set1_epi32(32);
+
+  __m256i boot[8];
+  if (bootcode == 6105) {
+    for (int k = 0; k < 8; ++k) {
+      const __m256i* p = (const __m256i*) &rom[CIC6105_WORDS + 32 * k];
+      boot[k] = _mm256_shuffle_epi8(_mm256_loadu_si256(p), bswap);
+    }
+  }
+
+  // t5 and t6 are kept broadcast in all lanes as the running value
+  __m256i t5 = _mm256_set1_epi32((int) state->t5);
+  __m256i t6 = _mm256_set1_epi32((int) state->t6);
+  __m256i t1 = _mm256_setzero_si256();
+  __m256i t3 = _mm256_setzero_si256();
+  __m256i sum_even = _mm256_setzero_si256();
+  __m256i sum_odd = _mm256_setzero_si256();
+  uint32_t t2 = state->t2;
+
+  alignas(32) uint32_t d_words[8];
+  alignas(32) uint32_t r_words[8];
+  alignas(32) uint32_t x_words[8];
+
+  uint32_t i = from;
+  for (; i + 32 <= to; i += 32) {
+    const __m256i d = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*) &rom[i]), bswap);
+    t3 = _mm256_xor_si256(t3, d);
+
+    // rotations, a shift by 32 gives 0 so ROL(d, 0) is d
+    const __m256i amount = _mm256_and_si256(d, rol_mask);
+    const __m256i r = _mm256_or_si256(_mm256_sllv_epi32(d, amount),
+                                      _mm256_srlv_epi32(d, _mm256_sub_epi32(thirty_two, amount)));
+
+    // t6 after each word, t4 counts its carries: the words are summed
+    // in 64 bits lanes and the high half of the total is taken at the end
+    const __m256i t6_after = _mm256_add_epi32(prefix_sum(d), t6);
+    t6 = _mm256_permutevar8x32_epi32(t6_after, last_lane);
+    sum_even = _mm256_add_epi64(sum_even, _mm256_and_si256(d, low_half));
+    sum_odd = _mm256_add_epi64(sum_odd, _mm256_srli_epi64(d, 32));
+
+    const __m256i t5_after = _mm256_add_epi32(prefix_sum(r), t5);
+    t5 = _mm256_permutevar8x32_epi32(t5_after, last_lane);
+
+    if (bootcode == 6105) t1 = _mm256_add_epi32(t1, _mm256_xor_si256(boot[(i & 0xFF) >> 5], d));
+    else t1 = _mm256_add_epi32(t1, _mm256_xor_si256(t5_after, d));
+
+    _mm256_store_si256((__m256i*) d_words, d);
+    _mm256_store_si256((__m256i*) r_words, r);
+    _mm256_store_si256((__m256i*) x_words, _mm256_xor_si256(t6_after, d));
+    t2 = next_t2_lanes(t2, d_words, r_words, x_words);
+  }
+
+  state->t1 += sum_lanes(t1);
+  state->t2 = t2;
+  state->t3 ^= xor_lanes(t3);
+  alignas(32) uint64_t sums[4];
+  _mm256_store_si256((__m256i*) sums, _mm256_add_epi64(sum_even, sum_odd));
+  state->t4 += (state->t6 + sums[0] + sums[1] + sums[2] + sums[3]) >> 32;
+  state->t5 = (uint32_t) _mm256_cvtsi256_si32(t5);
+  state->t6 = (uint32_t) _mm256_cvtsi256_si32(t6);
+  return i;
+}
+#endif
+
+void cic_update(CicState* state, const byte* rom, const uint32_t from, const uint32_t to,
+                const int32_t bootcode) {
+  uint32_t done = from;
+#ifdef HAS_X86_SIMD
+  if ((from & 0x1F) == 0 && cpu_has_avx2()) done = update_avx2(state, rom, from, to, bootcode);
+#endif
+  cic_update_scalar(state, rom, done, to, bootcode);
+}
+
+void cic_final(const CicState& state, const int32_t bootcode, uint32_t* out_crc) {
+  if (bootcode == 6103) {
+      out_crc[0] = (state.t6 ^ state.t4) + state.t3;
+      out_crc[1] = (state.t5 ^ state.t2) + state.t1;
+  } else if (bootcode == 6106) {
+      out_crc[0] = (state.t6 * state.t4) + state.t3;
+      out_crc[1] = (state.t5 * state.t2) + state.t1;
+  } else {
+      out_crc[0] = state.t6 ^ state.t4 ^ state.t3;
+      out_crc[1] = state.t5 ^ state.t2 ^ state.t1;
+  }
+}
+
+bool cic_checkpoints_build(CicCheckpoints* checkpoints, const byte* rom, const int32_t bootcode) {
+  if (!cic_init(&checkpoints->state[0], bootcode)) return false;
+  checkpoints->bootcode = bootcode;
+  for (uint32_t k = 0; k < CIC_CHECKPOINTS; ++k) {
+    const uint32_t start = CHECKSUM_START + k * CIC_CHECKPOINT_INTERVAL;
+    checkpoints->state[k+1] = checkpoints->state[k];
+    cic_update(&checkpoints->state[k+1], rom, start, start + CIC_CHECKPOINT_INTERVAL, bootcode);
+  }
+  return true;
+}
+
+void cic_checkpoints_update(CicCheckpoints* checkpoints, const byte* rom,
+                            const uint32_t from, const uint32_t to) {
+  const uint32_t end = CHECKSUM_START + CHECKSUM_LENGTH;
+  if (to <= CHECKSUM_START || from >= end) return;
+
+  uint32_t k = from < CHECKSUM_START ? 0 : (from - CHECKSUM_START) / CIC_CHECKPOINT_INTERVAL;
+  for (; k < CIC_CHECKPOINTS; ++k) {
+    const uint32_t start = CHECKSUM_START + k * CIC_CHECKPOINT_INTERVAL;
+    CicState next = checkpoints->state[k];
+    cic_update(&next, rom, start, start + CIC_CHECKPOINT_INTERVAL, checkpoints->bootcode);
+    // past the write the same state gives the same checksum
+    if (start >= to && memcmp(&next, &checkpoints->state[k+1], sizeof(next)) == 0) break;
+    checkpoints->state[k+1] = next;
+  }
+}
+
+void cic_checkpoints_crc(const CicCheckpoints& checkpoints, uint32_t* out_crc) {
+  cic_final(checkpoints.state[CIC_CHECKPOINTS], checkpoints.bootcode, out_crc);
+}
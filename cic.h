@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "defs.h"
+
+/*
+  CIC checksum engine, computes the CRC1/CRC2 pair stored in the header
+  over the first MB of code after the bootcode.
+
+  The accumulators are kept in a CicState so the checksum can be
+  computed in several steps over consecutive ranges of the area.
+  t3, t4, t5 and t6 only depend on the words (xor, sums and rotations)
+  and are reduced in SIMD lanes. t1 depends on the running t5 which is
+  a prefix sum. t2 depends on its own previous value and stays serial.
+*/
+
+static const uint32_t HEADER_SIZE      = 0x40;
+static const uint32_t BOOTCODE_SIZE    = 0x1000 - HEADER_SIZE;
+static const uint32_t CHECKSUM_START   = 0x00001000;
+static const uint32_t CHECKSUM_LENGTH  = 0x00100000;
+static const uint32_t CHECKSUM_CIC6102 = 0xF8CA4DDC;
+static const uint32_t CHECKSUM_CIC6103 = 0xA3886759;
+static const uint32_t CHECKSUM_CIC6105 = 0xDF26F436;
+static const uint32_t CHECKSUM_CIC6106 = 0x1FEA617A;
+
+struct CicState {
+  uint32_t t1, t2, t3;
+  uint32_t t4, t5, t6;
+};
+
+// false if the bootcode is unknown
+bool cic_init(CicState* state, const int32_t bootcode);
+
+// Accumulate the words of rom in [from, to), both multiple of 4.
+// rom is the whole image, the 6105 checksum reads into the bootcode.
+void cic_update(CicState* state, const byte* rom, const uint32_t from, const uint32_t to,
+                const int32_t bootcode);
+void cic_update_scalar(CicState* state, const byte* rom, const uint32_t from, const uint32_t to,
+                       const int32_t bootcode);
+
+void cic_final(const CicState& state, const int32_t bootcode, uint32_t* out_crc);
+
+/*
+  The state saved every CIC_CHECKPOINT_INTERVAL bytes of the area, so
+  after a write only the span from the checkpoint before it to the end
+  of the area is recomputed. The recomputation stops early when a
+  checkpoint after the write comes out unchanged.
+*/
+
+static const uint32_t CIC_CHECKPOINT_INTERVAL = 0x1000;
+static const uint32_t CIC_CHECKPOINTS = CHECKSUM_LENGTH / CIC_CHECKPOINT_INTERVAL;
+
+struct CicCheckpoints {
+  int32_t bootcode;
+  // state[k] is the state before the k-th interval, the last one is final
+  CicState state[CIC_CHECKPOINTS + 1];
+};
+
+bool cic_checkpoints_build(CicCheckpoints* checkpoints, const byte* rom, const int32_t bootcode);
+// rom was modified in [from, to)
+void cic_checkpoints_update(CicCheckpoints* checkpoints, const byte* rom,
+                            const uint32_t from, const uint32_t to);
+void cic_checkpoints_crc(const CicCheckpoints& checkpoints, uint32_t* out_crc);
@@ -0,0 +1,465 @@
+#include "classify.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#include "mips.h"
+#include "simd.h"
+
+// word scores
+static const int8_t SCORE_INVALID = -6;
+static const int8_t SCORE_COMMON = 2;
+static const int8_t SCORE_RARE = -3;
+static const int8_t SCORE_ZERO_WRITE = -3;
+static const int8_t SCORE_KERNEL_REG = -2;
+// a window is code when its mean score is at least this
+static const int32_t CODE_THRESHOLD = 1;
+// words scored at once
+static const uint32_t SCORE_BLOCK = 1024;
+
+static const uint32_t REG_K0 = 26;
+static const uint32_t REG_K1 = 27;
+
+struct MnemonicScores {
+  int8_t score[MN_COUNT];
+};
+
+static MnemonicScores build_scores() {
+  MnemonicScores scores;
+  memset(scores.score, 0, sizeof(scores.score));
+
+  // what compiled code is made of
+  static const uint8_t common[] = {
+    MN_SLL, MN_SRL, MN_SRA, MN_SLLV, MN_SRLV, MN_JR, MN_JALR, MN_MFHI, MN_MFLO,
+    MN_MULT, MN_MULTU, MN_DIV, MN_DIVU, MN_ADDU, MN_MOVE, MN_SUBU, MN_AND, MN_OR,
+    MN_XOR, MN_NOR, MN_SLT, MN_SLTU, MN_BLTZ, MN_BGEZ, MN_J, MN_JAL, MN_BEQ, MN_BNE,
+    MN_BNEZ, MN_BLEZ, MN_BGTZ, MN_ADDIU, MN_SLTI, MN_SLTIU, MN_ANDI, MN_ORI, MN_LUI,
+    MN_LB, MN_LH, MN_LW, MN_LBU, MN_LHU, MN_SB, MN_SH, MN_SW, MN_LWC1, MN_SWC1,
+    MN_MFC1, MN_MTC1, MN_ADD_FMT, MN_SUB_FMT, MN_MUL_FMT, MN_DIV_FMT, MN_MOV_FMT,
+    MN_CVT_S, MN_CVT_D, MN_CVT_W, MN_C_COND, MN_BC1F, MN_BC1T
+  };
+  // valid but next to never emitted, or only in boot code
+  static const uint8_t rare[] = {
+    MN_DSLLV, MN_DSRLV, MN_DSRAV, MN_DMULT, MN_DMULTU, MN_DDIV, MN_DDIVU, MN_DADD,
+    MN_DADDU, MN_DSUB, MN_DSUBU, MN_TGE, MN_TGEU, MN_TLT, MN_TLTU, MN_TEQ, MN_TNE,
+    MN_DSLL, MN_DSRL, MN_DSRA, MN_DSLL32, MN_DSRL32, MN_DSRA32, MN_TGEI, MN_TGEIU,
+    MN_TLTI, MN_TLTIU, MN_TEQI, MN_TNEI, MN_BLTZALL, MN_BGEZALL, MN_DADDI, MN_DADDIU,
+    MN_LDR, MN_LWU, MN_SDL, MN_SDR, MN_CACHE, MN_LL, MN_LWC2, MN_LLD, MN_LDC2, MN_SC,
+    MN_SWC2, MN_SCD, MN_SDC2, MN_BC0F, MN_BC0T, MN_BC0FL, MN_BC0TL, MN_COP0, MN_TLBR,
+    MN_TLBWI, MN_TLBWR, MN_TLBP, MN_BC2F, MN_BC2T, MN_BC2FL, MN_BC2TL, MN_COP2, MN_MFC2,
+    MN_CFC2, MN_MTC2, MN_CTC2
+  };
+  for (size_t i = 0; i < sizeof(common); ++i) scores.score[common[i]] = SCORE_COMMON;
+  for (size_t i = 0; i < sizeof(rare); ++i) scores.score[rare[i]] = SCORE_RARE;
+  scores.score[MN_INVALID] = SCORE_INVALID;
+  return scores;
+}
+
+static const MnemonicScores mnemonic_scores = build_scores();
+
+// the GPR the instruction writes, -1 if none
+static int written_gpr(const DecodedInstruction& inst) {
+  switch (inst.mnemonic) {
+    // hi/lo, rd must be zero
+    case MN_DIV: case MN_DIVU: case MN_DMULT: case MN_DMULTU: case MN_DDIV: case MN_DDIVU:
+      return -1;
+    default: break;
+  }
+  switch (inst.format) {
+    case FMT_SHIFT:
+    case FMT_SHIFT_HEX:
+    case FMT_SHIFTV:
+    case FMT_RD:
+    case FMT_RD_RS:
+    case FMT_RD_RS_RT:
+      return inst.rd;
+    case FMT_RT_RS_SIMM:
+    case FMT_RT_RS_UIMM:
+    case FMT_RT_RS_PCREL:
+    case FMT_LUI:
+      return inst.rt;
+    case FMT_MEM:
+      // loads only, the stores have opcode bit 3 set
+      return ((inst.word >> 26) & 0x8) == 0 ? inst.rt : -1;
+    default:
+      return -1;
+  }
+}
+
+// bit n set when GPR n is read or written through rs or rt, the other
+// formats use these fields for targets, codes or FPU registers
+static uint32_t rs_rt_gprs(const DecodedInstruction& inst) {
+  switch (inst.format) {
+    case FMT_RS:
+    case FMT_RD_RS:
+    case FMT_BRANCH_RS:
+    case FMT_FMEM:
+    case FMT_CACHE:
+      return 1u << inst.rs;
+    case FMT_SHIFT:
+    case FMT_SHIFT_HEX:
+    case FMT_LUI:
+    case FMT_MOVE_COP:
+    case FMT_MOVE_CTRL:
+      return 1u << inst.rt;
+    case FMT_SHIFTV:
+    case FMT_RS_RT:
+    case FMT_RD_RS_RT:
+    case FMT_BRANCH_RS_RT:
+    case FMT_RT_RS_SIMM:
+    case FMT_RT_RS_UIMM:
+    case FMT_RT_RS_PCREL:
+    case FMT_MEM:
+      return 1u << inst.rs | 1u << inst.rt;
+    default:
+      return 0;
+  }
+}
+
+// the coprocessor words, through the decoder
+static int32_t score_decoded(const uint32_t word, const int options) {
+  DecodedInstruction inst;
+  if (!mips_decode(0, word, &inst, options)) return SCORE_INVALID;
+
+  int32_t score = mnemonic_scores.score[inst.mnemonic];
+  // no effect, only a nop would do that on purpose
+  if (inst.mnemonic != MN_NOP && written_gpr(inst) == 0) score += SCORE_ZERO_WRITE;
+  // reserved to the exception handlers
+  if (rs_rt_gprs(inst) & (1u << REG_K0 | 1u << REG_K1)) score += SCORE_KERNEL_REG;
+  return score;
+}
+
+/*
+  The same scores by opcode table entry, indexed like the pre-filter of
+  mips_find_invalid(), so the other words are scored without decoding.
+  The aliases decode_word() makes (move, bnez) score like the
+  instruction they stand for, only the nops differ. One array per
+  field so the AVX2 kernel gathers them.
+*/
+static const int32_t OP_RS_GPR = 0x100;
+static const int32_t OP_RT_GPR = 0x200;
+static const int32_t OP_DECODE = 0x400;
+
+struct OpScores {
+  uint32_t zero_mask[MIPS_OP_INDEXES];
+  // sll/sllv are nops when these bits are clear, 0 for the others
+  uint32_t nop_mask[MIPS_OP_INDEXES];
+  // bits of the written GPR field, 0 if there is none
+  uint32_t write_mask[MIPS_OP_INDEXES];
+  // score in the low byte, OP_* flags
+  int32_t info[MIPS_OP_INDEXES];
+};
+
+static OpScores build_op_scores() {
+  OpScores scores;
+  memset(&scores, 0, sizeof(scores));
+  for (uint32_t index = 0; index < MIPS_OP_INDEXES; ++index) {
+    DecodedInstruction inst;
+    memset(&inst, 0, sizeof(inst));
+    if (!mips_op_entry(index, &inst.mnemonic, &inst.format, &scores.zero_mask[index])) {
+      scores.info[index] = OP_DECODE;
+      continue;
+    }
+    if (inst.mnemonic == MN_INVALID) scores.zero_mask[index] = ~0u;
+    if (inst.mnemonic == MN_SLL) scores.nop_mask[index] = 0x1F << 6;
+    if (inst.mnemonic == MN_SLLV) scores.nop_mask[index] = 0x1F << 21;
+
+    // distinct registers in the fields tell which ones are used how
+    inst.word = index < 64 ? index << 26 : index < 128 ? index - 64 : 1 << 26 | (index - 128) << 16;
+    inst.rs = 1;
+    inst.rt = 2;
+    inst.rd = 3;
+    const int written = written_gpr(inst);
+    scores.write_mask[index] = written == 1 ? 0x1Fu << 21 : written == 2 ? 0x1Fu << 16
+                             : written == 3 ? 0x1Fu << 11 : 0;
+    const uint32_t gprs = rs_rt_gprs(inst);
+    scores.info[index] = (uint8_t) mnemonic_scores.score[inst.mnemonic] |
+                         ((gprs & (1u << 1)) ? OP_RS_GPR : 0) | ((gprs & (1u << 2)) ? OP_RT_GPR : 0);
+  }
+  return scores;
+}
+
+static const OpScores op_scores = build_op_scores();
+
+static inline int32_t kernel_reg(const uint32_t reg) {
+  return (reg | 1) == REG_K1;
+}
+
+// without branches on the fields, they are random in the data
+static inline int32_t score_word(const uint32_t word, const int options) {
+  const uint32_t index = mips_op_index(word);
+  const int32_t info = op_scores.info[index];
+  if (info & OP_DECODE) return score_decoded(word, options);
+
+  const int32_t kernel = (((info & OP_RS_GPR) != 0) & kernel_reg((word >> 21) & 0x1F)) |
+                         (((info & OP_RT_GPR) != 0) & kernel_reg((word >> 16) & 0x1F));
+  const uint32_t write_mask = op_scores.write_mask[index];
+  const uint32_t nop_mask = op_scores.nop_mask[index];
+  const int32_t zero_write = (write_mask != 0) & ((word & write_mask) == 0);
+  const int32_t nop = (nop_mask != 0) & ((word & nop_mask) == 0);
+  const int32_t invalid = (word & op_scores.zero_mask[index]) != 0;
+  int32_t score = (int8_t) info + zero_write * SCORE_ZERO_WRITE + kernel * SCORE_KERNEL_REG;
+  score += nop * (mnemonic_scores.score[MN_NOP] - score);
+  return score + invalid * (SCORE_INVALID - score);
+}
+
+static void score_words_scalar(const byte* words, const size_t count, int32_t* out,
+                               const int options) {
+  for (size_t i = 0; i < count; ++i) {
+    const byte* at = &words[i * 4];
+    out[i] = score_word(at[0] << 24 | at[1] << 16 | at[2] << 8 | at[3], options);
+  }
+}
+
+#ifdef HAS_X86_SIMD
+// 8 words per iteration, the coprocessor lanes are decoded after
+TARGET_AVX2 static size_t score_words_avx2(const byte* words, const size_t count, int32_t* out,
+                                           const int options) {
+  const __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i field = _mm256_set1_epi32(0x1F);
+  const __m256i k1 = _mm256_set1_epi32(REG_K1);
+  const __m256i rs_gpr = _mm256_set1_epi32(OP_RS_GPR);
+  const __m256i rt_gpr = _mm256_set1_epi32(OP_RT_GPR);
+  const __m256i nop_score = _mm256_set1_epi32(mnemonic_scores.score[MN_NOP]);
+  const __m256i invalid_score = _mm256_set1_epi32(SCORE_INVALID);
+  size_t done = 0;
+  for (; done + 8 <= count; done += 8) {
+    const __m256i word = _mm256_shuffle_epi8(
+        _mm256_loadu_si256((const __m256i*) &words[done * 4]), swap);
+    // mips_op_index()
+    const __m256i opcode = _mm256_srli_epi32(word, 26);
+    const __m256i special = _mm256_and_si256(
+        _mm256_cmpeq_epi32(opcode, zero),
+        _mm256_add_epi32(_mm256_set1_epi32(64), _mm256_and_si256(word, _mm256_set1_epi32(0x3F))));
+    const __m256i rt = _mm256_and_si256(_mm256_srli_epi32(word, 16), field);
+    const __m256i regimm = _mm256_and_si256(_mm256_cmpeq_epi32(opcode, one),
+                                            _mm256_add_epi32(_mm256_set1_epi32(127), rt));
+    const __m256i index = _mm256_add_epi32(opcode, _mm256_add_epi32(special, regimm));
+
+    const __m256i info = _mm256_i32gather_epi32(op_scores.info, index, 4);
+    const __m256i zero_mask = _mm256_i32gather_epi32((const int*) op_scores.zero_mask, index, 4);
+    const __m256i nop_mask = _mm256_i32gather_epi32((const int*) op_scores.nop_mask, index, 4);
+    const __m256i write_mask = _mm256_i32gather_epi32((const int*) op_scores.write_mask, index, 4);
+
+    const __m256i rs = _mm256_and_si256(_mm256_srli_epi32(word, 21), field);
+    const __m256i kernel = _mm256_or_si256(
+        _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_or_si256(rs, one), k1),
+                         _mm256_cmpeq_epi32(_mm256_and_si256(info, rs_gpr), rs_gpr)),
+        _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_or_si256(rt, one), k1),
+                         _mm256_cmpeq_epi32(_mm256_and_si256(info, rt_gpr), rt_gpr)));
+    const __m256i zero_write = _mm256_andnot_si256(
+        _mm256_cmpeq_epi32(write_mask, zero),
+        _mm256_cmpeq_epi32(_mm256_and_si256(word, write_mask), zero));
+    const __m256i nop = _mm256_andnot_si256(
+        _mm256_cmpeq_epi32(nop_mask, zero),
+        _mm256_cmpeq_epi32(_mm256_and_si256(word, nop_mask), zero));
+    const __m256i valid = _mm256_cmpeq_epi32(_mm256_and_si256(word, zero_mask), zero);
+
+    __m256i score = _mm256_srai_epi32(_mm256_slli_epi32(info, 24), 24);
+    score = _mm256_add_epi32(score, _mm256_and_si256(zero_write, _mm256_set1_epi32(SCORE_ZERO_WRITE)));
+    score = _mm256_add_epi32(score, _mm256_and_si256(kernel, _mm256_set1_epi32(SCORE_KERNEL_REG)));
+    score = _mm256_blendv_epi8(score, nop_score, nop);
+    score = _mm256_blendv_epi8(invalid_score, score, valid);
+    _mm256_storeu_si256((__m256i*) &out[done], score);
+
+    const __m256i decode = _mm256_cmpeq_epi32(_mm256_and_si256(info, _mm256_set1_epi32(OP_DECODE)),
+                                              _mm256_set1_epi32(OP_DECODE));
+    int lanes = _mm256_movemask_ps(_mm256_castsi256_ps(decode));
+    while (lanes != 0) {
+      const int lane = __builtin_ctz(lanes);
+      lanes &= lanes - 1;
+      score_words_scalar(&words[(done + lane) * 4], 1, &out[done + lane], options);
+    }
+  }
+  return done;
+}
+#endif
+
+// Scores of count big endian words
+static void score_words(const byte* words, const size_t count, int32_t* out, const int options) {
+  size_t done = 0;
+#ifdef HAS_X86_SIMD
+  if (cpu_has_avx2()) done = score_words_avx2(words, count, out, options);
+#endif
+  score_words_scalar(&words[done * 4], count - done, &out[done], options);
+}
+
+static bool region_append(RegionMap* map, const uint32_t start, const uint32_t end,
+                          const uint8_t kind, const int64_t score) {
+  if (map->size == map->capacity) {
+    const size_t capacity = map->capacity ? map->capacity * 2 : 64;
+    Region* items = (Region*) realloc(map->items, capacity * sizeof(Region));
+    if (items == NULL) return false;
+    map->items = items;
+    map->capacity = capacity;
+  }
+  Region* region = &map->items[map->size++];
+  region->start = start;
+  region->end = end;
+  region->score = score;
+  region->kind = kind;
+  return true;
+}
+
+static bool region_push(RegionMap* map, const Region& run) {
+  if (map->size > 0) {
+    Region* last = &map->items[map->size - 1];
+    // short runs are noise of the region before them
+    if (last->kind == run.kind || (run.end - run.start) / 4 < CLASSIFY_WINDOW / 2) {
+      last->end = run.end;
+      last->score += run.score;
+      return true;
+    }
+  }
+  return region_append(map, run.start, run.end, run.kind, run.score);
+}
+
+/*
+  Label the words [from, to) of the area, the windows still read the
+  words around them so a shard gives the same labels as the whole area.
+  The words are labelled SCORE_BLOCK at a time: the block and the half
+  windows around it are scored, then the sum of each window is the
+  difference of two prefix sums.
+  The runs of words with the same label go to runs as they are.
+*/
+static bool classify_shard(RegionMap* runs, const byte* data, const uint32_t start,
+                           const uint32_t words, const uint32_t from, const uint32_t to,
+                           const int options) {
+  static const uint32_t HALF = CLASSIFY_WINDOW / 2;
+  int32_t scores[SCORE_BLOCK + CLASSIFY_WINDOW];
+  // prefix[i] is the sum of the scores before i
+  int32_t prefix[SCORE_BLOCK + CLASSIFY_WINDOW + 1];
+
+  uint32_t run_start = from;
+  int64_t run_score = 0;
+  uint8_t run_kind = REGION_DATA;
+  for (uint32_t block = from; block < to; block += SCORE_BLOCK) {
+    const uint32_t block_end = to - block < SCORE_BLOCK ? to : block + SCORE_BLOCK;
+    // the window of a word is [word - HALF, word + HALF) clamped to the area
+    const uint32_t low = block > HALF ? block - HALF : 0;
+    const uint32_t high = words - block_end < HALF ? words : block_end + HALF;
+    score_words(&data[start + low * 4], high - low, scores, options);
+    prefix[0] = 0;
+    for (uint32_t i = 0; i < high - low; ++i) prefix[i + 1] = prefix[i] + scores[i];
+
+    for (uint32_t word = block; word < block_end; ++word) {
+      const uint32_t first = word > HALF ? word - HALF : 0;
+      const uint32_t last = words - word < HALF ? words : word + HALF;
+      const int32_t sum = prefix[last - low] - prefix[first - low];
+      const uint8_t kind = sum >= CODE_THRESHOLD * (int32_t) (last - first) ? REGION_CODE
+                                                                           : REGION_DATA;
+      if (word == from) {
+        run_kind = kind;
+      } else if (kind != run_kind) {
+        if (!region_append(runs, start + run_start * 4, start + word * 4, run_kind, run_score)) {
+          return false;
+        }
+        run_start = word;
+        run_score = 0;
+        run_kind = kind;
+      }
+      run_score += scores[word - low];
+    }
+  }
+  return from == to || region_append(runs, start + run_start * 4, start + to * 4, run_kind,
+                                     run_score);
+}
+
+bool region_map_build(RegionMap* map, const byte* data, const uint32_t start, const uint32_t end,
+                      const int options, const unsigned threads) {
+  memset(map, 0, sizeof(RegionMap));
+  const uint32_t words = (end - start) / 4;
+  // at least a few windows per shard
+  unsigned shard_count = threads > 0 ? threads : 1;
+  if (words / shard_count < CLASSIFY_WINDOW * 16) shard_count = 1;
+
+  bool ok = true;
+  std::vector<RegionMap> shards(shard_count);
+  memset(&shards[0], 0, shard_count * sizeof(RegionMap));
+  std::vector<char> shard_ok(shard_count);
+  if (shard_count == 1) {
+    shard_ok[0] = classify_shard(&shards[0], data, start, words, 0, words, options);
+  } else {
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < shard_count; ++i) {
+      const uint32_t from = (uint64_t) words * i / shard_count;
+      const uint32_t to = (uint64_t) words * (i + 1) / shard_count;
+      pool.push_back(std::thread([&shards, &shard_ok, data, start, words, from, to, options, i] {
+        shard_ok[i] = classify_shard(&shards[i], data, start, words, from, to, options);
+      }));
+    }
+    for (size_t i = 0; i < pool.size(); ++i) pool[i].join();
+  }
+
+  // merged in order, a run can continue in the next shard
+  Region pending;
+  bool has_pending = false;
+  for (unsigned i = 0; i < shard_count; ++i) {
+    ok = ok && shard_ok[i];
+    for (size_t r = 0; ok && r < shards[i].size; ++r) {
+      const Region& run = shards[i].items[r];
+      if (has_pending && pending.kind == run.kind) {
+        pending.end = run.end;
+        pending.score += run.score;
+        continue;
+      }
+      if (has_pending) ok = region_push(map, pending);
+      pending = run;
+      has_pending = true;
+    }
+    region_map_free(&shards[i]);
+  }
+  if (ok && has_pending) ok = region_push(map, pending);
+  if (!ok) region_map_free(map);
+  return ok;
+}
+
+float region_confidence(const Region& region) {
+  const int64_t words = (region.end - region.start) / 4;
+  if (words == 0) return 0;
+  const float confidence = (float) region.score / words / SCORE_COMMON;
+  return confidence < 0 ? 0 : confidence > 1 ? 1 : confidence;
+}
+
+void region_map_free(RegionMap* map) {
+  free(map->items);
+  memset(map, 0, sizeof(RegionMap));
+}
+
+uint32_t region_map_size(const RegionMap& map, const uint8_t kind) {
+  uint32_t size = 0;
+  for (size_t i = 0; i < map.size; ++i) {
+    if (map.items[i].kind == kind) size += map.items[i].end - map.items[i].start;
+  }
+  return size;
+}
+
+bool region_map_write(const RegionMap& map, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) return false;
+  for (size_t i = 0; i < map.size; ++i) {
+    fprintf(file, "0x%08X 0x%08X %s\n", map.items[i].start, map.items[i].end,
+            map.items[i].kind == REGION_CODE ? "code" : "data");
+  }
+  const bool written = ferror(file) == 0;
+  return fclose(file) == 0 && written;
+}
+
+bool region_map_write_code(const RegionMap& map, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) return false;
+  for (size_t i = 0; i < map.size; ++i) {
+    if (map.items[i].kind != REGION_CODE) continue;
+    fprintf(file, "0x%08X 0x%08X %.2f\n", map.items[i].start, map.items[i].end,
+            region_confidence(map.items[i]));
+  }
+  const bool written = ferror(file) == 0;
+  return fclose(file) == 0 && written;
+}
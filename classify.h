@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defs.h"
+
+/*
+  Code/data classifier for a whole ROM, in one pass over the words.
+
+  Each word gets a small score: invalid words count heavily against,
+  the instructions compilers emit all the time (loads, stores, addiu,
+  jal, branches) count for, the rare ones (64 bits, traps, tlb, cop2)
+  against, as do impossible register uses like writing $zero or using
+  $k0/$k1 as a GPR operand outside of mfc0/mtc0. The scores come from
+  a table indexed like the pre-filter of mips_find_invalid() (opcode,
+  funct, rt), 8 words at a time with AVX2, only the coprocessor words
+  are decoded.
+  A window of CLASSIFY_WINDOW words is centered on each word, its sum is
+  the difference of two prefix sums of the scores, and the word is code
+  when the mean is over the threshold.
+  The labels are merged into regions, the runs shorter than half a
+  window join the region before them.
+
+  The area can be split in shards labelled on several threads, the
+  windows read across the shard boundaries and the runs are merged in
+  order, so the regions are the same as with one thread. The code
+  regions are the islands later passes can disassemble, overlays and
+  segments loaded at run time included.
+*/
+
+static const uint32_t CLASSIFY_WINDOW = 64;
+
+// Region kinds
+static const uint8_t REGION_DATA = 0;
+static const uint8_t REGION_CODE = 1;
+
+struct Region {
+  // ROM offsets, end excluded
+  uint32_t start;
+  uint32_t end;
+  // sum of the word scores
+  int64_t score;
+  uint8_t kind;
+};
+
+struct RegionMap {
+  Region* items;
+  size_t size;
+  size_t capacity;
+};
+
+// Classify the big endian words of data in [start, end)
+bool region_map_build(RegionMap* map, const byte* data, const uint32_t start, const uint32_t end,
+                      const int options, const unsigned threads = 1);
+void region_map_free(RegionMap* map);
+// Bytes in the regions of that kind
+uint32_t region_map_size(const RegionMap& map, const uint8_t kind);
+// Mean word score of the region scaled to [0, 1], 1 for code made of
+// common instructions only
+float region_confidence(const Region& region);
+// One "0xSTART 0xEND code|data" line per region
+bool region_map_write(const RegionMap& map, const char* path);
+// One "0xSTART 0xEND confidence" line per code region
+bool region_map_write_code(const RegionMap& map, const char* path);
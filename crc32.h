@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defs.h"
+
+/*
+  Standard CRC32 (reflected 0x04C11DB7, as in zlib), used to identify
+  the IPL3 bootcode. crc32() picks the fastest path the CPU supports,
+  the others are exposed so they can be compared.
+*/
+
+// reference, one table lookup per byte
+uint32_t crc32_bytewise(const byte* data, const size_t size);
+// slicing-by-8, eight table lookups per 8 bytes
+uint32_t crc32_slice8(const byte* data, const size_t size);
+// carry-less multiply folding, falls back to slicing-by-8 without PCLMULQDQ
+uint32_t crc32_clmul(const byte* data, const size_t size);
+
+uint32_t crc32(const byte* data, const size_t size);
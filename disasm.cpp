@@ -0,0 +1,231 @@
+#include "disasm.h"
+
+#include <stdlib.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+static const size_t BLOCK_SIZE = 1024;
+
+static uint32_t sweep_serial(MipsContext* ctx, const byte* data, const uint32_t from,
+                             const uint32_t to, uint32_t pc) {
+  DecodedInstruction block[BLOCK_SIZE];
+  for (uint32_t at = from; at + 4 <= to; ) {
+    size_t words = (to - at) / 4;
+    if (words > BLOCK_SIZE) words = BLOCK_SIZE;
+    const size_t valid = mips_decode_block(&data[at], words, pc, block, ctx->options);
+    for (size_t i = 0; i < valid; ++i) {
+      mips_print(ctx, block[i]);
+      mips_count(&ctx->counters, block[i]);
+    }
+    at += valid * 4;
+    pc += valid * 4;
+    if (valid < words) {
+      // still printed when reserved
+      mips_print(ctx, block[valid]);
+      mips_count(&ctx->counters, block[valid]);
+      return at;
+    }
+  }
+  return to;
+}
+
+struct Chunk {
+  char* text;
+  size_t text_size;
+  uint32_t words;
+  // valid words, lower than words if the chunk has the invalid one
+  uint32_t valid;
+  MipsCounters counters;
+  bool done;
+};
+
+struct Sweep {
+  int options;
+  // each worker has its own text cache
+  bool cache;
+  const byte* data;
+  uint32_t from;
+  uint32_t to;
+  uint32_t pc;
+  size_t chunk_count;
+  size_t window;
+  Chunk* chunks;
+
+  std::mutex mutex;
+  std::condition_variable work_ready;
+  std::condition_variable chunk_done;
+  // next chunk to claim, chunks written so far
+  size_t next;
+  size_t written;
+  bool stop;
+};
+
+static void format_chunk(const Sweep& sweep, const size_t index, MipsCache* cache, Chunk* chunk) {
+  const uint32_t start = sweep.from + index * DISASM_CHUNK_WORDS * 4;
+  uint32_t words = (sweep.to - start) / 4;
+  if (words > DISASM_CHUNK_WORDS) words = DISASM_CHUNK_WORDS;
+
+  chunk->text_size = 0;
+  chunk->words = words;
+  chunk->valid = 0;
+  mips_counters_reset(&chunk->counters);
+
+  DecodedInstruction block[BLOCK_SIZE];
+  while (chunk->valid < words) {
+    size_t n = words - chunk->valid;
+    if (n > BLOCK_SIZE) n = BLOCK_SIZE;
+    const uint32_t at = start + chunk->valid * 4;
+    const size_t valid = mips_decode_block(&sweep.data[at], n, sweep.pc + (at - sweep.from), block,
+                                           sweep.options);
+    for (size_t i = 0; i < valid; ++i) {
+      chunk->text_size += mips_format_cached(block[i], cache, &chunk->counters,
+                                             chunk->text + chunk->text_size);
+      mips_count(&chunk->counters, block[i]);
+    }
+    chunk->valid += valid;
+    if (valid < n) {
+      chunk->text_size += mips_format_cached(block[valid], cache, &chunk->counters,
+                                             chunk->text + chunk->text_size);
+      mips_count(&chunk->counters, block[valid]);
+      return;
+    }
+  }
+}
+
+static void worker(Sweep* sweep) {
+  // formatted without it if it can't be allocated
+  MipsCache* cache = sweep->cache ? (MipsCache*) calloc(1, sizeof(MipsCache)) : NULL;
+  for (;;) {
+    size_t index;
+    {
+      std::unique_lock<std::mutex> lock(sweep->mutex);
+      // stay within the window ahead of the writer, its slots are free
+      while (!sweep->stop && sweep->next < sweep->chunk_count &&
+             sweep->next >= sweep->written + sweep->window) {
+        sweep->work_ready.wait(lock);
+      }
+      if (sweep->stop || sweep->next >= sweep->chunk_count) break;
+      index = sweep->next++;
+    }
+
+    Chunk* chunk = &sweep->chunks[index % sweep->window];
+    format_chunk(*sweep, index, cache, chunk);
+
+    std::lock_guard<std::mutex> lock(sweep->mutex);
+    chunk->done = true;
+    sweep->chunk_done.notify_all();
+  }
+  free(cache);
+}
+
+static uint32_t sweep_parallel(MipsContext* ctx, const byte* data, const uint32_t from,
+                               const uint32_t to, const uint32_t pc, const unsigned threads) {
+  Sweep sweep;
+  sweep.options = ctx->options;
+  sweep.cache = ctx->cache != NULL;
+  sweep.data = data;
+  sweep.from = from;
+  sweep.to = to;
+  sweep.pc = pc;
+  sweep.chunk_count = ((to - from) / 4 + DISASM_CHUNK_WORDS - 1) / DISASM_CHUNK_WORDS;
+  sweep.window = 2 * threads;
+  sweep.next = 0;
+  sweep.written = 0;
+  sweep.stop = false;
+
+  uint32_t end = to;
+  std::vector<std::thread> pool;
+
+  sweep.chunks = (Chunk*) calloc(sweep.window, sizeof(Chunk));
+  if (sweep.chunks == NULL) goto serial;
+  for (size_t i = 0; i < sweep.window; ++i) {
+    sweep.chunks[i].text = (char*) malloc(DISASM_CHUNK_WORDS * MIPS_MAX_LINE);
+    if (sweep.chunks[i].text == NULL) goto serial;
+  }
+
+  for (unsigned i = 0; i < threads; ++i) pool.push_back(std::thread(worker, &sweep));
+
+  for (size_t index = 0; index < sweep.chunk_count; ++index) {
+    Chunk* chunk = &sweep.chunks[index % sweep.window];
+    {
+      std::unique_lock<std::mutex> lock(sweep.mutex);
+      while (!chunk->done) sweep.chunk_done.wait(lock);
+    }
+
+    mips_write(ctx, chunk->text, chunk->text_size);
+    mips_counters_add(&ctx->counters, chunk->counters);
+
+    std::lock_guard<std::mutex> lock(sweep.mutex);
+    chunk->done = false;
+    ++sweep.written;
+    if (chunk->valid < chunk->words) {
+      end = from + index * DISASM_CHUNK_WORDS * 4 + chunk->valid * 4;
+      sweep.stop = true;
+    }
+    sweep.work_ready.notify_all();
+    if (sweep.stop) break;
+  }
+
+  for (size_t i = 0; i < pool.size(); ++i) pool[i].join();
+  for (size_t i = 0; i < sweep.window; ++i) free(sweep.chunks[i].text);
+  free(sweep.chunks);
+  return end;
+
+serial:
+  if (sweep.chunks != NULL) {
+    for (size_t i = 0; i < sweep.window; ++i) free(sweep.chunks[i].text);
+    free(sweep.chunks);
+  }
+  return sweep_serial(ctx, data, from, to, pc);
+}
+
+uint32_t disasm_linear(MipsContext* ctx, const byte* data, const uint32_t from,
+                       uint32_t to, const uint32_t pc, const unsigned threads) {
+  // the sweep stops at the first word the pre-filter rejects at the latest,
+  // so the workers don't format chunks past it
+  const uint32_t words = (to - from) / 4;
+  const uint32_t invalid = mips_find_invalid(&data[from], words);
+  if (invalid < words) to = from + (invalid + 1) * 4;
+
+  if (threads <= 1 || to - from <= DISASM_CHUNK_WORDS * 4) {
+    return sweep_serial(ctx, data, from, to, pc);
+  }
+  return sweep_parallel(ctx, data, from, to, pc, threads);
+}
+
+void disasm_code_map(MipsContext* ctx, const byte* data, const CodeMap& map,
+                     const AddressRefs* refs) {
+  // refs by_pc is in address order too, walked along
+  size_t next_ref = 0;
+  for (uint32_t index = 0; index < map.words; ++index) {
+    // skip the empty parts of the bitmap a whole word at a time
+    if (map.visited[index / 32] == 0) {
+      index |= 31;
+      continue;
+    }
+    if (!code_map_reachable(map, index)) continue;
+    const byte* at = &data[map.start + index * 4];
+    const uint32_t pc = map.base_pc + index * 4;
+    DecodedInstruction inst;
+    mips_decode(pc, at[0] << 24 | at[1] << 16 | at[2] << 8 | at[3], &inst, ctx->options);
+    mips_count(&ctx->counters, inst);
+
+    if (refs != NULL) {
+      while (next_ref < refs->count && refs->by_pc[next_ref].pc < pc) ++next_ref;
+      if (next_ref < refs->count && refs->by_pc[next_ref].pc == pc) {
+        mips_print_address(ctx, inst, refs->by_pc[next_ref].address);
+        continue;
+      }
+    }
+    mips_print(ctx, inst);
+  }
+}
+
+unsigned disasm_default_threads() {
+  const unsigned cores = std::thread::hardware_concurrency();
+  return cores > 0 ? cores : 1;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "defs.h"
+#include "mips.h"
+#include "xref.h"
+
+/*
+  Linear sweep disassembly: the words are decoded and printed to the
+  context file until the first invalid one, and added to its counters.
+
+  With several threads the area is cut in chunks of DISASM_CHUNK_WORDS
+  which are decoded and formatted by a pool of workers into their own
+  buffers, then written in address order. Workers only run a few chunks
+  ahead of the writer so little is wasted past the end of the code.
+  The output is the same as the serial sweep.
+*/
+
+static const uint32_t DISASM_CHUNK_WORDS = 0x4000;
+
+// Sweep the big endian words of data in [from, to), the first one at pc.
+// Returns the offset of the first invalid word, or to if all are valid.
+uint32_t disasm_linear(MipsContext* ctx, const byte* data, const uint32_t from,
+                       const uint32_t to, const uint32_t pc, const unsigned threads);
+
+// Print only the reachable words of the map, in address order.
+// The addresses in refs are added as comments if not NULL.
+void disasm_code_map(MipsContext* ctx, const byte* data, const CodeMap& map,
+                     const AddressRefs* refs = NULL);
+
+// Worker count for the parallel sweep, one per core.
+unsigned disasm_default_threads();
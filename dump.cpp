@@ -1,14 +1,35 @@
+#include <string.h>
+
 #include "log.h"
 #include "rom.h"
 
 int main(int argc, char **argv) {
-  if (argc < 2) {
+  const char* path = NULL;
+  int load_flags = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--mmap") == 0) load_flags |= ROM_LOAD_MMAP;
+    else if (strcmp(argv[i], "--populate") == 0) load_flags |= ROM_LOAD_MMAP | ROM_LOAD_POPULATE;
+    else if (strcmp(argv[i], "--parallel") == 0) load_flags |= ROM_LOAD_PARALLEL;
+    else if (strcmp(argv[i], "--descent") == 0) load_flags |= ROM_LOAD_DESCENT;
+    else if (strcmp(argv[i], "--symbols") == 0) load_flags |= ROM_LOAD_SYMBOLS;
+    else if (strcmp(argv[i], "--callgraph") == 0) load_flags |= ROM_LOAD_CALLGRAPH;
+    else if (strcmp(argv[i], "--addresses") == 0) load_flags |= ROM_LOAD_ADDRESSES;
+    else if (strcmp(argv[i], "--cache") == 0) load_flags |= ROM_LOAD_CACHE;
+    else if (strcmp(argv[i], "--regions") == 0) load_flags |= ROM_LOAD_REGIONS;
+    else if (strcmp(argv[i], "--islands") == 0) load_flags |= ROM_LOAD_ISLANDS;
+    else if (strcmp(argv[i], "--stats") == 0) load_flags |= ROM_LOAD_STATS;
+    else if (strcmp(argv[i], "--text-runs") == 0) load_flags |= ROM_LOAD_TEXT_RUNS;
+    else if (strcmp(argv[i], "--pointers") == 0) load_flags |= ROM_LOAD_POINTERS;
+    else path = argv[i];
+  }
+
+  if (path == NULL) {
     LOG_ERROR("Provide path to N64 rom file.\n");
     return -1;
   }
 
   Rom rom;
-  if (rom.load(argv[1]) == false) {
+  if (rom.load(path, load_flags) == false) {
     LOG_ERROR("Error loading the ROM.\n");
     return -1;
   }
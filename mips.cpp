@@ -1,369 +1,487 @@
 #include "mips.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simd.h"
+
+// defaults of MipsContext::options
 //#define ENABLE_COPZ
 
 #define PRINT_MIPS
 
+void mips_context_init(MipsContext* ctx) {
+  ctx->options = 0;
 #ifdef PRINT_MIPS
-#include <stdio.h>
-FILE* f = stdout;
-#define PRINT(...) do { fprintf(f,"0x%08X ", pc); fprintf(f,__VA_ARGS__); } while (0)
-#else
-#define PRINT(...) ;
+  ctx->options |= MIPS_PRINT;
 #endif
+#ifdef ENABLE_COPZ
+  ctx->options |= MIPS_COPZ;
+#endif
+  ctx->sink.file = NULL;
+  ctx->sink.size = 0;
+  mips_counters_reset(&ctx->counters);
+  ctx->cache = NULL;
+}
 
-void mips_set_file(const char* name) {
-#ifdef PRINT_MIPS
+bool mips_context_open(MipsContext* ctx, const char* name) {
+  if (!(ctx->options & MIPS_PRINT)) return true;
   char file_name[128];
-  if (snprintf(file_name, 64, "%s.asm", name) < 0) return;
-  f = fopen(file_name, "w");
-  if (f == NULL) f = stdout;
-#else
-  (void) name;
-#endif
+  if (snprintf(file_name, 64, "%s.asm", name) < 0) return false;
+  return sink_open(&ctx->sink, file_name);
 }
 
-void mips_close_file() {
-#ifdef PRINT_MIPS
-  fclose(f);
-  f = stdout;
-#endif
+void mips_context_close(MipsContext* ctx) {
+  sink_close(&ctx->sink);
+  free(ctx->cache);
+  ctx->cache = NULL;
 }
 
-static const char* cond_str(const unsigned int cond) {
-  switch (cond) {
-    case 0:  return "f";
-    case 1:  return "un";
-    case 2:  return "eq";
-    case 3:  return "uqe";
-    case 4:  return "olt";
-    case 5:  return "ult";
-    case 6:  return "ole";
-    case 7:  return "ule";
-    case 8:  return "sf";
-    case 9:  return "ngle";
-    case 10: return "seq";
-    case 11: return "ngl";
-    case 12: return "lt";
-    case 13: return "nge";
-    case 14: return "le";
-    case 15: return "ngt";
-    default: return NULL;
-  }
+bool mips_context_enable_cache(MipsContext* ctx) {
+  if (ctx->cache == NULL) ctx->cache = (MipsCache*) calloc(1, sizeof(MipsCache));
+  return ctx->cache != NULL;
 }
 
-static const char* reg_str(const unsigned int reg) {
-  switch (reg) {
-    case 0:  return "$zero";
-    case 1:  return "$at";
-    case 2:  return "$v0";
-    case 3:  return "$v1";
-    case 4:  return "$a0";
-    case 5:  return "$a1";
-    case 6:  return "$a2";
-    case 7:  return "$a3";
-    case 8:  return "$t0";
-    case 9:  return "$t1";
-    case 10: return "$t2";
-    case 11: return "$t3";
-    case 12: return "$t4";
-    case 13: return "$t5";
-    case 14: return "$t6";
-    case 15: return "$t7";
-    case 16: return "$s0";
-    case 17: return "$s1";
-    case 18: return "$s2";
-    case 19: return "$s3";
-    case 20: return "$s4";
-    case 21: return "$s5";
-    case 22: return "$s6";
-    case 23: return "$s7";
-    case 24: return "$t8";
-    case 25: return "$t9";
-    case 26: return "$k0";
-    case 27: return "$k1";
-    case 28: return "$gp";
-    case 29: return "$sp";
-    case 30: return "$fp";
-    case 31: return "$ra";
-    // cannot happen, we handle all the possible 5 bits integer
-    default: return NULL;
-  }
+void mips_write(MipsContext* ctx, const char* text, const size_t size) {
+  if (ctx->options & MIPS_PRINT) sink_write(&ctx->sink, text, size);
 }
 
-// check for inconditional branch
-bool mips_is_b(const struct IType inst) {
-  return inst.opcode == 4 && inst.rs == 0 && inst.rt == 0;
+static const char* const cond_str[16] = {
+  "f", "un", "eq", "uqe", "olt", "ult", "ole", "ule",
+  "sf", "ngle", "seq", "ngl", "lt", "nge", "le", "ngt"
+};
+
+// padded so put_reg() can always copy 8 bytes
+static const char reg_str[32][8] = {
+  "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+  "$t0",   "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+  "$s0",   "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+  "$t8",   "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra"
+};
+
+static const char* const mnemonic_str[MN_COUNT] = {
+#define X(id, text, flags) text,
+  MIPS_MNEMONICS(X)
+#undef X
+};
+
+static const uint8_t mnemonic_flags[MN_COUNT] = {
+#define X(id, text, flags) flags,
+  MIPS_MNEMONICS(X)
+#undef X
+};
+
+/*
+  One lookup per word gives the mnemonic, how to print it and which bits
+  must be zero, so validation is a single mask and compare.
+  Words with opcode SPECIAL are indexed by funct, REGIMM by rt and the
+  rest by opcode. The coprocessors have sub opcodes in several fields
+  and go through their own decoder.
+  Reserved entries have every bit in the mask, their index is non zero
+  so the compare always fails.
+*/
+
+struct OpEntry {
+  uint8_t mnemonic;
+  uint8_t format;
+  uint32_t zero_mask;
+};
+
+static const uint32_t RS = 0x1F << 21;
+static const uint32_t RT = 0x1F << 16;
+static const uint32_t RD = 0x1F << 11;
+static const uint32_t SA = 0x1F << 6;
+
+#define RESERVED_OP {MN_INVALID, FMT_RESERVED, 0xFFFFFFFF}
+#define INVALID_OP  {MN_INVALID, FMT_INVALID,  0xFFFFFFFF}
+
+static const OpEntry special_table[64] = {
+  {MN_SLL, FMT_SHIFT, RS},                             // 0
+  RESERVED_OP,                                       // 1
+  {MN_SRL, FMT_SHIFT, RS},                             // 2
+  {MN_SRA, FMT_SHIFT, RS},                             // 3
+  {MN_SLLV, FMT_SHIFTV, SA},                           // 4
+  RESERVED_OP,                                       // 5
+  {MN_SRLV, FMT_SHIFTV, SA},                           // 6
+  {MN_SRAV, FMT_SHIFTV, SA},                           // 7
+  {MN_JR, FMT_RS, RT | RD | SA},                       // 8
+  {MN_JALR, FMT_RS, RT | SA},                          // 9
+  RESERVED_OP,                                       // 10
+  RESERVED_OP,                                       // 11
+  {MN_SYSCALL, FMT_SYSCALL, 0},                        // 12
+  {MN_BREAK, FMT_BREAK, 0},                            // 13
+  RESERVED_OP,                                       // 14
+  {MN_NOP, FMT_NONE, RS | RT | RD | SA},               // 15
+  {MN_MFHI, FMT_RD, RS | RT | SA},                     // 16
+  {MN_MTHI, FMT_RS, RT | RD | SA},                     // 17
+  {MN_MFLO, FMT_RD, RS | RT | SA},                     // 18
+  {MN_MTLO, FMT_RS, RT | RD | SA},                     // 19
+  {MN_DSLLV, FMT_SHIFTV, SA},                          // 20
+  RESERVED_OP,                                       // 21
+  {MN_DSRLV, FMT_SHIFTV, SA},                          // 22
+  {MN_DSRAV, FMT_SHIFTV, SA},                          // 23
+  {MN_MULT, FMT_RS_RT, RD | SA},                       // 24
+  {MN_MULTU, FMT_RS_RT, RD | SA},                      // 25
+  {MN_DIV, FMT_RD_RS_RT, RD | SA},                     // 26
+  {MN_DIVU, FMT_RD_RS_RT, RD | SA},                    // 27
+  {MN_DMULT, FMT_RD_RS_RT, RD | SA},                   // 28
+  {MN_DMULTU, FMT_RD_RS_RT, RD | SA},                  // 29
+  {MN_DDIV, FMT_RD_RS_RT, RD | SA},                    // 30
+  {MN_DDIVU, FMT_RD_RS_RT, RD | SA},                   // 31
+  {MN_ADD, FMT_RD_RS_RT, SA},                          // 32
+  {MN_ADDU, FMT_RD_RS_RT, SA},                         // 33
+  {MN_SUB, FMT_RD_RS_RT, SA},                          // 34
+  {MN_SUBU, FMT_RD_RS_RT, SA},                         // 35
+  {MN_AND, FMT_RD_RS_RT, SA},                          // 36
+  {MN_OR, FMT_RD_RS_RT, SA},                           // 37
+  {MN_XOR, FMT_RD_RS_RT, SA},                          // 38
+  {MN_NOR, FMT_RD_RS_RT, SA},                          // 39
+  RESERVED_OP,                                       // 40
+  RESERVED_OP,                                       // 41
+  {MN_SLT, FMT_RD_RS_RT, SA},                          // 42
+  {MN_SLTU, FMT_RD_RS_RT, 0},                          // 43
+  {MN_DADD, FMT_RD_RS_RT, SA},                         // 44
+  {MN_DADDU, FMT_RD_RS_RT, SA},                        // 45
+  {MN_DSUB, FMT_RD_RS_RT, SA},                         // 46
+  {MN_DSUBU, FMT_RD_RS_RT, SA},                        // 47
+  {MN_TGE, FMT_RS_RT, 0},                              // 48
+  {MN_TGEU, FMT_RS_RT, 0},                             // 49
+  {MN_TLT, FMT_RS_RT, 0},                              // 50
+  {MN_TLTU, FMT_RS_RT, 0},                             // 51
+  {MN_TEQ, FMT_RS_RT, 0},                              // 52
+  RESERVED_OP,                                       // 53
+  {MN_TNE, FMT_RS_RT, 0},                              // 54
+  RESERVED_OP,                                       // 55
+  {MN_DSLL, FMT_SHIFT_HEX, RS},                        // 56
+  RESERVED_OP,                                       // 57
+  {MN_DSRL, FMT_SHIFT_HEX, RS},                        // 58
+  {MN_DSRA, FMT_SHIFT_HEX, RS},                        // 59
+  {MN_DSLL32, FMT_SHIFT_HEX, RS},                      // 60
+  RESERVED_OP,                                       // 61
+  {MN_DSRL32, FMT_SHIFT_HEX, RS},                      // 62
+  {MN_DSRA32, FMT_SHIFT_HEX, RS}                       // 63
+};
+
+static const OpEntry regimm_table[32] = {
+  {MN_BLTZ, FMT_BRANCH_RS, 0},                         // 0
+  {MN_BGEZ, FMT_BRANCH_RS, 0},                         // 1
+  {MN_BLTZL, FMT_BRANCH_RS, 0},                        // 2
+  {MN_BGEZL, FMT_BRANCH_RS, 0},                        // 3
+  INVALID_OP,                                        // 4
+  INVALID_OP,                                        // 5
+  INVALID_OP,                                        // 6
+  INVALID_OP,                                        // 7
+  {MN_TGEI, FMT_BRANCH_RS, 0},                         // 8
+  {MN_TGEIU, FMT_BRANCH_RS, 0},                        // 9
+  {MN_TLTI, FMT_BRANCH_RS, 0},                         // 10
+  {MN_TLTIU, FMT_BRANCH_RS, 0},                        // 11
+  {MN_TEQI, FMT_BRANCH_RS, 0},                         // 12
+  INVALID_OP,                                        // 13
+  {MN_TNEI, FMT_BRANCH_RS, 0},                         // 14
+  INVALID_OP,                                        // 15
+  {MN_BLTZAL, FMT_BRANCH_RS, 0},                       // 16
+  {MN_BGEZAL, FMT_BRANCH_RS, 0},                       // 17
+  {MN_BLTZALL, FMT_BRANCH_RS, 0},                      // 18
+  {MN_BGEZALL, FMT_BRANCH_RS, 0},                      // 19
+  INVALID_OP,                                        // 20
+  INVALID_OP,                                        // 21
+  INVALID_OP,                                        // 22
+  INVALID_OP,                                        // 23
+  INVALID_OP,                                        // 24
+  INVALID_OP,                                        // 25
+  INVALID_OP,                                        // 26
+  INVALID_OP,                                        // 27
+  INVALID_OP,                                        // 28
+  INVALID_OP,                                        // 29
+  INVALID_OP,                                        // 30
+  INVALID_OP                                         // 31
+};
+
+static const OpEntry opcode_table[64] = {
+  RESERVED_OP,                                       // 0
+  RESERVED_OP,                                       // 1
+  {MN_J, FMT_JUMP, 0},                                 // 2
+  {MN_JAL, FMT_JUMP, 0},                               // 3
+  {MN_BEQ, FMT_BRANCH_RS_RT, 0},                       // 4
+  {MN_BNE, FMT_BRANCH_RS_RT, 0},                       // 5
+  {MN_BLEZ, FMT_BRANCH_RS, RT},                        // 6
+  {MN_BGTZ, FMT_BRANCH_RS, RT},                        // 7
+  {MN_ADDI, FMT_RT_RS_SIMM, 0},                        // 8
+  {MN_ADDIU, FMT_RT_RS_SIMM, 0},                       // 9
+  {MN_SLTI, FMT_RT_RS_SIMM, 0},                        // 10
+  {MN_SLTIU, FMT_RT_RS_SIMM, 0},                       // 11
+  {MN_ANDI, FMT_RT_RS_UIMM, 0},                        // 12
+  {MN_ORI, FMT_RT_RS_UIMM, 0},                         // 13
+  {MN_XORI, FMT_RT_RS_UIMM, 0},                        // 14
+  {MN_LUI, FMT_LUI, RS},                               // 15
+  {MN_INVALID, FMT_COP0, 0},                           // 16
+  {MN_INVALID, FMT_COP1, 0},                           // 17
+  {MN_INVALID, FMT_COP2, 0},                           // 18
+  RESERVED_OP,                                       // 19
+  {MN_BEQL, FMT_BRANCH_RS_RT, 0},                      // 20
+  {MN_BNEL, FMT_BRANCH_RS_RT, 0},                      // 21
+  {MN_BLEZL, FMT_BRANCH_RS, 0},                        // 22
+  {MN_BGTZL, FMT_BRANCH_RS, 0},                        // 23
+  {MN_DADDI, FMT_RT_RS_PCREL, 0},                      // 24
+  {MN_DADDIU, FMT_RT_RS_PCREL, 0},                     // 25
+  RESERVED_OP,                                       // 26
+  {MN_LDR, FMT_MEM, 0},                                // 27
+  RESERVED_OP,                                       // 28
+  RESERVED_OP,                                       // 29
+  RESERVED_OP,                                       // 30
+  RESERVED_OP,                                       // 31
+  {MN_LB, FMT_MEM, 0},                                 // 32
+  {MN_LH, FMT_MEM, 0},                                 // 33
+  {MN_LWL, FMT_MEM, 0},                                // 34
+  {MN_LW, FMT_MEM, 0},                                 // 35
+  {MN_LBU, FMT_MEM, 0},                                // 36
+  {MN_LHU, FMT_MEM, 0},                                // 37
+  {MN_LWR, FMT_MEM, 0},                                // 38
+  {MN_LWU, FMT_MEM, 0},                                // 39
+  {MN_SB, FMT_MEM, 0},                                 // 40
+  {MN_SH, FMT_MEM, 0},                                 // 41
+  {MN_SWL, FMT_MEM, 0},                                // 42
+  {MN_SW, FMT_MEM, 0},                                 // 43
+  {MN_SDL, FMT_MEM, 0},                                // 44
+  {MN_SDR, FMT_MEM, 0},                                // 45
+  {MN_SWR, FMT_MEM, 0},                                // 46
+  {MN_CACHE, FMT_CACHE, 0},                            // 47
+  {MN_LL, FMT_MEM, 0},                                 // 48
+  {MN_LWC1, FMT_FMEM, 0},                              // 49
+  {MN_LWC2, FMT_FMEM, 0},                              // 50
+  RESERVED_OP,                                       // 51
+  {MN_LLD, FMT_MEM, 0},                                // 52
+  {MN_LDC1, FMT_FMEM, 0},                              // 53
+  {MN_LDC2, FMT_FMEM, 0},                              // 54
+  {MN_LD, FMT_MEM, 0},                                 // 55
+  {MN_SC, FMT_MEM, 0},                                 // 56
+  {MN_SWC1, FMT_FMEM, 0},                              // 57
+  {MN_SWC2, FMT_FMEM, 0},                              // 58
+  RESERVED_OP,                                       // 59
+  {MN_SCD, FMT_MEM, 0},                                // 60
+  {MN_SDC1, FMT_FMEM, 0},                              // 61
+  {MN_SDC2, FMT_FMEM, 0},                              // 62
+  {MN_SD, FMT_MEM, 0}                                  // 63
+};
+
+static const OpEntry cop1_table[64] = {
+  {MN_ADD_FMT, FMT_FPU3, 0},                           // 0
+  {MN_SUB_FMT, FMT_FPU3, 0},                           // 1
+  {MN_MUL_FMT, FMT_FPU3, 0},                           // 2
+  {MN_DIV_FMT, FMT_FPU3, 0},                           // 3
+  {MN_SQRT_FMT, FMT_FPU_SQRT, RT},                     // 4
+  INVALID_OP,                                        // 5
+  {MN_MOV_FMT, FMT_FPU2, RT},                          // 6
+  {MN_NEG_FMT, FMT_FPU2, RT},                          // 7
+  {MN_ROUND_L, FMT_FPU2, RT},                          // 8
+  {MN_TRUNC_L, FMT_FPU2, RT},                          // 9
+  {MN_CEIL_L, FMT_FPU2, RT},                           // 10
+  {MN_FLOOR_L, FMT_FPU2, RT},                          // 11
+  {MN_ROUND_W, FMT_FPU2, RT},                          // 12
+  {MN_TRUNC_W, FMT_FPU2, RT},                          // 13
+  {MN_CEIL_W, FMT_FPU2, RT},                           // 14
+  {MN_FLOOR_W, FMT_FPU2, RT},                          // 15
+  INVALID_OP,                                        // 16
+  INVALID_OP,                                        // 17
+  INVALID_OP,                                        // 18
+  INVALID_OP,                                        // 19
+  INVALID_OP,                                        // 20
+  INVALID_OP,                                        // 21
+  INVALID_OP,                                        // 22
+  INVALID_OP,                                        // 23
+  INVALID_OP,                                        // 24
+  INVALID_OP,                                        // 25
+  INVALID_OP,                                        // 26
+  INVALID_OP,                                        // 27
+  INVALID_OP,                                        // 28
+  INVALID_OP,                                        // 29
+  INVALID_OP,                                        // 30
+  INVALID_OP,                                        // 31
+  {MN_CVT_S, FMT_FPU_CVT, RT},                         // 32
+  {MN_CVT_D, FMT_FPU_CVT, RT},                         // 33
+  INVALID_OP,                                        // 34
+  INVALID_OP,                                        // 35
+  {MN_CVT_W, FMT_FPU_CVT, RT},                         // 36
+  {MN_CVT_L, FMT_FPU_CVT, RT},                         // 37
+  INVALID_OP,                                        // 38
+  INVALID_OP,                                        // 39
+  INVALID_OP,                                        // 40
+  INVALID_OP,                                        // 41
+  INVALID_OP,                                        // 42
+  INVALID_OP,                                        // 43
+  INVALID_OP,                                        // 44
+  INVALID_OP,                                        // 45
+  INVALID_OP,                                        // 46
+  INVALID_OP,                                        // 47
+  INVALID_OP,                                        // 48
+  INVALID_OP,                                        // 49
+  INVALID_OP,                                        // 50
+  INVALID_OP,                                        // 51
+  INVALID_OP,                                        // 52
+  INVALID_OP,                                        // 53
+  INVALID_OP,                                        // 54
+  INVALID_OP,                                        // 55
+  INVALID_OP,                                        // 56
+  INVALID_OP,                                        // 57
+  INVALID_OP,                                        // 58
+  INVALID_OP,                                        // 59
+  INVALID_OP,                                        // 60
+  INVALID_OP,                                        // 61
+  INVALID_OP,                                        // 62
+  INVALID_OP                                         // 63
+};
+
+static inline uint32_t field_rs(const uint32_t word) { return (word >> 21) & 0x1F; }
+static inline uint32_t field_rt(const uint32_t word) { return (word >> 16) & 0x1F; }
+static inline uint32_t field_rd(const uint32_t word) { return (word >> 11) & 0x1F; }
+static inline uint32_t field_sa(const uint32_t word) { return (word >> 6) & 0x1F; }
+static inline uint32_t field_imm(const uint32_t word) { return word & 0xFFFF; }
+
+static inline bool accept(DecodedInstruction* out, const uint8_t mnemonic, const uint8_t format) {
+  out->mnemonic = mnemonic;
+  out->format = format;
+  out->reject = REJECT_NONE;
+  out->candidate = MN_INVALID;
+  return true;
 }
 
-bool mips_is_j(const struct JType inst) {
-  return inst.opcode == 2;
+static inline bool reject(DecodedInstruction* out, const uint8_t format, const uint8_t reason,
+                          const uint8_t candidate = MN_INVALID) {
+  out->mnemonic = MN_INVALID;
+  out->format = format;
+  out->reject = reason;
+  out->candidate = candidate;
+  return false;
 }
 
-bool handle_r(const uint32_t pc, const struct RType inst) {
-  switch(inst.funct) {
-    case 0:
-      if (inst.rs != 0) return false;
-      // If the shift value of this instruction is 0,
-      // the assembler may treats this instruction as NOP.
-      if (inst.shamt == 0) PRINT("%-8s\n", "NOP");
-      else PRINT("%-8s %s, %s, %u\n", "sll", reg_str(inst.rd), reg_str(inst.rt), inst.shamt);
-      break;
-    case 2:
-      if (inst.rs != 0) return false;
-      PRINT("%-8s %s, %s, %u\n", "srl", reg_str(inst.rd), reg_str(inst.rt), inst.shamt);
-      break;
-    case 3:
-      if (inst.rs != 0x0) return false;
-      PRINT("%-8s %s, %s, %u\n", "sra", reg_str(inst.rd), reg_str(inst.rt), inst.shamt);
-      break;
-    case 4:
-      if (inst.shamt != 0) return false;
-      // If the shift value of this instruction is 0,
-      // the assembler may treats this instruction as NOP.
-      if (inst.rs == 0) PRINT("%-8s\n", "NOP");
-      else PRINT("%-8s %s, %s, %s\n", "sllv", reg_str(inst.rd), reg_str(inst.rt), reg_str(inst.rs));
-      break;
-    case 6:
-      if (inst.shamt != 0) return false;
-      PRINT("%-8s %s, %s, %s\n", "srlv", reg_str(inst.rd), reg_str(inst.rt), reg_str(inst.rs));
-      break;
-    case 7:
-      if ((inst.rt & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "srav", reg_str(inst.rd), reg_str(inst.rt), reg_str(inst.rs));
-      break;
-    case 8:
-      if ((inst.rd & inst.rt & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s\n", "jr", reg_str(inst.rs));
-      break;
-    case 9:
-      if ((inst.rt & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s\n", "jalr", reg_str(inst.rs));
-      break;
-    case 12:
-      PRINT("%-8s \n", "syscall");
-      break;
-    case 13:
-      PRINT("%-8s %u\n", "break", inst.rs << 5 | inst.rt);
-      break;
-    case 15:
-      if ((inst.rs & inst.rt & inst.rd & inst.shamt) != 0x0) return false;
-      // The SYNC instruction is executed as a NOP on the VR4300. This operation
-      // maintains compatibility with code that conforms to the VR4400.
-      //PRINT("%-8s %u\n", "sync", inst.rs << 5 | inst.rt);
-      PRINT("%-8s\n", "NOP");
-      break;
-    case 16:
-      if ((inst.rs & inst.rt & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s\n", "mfhi", reg_str(inst.rd));
-      break;
-    case 17:
-      if ((inst.rt & inst.rd & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s\n", "mthi", reg_str(inst.rs));
-      break;
-    case 18:
-      if ((inst.rs & inst.rt & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s\n", "mflo", reg_str(inst.rd));
-      break;
-    case 19:
-      if ((inst.rt & inst.rd & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s\n", "mtlo", reg_str(inst.rs));
-      break;
-    case 20:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "dsllv", reg_str(inst.rd), reg_str(inst.rt), reg_str(inst.rs));
-      break;
-    case 22:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "dsrlv", reg_str(inst.rd), reg_str(inst.rt), reg_str(inst.rs));
-      break;
-    case 23:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "dsrav", reg_str(inst.rd), reg_str(inst.rt), reg_str(inst.rs));
-      break;
-    case 24:
-      if ((inst.rd & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s, %s\n", "mult", reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 25:
-      if ((inst.rd & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s, %s\n", "multu", reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 26:
-      if ((inst.rd & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "div", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 27:
-      if ((inst.rd & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "divu", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 28:
-      if ((inst.rd & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "dmult", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 29:
-      if ((inst.rd & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "dmultu", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 30:
-      if ((inst.rd & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "ddiv", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 31:
-      if ((inst.rd & inst.shamt) != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "ddivu", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 32:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "add", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 33:
-      if (inst.shamt != 0x0) return false;
-      if (inst.rt == 0) PRINT("%-8s %s, %s\n", "move", reg_str(inst.rd), reg_str(inst.rs));
-      else PRINT("%-8s %s, %s, %s\n", "addu", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 34:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "sub", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 35:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "subu", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 36:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "and", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 37:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "or", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 38:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "xor", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 39:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "nor", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 42:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "slt", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 43:
-      PRINT("%-8s %s, %s, %s\n", "sltu", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 44:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "dadd", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 45:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "daddu", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 46:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "dsub", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 47:
-      if (inst.shamt != 0x0) return false;
-      PRINT("%-8s %s, %s, %s\n", "dsubu", reg_str(inst.rd), reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 48:
-      PRINT("%-8s %s, %s\n", "tge", reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 49:
-      PRINT("%-8s %s, %s\n", "tgeu", reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 50:
-      PRINT("%-8s %s, %s\n", "tlt", reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 51:
-      PRINT("%-8s %s, %s\n", "tltu", reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 54:
-      PRINT("%-8s %s, %s\n", "tne", reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 52:
-      PRINT("%-8s %s, %s\n", "teq", reg_str(inst.rs), reg_str(inst.rt));
-      break;
-    case 56:
-      if (inst.rs != 0x0) return false;
-      PRINT("%-8s %s, %s, 0x%x\n", "dsll", reg_str(inst.rd), reg_str(inst.rt), inst.shamt);
-      break;
-    case 58:
-      if (inst.rs != 0x0) return false;
-      PRINT("%-8s %s, %s, 0x%x\n", "dsrl", reg_str(inst.rd), reg_str(inst.rt), inst.shamt);
-      break;
-    case 59:
-      if (inst.rs != 0x0) return false;
-      PRINT("%-8s %s, %s, 0x%x\n", "dsra", reg_str(inst.rd), reg_str(inst.rt), inst.shamt);
-      break;
-    case 60:
-      if (inst.rs != 0x0) return false;
-      PRINT("%-8s %s, %s, 0x%x\n", "dsll32", reg_str(inst.rd), reg_str(inst.rt), inst.shamt);
-      break;
-    case 62:
-      if (inst.rs != 0x0) return false;
-      PRINT("%-8s %s, %s, 0x%x\n", "dsrl32", reg_str(inst.rd), reg_str(inst.rt), inst.shamt);
-      break;
-    case 63:
-      if (inst.rs != 0x0) return false;
-      PRINT("%-8s %s, %s, 0x%x\n", "dsra32", reg_str(inst.rd), reg_str(inst.rt), inst.shamt);
-      break;
-    default:
-      PRINT("NOT IMPLEMENTED\n");
-      return false;
+// the COPz operations are only decoded with MIPS_COPZ
+static inline uint8_t cop_reason(const uint32_t word, const uint8_t reason) {
+  return (field_rs(word) >> 4) == 0x1 ? (uint8_t) REJECT_COPZ : reason;
+}
+
+// first field with a bit that must be zero
+static inline uint8_t nonzero_reason(const uint32_t bits) {
+  if (bits & RS) return REJECT_NONZERO_RS;
+  if (bits & RT) return REJECT_NONZERO_RT;
+  if (bits & RD) return REJECT_NONZERO_RD;
+  return REJECT_NONZERO_SA;
+}
+
+// Branch On Coprocessor z, bc_base is the BCzF id of the coprocessor
+static inline bool decode_bc(const uint32_t word, const uint8_t bc_base, DecodedInstruction* out) {
+  return accept(out, bc_base + (field_rt(word) & 0x3), FMT_COP_BRANCH);
+}
+
+static bool decode_cop0(const uint32_t word, const int options, DecodedInstruction* out) {
+  const uint32_t rs = field_rs(word);
+  if (rs == 0x8) return decode_bc(word, MN_BC0F, out);
+  if ((options & MIPS_COPZ) && (rs >> 4) == 0x1) return accept(out, MN_COP0, FMT_COPZ);
+  if ((word & 0x03FFFFC0) == 0x02000000) {
+    // check last 6 bits first
+    switch (word & 0x3F) {
+      case 0x1:  return accept(out, MN_TLBR, FMT_NONE);
+      case 0x2:  return accept(out, MN_TLBWI, FMT_NONE);
+      case 0x6:  return accept(out, MN_TLBWR, FMT_NONE);
+      case 0x8:  return accept(out, MN_TLBP, FMT_NONE);
+      case 0x18: return accept(out, MN_ERET, FMT_NONE);
+      default: break;
+    }
+  }
+  // else last 11 must be 0
+  if ((word & 0x7FF) != 0) return reject(out, FMT_INVALID, cop_reason(word, REJECT_COP_LOW_BITS));
+  switch (rs) {
+    case 0:  return accept(out, MN_MFC0, FMT_MOVE_COP0);
+    case 1:  return accept(out, MN_DMFC0, FMT_MOVE_COP0);
+    case 4:  return accept(out, MN_MTC0, FMT_MOVE_COP0);
+    default: return reject(out, FMT_INVALID, cop_reason(word, REJECT_COP_RS));
+  }
+}
+
+static bool decode_cop1(const uint32_t word, const int options, DecodedInstruction* out) {
+  const uint32_t rs = field_rs(word);
+  if (rs == 0x8) return decode_bc(word, MN_BC1F, out);
+  if ((options & MIPS_COPZ) && (rs >> 4) == 0x1) return accept(out, MN_COP1, FMT_COPZ);
+  // check last 6 bits for FPU instructions,
+  // with funct 0 and rs up to 6 it's a move
+  const OpEntry& op = cop1_table[word & 0x3F];
+  if ((word & op.zero_mask) == 0 && (op.mnemonic != MN_ADD_FMT || rs > 6)) {
+    return accept(out, op.mnemonic, op.format);
+  }
+
+  // floating point compare
+  if (((word >> 4) & 0xF) == 0x3) return accept(out, MN_C_COND, FMT_FPU_CMP);
+
+  // else last 11 bits must be 0
+  if ((word & 0x7FF) != 0) return reject(out, FMT_INVALID, cop_reason(word, REJECT_COP_LOW_BITS));
+
+  // handle other stuff that's on COP1 10001
+  switch (rs) {
+    case 0:  return accept(out, MN_MFC1, FMT_MOVE_COP);
+    case 2:  return accept(out, MN_CFC1, FMT_MOVE_COP);
+    case 4:  return accept(out, MN_MTC1, FMT_MOVE_COP);
+    case 6:  return accept(out, MN_CTC1, FMT_MOVE_CTRL);
+    default: return reject(out, FMT_INVALID, cop_reason(word, REJECT_COP_RS));
+  }
+}
+
+static bool decode_cop2(const uint32_t word, const int options, DecodedInstruction* out) {
+  const uint32_t rs = field_rs(word);
+  if (rs == 0x8) return decode_bc(word, MN_BC2F, out);
+  if ((options & MIPS_COPZ) && (rs >> 4) == 0x1) return accept(out, MN_COP2, FMT_COPZ);
+  // else last 11 must be 0
+  if ((word & 0x7FF) != 0) return reject(out, FMT_INVALID, cop_reason(word, REJECT_COP_LOW_BITS));
+  switch (rs) {
+    case 0:  return accept(out, MN_MFC2, FMT_MOVE_COP);
+    case 2:  return accept(out, MN_CFC2, FMT_MOVE_COP);
+    case 4:  return accept(out, MN_MTC2, FMT_MOVE_COP);
+    case 6:  return accept(out, MN_CTC2, FMT_MOVE_CTRL);
+    default: return reject(out, FMT_INVALID, cop_reason(word, REJECT_COP_RS));
   }
-  return true;
 }
 
-static const char* bc_str(const uint8_t bc, const int cop) {
-  switch (bc) {
-    case 0:
-      if      (cop==0) return "bc0f";
-      else if (cop==1) return "bc1f";
-      else if (cop==2) return "bc2f";
+static bool decode_word(const uint32_t word, const int options, DecodedInstruction* out) {
+  const uint32_t opcode = word >> 26;
+  const OpEntry* op;
+  if (opcode == 0) op = &special_table[word & 0x3F];
+  else if (opcode == 1) op = &regimm_table[field_rt(word)];
+  else op = &opcode_table[opcode];
+
+  const uint32_t nonzero = word & op->zero_mask;
+  if (nonzero != 0) {
+    if (op->mnemonic != MN_INVALID) {
+      return reject(out, FMT_INVALID, nonzero_reason(nonzero), op->mnemonic);
+    }
+    const uint8_t reason = opcode == 0 ? REJECT_SPECIAL_FUNCT
+                         : opcode == 1 ? REJECT_REGIMM_RT : REJECT_OPCODE;
+    return reject(out, op->format == FMT_RESERVED ? FMT_RESERVED : FMT_INVALID, reason);
+  }
+
+  switch (op->format) {
+    case FMT_COP0: return decode_cop0(word, options, out);
+    case FMT_COP1: return decode_cop1(word, options, out);
+    case FMT_COP2: return decode_cop2(word, options, out);
+    default: break;
+  }
+
+  // If the shift value of this instruction is 0,
+  // the assembler may treats this instruction as NOP.
+  switch (op->mnemonic) {
+    case MN_SLL:
+      if (field_sa(word) == 0) return accept(out, MN_NOP, FMT_NONE);
       break;
-    case 1:
-      if      (cop==0) return "bc0t";
-      else if (cop==1) return "bc1t";
-      else if (cop==2) return "bc2t";
+    case MN_SLLV:
+      if (field_rs(word) == 0) return accept(out, MN_NOP, FMT_NONE);
       break;
-    case 2:
-      if      (cop==0) return "bc0fl";
-      else if (cop==1) return "bc1fl";
-      else if (cop==2) return "bc2fl";
+    case MN_ADDU:
+      if (field_rt(word) == 0) return accept(out, MN_MOVE, FMT_RD_RS);
       break;
-    case 3:
-      if      (cop==0) return "bc0tl";
-      else if (cop==1) return "bc1tl";
-      else if (cop==2) return "bc2tl";
+    case MN_BNE:
+      if (field_rt(word) == 0) return accept(out, MN_BNEZ, FMT_BRANCH_RS);
       break;
-    default: return NULL;
-  }
-  return NULL;
-}
-
-// copz
-static const char* regimm_str(const uint32_t regimm) {
-  switch (regimm) {
-    case 0:  return "bltz";
-    case 1:  return "begz";
-    case 2:  return "bltzl";
-    case 3:  return "bgezl";
-    case 8:  return "tgei";
-    case 9:  return "tgeiu";
-    case 10: return "tlti";
-    case 11: return "tltiu";
-    case 12: return "teqi";
-    case 14: return "tnei";
-    case 16: return "bltzal";
-    case 17: return "bgezal";
-    case 18: return "bltzall";
-    case 19: return "bgezall";
-    default: return NULL;
+    default: break;
   }
+  return accept(out, op->mnemonic, op->format);
 }
 
 static char fmt_str(const uint32_t fmt) {
@@ -375,416 +493,641 @@ static char fmt_str(const uint32_t fmt) {
   return '?';
 }
 
-// FIXME, change to Rtype
-static bool handle_fpu(const uint32_t pc, const IType inst) {
-  // check if Branch On FPU
-  if (inst.rs == 0x8) {
-    const char* bc = bc_str(inst.rt & 0x3, 1);
-    if (bc != NULL) {
-      int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-      PRINT("%-8s 0x%0x\n", bc, offset);
-      return true;
-    }
+/*
+  The text is built by hand instead of going through printf, the format
+  strings in the comments are what each case used to print and the
+  output is the same byte for byte.
+*/
+
+static const uint8_t mnemonic_len[MN_COUNT] = {
+#define X(id, text, flags) sizeof(text) - 1,
+  MIPS_MNEMONICS(X)
+#undef X
+};
+
+static const uint8_t reg_len[32] = {
+  5, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3
+};
+
+static const char HEX_UPPER[] = "0123456789ABCDEF";
+static const char HEX_LOWER[] = "0123456789abcdef";
+
+static const char DIGIT_PAIRS[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static inline char* put(char* p, const char* text, const size_t size) {
+  memcpy(p, text, size);
+  return p + size;
+}
+
+// %-8s
+static inline char* put_mnemonic(char* p, const uint8_t mnemonic) {
+  memcpy(p, "        ", 8);
+  memcpy(p, mnemonic_str[mnemonic], mnemonic_len[mnemonic]);
+  return p + (mnemonic_len[mnemonic] > 8 ? mnemonic_len[mnemonic] : 8);
+}
+
+static inline char* put_reg(char* p, const uint32_t reg) {
+  memcpy(p, reg_str[reg], 8);
+  return p + reg_len[reg];
+}
+
+// 0x%08X
+static inline char* put_hex8(char* p, const uint32_t value) {
+  p[0] = '0';
+  p[1] = 'x';
+  for (int i = 0; i < 8; ++i) p[2 + i] = HEX_UPPER[(value >> (28 - 4 * i)) & 0xF];
+  return p + 10;
+}
+
+// 0x%x
+static inline char* put_hex(char* p, uint32_t value) {
+  char tmp[8];
+  int n = 0;
+  do {
+    tmp[n++] = HEX_LOWER[value & 0xF];
+    value >>= 4;
+  } while (value != 0);
+  *p++ = '0';
+  *p++ = 'x';
+  while (n > 0) *p++ = tmp[--n];
+  return p;
+}
+
+// %u
+static inline char* put_uint(char* p, uint32_t value) {
+  char tmp[10];
+  int n = 10;
+  while (value >= 100) {
+    const uint32_t pair = (value % 100) * 2;
+    value /= 100;
+    tmp[--n] = DIGIT_PAIRS[pair + 1];
+    tmp[--n] = DIGIT_PAIRS[pair];
   }
-#ifdef ENABLE_COPZ
-  if ((inst.rs >> 4) == 0x1) {
-    PRINT("%-8s 0x%x\n", "cop1", ((inst.rs & 0xF) << 20) | (inst.rt << 15) | (inst.immediate));
-    return true;
+  if (value >= 10) {
+    tmp[--n] = DIGIT_PAIRS[value * 2 + 1];
+    tmp[--n] = DIGIT_PAIRS[value * 2];
+  } else {
+    tmp[--n] = '0' + value;
   }
-#endif
-  // check last 6 bits for FPU instructions
-  switch (inst.immediate & 0x3F) {
-    case 0x0: 
-      if (inst.rs > 6) {
-        PRINT("%-s%-4c $f%d, $f%d, $f%d\n", "add.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11, inst.rt);
-        return true;
-      }
-      break;
-    case 0x1:
-        PRINT("%-s%-4c $f%d, $f%d, $f%d\n", "sub.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11, inst.rt);
-        return true;
-    case 0x2:
-      PRINT("%-s%-4c $f%d, $f%d, $f%d\n", "mul.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11, inst.rt);
-      return true;
-    case 0x3:
-      PRINT("%-s%-4c $f%d, $f%d, $f%d\n", "div.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11, inst.rt);
-      return true;
-    case 0x4:
-      if (inst.rt == 0) {
-        PRINT("%-s%-3c $f%d, $f%d\n", "sqrt.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
-      break;
-    case 0x6:
-      if (inst.rt == 0) {
-        PRINT("%-s%-4c $f%d, $f%d\n", "mov.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
-      break;
-    case 0x7:
-      if (inst.rt == 0) {
-        PRINT("%-s%-4c $f%d, $f%d\n", "neg.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
-      break;
-    case 0x8:
-      if (inst.rt == 0) {
-        PRINT("%-s%-4c $f%d, $f%d\n", "round.l.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
-      break;
-    case 0x9:
-      if (inst.rt == 0) {
-        PRINT("%-s%-4c $f%d, $f%d\n", "trunc.l.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
-      break;
-    case 0xa:
-      if (inst.rt == 0) {
-        PRINT("%-s%-4c $f%d, $f%d\n", "ceil.l.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
-      break;
-    case 0xb:
-      if (inst.rt == 0) {
-        PRINT("%-s%-4c $f%d, $f%d\n", "floor.l.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
-      break;
-    case 0xc:
-      if (inst.rt == 0) {
-        PRINT("%-s%-4c $f%d, $f%d\n", "round.w.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
-      break;
-    case 0xd:
-      if (inst.rt == 0) {
-        PRINT("%-s%-4c $f%d, $f%d\n", "trunc.w.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
-      break;
-    case 0xe:
-      if (inst.rt == 0) {
-        PRINT("%-s%-4c $f%d, $f%d\n", "ceil.w.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
-      break;
-    case 0xf:
-      if (inst.rt == 0) {
-        PRINT("%-s%-4c $f%d, $f%d\n", "floor.w.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
-      break;
-    case 0x20:
-      if (inst.rt == 0) {
-        PRINT("%-s%-2c $f%d, $f%d\n", "cvt.s.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
-      break;
-    case 0x21:
-      if (inst.rt == 0) {
-        PRINT("%-s%-2c $f%d, $f%d\n", "cvt.d.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
-      break;
-    case 0x24:
-      if (inst.rt == 0) {
-        PRINT("%-s%-2c $f%d, $f%d\n", "cvt.w.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
+  return put(p, tmp + n, 10 - n);
+}
+
+// %i
+static inline char* put_int(char* p, const int32_t value) {
+  if (value >= 0) return put_uint(p, value);
+  *p++ = '-';
+  return put_uint(p, 0 - (uint32_t) value);
+}
+
+static inline char* put_sep(char* p) {
+  p[0] = ',';
+  p[1] = ' ';
+  return p + 2;
+}
+
+// $f%d
+static inline char* put_fpr(char* p, const uint32_t reg) {
+  p[0] = '$';
+  p[1] = 'f';
+  return put_uint(p + 2, reg);
+}
+
+// %-s%-Nc, FPU mnemonic followed by the format letter padded to width
+static inline char* put_fpu(char* p, const uint8_t mnemonic, const uint32_t fmt, const int width) {
+  p = put(p, mnemonic_str[mnemonic], mnemonic_len[mnemonic]);
+  memcpy(p, "    ", 4);
+  p[0] = fmt_str(fmt);
+  return p + width;
+}
+
+size_t mips_format(const DecodedInstruction& inst, char* out) {
+  const uint32_t pc = inst.pc;
+  const uint32_t word = inst.word;
+  const uint32_t rs = inst.rs;
+  const uint32_t rt = inst.rt;
+  const uint32_t rd = inst.rd;
+  const uint32_t imm = field_imm(word);
+  const int16_t simm = (int16_t) imm;
+  const uint32_t offset = ((uint32_t)(int32_t) simm << 2) + (pc + 4);
+
+  switch (inst.format) {
+    case FMT_INVALID:
+    case FMT_COP0:
+    case FMT_COP1:
+    case FMT_COP2:
+      return 0;
+    default: break;
+  }
+
+  // "0x%08X "
+  char* p = put_hex8(out, pc);
+  *p++ = ' ';
+
+  switch (inst.format) {
+    // "%-8s"
+    case FMT_NONE:
+      p = put_mnemonic(p, inst.mnemonic);
+      break;
+    // "%-8s "
+    case FMT_SYSCALL:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      break;
+    // "%-8s %u"
+    case FMT_BREAK:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_uint(p, rs << 5 | rt);
+      break;
+    // "%-8s %s, %s, %u"
+    case FMT_SHIFT:
+    // "%-8s %s, %s, 0x%x"
+    case FMT_SHIFT_HEX:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_sep(put_reg(p, rd));
+      p = put_sep(put_reg(p, rt));
+      p = inst.format == FMT_SHIFT ? put_uint(p, inst.sa) : put_hex(p, inst.sa);
+      break;
+    // "%-8s %s, %s, %s"
+    case FMT_SHIFTV:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_sep(put_reg(p, rd));
+      p = put_sep(put_reg(p, rt));
+      p = put_reg(p, rs);
+      break;
+    // "%-8s %s"
+    case FMT_RS:
+    case FMT_RD:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_reg(p, inst.format == FMT_RS ? rs : rd);
+      break;
+    // "%-8s %s, %s"
+    case FMT_RS_RT:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_sep(put_reg(p, rs));
+      p = put_reg(p, rt);
+      break;
+    case FMT_RD_RS:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_sep(put_reg(p, rd));
+      p = put_reg(p, rs);
+      break;
+    // "%-8s %s, %s, %s"
+    case FMT_RD_RS_RT:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_sep(put_reg(p, rd));
+      p = put_sep(put_reg(p, rs));
+      p = put_reg(p, rt);
+      break;
+    // "%-8s %s, 0x%08X"
+    case FMT_BRANCH_RS:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_sep(put_reg(p, rs));
+      p = put_hex8(p, offset);
+      break;
+    // "%-8s %s, %s, 0x%08X"
+    case FMT_BRANCH_RS_RT:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_sep(put_reg(p, rs));
+      p = put_sep(put_reg(p, rt));
+      p = put_hex8(p, offset);
+      break;
+    // "%-8s %s, %s, %i"
+    case FMT_RT_RS_SIMM:
+    case FMT_RT_RS_PCREL:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_sep(put_reg(p, rt));
+      p = put_sep(put_reg(p, rs));
+      p = put_int(p, inst.format == FMT_RT_RS_SIMM ? simm : (int32_t) offset);
+      break;
+    // "%-8s %s, %s, 0x%x"
+    case FMT_RT_RS_UIMM:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_sep(put_reg(p, rt));
+      p = put_sep(put_reg(p, rs));
+      p = put_hex(p, imm);
+      break;
+    // "%-8s %s, 0x%x"
+    case FMT_LUI:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_sep(put_reg(p, rt));
+      p = put_hex(p, imm);
+      break;
+    // "%-8s %s, %i(%s)", "%-8s $f%d, %i(%s)", "%-8s %i, %i(%s)"
+    case FMT_MEM:
+    case FMT_FMEM:
+    case FMT_CACHE:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      if (inst.format == FMT_MEM) p = put_reg(p, rt);
+      else if (inst.format == FMT_FMEM) p = put_fpr(p, rt);
+      else p = put_uint(p, rt);
+      p = put_sep(p);
+      p = put_int(p, simm);
+      *p++ = '(';
+      p = put_reg(p, rs);
+      *p++ = ')';
+      break;
+    // "%-8s 0x%08X"
+    case FMT_JUMP:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      // printed as it always was, inst.target has the full 26 bits
+      p = put_hex8(p, ((pc + 4) & 0xF0000000) | ((word & 0xFFFFFF) << 2));
+      break;
+    // "%-8s 0x%0x"
+    case FMT_COP_BRANCH:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_hex(p, offset);
+      break;
+    // "%-8s 0x%x"
+    case FMT_COPZ:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_hex(p, ((rs & 0xF) << 20) | (rt << 15) | imm);
+      break;
+    // "%-8s %s, %s"
+    case FMT_MOVE_COP0:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_sep(put_reg(p, rt));
+      p = put_reg(p, rd);
+      break;
+    // "%-8s %s, $f%d"
+    case FMT_MOVE_COP:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_sep(put_reg(p, rt));
+      p = put_fpr(p, rd);
+      break;
+    // "%-8s %s, $%d"
+    case FMT_MOVE_CTRL:
+      p = put_mnemonic(p, inst.mnemonic);
+      *p++ = ' ';
+      p = put_sep(put_reg(p, rt));
+      *p++ = '$';
+      p = put_uint(p, rd);
+      break;
+    // "%-s%-4c $f%d, $f%d, $f%d"
+    case FMT_FPU3:
+      p = put_fpu(p, inst.mnemonic, rs, 4);
+      *p++ = ' ';
+      p = put_sep(put_fpr(p, (imm >> 6) & 0x3F));
+      p = put_sep(put_fpr(p, rd));
+      p = put_fpr(p, rt);
+      break;
+    // "%-s%-4c $f%d, $f%d", sqrt uses %-3c and cvt %-2c
+    case FMT_FPU2:
+    case FMT_FPU_SQRT:
+    case FMT_FPU_CVT:
+      p = put_fpu(p, inst.mnemonic, rs, inst.format == FMT_FPU2 ? 4 : inst.format == FMT_FPU_SQRT ? 3 : 2);
+      *p++ = ' ';
+      p = put_sep(put_fpr(p, (imm >> 6) & 0x3F));
+      p = put_fpr(p, rd);
+      break;
+    // "%-s%s.%-3c $f%d, $f%d"
+    case FMT_FPU_CMP:
+    {
+      p = put(p, mnemonic_str[inst.mnemonic], mnemonic_len[inst.mnemonic]);
+      const char* cond = cond_str[imm & 0xF];
+      p = put(p, cond, strlen(cond));
+      *p++ = '.';
+      memcpy(p, "   ", 3);
+      p[0] = fmt_str(rs);
+      p += 3;
+      *p++ = ' ';
+      p = put_sep(put_fpr(p, rd));
+      p = put_fpr(p, rt);
       break;
-    case 0x25:
-      if (inst.rt == 0) {
-        PRINT("%-s%-2c $f%d, $f%d\n", "cvt.l.", fmt_str(inst.rs), (inst.immediate >> 6) & 0x3F, inst.immediate >> 11);
-        return true;
-      }
+    }
+    case FMT_RESERVED:
+      p = put(p, "NOT IMPLEMENTED", 15);
       break;
     default: break;
   }
+  *p++ = '\n';
+  return p - out;
+}
 
-  // floating point compare
-  if (((inst.immediate >> 4) & 0xF) == 0x3) {
-    PRINT("%-s%s.%-3c $f%d, $f%d\n", "c.", cond_str(inst.immediate & 0xF), fmt_str(inst.rs), inst.immediate >> 11, inst.rt);
-    return true;
+// the text has the branch or jump target
+static inline bool pc_relative(const uint8_t format) {
+  switch (format) {
+    case FMT_BRANCH_RS:
+    case FMT_BRANCH_RS_RT:
+    case FMT_RT_RS_PCREL:
+    case FMT_JUMP:
+    case FMT_COP_BRANCH:
+      return true;
+    default:
+      return false;
   }
+}
 
-  // else last 3 bits must not be 0
-  if ((inst.immediate & 0x7FF) != 0) return false;
+size_t mips_format_cached(const DecodedInstruction& inst, MipsCache* cache,
+                          MipsCounters* counters, char* out) {
+  if (cache == NULL) return mips_format(inst, out);
+  if (pc_relative(inst.format)) {
+    ++counters->cache_misses;
+    return mips_format(inst, out);
+  }
 
-  // handle other stuff that's on COP1 10001
-  if      (inst.rs == 0) PRINT("%-8s %s, $f%d\n", "mfc1", reg_str(inst.rt), inst.immediate >> 11);
-  else if (inst.rs == 2) PRINT("%-8s %s, $f%d\n", "cfc1", reg_str(inst.rt), inst.immediate >> 11);
-  else if (inst.rs == 4) PRINT("%-8s %s, $f%d\n", "mtc1", reg_str(inst.rt), inst.immediate >> 11);
-  else if (inst.rs == 6) PRINT("%-8s %s, $%d\n",  "ctc1", reg_str(inst.rt), inst.immediate >> 11);
-  else return false;
+  // multiplicative hash, the low bits of the words repeat too much
+  const uint32_t slot = (inst.word * 0x9E3779B1u) >> (32 - MIPS_CACHE_BITS);
+  const size_t cached = cache->sizes[slot];
+  if (cached != 0 && cache->words[slot] == inst.word) {
+    ++counters->cache_hits;
+    char* p = put_hex8(out, inst.pc);
+    *p++ = ' ';
+    // most lines fit in half the text, out has room for MIPS_MAX_LINE
+    memcpy(p, cache->text[slot], MIPS_CACHE_TEXT / 2);
+    if (cached > MIPS_CACHE_TEXT / 2) {
+      memcpy(p + MIPS_CACHE_TEXT / 2, cache->text[slot] + MIPS_CACHE_TEXT / 2, MIPS_CACHE_TEXT / 2);
+    }
+    return MIPS_ADDRESS_SIZE + cached;
+  }
+
+  ++counters->cache_misses;
+  const size_t size = mips_format(inst, out);
+  if (cache->words[slot] != inst.word) {
+    // the words seen once aren't worth the copy
+    cache->words[slot] = inst.word;
+    cache->sizes[slot] = 0;
+  } else if (size > MIPS_ADDRESS_SIZE && size - MIPS_ADDRESS_SIZE <= MIPS_CACHE_TEXT) {
+    cache->sizes[slot] = size - MIPS_ADDRESS_SIZE;
+    memcpy(cache->text[slot], out + MIPS_ADDRESS_SIZE, MIPS_CACHE_TEXT);
+  }
+  return size;
+}
 
+void mips_print(MipsContext* ctx, const DecodedInstruction& inst) {
+  if (!(ctx->options & MIPS_PRINT)) return;
+  char* out = sink_reserve(&ctx->sink, MIPS_MAX_LINE);
+  sink_commit(&ctx->sink, mips_format_cached(inst, ctx->cache, &ctx->counters, out));
+}
+
+void mips_print_address(MipsContext* ctx, const DecodedInstruction& inst, const uint32_t address) {
+  if (!(ctx->options & MIPS_PRINT)) return;
+  char* out = sink_reserve(&ctx->sink, MIPS_MAX_LINE);
+  const size_t size = mips_format(inst, out);
+  if (size == 0) return;
+  // "  # 0x%08X" before the newline
+  char* p = put(out + size - 1, "  # ", 4);
+  p = put_hex8(p, address);
+  *p++ = '\n';
+  sink_commit(&ctx->sink, p - out);
+}
+
+bool mips_decode(const uint32_t pc, const uint32_t word, DecodedInstruction* out,
+                 const int options) {
+  out->pc = pc;
+  out->word = word;
+  out->rs = field_rs(word);
+  out->rt = field_rt(word);
+  out->rd = field_rd(word);
+  out->sa = field_sa(word);
+  const bool ok = decode_word(word, options, out);
+
+  out->flags = mnemonic_flags[out->mnemonic];
+  if (out->flags & (MIPS_BRANCH | MIPS_JUMP)) out->flags |= MIPS_DELAY_SLOT;
+
+  const uint32_t imm = field_imm(word);
+  if (out->format == FMT_RT_RS_UIMM || out->format == FMT_LUI) out->imm = imm;
+  else out->imm = (int16_t) imm;
+
+  // the 26 bits target is shifted left twice
+  // and takes the first four bits of the PC
+  if (out->flags & MIPS_BRANCH) out->target = (uint32_t) out->imm * 4 + (pc + 4);
+  else if (out->format == FMT_JUMP) out->target = ((pc + 4) & 0xF0000000) | ((word & 0x3FFFFFF) << 2);
+  else out->target = 0;
+  return ok;
+}
+
+/*
+  Masks of the pre-filter, a word is certainly invalid when it has one
+  of the bits of its mask. Indexed like decode_word(): opcode, 64 + funct
+  for SPECIAL, 128 + rt for REGIMM. The coprocessors are left to their
+  decoders with an empty mask.
+*/
+static const size_t FILTER_SPECIAL = 64;
+static const size_t FILTER_REGIMM = 128;
+static const size_t FILTER_SIZE = 160;
+
+struct FilterMasks {
+  uint32_t mask[FILTER_SIZE];
+};
+
+static FilterMasks build_filter_masks() {
+  FilterMasks masks;
+  for (size_t i = 0; i < 64; ++i) {
+    const OpEntry& op = opcode_table[i];
+    const bool cop = op.format == FMT_COP0 || op.format == FMT_COP1 || op.format == FMT_COP2;
+    masks.mask[i] = cop ? 0 : op.zero_mask;
+    masks.mask[FILTER_SPECIAL + i] = special_table[i].zero_mask;
+  }
+  for (size_t i = 0; i < 32; ++i) masks.mask[FILTER_REGIMM + i] = regimm_table[i].zero_mask;
+  return masks;
+}
+
+static const FilterMasks filter_masks = build_filter_masks();
+
+static inline uint32_t filter_index(const uint32_t word) {
+  return mips_op_index(word);
+}
+
+bool mips_op_entry(const uint32_t index, uint8_t* mnemonic, uint8_t* format, uint32_t* zero_mask) {
+  if (index >= FILTER_SIZE) return false;
+  const OpEntry& op = index >= FILTER_REGIMM ? regimm_table[index - FILTER_REGIMM]
+                    : index >= FILTER_SPECIAL ? special_table[index - FILTER_SPECIAL]
+                    : opcode_table[index];
+  if (op.format == FMT_COP0 || op.format == FMT_COP1 || op.format == FMT_COP2) return false;
+  *mnemonic = op.mnemonic;
+  *format = op.format;
+  *zero_mask = op.zero_mask;
   return true;
 }
 
-bool handle_i(const uint32_t pc, const struct IType inst) {
-  switch (inst.opcode) {
-      case 1:
-      {
-        const char* regimm = regimm_str(inst.rt);
-        if (regimm == NULL) return false;
-        int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-        PRINT("%-8s %s, 0x%08X\n", regimm_str(inst.rt), reg_str(inst.rs), offset);
-        break;
-      }
-      case 4:
-      {
-        int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-        PRINT("%-8s %s, %s, 0x%08X\n", "beq", reg_str(inst.rs), reg_str(inst.rt), offset);
-        break;
-      }
-      case 5:
-      {
-        int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-        if (inst.rt == 0) PRINT("%-8s %s, 0x%08X\n", "bnez", reg_str(inst.rs), offset);
-        else PRINT("%-8s %s, %s, 0x%08X\n", "bne", reg_str(inst.rs), reg_str(inst.rt), offset);
-        break;
-      }
-      case 6:
-      {
-        if (inst.rt != 0x0) return false;
-        int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-        PRINT("%-8s %s, 0x%08X\n", "blez", reg_str(inst.rs), offset);
-        break;
-      }
-      case 7:
-      {
-        if (inst.rt != 0x0) return false;
-        int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-        PRINT("%-8s %s, 0x%08X\n", "bgtz", reg_str(inst.rs), offset);
-        break;
-      }
-      case 8:
-        PRINT("%-8s %s, %s, %i\n", "addi", reg_str(inst.rt), reg_str(inst.rs), (int16_t)inst.immediate);
-        break;
-      case 9:
-        PRINT("%-8s %s, %s, %i\n", "addiu", reg_str(inst.rt), reg_str(inst.rs), (int16_t)inst.immediate);
-        break;
-      case 10:
-        PRINT("%-8s %s, %s, %i\n", "slti", reg_str(inst.rt), reg_str(inst.rs), (int16_t) inst.immediate);
-        break;
-      case 11:
-        PRINT("%-8s %s, %s, %i\n", "sltiu", reg_str(inst.rt), reg_str(inst.rs), (int16_t) inst.immediate);
-        break;
-      case 12:
-        PRINT("%-8s %s, %s, 0x%x\n", "andi", reg_str(inst.rt), reg_str(inst.rs), inst.immediate);
-        break;
-      case 13:
-        PRINT("%-8s %s, %s, 0x%x\n", "ori", reg_str(inst.rt), reg_str(inst.rs), inst.immediate);
-        break;
-      case 14:
-        PRINT("%-8s %s, %s, 0x%x\n", "xori", reg_str(inst.rt), reg_str(inst.rs), inst.immediate);
-        break;
-      case 15:
-        if (inst.rs != 0x0) return false;
-        PRINT("%-8s %s, 0x%x\n", "lui", reg_str(inst.rt), inst.immediate);
-        break;
-      case 16:
-        // check if Branch On FPU
-        if (inst.rs == 0x8) {
-          const char* bc = bc_str(inst.rt & 0x3, 0);
-          if (bc != NULL) {
-            int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-            PRINT("%-8s 0x%0x\n", bc, offset);
-            return true;
-          }
-        }
-#ifdef ENABLE_COPZ
-        if ((inst.rs >> 4) == 0x1) {
-          PRINT("%-8s 0x%x\n", "cop0", ((inst.rs & 0xF) << 20) | (inst.rt << 15) | (inst.immediate));
-          return true;
-        }
+size_t mips_find_invalid_scalar(const byte* words, const size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    const byte* at = &words[i * 4];
+    const uint32_t word = at[0] << 24 | at[1] << 16 | at[2] << 8 | at[3];
+    if ((word & filter_masks.mask[filter_index(word)]) != 0) return i;
+  }
+  return count;
+}
+
+#ifdef HAS_X86_SIMD
+// 8 words per iteration, returns where the scalar loop takes over
+TARGET_AVX2 static size_t find_invalid_avx2(const byte* words, const size_t count) {
+  const __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i low6 = _mm256_set1_epi32(0x3F);
+  const __m256i low5 = _mm256_set1_epi32(0x1F);
+  const __m256i special = _mm256_set1_epi32(FILTER_SPECIAL);
+  const __m256i regimm = _mm256_set1_epi32(FILTER_REGIMM);
+  const int* table = (const int*) filter_masks.mask;
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256i raw = _mm256_loadu_si256((const __m256i*) &words[i * 4]);
+    const __m256i word = _mm256_shuffle_epi8(raw, swap);
+    const __m256i opcode = _mm256_srli_epi32(word, 26);
+    const __m256i funct = _mm256_add_epi32(special, _mm256_and_si256(word, low6));
+    const __m256i rt = _mm256_add_epi32(regimm, _mm256_and_si256(_mm256_srli_epi32(word, 16), low5));
+    __m256i index = _mm256_blendv_epi8(opcode, funct, _mm256_cmpeq_epi32(opcode, zero));
+    index = _mm256_blendv_epi8(index, rt, _mm256_cmpeq_epi32(opcode, one));
+    const __m256i mask = _mm256_i32gather_epi32(table, index, 4);
+    const __m256i valid = _mm256_cmpeq_epi32(_mm256_and_si256(word, mask), zero);
+    const int lanes = _mm256_movemask_ps(_mm256_castsi256_ps(valid));
+    if (lanes != 0xFF) return i + __builtin_ctz(~lanes & 0xFF);
+  }
+  return i;
+}
 #endif
-        if ((inst.immediate >> 6) == 0 && inst.rt == 0 && inst.rs == 0x10) {
-          // check last 6 bits first
-          switch (inst.immediate & 0x3F) {
-            case 0x1:  PRINT("%-8s\n", "tlbr");  return true;
-            case 0x2:  PRINT("%-8s\n", "tlbwi"); return true;
-            case 0x6:  PRINT("%-8s\n", "tlbwr"); return true;
-            case 0x8:  PRINT("%-8s\n", "tlbp");  return true;
-            case 0x18: PRINT("%-8s\n", "eret");  return true;
-            default: break;
-          }
-        }
-        // else last 11 must be 0
-        if ((inst.immediate & 0x7FF) != 0) return false;
-        if      (inst.rs == 0) PRINT("%-8s %s, %s\n", "mfc0", reg_str(inst.rt), reg_str(inst.immediate >> 11));
-        else if (inst.rs == 1) PRINT("%-8s %s, %s\n","dmfc0", reg_str(inst.rt), reg_str(inst.immediate >> 11));
-        else if (inst.rs == 4) PRINT("%-8s %s, %s\n", "mtc0", reg_str(inst.rt), reg_str(inst.immediate >> 11));
-        else return false;
-        break;
-      case 17: return handle_fpu(pc, inst);
-      case 18:
-        // check if Branch On FPU
-        if (inst.rs == 0x8) {
-          const char* bc = bc_str(inst.rt & 0x3, 2);
-          if (bc != NULL) {
-            int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-            PRINT("%-8s 0x%0x\n", bc, offset);
-            return true;
-          }
-        }
-#ifdef ENABLE_COPZ
-        if ((inst.rs >> 4) == 0x1) {
-          PRINT("%-8s 0x%x\n", "cop2", ((inst.rs & 0xF) << 20) | (inst.rt << 15) | (inst.immediate));
-          return true;
-        }
+
+size_t mips_find_invalid(const byte* words, const size_t count) {
+  size_t done = 0;
+#ifdef HAS_X86_SIMD
+  if (cpu_has_avx2()) done = find_invalid_avx2(words, count);
 #endif
-        // else last 11 must be 0
-        if ((inst.immediate & 0x7FF) != 0) return false;
-        if      (inst.rs == 0) PRINT("%-8s %s, $f%d\n", "mfc2", reg_str(inst.rt), inst.immediate >> 11);
-        else if (inst.rs == 2) PRINT("%-8s %s, $f%d\n", "cfc2", reg_str(inst.rt), inst.immediate >> 11);
-        else if (inst.rs == 4) PRINT("%-8s %s, $f%d\n", "mtc2", reg_str(inst.rt), inst.immediate >> 11);
-        else if (inst.rs == 6) PRINT("%-8s %s, $%d\n",  "ctc2", reg_str(inst.rt), inst.immediate >> 11);
-        else return false;        
-        break;
-      case 20:
-      {
-        int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-        PRINT("%-8s %s, %s, 0x%08X\n", "beql", reg_str(inst.rs), reg_str(inst.rt), offset);
-        break;
-      }
-      case 21:
-      {
-        int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-        PRINT("%-8s %s, %s, 0x%08X\n", "bnel", reg_str(inst.rs), reg_str(inst.rt), offset);
-        break;
-      }
-      case 22:
-      {
-        int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-        PRINT("%-8s %s, 0x%08X\n", "blezl", reg_str(inst.rs), offset);
-        break;
-      }
-      case 23:
-      {
-        int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-        PRINT("%-8s %s, 0x%08X\n", "bgtzl", reg_str(inst.rs), offset);
-        break;
-      }
-      case 24:
-      {
-        int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-        PRINT("%-8s %s, %s, %i\n", "daddi", reg_str(inst.rt), reg_str(inst.rs), offset);
-        break;
-      }
-      case 25:
-      {
-        int32_t offset = (((int16_t) inst.immediate) << 2) + (pc + 4);
-        PRINT("%-8s %s, %s, %i\n", "daddiu", reg_str(inst.rt), reg_str(inst.rs), offset);
-        break;
-      }
-      case 27:
-        PRINT("%-8s %s, %i(%s)\n", "ldr", reg_str(inst.rt), (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 32:
-        PRINT("%-8s %s, %i(%s)\n", "lb", reg_str(inst.rt), (int16_t) inst.immediate, reg_str(inst.rs));
-        break;
-      case 33:
-        PRINT("%-8s %s, %i(%s)\n", "lh", reg_str(inst.rt), (int16_t) inst.immediate, reg_str(inst.rs));
-        break;
-      case 34:
-        PRINT("%-8s %s, %i(%s)\n", "lwl", reg_str(inst.rt), (int16_t) inst.immediate, reg_str(inst.rs));
-        break;
-      case 35:
-        PRINT("%-8s %s, %i(%s)\n", "lw", reg_str(inst.rt), (int16_t) inst.immediate, reg_str(inst.rs));
-        break;
-      case 36:
-        PRINT("%-8s %s, %i(%s)\n", "lbu", reg_str(inst.rt),(int16_t) inst.immediate, reg_str(inst.rs));
-        break;
-      case 37:
-        PRINT("%-8s %s, %i(%s)\n", "lhu", reg_str(inst.rt), (int16_t) inst.immediate, reg_str(inst.rs));
-        break;
-      case 38:
-        PRINT("%-8s %s, %i(%s)\n", "lwr", reg_str(inst.rt),(int16_t) inst.immediate,reg_str(inst.rs));
-        break;
-      case 39:
-        PRINT("%-8s %s, %i(%s)\n", "lwu", reg_str(inst.rt), (int16_t) inst.immediate,reg_str(inst.rs));
-        break;
-      case 40:
-        PRINT("%-8s %s, %i(%s)\n", "sb", reg_str(inst.rt), (int16_t) inst.immediate, reg_str(inst.rs));
-        break;
-      case 41:
-        PRINT("%-8s %s, %i(%s)\n", "sh", reg_str(inst.rt), (int16_t) inst.immediate, reg_str(inst.rs));
-        break;
-      case 42:
-        PRINT("%-8s %s, %i(%s)\n", "swl", reg_str(inst.rt), (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 43:
-        PRINT("%-8s %s, %i(%s)\n", "sw", reg_str(inst.rt), (int16_t) inst.immediate, reg_str(inst.rs));
-        break;
-      case 44:
-        PRINT("%-8s %s, %i(%s)\n", "sdl", reg_str(inst.rt), (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 45:
-        PRINT("%-8s %s, %i(%s)\n", "sdr", reg_str(inst.rt), (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 46:
-        PRINT("%-8s %s, %i(%s)\n", "swr", reg_str(inst.rt), (int16_t) inst.immediate, reg_str(inst.rs));
-        break;
-      case 47:
-        PRINT("%-8s %i, %i(%s)\n", "cache", inst.rt, (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 48:
-        PRINT("%-8s %s, %i(%s)\n", "ll", reg_str(inst.rt), (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 49:
-        PRINT("%-8s $f%d, %i(%s)\n", "lwc1", inst.rt, (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 50:
-        PRINT("%-8s $f%d, %i(%s)\n", "lwc2", inst.rt, (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 52:
-        PRINT("%-8s %s, %i(%s)\n", "lld", reg_str(inst.rt), (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 53:
-        PRINT("%-8s $f%d, %i(%s)\n", "ldc1", inst.rt, (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 54:
-        PRINT("%-8s $f%d, %i(%s)\n", "ldc2", inst.rt, (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 55:
-        PRINT("%-8s %s, %i(%s)\n", "ld", reg_str(inst.rt), (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 56:
-        PRINT("%-8s %s, %i(%s)\n", "sc", reg_str(inst.rt), (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 57:
-        PRINT("%-8s $f%d, %i(%s)\n", "swc1", inst.rt, (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 58:
-        PRINT("%-8s $f%d, %i(%s)\n", "swc2", inst.rt, (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 60:
-        PRINT("%-8s %s, %i(%s)\n", "scd", reg_str(inst.rt), (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 61:
-        PRINT("%-8s $f%d, %i(%s)\n", "sdc1", inst.rt, (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 62:
-        PRINT("%-8s $f%d, %i(%s)\n", "sdc2", inst.rt, (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      case 63:
-        PRINT("%-8s %s, %i(%s)\n", "sd", reg_str(inst.rt), (int16_t)inst.immediate, reg_str(inst.rs));
-        break;
-      default:
-        PRINT("NOT IMPLEMENTED\n");
-        return false;
+  return done + mips_find_invalid_scalar(&words[done * 4], count - done);
+}
+
+size_t mips_decode_block(const byte* words, const size_t count, const uint32_t pc,
+                         DecodedInstruction* out, const int options) {
+  for (size_t i = 0; i < count; ++i) {
+    const byte* at = &words[i * 4];
+    const uint32_t word = at[0] << 24 | at[1] << 16 | at[2] << 8 | at[3];
+    if (!mips_decode(pc + i * 4, word, &out[i], options)) return i;
   }
-  return true;
+  return count;
 }
 
-bool handle_j(const uint32_t pc, const struct JType inst) {
-  uint32_t target = (uint32_t)inst.target;
-  // shift left twice
-  target = (target & 0xFFFFFF ) << 2;
-  // add the first for bits of PC
-  target = ((pc+4) & 0xF0000000) | target;
+void mips_counters_reset(MipsCounters* counters) {
+  memset(counters, 0, sizeof(MipsCounters));
+}
 
-  PRINT("%-8s 0x%08X\n", inst.opcode == 2 ? "j" : "jal", target);
-  return true;
+void mips_count(MipsCounters* counters, const DecodedInstruction& inst) {
+  if (inst.mnemonic == MN_INVALID) {
+    ++counters->invalid;
+    ++counters->rejects[inst.reject];
+    // MN_INVALID for the other reasons, not exported
+    ++counters->nonzero_fields[inst.candidate];
+    return;
+  }
+  ++counters->decoded;
+  ++counters->mnemonics[inst.mnemonic];
+  if (inst.mnemonic == MN_J) ++counters->jump_count;
+  if (inst.mnemonic == MN_BEQ && inst.rs == 0 && inst.rt == 0) ++counters->incond_branch;
+}
+
+void mips_counters_add(MipsCounters* counters, const MipsCounters& other) {
+  counters->decoded += other.decoded;
+  counters->invalid += other.invalid;
+  counters->jump_count += other.jump_count;
+  counters->incond_branch += other.incond_branch;
+  counters->cache_hits += other.cache_hits;
+  counters->cache_misses += other.cache_misses;
+  for (size_t i = 0; i < MN_COUNT; ++i) {
+    counters->mnemonics[i] += other.mnemonics[i];
+    counters->nonzero_fields[i] += other.nonzero_fields[i];
+  }
+  for (size_t i = 0; i < REJECT_COUNT; ++i) counters->rejects[i] += other.rejects[i];
+}
+
+static const char* const mnemonic_id_str[MN_COUNT] = {
+#define X(id, text, flags) #id,
+  MIPS_MNEMONICS(X)
+#undef X
+};
+
+static const char* const reject_str[REJECT_COUNT] = {
+#define X(id, text) text,
+  MIPS_REJECTS(X)
+#undef X
+};
+
+// "name": count pairs of the non zero counts, names in lower case
+static void write_json_counts(FILE* file, const char* name, const uint64_t* counts,
+                              const char* const* names, const size_t count) {
+  fprintf(file, ",\n  \"%s\": {", name);
+  bool first = true;
+  for (size_t i = 0; i < count; ++i) {
+    if (counts[i] == 0) continue;
+    fprintf(file, "%s\n    \"", first ? "" : ",");
+    for (const char* c = names[i]; *c; ++c) fputc(*c >= 'A' && *c <= 'Z' ? *c - 'A' + 'a' : *c, file);
+    fprintf(file, "\": %llu", (unsigned long long) counts[i]);
+    first = false;
+  }
+  fprintf(file, "%s}", first ? "" : "\n  ");
+}
+
+bool mips_counters_write_json(const MipsCounters& counters, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) return false;
+  fprintf(file, "{\n  \"decoded\": %llu,\n  \"invalid\": %llu,\n",
+          (unsigned long long) counters.decoded, (unsigned long long) counters.invalid);
+  fprintf(file, "  \"jumps\": %i,\n  \"unconditional_branches\": %i,\n", counters.jump_count,
+          counters.incond_branch);
+  fprintf(file, "  \"cache_hits\": %llu,\n  \"cache_misses\": %llu",
+          (unsigned long long) counters.cache_hits, (unsigned long long) counters.cache_misses);
+  write_json_counts(file, "mnemonics", counters.mnemonics, mnemonic_id_str, MN_COUNT);
+  // no reason for the valid words
+  write_json_counts(file, "rejects", counters.rejects + 1, reject_str + 1, REJECT_COUNT - 1);
+  write_json_counts(file, "nonzero_fields", counters.nonzero_fields + 1, mnemonic_id_str + 1,
+                    MN_COUNT - 1);
+  fprintf(file, "\n}\n");
+  return fclose(file) == 0;
+}
+
+static bool handle(MipsContext* ctx, const uint32_t pc, const uint32_t word) {
+  DecodedInstruction inst;
+  const bool ok = mips_decode(pc, word, &inst, ctx->options);
+  mips_count(&ctx->counters, inst);
+  mips_print(ctx, inst);
+  return ok;
+}
+
+// check for inconditional branch
+bool mips_is_b(const struct IType inst) {
+  return inst.opcode == 4 && inst.rs == 0 && inst.rt == 0;
+}
+
+bool mips_is_j(const struct JType inst) {
+  return inst.opcode == 2;
+}
+
+bool handle_r(MipsContext* ctx, const uint32_t pc, const struct RType inst) {
+  uint32_t word;
+  memcpy(&word, &inst, sizeof(word));
+  return handle(ctx, pc, word);
+}
+
+bool handle_i(MipsContext* ctx, const uint32_t pc, const struct IType inst) {
+  uint32_t word;
+  memcpy(&word, &inst, sizeof(word));
+  return handle(ctx, pc, word);
+}
+
+bool handle_j(MipsContext* ctx, const uint32_t pc, const struct JType inst) {
+  uint32_t word;
+  memcpy(&word, &inst, sizeof(word));
+  return handle(ctx, pc, word);
 }
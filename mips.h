@@ -1,7 +1,11 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include "defs.h"
+#include "sink.h"
+
 /*
   Almost complete MIPS binary parser for the VR4300 CPU.
   This produces ASM code in text format.
@@ -55,12 +59,395 @@ typedef union Instruction {
   struct JType j;
 } Instruction;
 
-void mips_set_file(const char* name);
-void mips_close_file();
+// Instruction properties, MIPS_DELAY_SLOT is set for every branch and jump.
+static const uint8_t MIPS_BRANCH     = 1 << 0;
+static const uint8_t MIPS_JUMP       = 1 << 1;
+static const uint8_t MIPS_LINK       = 1 << 2;
+static const uint8_t MIPS_LIKELY     = 1 << 3;
+static const uint8_t MIPS_DELAY_SLOT = 1 << 4;
+
+// Mnemonic id, text and flags.
+// Aliases the assembler would use (NOP, move, bnez) have their own id.
+#define MIPS_MNEMONICS(X) \
+  X(INVALID,  "",         0) \
+  X(NOP,      "NOP",      0) \
+  X(SLL,      "sll",      0) \
+  X(SRL,      "srl",      0) \
+  X(SRA,      "sra",      0) \
+  X(SLLV,     "sllv",     0) \
+  X(SRLV,     "srlv",     0) \
+  X(SRAV,     "srav",     0) \
+  X(JR,       "jr",       MIPS_JUMP) \
+  X(JALR,     "jalr",     MIPS_JUMP | MIPS_LINK) \
+  X(SYSCALL,  "syscall",  0) \
+  X(BREAK,    "break",    0) \
+  X(MFHI,     "mfhi",     0) \
+  X(MTHI,     "mthi",     0) \
+  X(MFLO,     "mflo",     0) \
+  X(MTLO,     "mtlo",     0) \
+  X(DSLLV,    "dsllv",    0) \
+  X(DSRLV,    "dsrlv",    0) \
+  X(DSRAV,    "dsrav",    0) \
+  X(MULT,     "mult",     0) \
+  X(MULTU,    "multu",    0) \
+  X(DIV,      "div",      0) \
+  X(DIVU,     "divu",     0) \
+  X(DMULT,    "dmult",    0) \
+  X(DMULTU,   "dmultu",   0) \
+  X(DDIV,     "ddiv",     0) \
+  X(DDIVU,    "ddivu",    0) \
+  X(ADD,      "add",      0) \
+  X(ADDU,     "addu",     0) \
+  X(MOVE,     "move",     0) \
+  X(SUB,      "sub",      0) \
+  X(SUBU,     "subu",     0) \
+  X(AND,      "and",      0) \
+  X(OR,       "or",       0) \
+  X(XOR,      "xor",      0) \
+  X(NOR,      "nor",      0) \
+  X(SLT,      "slt",      0) \
+  X(SLTU,     "sltu",     0) \
+  X(DADD,     "dadd",     0) \
+  X(DADDU,    "daddu",    0) \
+  X(DSUB,     "dsub",     0) \
+  X(DSUBU,    "dsubu",    0) \
+  X(TGE,      "tge",      0) \
+  X(TGEU,     "tgeu",     0) \
+  X(TLT,      "tlt",      0) \
+  X(TLTU,     "tltu",     0) \
+  X(TEQ,      "teq",      0) \
+  X(TNE,      "tne",      0) \
+  X(DSLL,     "dsll",     0) \
+  X(DSRL,     "dsrl",     0) \
+  X(DSRA,     "dsra",     0) \
+  X(DSLL32,   "dsll32",   0) \
+  X(DSRL32,   "dsrl32",   0) \
+  X(DSRA32,   "dsra32",   0) \
+  X(BLTZ,     "bltz",     MIPS_BRANCH) \
+  X(BGEZ,     "begz",     MIPS_BRANCH) \
+  X(BLTZL,    "bltzl",    MIPS_BRANCH | MIPS_LIKELY) \
+  X(BGEZL,    "bgezl",    MIPS_BRANCH | MIPS_LIKELY) \
+  X(TGEI,     "tgei",     0) \
+  X(TGEIU,    "tgeiu",    0) \
+  X(TLTI,     "tlti",     0) \
+  X(TLTIU,    "tltiu",    0) \
+  X(TEQI,     "teqi",     0) \
+  X(TNEI,     "tnei",     0) \
+  X(BLTZAL,   "bltzal",   MIPS_BRANCH | MIPS_LINK) \
+  X(BGEZAL,   "bgezal",   MIPS_BRANCH | MIPS_LINK) \
+  X(BLTZALL,  "bltzall",  MIPS_BRANCH | MIPS_LINK | MIPS_LIKELY) \
+  X(BGEZALL,  "bgezall",  MIPS_BRANCH | MIPS_LINK | MIPS_LIKELY) \
+  X(J,        "j",        MIPS_JUMP) \
+  X(JAL,      "jal",      MIPS_JUMP | MIPS_LINK) \
+  X(BEQ,      "beq",      MIPS_BRANCH) \
+  X(BNE,      "bne",      MIPS_BRANCH) \
+  X(BNEZ,     "bnez",     MIPS_BRANCH) \
+  X(BLEZ,     "blez",     MIPS_BRANCH) \
+  X(BGTZ,     "bgtz",     MIPS_BRANCH) \
+  X(ADDI,     "addi",     0) \
+  X(ADDIU,    "addiu",    0) \
+  X(SLTI,     "slti",     0) \
+  X(SLTIU,    "sltiu",    0) \
+  X(ANDI,     "andi",     0) \
+  X(ORI,      "ori",      0) \
+  X(XORI,     "xori",     0) \
+  X(LUI,      "lui",      0) \
+  X(BEQL,     "beql",     MIPS_BRANCH | MIPS_LIKELY) \
+  X(BNEL,     "bnel",     MIPS_BRANCH | MIPS_LIKELY) \
+  X(BLEZL,    "blezl",    MIPS_BRANCH | MIPS_LIKELY) \
+  X(BGTZL,    "bgtzl",    MIPS_BRANCH | MIPS_LIKELY) \
+  X(DADDI,    "daddi",    0) \
+  X(DADDIU,   "daddiu",   0) \
+  X(LDR,      "ldr",      0) \
+  X(LB,       "lb",       0) \
+  X(LH,       "lh",       0) \
+  X(LWL,      "lwl",      0) \
+  X(LW,       "lw",       0) \
+  X(LBU,      "lbu",      0) \
+  X(LHU,      "lhu",      0) \
+  X(LWR,      "lwr",      0) \
+  X(LWU,      "lwu",      0) \
+  X(SB,       "sb",       0) \
+  X(SH,       "sh",       0) \
+  X(SWL,      "swl",      0) \
+  X(SW,       "sw",       0) \
+  X(SDL,      "sdl",      0) \
+  X(SDR,      "sdr",      0) \
+  X(SWR,      "swr",      0) \
+  X(CACHE,    "cache",    0) \
+  X(LL,       "ll",       0) \
+  X(LWC1,     "lwc1",     0) \
+  X(LWC2,     "lwc2",     0) \
+  X(LLD,      "lld",      0) \
+  X(LDC1,     "ldc1",     0) \
+  X(LDC2,     "ldc2",     0) \
+  X(LD,       "ld",       0) \
+  X(SC,       "sc",       0) \
+  X(SWC1,     "swc1",     0) \
+  X(SWC2,     "swc2",     0) \
+  X(SCD,      "scd",      0) \
+  X(SDC1,     "sdc1",     0) \
+  X(SDC2,     "sdc2",     0) \
+  X(SD,       "sd",       0) \
+  X(BC0F,     "bc0f",     MIPS_BRANCH) \
+  X(BC0T,     "bc0t",     MIPS_BRANCH) \
+  X(BC0FL,    "bc0fl",    MIPS_BRANCH | MIPS_LIKELY) \
+  X(BC0TL,    "bc0tl",    MIPS_BRANCH | MIPS_LIKELY) \
+  X(COP0,     "cop0",     0) \
+  X(TLBR,     "tlbr",     0) \
+  X(TLBWI,    "tlbwi",    0) \
+  X(TLBWR,    "tlbwr",    0) \
+  X(TLBP,     "tlbp",     0) \
+  X(ERET,     "eret",     0) \
+  X(MFC0,     "mfc0",     0) \
+  X(DMFC0,    "dmfc0",    0) \
+  X(MTC0,     "mtc0",     0) \
+  X(BC1F,     "bc1f",     MIPS_BRANCH) \
+  X(BC1T,     "bc1t",     MIPS_BRANCH) \
+  X(BC1FL,    "bc1fl",    MIPS_BRANCH | MIPS_LIKELY) \
+  X(BC1TL,    "bc1tl",    MIPS_BRANCH | MIPS_LIKELY) \
+  X(COP1,     "cop1",     0) \
+  X(ADD_FMT,  "add.",     0) \
+  X(SUB_FMT,  "sub.",     0) \
+  X(MUL_FMT,  "mul.",     0) \
+  X(DIV_FMT,  "div.",     0) \
+  X(SQRT_FMT, "sqrt.",    0) \
+  X(MOV_FMT,  "mov.",     0) \
+  X(NEG_FMT,  "neg.",     0) \
+  X(ROUND_L,  "round.l.", 0) \
+  X(TRUNC_L,  "trunc.l.", 0) \
+  X(CEIL_L,   "ceil.l.",  0) \
+  X(FLOOR_L,  "floor.l.", 0) \
+  X(ROUND_W,  "round.w.", 0) \
+  X(TRUNC_W,  "trunc.w.", 0) \
+  X(CEIL_W,   "ceil.w.",  0) \
+  X(FLOOR_W,  "floor.w.", 0) \
+  X(CVT_S,    "cvt.s.",   0) \
+  X(CVT_D,    "cvt.d.",   0) \
+  X(CVT_W,    "cvt.w.",   0) \
+  X(CVT_L,    "cvt.l.",   0) \
+  X(C_COND,   "c.",       0) \
+  X(MFC1,     "mfc1",     0) \
+  X(CFC1,     "cfc1",     0) \
+  X(MTC1,     "mtc1",     0) \
+  X(CTC1,     "ctc1",     0) \
+  X(BC2F,     "bc2f",     MIPS_BRANCH) \
+  X(BC2T,     "bc2t",     MIPS_BRANCH) \
+  X(BC2FL,    "bc2fl",    MIPS_BRANCH | MIPS_LIKELY) \
+  X(BC2TL,    "bc2tl",    MIPS_BRANCH | MIPS_LIKELY) \
+  X(COP2,     "cop2",     0) \
+  X(MFC2,     "mfc2",     0) \
+  X(CFC2,     "cfc2",     0) \
+  X(MTC2,     "mtc2",     0) \
+  X(CTC2,     "ctc2",     0)
+
+enum Mnemonic {
+#define X(id, text, flags) MN_##id,
+  MIPS_MNEMONICS(X)
+#undef X
+  MN_COUNT
+};
+
+// How the operands are printed.
+enum Format {
+  FMT_INVALID,     // rejected
+  FMT_RESERVED,    // rejected, reported as NOT IMPLEMENTED
+  FMT_COP0,        // coprocessor sub opcodes, only seen inside the decoder
+  FMT_COP1,
+  FMT_COP2,
+  FMT_NONE,        // mnemonic only
+  FMT_SYSCALL,
+  FMT_BREAK,       // code
+  FMT_SHIFT,       // rd, rt, sa
+  FMT_SHIFT_HEX,   // rd, rt, 0xsa
+  FMT_SHIFTV,      // rd, rt, rs
+  FMT_RS,
+  FMT_RD,
+  FMT_RS_RT,
+  FMT_RD_RS,
+  FMT_RD_RS_RT,
+  FMT_BRANCH_RS,   // rs, target
+  FMT_BRANCH_RS_RT, // rs, rt, target
+  FMT_RT_RS_SIMM,  // rt, rs, signed immediate
+  FMT_RT_RS_UIMM,  // rt, rs, 0ximmediate
+  FMT_RT_RS_PCREL, // rt, rs, immediate shifted and added to the PC like a branch
+  FMT_LUI,         // rt, 0ximmediate
+  FMT_MEM,         // rt, offset(rs)
+  FMT_FMEM,        // $frt, offset(rs)
+  FMT_CACHE,       // op, offset(rs)
+  FMT_JUMP,        // target
+  FMT_COP_BRANCH,  // target
+  FMT_COPZ,        // 0xcofun
+  FMT_MOVE_COP0,   // rt, rd (printed as a GPR)
+  FMT_MOVE_COP,    // rt, $frd
+  FMT_MOVE_CTRL,   // rt, $rd
+  FMT_FPU3,        // fd, fs, ft
+  FMT_FPU2,        // fd, fs
+  FMT_FPU_SQRT,    // fd, fs
+  FMT_FPU_CVT,     // fd, fs
+  FMT_FPU_CMP      // fs, ft
+};
+
+// Why a word was rejected, id and text.
+#define MIPS_REJECTS(X) \
+  X(NONE,          "none") \
+  X(OPCODE,        "reserved opcode") \
+  X(SPECIAL_FUNCT, "reserved special funct") \
+  X(REGIMM_RT,     "invalid regimm rt") \
+  X(NONZERO_RS,    "nonzero rs") \
+  X(NONZERO_RT,    "nonzero rt") \
+  X(NONZERO_RD,    "nonzero rd") \
+  X(NONZERO_SA,    "nonzero sa") \
+  X(COP_LOW_BITS,  "nonzero cop low bits") \
+  X(COP_RS,        "invalid cop rs") \
+  X(COPZ,          "unimplemented copz")
+
+enum Reject {
+#define X(id, text) REJECT_##id,
+  MIPS_REJECTS(X)
+#undef X
+  REJECT_COUNT
+};
+
+/*
+  Result of decoding one word, without any formatting.
+  Invalid words have mnemonic MN_INVALID and format FMT_INVALID or
+  FMT_RESERVED, the fields are still filled.
+*/
+struct DecodedInstruction {
+  uint32_t pc;
+  uint32_t word;
+  // destination of PC relative branches and j/jal, 0 otherwise
+  uint32_t target;
+  // sign extended, zero extended for the logical immediates and lui
+  int32_t imm;
+  uint8_t mnemonic;
+  uint8_t format;
+  uint8_t flags;
+  uint8_t rs, rt, rd, sa;
+  // REJECT_NONE for valid words, and for nonzero fields the mnemonic
+  // the word would have had
+  uint8_t reject;
+  uint8_t candidate;
+};
+
+// MipsContext options
+// print the instructions to the context file
+static const int MIPS_PRINT = 0x1;
+// decode the COPz coprocessor operations
+static const int MIPS_COPZ = 0x2;
+
+struct MipsCounters {
+  uint64_t decoded;
+  uint64_t invalid;
+  int jump_count;
+  int incond_branch;
+  // lines printed from the text cache or formatted,
+  // the PC relative ones are always formatted
+  uint64_t cache_hits;
+  uint64_t cache_misses;
+  // valid words by mnemonic, rejected ones by reason,
+  // and the ones rejected for a nonzero field by candidate
+  uint64_t mnemonics[MN_COUNT];
+  uint64_t rejects[REJECT_COUNT];
+  uint64_t nonzero_fields[MN_COUNT];
+};
+
+void mips_counters_reset(MipsCounters* counters);
+// Add the instruction to the counters
+void mips_count(MipsCounters* counters, const DecodedInstruction& inst);
+void mips_counters_add(MipsCounters* counters, const MipsCounters& other);
+// The counters as a JSON object, false if the file can't be written
+bool mips_counters_write_json(const MipsCounters& counters, const char* path);
+
+// Longest line mips_format() can produce, with the address and newline
+static const size_t MIPS_MAX_LINE = 96;
+
+/*
+  Text of the last instructions printed, without the address, for the
+  words that print the same at any PC. Direct mapped on the word: ROM
+  code repeats a few hundred encodings (nop, jr $ra, stack moves) for
+  most of its words.
+*/
+static const uint32_t MIPS_CACHE_BITS = 10;
+// "0x%08X " before the cached text
+static const size_t MIPS_ADDRESS_SIZE = 11;
+// one cache line per text, the longer lines are not kept
+static const size_t MIPS_CACHE_TEXT = 64;
+
+struct MipsCache {
+  // apart from the text so a miss only reads these
+  uint32_t words[1 << MIPS_CACHE_BITS];
+  // 0 while the word was seen once, its text is kept the second time
+  uint8_t sizes[1 << MIPS_CACHE_BITS];
+  char text[1 << MIPS_CACHE_BITS][MIPS_CACHE_TEXT];
+};
+
+/*
+  Everything one disassembly needs: options, output and counters.
+  Several contexts can be used at once, one per ROM or per thread.
+  The sink buffer is inline, keep contexts off small stacks.
+*/
+struct MipsContext {
+  int options;
+  Sink sink;
+  // filled by handle_r/i/j and disasm_linear()
+  MipsCounters counters;
+  // NULL unless mips_context_enable_cache() was called
+  MipsCache* cache;
+};
+
+// Default options, no file (prints to stdout), counters at 0
+void mips_context_init(MipsContext* ctx);
+// Output to name.asm, stdout if it can't be created
+bool mips_context_open(MipsContext* ctx, const char* name);
+// Also frees the cache
+void mips_context_close(MipsContext* ctx);
+// Reuse the text of repeated words, false if the cache can't be allocated
+bool mips_context_enable_cache(MipsContext* ctx);
+
+bool mips_decode(const uint32_t pc, const uint32_t word, DecodedInstruction* out,
+                 const int options = 0);
+// Decode count big endian words starting at pc into out.
+// Returns the number of valid instructions before the first invalid one,
+// which is also decoded in out when the return is lower than count.
+size_t mips_decode_block(const byte* words, const size_t count, const uint32_t pc,
+                         DecodedInstruction* out, const int options = 0);
+// Index of the first of the count big endian words that is certainly
+// invalid, from its opcode and must be zero bits, count if none is.
+// The words before it can still be invalid, only mips_decode() tells.
+size_t mips_find_invalid(const byte* words, const size_t count);
+size_t mips_find_invalid_scalar(const byte* words, const size_t count);
+// Index of the opcode table entry of a word, as the pre-filter sees it:
+// opcode, 64 + funct for SPECIAL, 128 + rt for REGIMM
+static const uint32_t MIPS_OP_INDEXES = 160;
+inline uint32_t mips_op_index(const uint32_t word) {
+  // without branches, the opcodes of data words are random
+  const uint32_t opcode = word >> 26;
+  const uint32_t special = opcode == 0;
+  const uint32_t regimm = opcode == 1;
+  return opcode + special * (64 + (word & 0x3F)) + regimm * (127 + ((word >> 16) & 0x1F));
+}
+// Mnemonic, format and must be zero bits of that entry, false for the
+// coprocessors which go through their own tables
+bool mips_op_entry(const uint32_t index, uint8_t* mnemonic, uint8_t* format, uint32_t* zero_mask);
+// Write the text line of the instruction to out, which has room for
+// MIPS_MAX_LINE bytes. Returns its size, 0 for invalid instructions
+// which have no text.
+size_t mips_format(const DecodedInstruction& inst, char* out);
+// Same through the cache when not NULL, the hits and misses go to counters
+size_t mips_format_cached(const DecodedInstruction& inst, MipsCache* cache,
+                          MipsCounters* counters, char* out);
+// Print the instruction to the context file, as handle_r/i/j would
+void mips_print(MipsContext* ctx, const DecodedInstruction& inst);
+// Same with the address the instruction refers to in a comment
+void mips_print_address(MipsContext* ctx, const DecodedInstruction& inst, const uint32_t address);
+// Append text already formatted with mips_format() to the context file
+void mips_write(MipsContext* ctx, const char* text, const size_t size);
 
 bool mips_is_j(const struct JType inst);
 bool mips_is_b(const struct IType inst);
 
-bool handle_r(const uint32_t pc, const struct RType inst);
-bool handle_i(const uint32_t pc, const struct IType inst);
-bool handle_j(const uint32_t pc, const struct JType inst);
+bool handle_r(MipsContext* ctx, const uint32_t pc, const struct RType inst);
+bool handle_i(MipsContext* ctx, const uint32_t pc, const struct IType inst);
+bool handle_j(MipsContext* ctx, const uint32_t pc, const struct JType inst);
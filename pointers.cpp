@@ -0,0 +1,163 @@
+#include "pointers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "text.h"
+
+static const uint32_t KSEG0 = 0x80000000;
+static const uint32_t KSEG0_SIZE = 0x20000000;
+
+static bool is_start(const byte* starts, const uint32_t offset) {
+  return starts[offset / 8] >> (offset % 8) & 1;
+}
+
+static bool append_string(PointerTables* tables, const uint32_t string) {
+  if (tables->string_count == tables->string_capacity) {
+    const size_t capacity = tables->string_capacity ? tables->string_capacity * 2 : 256;
+    uint32_t* strings = (uint32_t*) realloc(tables->strings, capacity * sizeof(uint32_t));
+    if (strings == NULL) return false;
+    tables->strings = strings;
+    tables->string_capacity = capacity;
+  }
+  tables->strings[tables->string_count++] = string;
+  return true;
+}
+
+static bool append_table(PointerTables* tables, const PointerTable& table) {
+  if (tables->size == tables->capacity) {
+    const size_t capacity = tables->capacity ? tables->capacity * 2 : 64;
+    PointerTable* items = (PointerTable*) realloc(tables->items, capacity * sizeof(PointerTable));
+    if (items == NULL) return false;
+    tables->items = items;
+    tables->capacity = capacity;
+  }
+  tables->items[tables->size++] = table;
+  return true;
+}
+
+// Keep the tables made of the pointers of the candidates that land on
+// a run start. The candidates are read in order and the strings are
+// moved down in place, the tables go to a new array since a candidate
+// can be split in several.
+static bool split_tables(PointerTables* tables, const byte* starts) {
+  PointerTable* candidates = tables->items;
+  const size_t candidate_count = tables->size;
+  tables->items = NULL;
+  tables->size = 0;
+  tables->capacity = 0;
+
+  bool ok = true;
+  size_t count = 0;
+  for (size_t i = 0; ok && i < candidate_count; ++i) {
+    const PointerTable& candidate = candidates[i];
+    PointerTable table = {0, 0, 0, candidate.kind};
+    for (uint32_t entry = 0; ok && entry <= candidate.count; ++entry) {
+      const bool end = entry == candidate.count;
+      const uint32_t string = end ? 0 : tables->strings[candidate.first + entry];
+      if (!end && is_start(starts, string)) {
+        if (table.count == 0) {
+          table.offset = candidate.offset + 4 * entry;
+          table.first = count;
+        }
+        tables->strings[count++] = string;
+        ++table.count;
+        continue;
+      }
+      // too short to be a table, forget its strings
+      if (table.count < POINTER_TABLE_MIN) {
+        count -= table.count;
+      } else {
+        ok = append_table(tables, table);
+      }
+      table.count = 0;
+    }
+  }
+  tables->string_count = count;
+  free(candidates);
+  return ok;
+}
+
+bool pointer_tables_build(PointerTables* tables, const byte* data, const uint32_t from,
+                          const uint32_t to, const uint32_t vram_start, const uint32_t rom_start) {
+  memset(tables, 0, sizeof(PointerTables));
+  // the runs of text as a bitmap of their first byte
+  byte* starts = (byte*) calloc(to / 8 + 1, 1);
+  if (starts == NULL) return false;
+
+  bool ok = true;
+  TextRun run;
+  bool more = text_find_run(data, from, to, &run);
+  // the candidate being read, its strings are already appended
+  PointerTable table = {0, 0, 0, POINTER_ROM};
+  uint32_t last = 0;
+  for (uint32_t at = (from + 3) & ~3u; ok && at + 4 <= to; at += 4) {
+    // the text scan stays ahead of the words
+    while (more && run.start < at + 4) {
+      starts[run.start / 8] |= 1 << (run.start % 8);
+      more = text_find_run(data, run.start + run.size, to, &run);
+    }
+
+    const uint32_t word = data[at] << 24 | data[at + 1] << 16 | data[at + 2] << 8 | data[at + 3];
+    uint8_t kind = POINTER_ROM;
+    uint32_t target = word;
+    if (word - KSEG0 < KSEG0_SIZE) {
+      kind = POINTER_VRAM;
+      target = word - vram_start + rom_start;
+    }
+    const bool inside = target >= from && target < to;
+
+    if (table.count > 0 && (!inside || kind != table.kind || target < last)) {
+      if (table.count < POINTER_TABLE_MIN) {
+        tables->string_count = table.first;
+      } else {
+        ok = append_table(tables, table);
+      }
+      table.count = 0;
+    }
+    if (!ok || !inside) continue;
+    if (table.count == 0) {
+      table.offset = at;
+      table.first = tables->string_count;
+      table.kind = kind;
+    }
+    ok = append_string(tables, target);
+    ++table.count;
+    last = target;
+  }
+  if (ok && table.count >= POINTER_TABLE_MIN) {
+    ok = append_table(tables, table);
+  } else if (table.count > 0) {
+    tables->string_count = table.first;
+  }
+  for (; more; more = text_find_run(data, run.start + run.size, to, &run)) {
+    starts[run.start / 8] |= 1 << (run.start % 8);
+  }
+
+  ok = ok && split_tables(tables, starts);
+  free(starts);
+  if (!ok) pointer_tables_free(tables);
+  return ok;
+}
+
+void pointer_tables_free(PointerTables* tables) {
+  free(tables->items);
+  free(tables->strings);
+  memset(tables, 0, sizeof(PointerTables));
+}
+
+bool pointer_tables_write(const PointerTables& tables, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) return false;
+  for (size_t i = 0; i < tables.size; ++i) {
+    const PointerTable& table = tables.items[i];
+    fprintf(file, "0x%08X %u %s\n", table.offset, table.count,
+            table.kind == POINTER_VRAM ? "vram" : "rom");
+    for (uint32_t entry = 0; entry < table.count; ++entry) {
+      fprintf(file, "  %u 0x%08X\n", entry, tables.strings[table.first + entry]);
+    }
+  }
+  const bool written = ferror(file) == 0;
+  return fclose(file) == 0 && written;
+}
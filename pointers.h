@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defs.h"
+
+/*
+  Pointer tables to the text, found in one pass over the data after
+  the code.
+
+  The strings of a text bank are reached through arrays of big endian
+  pointers, ROM offsets or KSEG0 addresses of the code segment. A table
+  is a sequence of at least POINTER_TABLE_MIN words of the same kind,
+  increasing (the same string can be listed twice in a row), each one
+  landing on the start of a run found by text_find_run().
+  The text scan and the words go through the data together. A pointer
+  can land on text the scan hasn't reached yet, so the sequences of
+  words pointing inside the data are kept as candidates, then split on
+  the ones that miss a run start once the runs are all marked.
+  The index drives dump_text(), the strings are written in table order.
+*/
+
+static const uint32_t POINTER_TABLE_MIN = 3;
+
+// Pointer kinds
+static const uint8_t POINTER_ROM = 0;
+static const uint8_t POINTER_VRAM = 1;
+
+struct PointerTable {
+  // ROM offset of the first pointer
+  uint32_t offset;
+  // the strings of the table are strings[first, first + count)
+  uint32_t first;
+  uint32_t count;
+  uint8_t kind;
+};
+
+struct PointerTables {
+  PointerTable* items;
+  size_t size;
+  size_t capacity;
+  // ROM offsets of the strings, table after table
+  uint32_t* strings;
+  size_t string_count;
+  size_t string_capacity;
+};
+
+// Tables in data[from, to), a KSEG0 address vram is at the ROM offset
+// vram - vram_start + rom_start
+bool pointer_tables_build(PointerTables* tables, const byte* data, const uint32_t from,
+                          const uint32_t to, const uint32_t vram_start, const uint32_t rom_start);
+void pointer_tables_free(PointerTables* tables);
+// A "0xTABLE count rom|vram" line per table, then a "  index 0xSTRING"
+// line per pointer
+bool pointer_tables_write(const PointerTables& tables, const char* path);
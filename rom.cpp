@@ -17,10 +17,24 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__linux__)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+# define HAS_MMAP
+#endif
+
+#include "byteswap.h"
+#include "classify.h"
 #include "crc_check.h"
+#include "disasm.h"
 #include "log.h"
 #include "mips.h"
+#include "pointers.h"
 #include "shift_js.h"
+#include "text.h"
+#include "xref.h"
 
 // Biggest possible N64 ROM is 512 megabits
 static const long MAX_ROM_SIZE = 0x3D09000;
@@ -68,13 +82,34 @@ static const char* country_string(const byte b) {
 }
 
 void Rom::unload() {
+#ifdef HAS_MMAP
+  if (mapped) munmap(data, data_size);
+  else free(data);
+#else
   free(data);
+#endif
   free(rom_name);
+  free(checksum);
+  data = NULL;
+  rom_name = NULL;
+  checksum = NULL;
 }
 
-bool Rom::load(const char* path) {
+bool Rom::check_size() const {
+  if (data_size == -1L) return false;
+  if (data_size < MIN_ROM_SIZE) {
+    LOG_ERROR("File is too small for a N64 ROM:%lu bytes\n", data_size);
+    return false;
+  }
+  if (data_size > MAX_ROM_SIZE) {
+    LOG_ERROR("File is too big for a N64 ROM:%lu bytes\n", data_size);
+    return false;
+  }
+  return true;
+}
+
+bool Rom::read_file(const char* path) {
   bool ok = false;
-  rom_name = NULL;
 
   // open the file
   FILE* file = fopen(path, "rb");
@@ -88,56 +123,116 @@ bool Rom::load(const char* path) {
 
   data_size = ftell(file);
   LOG_TRACE("ROM size is: %liMBs\n", data_size / 1024 / 1024);
-
-  if (data_size == -1L) goto close_file;
-  if (data_size < MIN_ROM_SIZE) {
-    LOG_ERROR("File is too small for a N64 ROM:%lu bytes\n", data_size);
-    goto close_file;
-  }
-  if (data_size > MAX_ROM_SIZE) {
-    LOG_ERROR("File is too big for a N64 ROM:%lu bytes\n", data_size);
-    goto close_file;
-  }
+  if (!check_size()) goto close_file;
 
   // load the ROM in memory
   if (fseek(file, 0L, SEEK_SET) != 0) goto close_file;
   data = (byte*) malloc(data_size);
   if (data == NULL) goto close_file;
-  if (fread(data, sizeof(byte), data_size, file) != (size_t) data_size) goto unload;
-
-  // sanity check
-  if (!check_format()) goto unload;
-  if (!parse_header()) goto unload;
-  if (!verify_header()) goto unload;
-  if (!find_binary()) goto unload;
+  if (fread(data, sizeof(byte), data_size, file) != (size_t) data_size) {
+    free(data);
+    data = NULL;
+    goto close_file;
+  }
 
   ok = true;
-  goto close_file;
-
-unload:
-  free(data);
-  free(rom_name);
 
 close_file:
   fclose(file);
   return ok;
 }
 
+#ifdef HAS_MMAP
+bool Rom::map_file(const char* path, const int flags) {
+  bool ok = false;
+
+  const int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+      LOG_ERROR("Can't open file:%s\n", path);
+      return ok;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) goto close_file;
+
+  data_size = st.st_size;
+  LOG_TRACE("ROM size is: %liMBs\n", data_size / 1024 / 1024);
+  if (!check_size()) goto close_file;
+
+  {
+    // Private mapping: reads share the page cache, a write through
+    // operator[] only copies the touched page and never reaches the file.
+    int map_flags = MAP_PRIVATE;
+# ifdef MAP_POPULATE
+    if (flags & ROM_LOAD_POPULATE) map_flags |= MAP_POPULATE;
+# endif
+    void* view = mmap(NULL, data_size, PROT_READ | PROT_WRITE, map_flags, fd, 0);
+    if (view == MAP_FAILED) {
+      LOG_ERROR("Can't map file:%s\n", path);
+      goto close_file;
+    }
+    data = (byte*) view;
+    mapped = true;
+  }
+
+  // The header, bootcode and checksummed area are needed right away,
+  // everything after is swept front to back at most once.
+  madvise(data, data_size, MADV_SEQUENTIAL);
+  madvise(data, CHECKSUM_START + CHECKSUM_LENGTH, MADV_WILLNEED);
+
+  ok = true;
+
+close_file:
+  close(fd);
+  return ok;
+}
+#endif
+
+bool Rom::load(const char* path, const int flags) {
+  rom_name = NULL;
+  data = NULL;
+  mapped = false;
+  checksum = NULL;
+
+#ifdef HAS_MMAP
+  const bool loaded = (flags & (ROM_LOAD_MMAP | ROM_LOAD_POPULATE))
+                    ? map_file(path, flags)
+                    : read_file(path);
+#else
+  if (flags & (ROM_LOAD_MMAP | ROM_LOAD_POPULATE)) LOG_INFO("No mmap on this platform, reading the ROM instead.\n");
+  const bool loaded = read_file(path);
+#endif
+  if (!loaded) return false;
+
+  // sanity check
+  if (!check_format() || !parse_header() || !verify_header() || !find_binary(flags)) {
+    unload();
+    return false;
+  }
+
+  return true;
+}
+
 static const uint32_t Z64_MAGIC = 0x80371240;
 static const uint32_t N64_MAGIC = 0x40123780;
 static const uint32_t V64_MAGIC = 0x37804012;
 
-bool Rom::check_format() const {
+bool Rom::check_format() {
   uint32_t endianness;
   read((byte*)&endianness, 0x00, 4);
   const uint32_t magic_number = be32toh(endianness);
   switch (magic_number) {
       case Z64_MAGIC: return true;
-      case N64_MAGIC: // fallthrough
-      case V64_MAGIC: // fallthrough
+      case N64_MAGIC:
+        LOG_TRACE("Converting N64 format to Z64.\n");
+        swap32(data, data_size);
+        return true;
+      case V64_MAGIC:
+        LOG_TRACE("Converting V64 format to Z64.\n");
+        swap16(data, data_size);
+        return true;
       default:
-        // TODO byteswap the other formats
-        LOG_ERROR("Only Z64 format is supported.\n");
+        LOG_ERROR("Unknown ROM format:%08x\n", magic_number);
         return false;
   }
 }
@@ -197,6 +292,44 @@ bool Rom::verify_header() {
   return true;
 }
 
+bool Rom::patch(const uint32_t offset, const byte* bytes, const uint32_t size) {
+  if ((long) offset + size > data_size) {
+    LOG_ERROR("Patch out of the ROM:0x%x+0x%x\n", offset, size);
+    return false;
+  }
+  memcpy(&data[offset], bytes, size);
+
+  const bool in_bootcode = offset < CHECKSUM_START && offset + size > HEADER_SIZE;
+  if (checksum == NULL || in_bootcode) {
+    // first patch, or the bootcode changed and with it possibly the CIC
+    if (checksum == NULL) {
+      checksum = (CicCheckpoints*) malloc(sizeof(CicCheckpoints));
+      if (checksum == NULL) return false;
+    }
+    bootcode = identify_bootcode(data);
+    if (!cic_checkpoints_build(checksum, data, bootcode)) {
+      LOG_ERROR("Error calculating the cart CRC!\n");
+      return false;
+    }
+  } else {
+    cic_checkpoints_update(checksum, data, offset, offset + size);
+  }
+
+  write_crc();
+  return true;
+}
+
+void Rom::write_crc() {
+  uint32_t crc[2];
+  cic_checkpoints_crc(*checksum, crc);
+  crc1 = crc[0];
+  crc2 = crc[1];
+  for (int i = 0; i < 4; ++i) {
+    data[0x10 + i] = crc1 >> (24 - 8 * i);
+    data[0x14 + i] = crc2 >> (24 - 8 * i);
+  }
+}
+
 void Rom::read(byte* target, const uint32_t from, const uint32_t size) const {
   memcpy(target, &data[from], size);
 }
@@ -228,58 +361,181 @@ uint32_t Rom::entry_point() const {
   }
 }
 
-void reverse_copy(byte* to, const byte* from, const size_t n) {
-  for (size_t i = 0; i < n; ++i) to[n-1-i] = from[i];
+// "name.ext" in file_name, which holds 128 bytes
+static bool output_name(char* file_name, const char* name, const char* ext) {
+  return snprintf(file_name, 128, "%s.%s", name, ext) > 0;
+}
+
+bool Rom::find_code(MipsContext* ctx, const uint32_t entry, const int flags, uint32_t* asm_end) {
+  bool ok = false;
+  char file_name[128];
+  const bool functions_needed = flags & (ROM_LOAD_SYMBOLS | ROM_LOAD_CALLGRAPH | ROM_LOAD_ADDRESSES);
+  CodeMap map = {0, 0, 0, NULL, 0};
+  XrefEdges edges = {NULL, 0, 0};
+  FunctionIndex functions = {0, NULL, NULL, NULL};
+  AddressRefs refs = {0, NULL, NULL};
+
+  if (!code_map_build(&map, data, BOOTCODE_ENDS, data_size, entry, entry, ctx->options,
+                      (flags & ROM_LOAD_CALLGRAPH) ? &edges : NULL)) goto cleanup;
+  LOG("# reachable instructions: %u\n", map.reachable);
+
+  if (functions_needed) {
+    if (!function_index_build(&functions, data, map, entry, ctx->options)) goto cleanup;
+    LOG("# functions: %zu\n", functions.count);
+  }
+  if (flags & ROM_LOAD_ADDRESSES) {
+    if (!address_refs_build(&refs, data, map, functions, ctx->options)) goto cleanup;
+    LOG("# address references: %zu\n", refs.count);
+  }
+
+  disasm_code_map(ctx, data, map, (flags & ROM_LOAD_ADDRESSES) ? &refs : NULL);
+  for (uint32_t index = map.words; index > 0; --index) {
+    if (code_map_reachable(map, index - 1)) {
+      *asm_end = BOOTCODE_ENDS + (index - 1) * 4;
+      break;
+    }
+  }
+
+  if ((flags & ROM_LOAD_SYMBOLS) && output_name(file_name, rom_name, "sym") &&
+      !function_index_write(functions, file_name)) {
+    LOG_ERROR("Couldn't write %s.\n", file_name);
+  }
+  if ((flags & ROM_LOAD_ADDRESSES) && output_name(file_name, rom_name, "refs") &&
+      !address_refs_write(refs, file_name)) {
+    LOG_ERROR("Couldn't write %s.\n", file_name);
+  }
+  if (flags & ROM_LOAD_CALLGRAPH) {
+    XrefIndex xrefs;
+    CallGraph graph;
+    if (!xref_index_build(&xrefs, edges)) goto cleanup;
+    if (call_graph_build(&graph, xrefs, functions)) {
+      LOG("# calls: %u\n", graph.callee_offsets[graph.function_count]);
+      if (output_name(file_name, rom_name, "dot") &&
+          !call_graph_write_dot(graph, functions, file_name)) {
+        LOG_ERROR("Couldn't write %s.\n", file_name);
+      }
+      call_graph_free(&graph);
+    }
+    xref_index_free(&xrefs);
+  }
+  ok = true;
+
+cleanup:
+  address_refs_free(&refs);
+  function_index_free(&functions);
+  xref_edges_free(&edges);
+  code_map_free(&map);
+  return ok;
+}
+
+bool Rom::find_regions(const int options, const int flags) const {
+  char file_name[128];
+  RegionMap map;
+  const unsigned threads = (flags & (ROM_LOAD_PARALLEL | ROM_LOAD_ISLANDS)) ? disasm_default_threads()
+                                                                            : 1;
+  if (!region_map_build(&map, data, BOOTCODE_ENDS, data_size, options, threads)) return false;
+  size_t code_regions = 0;
+  for (size_t i = 0; i < map.size; ++i) code_regions += map.items[i].kind == REGION_CODE;
+  LOG("# code regions: %zu, %u bytes\n", code_regions, region_map_size(map, REGION_CODE));
+
+  bool ok = true;
+  if ((flags & ROM_LOAD_REGIONS) && output_name(file_name, rom_name, "regions") &&
+      !region_map_write(map, file_name)) {
+    LOG_ERROR("Couldn't write %s.\n", file_name);
+    ok = false;
+  }
+  if ((flags & ROM_LOAD_ISLANDS) && output_name(file_name, rom_name, "islands") &&
+      !region_map_write_code(map, file_name)) {
+    LOG_ERROR("Couldn't write %s.\n", file_name);
+    ok = false;
+  }
+  region_map_free(&map);
+  return ok;
+}
+
+bool Rom::build_pointer_tables(PointerTables* tables) const {
+  // the KSEG0 pointers are taken as addresses in the code segment
+  return pointer_tables_build(tables, data, binary_start, data_size, entry_point(),
+                              BOOTCODE_ENDS);
+}
+
+bool Rom::find_pointers() const {
+  char file_name[128];
+  PointerTables tables;
+  if (!build_pointer_tables(&tables)) return false;
+  LOG("# pointer tables: %zu, %zu strings\n", tables.size, tables.string_count);
+
+  bool ok = true;
+  if (output_name(file_name, rom_name, "tables") && !pointer_tables_write(tables, file_name)) {
+    LOG_ERROR("Couldn't write %s.\n", file_name);
+    ok = false;
+  }
+  pointer_tables_free(&tables);
+  return ok;
 }
 
-bool Rom::find_binary() {
+bool Rom::find_binary(const int flags) {
   const uint32_t entry = entry_point();
   LOG("bootcode %i\n", bootcode);
   LOG("program_counter 0x%x\n", program_counter);
   LOG("entry 0x%x\n", entry);
 
-  int jump_count = 0;
-  int incond_branch = 0;
   uint32_t asm_end = 0;
 
-  mips_set_file(rom_name);
+  MipsContext* ctx = (MipsContext*) malloc(sizeof(MipsContext));
+  if (ctx == NULL) return false;
+  mips_context_init(ctx);
+  mips_context_open(ctx, rom_name);
+  if ((flags & ROM_LOAD_CACHE) && !mips_context_enable_cache(ctx)) {
+    LOG_ERROR("Couldn't allocate the text cache.\n");
+  }
+  if (flags & (ROM_LOAD_REGIONS | ROM_LOAD_ISLANDS)) find_regions(ctx->options, flags);
 
   // We process each 32 bits as MIPS instructions until we hit
   // something malformed, then assume ASM stops there.
   // This is not foolproof, as non ASM binary data could still be
   // valid MIPS. This is as good as we can get when decompiling.
-  Instruction mips_inst;
-  for (uint32_t at = BOOTCODE_ENDS; at < data_size; at += sizeof(mips_inst)) {
-    reverse_copy((byte*)&mips_inst, &data[at], sizeof(mips_inst));
-    bool ok;
-    switch (mips_inst.r.opcode) {
-      case 0:
-        ok = handle_r(program_counter, mips_inst.r);
-        break;
-      case 2:
-      case 3:
-        ok = handle_j(program_counter, mips_inst.j);
-        if (ok && mips_is_j(mips_inst.j)) ++jump_count;
-        break;
-      default:
-        ok = handle_i(program_counter, mips_inst.i);
-        if (ok && mips_is_b(mips_inst.i)) ++incond_branch;
-        break;
-    }
-    if (!ok) {
-      asm_end = at - sizeof(mips_inst);
-      break;
+  if (flags & ROM_LOAD_ANALYSIS) {
+    // Or follow the control flow from the entry point,
+    // the code ends with the last reachable word.
+    if (!find_code(ctx, entry, flags, &asm_end)) {
+      mips_context_close(ctx);
+      free(ctx);
+      return false;
     }
-    program_counter += sizeof(mips_inst);
+  } else {
+    const unsigned threads = (flags & ROM_LOAD_PARALLEL) ? disasm_default_threads() : 1;
+    const uint32_t end = disasm_linear(ctx, data, BOOTCODE_ENDS, data_size, entry, threads);
+    if (end < (uint32_t) data_size) asm_end = end - 4;
   }
+
+  mips_context_close(ctx);
+
   binary_start = asm_end + 4;
-  LOG("# inconditional jumps: %i\n", jump_count);
-  LOG("# inconditional branches: %i\n", incond_branch);
+  LOG("# inconditional jumps: %i\n", ctx->counters.jump_count);
+  LOG("# inconditional branches: %i\n", ctx->counters.incond_branch);
+  char file_name[128];
+  if ((flags & ROM_LOAD_STATS) && output_name(file_name, rom_name, "json") &&
+      !mips_counters_write_json(ctx->counters, file_name)) {
+    LOG_ERROR("Couldn't write %s.\n", file_name);
+  }
+  size_t runs = 0;
+  if ((flags & ROM_LOAD_TEXT_RUNS) && output_name(file_name, rom_name, "runs")) {
+    if (text_runs_write(data, binary_start, data_size, file_name, &runs)) {
+      LOG("# text runs found: %zu\n", runs);
+    } else {
+      LOG_ERROR("Couldn't write %s.\n", file_name);
+    }
+  }
+  if (flags & ROM_LOAD_POINTERS) find_pointers();
+  if (flags & ROM_LOAD_CACHE) {
+    const uint64_t lines = ctx->counters.cache_hits + ctx->counters.cache_misses;
+    LOG("# text cache hits: %.1f%%\n", lines ? 100.0 * ctx->counters.cache_hits / lines : 0.0);
+  }
   LOG("asm code ends at: 0x%x\n", asm_end);
   LOG("binary starts at: 0x%x\n", binary_start);
 
-  mips_close_file();
-
+  free(ctx);
   return true;
 }
 
@@ -287,15 +543,28 @@ bool Rom::dump_text() {
   // check that it's the correct ROM
   if (crc1 != 0xb3d451c6 || crc2 != 0xe1cb58e2) return false;
 
-  // Now the real fun begins, we must figure out whatever
-  // is encoded in that binary thingie.
-  // A) check for common format
-  // zip format, text encoding, etc
-  // improbable, but we never know
-
-  // B) check what is the asm doing/loading
-  // too slow manually, need to make an emulator or decompiler
+  // The text banks are after the code. The strings reached through
+  // the pointer tables go first, in table order, then the runs of
+  // Shift JIS no table reaches, each converted and written as it goes.
+  char file_name[128];
+  if (!output_name(file_name, rom_name, "txt")) return false;
+  Sink* sink = (Sink*) malloc(sizeof(Sink));
+  if (sink == NULL) return false;
+  sink->file = NULL;
+  sink->size = 0;
+  if (!sink_open(sink, file_name)) {
+    LOG_ERROR("Couldn't write %s.\n", file_name);
+    free(sink);
+    return false;
+  }
 
-  // we aren't doing anything yet
-  return false;
+  PointerTables tables;
+  const bool indexed = build_pointer_tables(&tables);
+  if (!indexed) LOG_ERROR("Couldn't index the pointer tables, scanning the text only.\n");
+  const size_t strings = text_dump(sink, data, binary_start, data_size, indexed ? &tables : NULL);
+  sink_close(sink);
+  free(sink);
+  LOG("# text strings: %zu, %zu tables\n", strings, indexed ? tables.size : 0);
+  if (indexed) pointer_tables_free(&tables);
+  return true;
 }
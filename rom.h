@@ -7,14 +7,58 @@
 
 #include "defs.h"
 
+struct CicCheckpoints;
+struct MipsContext;
+struct PointerTables;
+
 static const size_t TITLE_SIZE = 20;
 static const size_t FORMAT_SIZE = 4;
 static const size_t ID_SIZE = 4;
 
+// Rom::load flags
+// map the file instead of reading it, only the touched pages are paged in
+static const int ROM_LOAD_MMAP = 0x1;
+// prefault the whole mapping, implies ROM_LOAD_MMAP
+static const int ROM_LOAD_POPULATE = 0x2;
+// disassemble on one thread per core
+static const int ROM_LOAD_PARALLEL = 0x4;
+// only disassemble the code reachable from the entry point
+static const int ROM_LOAD_DESCENT = 0x8;
+// write the functions found in the reachable code to a .sym listing,
+// implies ROM_LOAD_DESCENT
+static const int ROM_LOAD_SYMBOLS = 0x10;
+// write the call graph between those functions to a .dot file,
+// implies ROM_LOAD_DESCENT
+static const int ROM_LOAD_CALLGRAPH = 0x20;
+// resolve the lui/addiu pairs to addresses, shown in the disassembly and
+// listed with their users in a .refs file, implies ROM_LOAD_DESCENT
+static const int ROM_LOAD_ADDRESSES = 0x40;
+// reuse the text of the instructions repeated in the disassembly
+static const int ROM_LOAD_CACHE = 0x80;
+// classify the whole ROM in code and data regions, listed in a .regions file
+static const int ROM_LOAD_REGIONS = 0x100;
+// list the code regions of the whole ROM with a confidence in a .islands
+// file, overlays and secondary segments included, on one thread per core
+static const int ROM_LOAD_ISLANDS = 0x200;
+// write the decoder counters (mnemonics, rejection reasons) to a .json file
+static const int ROM_LOAD_STATS = 0x400;
+// list the runs of Shift JIS text after the code with a plausibility score
+// in a .runs file, whatever the version of the ROM
+static const int ROM_LOAD_TEXT_RUNS = 0x800;
+// find the pointer tables to those runs, listed in a .tables file
+static const int ROM_LOAD_POINTERS = 0x1000;
+// any of the flags that need the recursive descent
+static const int ROM_LOAD_ANALYSIS = ROM_LOAD_DESCENT | ROM_LOAD_SYMBOLS | ROM_LOAD_CALLGRAPH |
+                                     ROM_LOAD_ADDRESSES;
+
 struct Rom {
-  bool load(const char* path);
+  bool load(const char* path, const int flags = 0);
   void unload();
   bool dump_text();
+  // Write size bytes at offset and update the header CRCs to match.
+  // The checksum is built once on the first patch, then only the part
+  // after the write is recomputed.
+  bool patch(const uint32_t offset, const byte* bytes, const uint32_t size);
 
   unsigned char operator[] (size_t i) const { return data[i]; }
   unsigned char& operator[] (size_t i) { return data[i]; }
@@ -22,6 +66,8 @@ struct Rom {
   char* rom_name;
   byte* data;
   long data_size;
+  bool mapped;
+  CicCheckpoints* checksum;
   uint32_t binary_start;
 
   int32_t bootcode;
@@ -35,12 +81,22 @@ struct Rom {
   byte version;
 
 private:
+  bool read_file(const char* path);
+  bool map_file(const char* path, const int flags);
+  bool check_size() const;
   bool parse_header();
-  bool check_format() const;
+  bool check_format();
   bool verify_header();
-  bool find_binary();
+  void write_crc();
+  bool find_binary(const int flags);
+  bool find_code(MipsContext* ctx, const uint32_t entry, const int flags, uint32_t* asm_end);
+  bool find_regions(const int options, const int flags) const;
+  bool build_pointer_tables(PointerTables* tables) const;
+  bool find_pointers() const;
   void read(byte* target, const uint32_t from, const uint32_t size) const;
 
+  // RAM address of ROM offset 0x1000, where the bootcode copies the code,
+  // the base address of every disassembly and pointer mapping
   uint32_t entry_point() const;
 
 };
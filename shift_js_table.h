@@ -0,0 +1,3149 @@
+#pragma once
+// Based on:
+// http://x0213.org/codetable/sjis-0213-2004-std.txt
+// Shift_JIS-2004 (JIS X 0213:2004 Appendix 1) vs Unicode mapping table
+// 
+// Date: 3 May 2009
+// License:
+//  Copyright (C) 2001 earthian@tama.or.jp, All Rights Reserved.
+//  Copyright (C) 2001 I'O, All Rights Reserved.
+//  Copyright (C) 2006, 2009 Project X0213, All Rights Reserved.
+
+const unsigned char shiftJIS_convTable[25088] = {
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x02, 0x00, 0x03, 
+    0x00, 0x04, 0x00, 0x05, 0x00, 0x06, 0x00, 0x07, 
+    0x00, 0x08, 0x00, 0x09, 0x00, 0x0a, 0x00, 0x0b, 
+    0x00, 0x0c, 0x00, 0x0d, 0x00, 0x0e, 0x00, 0x0f, 
+    0x00, 0x10, 0x00, 0x11, 0x00, 0x12, 0x00, 0x13, 
+    0x00, 0x14, 0x00, 0x15, 0x00, 0x16, 0x00, 0x17, 
+    0x00, 0x18, 0x00, 0x19, 0x00, 0x1a, 0x00, 0x1b, 
+    0x00, 0x1c, 0x00, 0x1d, 0x00, 0x1e, 0x00, 0x1f, 
+    0x00, 0x20, 0x00, 0x21, 0x00, 0x22, 0x00, 0x23, 
+    0x00, 0x24, 0x00, 0x25, 0x00, 0x26, 0x00, 0x27, 
+    0x00, 0x28, 0x00, 0x29, 0x00, 0x2a, 0x00, 0x2b, 
+    0x00, 0x2c, 0x00, 0x2d, 0x00, 0x2e, 0x00, 0x2f, 
+    0x00, 0x30, 0x00, 0x31, 0x00, 0x32, 0x00, 0x33, 
+    0x00, 0x34, 0x00, 0x35, 0x00, 0x36, 0x00, 0x37, 
+    0x00, 0x38, 0x00, 0x39, 0x00, 0x3a, 0x00, 0x3b, 
+    0x00, 0x3c, 0x00, 0x3d, 0x00, 0x3e, 0x00, 0x3f, 
+    0x00, 0x40, 0x00, 0x41, 0x00, 0x42, 0x00, 0x43, 
+    0x00, 0x44, 0x00, 0x45, 0x00, 0x46, 0x00, 0x47, 
+    0x00, 0x48, 0x00, 0x49, 0x00, 0x4a, 0x00, 0x4b, 
+    0x00, 0x4c, 0x00, 0x4d, 0x00, 0x4e, 0x00, 0x4f, 
+    0x00, 0x50, 0x00, 0x51, 0x00, 0x52, 0x00, 0x53, 
+    0x00, 0x54, 0x00, 0x55, 0x00, 0x56, 0x00, 0x57, 
+    0x00, 0x58, 0x00, 0x59, 0x00, 0x5a, 0x00, 0x5b, 
+    0x00, 0xa5, 0x00, 0x5d, 0x00, 0x5e, 0x00, 0x5f, 
+    0x00, 0x60, 0x00, 0x61, 0x00, 0x62, 0x00, 0x63, 
+    0x00, 0x64, 0x00, 0x65, 0x00, 0x66, 0x00, 0x67, 
+    0x00, 0x68, 0x00, 0x69, 0x00, 0x6a, 0x00, 0x6b, 
+    0x00, 0x6c, 0x00, 0x6d, 0x00, 0x6e, 0x00, 0x6f, 
+    0x00, 0x70, 0x00, 0x71, 0x00, 0x72, 0x00, 0x73, 
+    0x00, 0x74, 0x00, 0x75, 0x00, 0x76, 0x00, 0x77, 
+    0x00, 0x78, 0x00, 0x79, 0x00, 0x7a, 0x00, 0x7b, 
+    0x00, 0x7c, 0x00, 0x7d, 0x20, 0x3e, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0xff, 0x61, 0xff, 0x62, 0xff, 0x63, 
+    0xff, 0x64, 0xff, 0x65, 0xff, 0x66, 0xff, 0x67, 
+    0xff, 0x68, 0xff, 0x69, 0xff, 0x6a, 0xff, 0x6b, 
+    0xff, 0x6c, 0xff, 0x6d, 0xff, 0x6e, 0xff, 0x6f, 
+    0xff, 0x70, 0xff, 0x71, 0xff, 0x72, 0xff, 0x73, 
+    0xff, 0x74, 0xff, 0x75, 0xff, 0x76, 0xff, 0x77, 
+    0xff, 0x78, 0xff, 0x79, 0xff, 0x7a, 0xff, 0x7b, 
+    0xff, 0x7c, 0xff, 0x7d, 0xff, 0x7e, 0xff, 0x7f, 
+    0xff, 0x80, 0xff, 0x81, 0xff, 0x82, 0xff, 0x83, 
+    0xff, 0x84, 0xff, 0x85, 0xff, 0x86, 0xff, 0x87, 
+    0xff, 0x88, 0xff, 0x89, 0xff, 0x8a, 0xff, 0x8b, 
+    0xff, 0x8c, 0xff, 0x8d, 0xff, 0x8e, 0xff, 0x8f, 
+    0xff, 0x90, 0xff, 0x91, 0xff, 0x92, 0xff, 0x93, 
+    0xff, 0x94, 0xff, 0x95, 0xff, 0x96, 0xff, 0x97, 
+    0xff, 0x98, 0xff, 0x99, 0xff, 0x9a, 0xff, 0x9b, 
+    0xff, 0x9c, 0xff, 0x9d, 0xff, 0x9e, 0xff, 0x9f, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x30, 0x00, 0x30, 0x01, 0x30, 0x02, 0xff, 0x0c, 
+    0xff, 0x0e, 0x30, 0xfb, 0xff, 0x1a, 0xff, 0x1b, 
+    0xff, 0x1f, 0xff, 0x01, 0x30, 0x9b, 0x30, 0x9c, 
+    0x00, 0xb4, 0xff, 0x40, 0x00, 0xa8, 0xff, 0x3e, 
+    0xff, 0xe3, 0xff, 0x3f, 0x30, 0xfd, 0x30, 0xfe, 
+    0x30, 0x9d, 0x30, 0x9e, 0x30, 0x03, 0x4e, 0xdd, 
+    0x30, 0x05, 0x30, 0x06, 0x30, 0x07, 0x30, 0xfc, 
+    0x20, 0x15, 0x20, 0x10, 0xff, 0x0f, 0x00, 0x5c, 
+    0x30, 0x1c, 0x20, 0x16, 0xff, 0x5c, 0x20, 0x26, 
+    0x20, 0x25, 0x20, 0x18, 0x20, 0x19, 0x20, 0x1c, 
+    0x20, 0x1d, 0xff, 0x08, 0xff, 0x09, 0x30, 0x14, 
+    0x30, 0x15, 0xff, 0x3b, 0xff, 0x3d, 0xff, 0x5b, 
+    0xff, 0x5d, 0x30, 0x08, 0x30, 0x09, 0x30, 0x0a, 
+    0x30, 0x0b, 0x30, 0x0c, 0x30, 0x0d, 0x30, 0x0e, 
+    0x30, 0x0f, 0x30, 0x10, 0x30, 0x11, 0xff, 0x0b, 
+    0x22, 0x12, 0x00, 0xb1, 0x00, 0xd7, 0x00, 0x20, 
+    0x00, 0xf7, 0xff, 0x1d, 0x22, 0x60, 0xff, 0x1c, 
+    0xff, 0x1e, 0x22, 0x66, 0x22, 0x67, 0x22, 0x1e, 
+    0x22, 0x34, 0x26, 0x42, 0x26, 0x40, 0x00, 0xb0, 
+    0x20, 0x32, 0x20, 0x33, 0x21, 0x03, 0xff, 0xe5, 
+    0xff, 0x04, 0x00, 0xa2, 0x00, 0xa3, 0xff, 0x05, 
+    0xff, 0x03, 0xff, 0x06, 0xff, 0x0a, 0xff, 0x20, 
+    0x00, 0xa7, 0x26, 0x06, 0x26, 0x05, 0x25, 0xcb, 
+    0x25, 0xcf, 0x25, 0xce, 0x25, 0xc7, 0x25, 0xc6, 
+    0x25, 0xa1, 0x25, 0xa0, 0x25, 0xb3, 0x25, 0xb2, 
+    0x25, 0xbd, 0x25, 0xbc, 0x20, 0x3b, 0x30, 0x12, 
+    0x21, 0x92, 0x21, 0x90, 0x21, 0x91, 0x21, 0x93, 
+    0x30, 0x13, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x22, 0x08, 0x22, 0x0b, 0x22, 0x86, 0x22, 0x87, 
+    0x22, 0x82, 0x22, 0x83, 0x22, 0x2a, 0x22, 0x29, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x22, 0x27, 0x22, 0x28, 0x00, 0xac, 0x21, 0xd2, 
+    0x21, 0xd4, 0x22, 0x00, 0x22, 0x03, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x22, 0x20, 0x22, 0xa5, 
+    0x23, 0x12, 0x22, 0x02, 0x22, 0x07, 0x22, 0x61, 
+    0x22, 0x52, 0x22, 0x6a, 0x22, 0x6b, 0x22, 0x1a, 
+    0x22, 0x3d, 0x22, 0x1d, 0x22, 0x35, 0x22, 0x2b, 
+    0x22, 0x2c, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x21, 0x2b, 0x20, 0x30, 0x26, 0x6f, 0x26, 0x6d, 
+    0x26, 0x6a, 0x20, 0x20, 0x20, 0x21, 0x00, 0xb6, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x25, 0xef, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0xff, 0x10, 
+    0xff, 0x11, 0xff, 0x12, 0xff, 0x13, 0xff, 0x14, 
+    0xff, 0x15, 0xff, 0x16, 0xff, 0x17, 0xff, 0x18, 
+    0xff, 0x19, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0xff, 0x21, 0xff, 0x22, 0xff, 0x23, 0xff, 0x24, 
+    0xff, 0x25, 0xff, 0x26, 0xff, 0x27, 0xff, 0x28, 
+    0xff, 0x29, 0xff, 0x2a, 0xff, 0x2b, 0xff, 0x2c, 
+    0xff, 0x2d, 0xff, 0x2e, 0xff, 0x2f, 0xff, 0x30, 
+    0xff, 0x31, 0xff, 0x32, 0xff, 0x33, 0xff, 0x34, 
+    0xff, 0x35, 0xff, 0x36, 0xff, 0x37, 0xff, 0x38, 
+    0xff, 0x39, 0xff, 0x3a, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0xff, 0x41, 0xff, 0x42, 0xff, 0x43, 
+    0xff, 0x44, 0xff, 0x45, 0xff, 0x46, 0xff, 0x47, 
+    0xff, 0x48, 0xff, 0x49, 0xff, 0x4a, 0xff, 0x4b, 
+    0xff, 0x4c, 0xff, 0x4d, 0xff, 0x4e, 0xff, 0x4f, 
+    0xff, 0x50, 0xff, 0x51, 0xff, 0x52, 0xff, 0x53, 
+    0xff, 0x54, 0xff, 0x55, 0xff, 0x56, 0xff, 0x57, 
+    0xff, 0x58, 0xff, 0x59, 0xff, 0x5a, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x30, 0x41, 
+    0x30, 0x42, 0x30, 0x43, 0x30, 0x44, 0x30, 0x45, 
+    0x30, 0x46, 0x30, 0x47, 0x30, 0x48, 0x30, 0x49, 
+    0x30, 0x4a, 0x30, 0x4b, 0x30, 0x4c, 0x30, 0x4d, 
+    0x30, 0x4e, 0x30, 0x4f, 0x30, 0x50, 0x30, 0x51, 
+    0x30, 0x52, 0x30, 0x53, 0x30, 0x54, 0x30, 0x55, 
+    0x30, 0x56, 0x30, 0x57, 0x30, 0x58, 0x30, 0x59, 
+    0x30, 0x5a, 0x30, 0x5b, 0x30, 0x5c, 0x30, 0x5d, 
+    0x30, 0x5e, 0x30, 0x5f, 0x30, 0x60, 0x30, 0x61, 
+    0x30, 0x62, 0x30, 0x63, 0x30, 0x64, 0x30, 0x65, 
+    0x30, 0x66, 0x30, 0x67, 0x30, 0x68, 0x30, 0x69, 
+    0x30, 0x6a, 0x30, 0x6b, 0x30, 0x6c, 0x30, 0x6d, 
+    0x30, 0x6e, 0x30, 0x6f, 0x30, 0x70, 0x30, 0x71, 
+    0x30, 0x72, 0x30, 0x73, 0x30, 0x74, 0x30, 0x75, 
+    0x30, 0x76, 0x30, 0x77, 0x30, 0x78, 0x30, 0x79, 
+    0x30, 0x7a, 0x30, 0x7b, 0x30, 0x7c, 0x30, 0x7d, 
+    0x30, 0x7e, 0x30, 0x7f, 0x30, 0x80, 0x30, 0x81, 
+    0x30, 0x82, 0x30, 0x83, 0x30, 0x84, 0x30, 0x85, 
+    0x30, 0x86, 0x30, 0x87, 0x30, 0x88, 0x30, 0x89, 
+    0x30, 0x8a, 0x30, 0x8b, 0x30, 0x8c, 0x30, 0x8d, 
+    0x30, 0x8e, 0x30, 0x8f, 0x30, 0x90, 0x30, 0x91, 
+    0x30, 0x92, 0x30, 0x93, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x30, 0xa1, 0x30, 0xa2, 0x30, 0xa3, 0x30, 0xa4, 
+    0x30, 0xa5, 0x30, 0xa6, 0x30, 0xa7, 0x30, 0xa8, 
+    0x30, 0xa9, 0x30, 0xaa, 0x30, 0xab, 0x30, 0xac, 
+    0x30, 0xad, 0x30, 0xae, 0x30, 0xaf, 0x30, 0xb0, 
+    0x30, 0xb1, 0x30, 0xb2, 0x30, 0xb3, 0x30, 0xb4, 
+    0x30, 0xb5, 0x30, 0xb6, 0x30, 0xb7, 0x30, 0xb8, 
+    0x30, 0xb9, 0x30, 0xba, 0x30, 0xbb, 0x30, 0xbc, 
+    0x30, 0xbd, 0x30, 0xbe, 0x30, 0xbf, 0x30, 0xc0, 
+    0x30, 0xc1, 0x30, 0xc2, 0x30, 0xc3, 0x30, 0xc4, 
+    0x30, 0xc5, 0x30, 0xc6, 0x30, 0xc7, 0x30, 0xc8, 
+    0x30, 0xc9, 0x30, 0xca, 0x30, 0xcb, 0x30, 0xcc, 
+    0x30, 0xcd, 0x30, 0xce, 0x30, 0xcf, 0x30, 0xd0, 
+    0x30, 0xd1, 0x30, 0xd2, 0x30, 0xd3, 0x30, 0xd4, 
+    0x30, 0xd5, 0x30, 0xd6, 0x30, 0xd7, 0x30, 0xd8, 
+    0x30, 0xd9, 0x30, 0xda, 0x30, 0xdb, 0x30, 0xdc, 
+    0x30, 0xdd, 0x30, 0xde, 0x30, 0xdf, 0x00, 0x20, 
+    0x30, 0xe0, 0x30, 0xe1, 0x30, 0xe2, 0x30, 0xe3, 
+    0x30, 0xe4, 0x30, 0xe5, 0x30, 0xe6, 0x30, 0xe7, 
+    0x30, 0xe8, 0x30, 0xe9, 0x30, 0xea, 0x30, 0xeb, 
+    0x30, 0xec, 0x30, 0xed, 0x30, 0xee, 0x30, 0xef, 
+    0x30, 0xf0, 0x30, 0xf1, 0x30, 0xf2, 0x30, 0xf3, 
+    0x30, 0xf4, 0x30, 0xf5, 0x30, 0xf6, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x03, 0x91, 
+    0x03, 0x92, 0x03, 0x93, 0x03, 0x94, 0x03, 0x95, 
+    0x03, 0x96, 0x03, 0x97, 0x03, 0x98, 0x03, 0x99, 
+    0x03, 0x9a, 0x03, 0x9b, 0x03, 0x9c, 0x03, 0x9d, 
+    0x03, 0x9e, 0x03, 0x9f, 0x03, 0xa0, 0x03, 0xa1, 
+    0x03, 0xa3, 0x03, 0xa4, 0x03, 0xa5, 0x03, 0xa6, 
+    0x03, 0xa7, 0x03, 0xa8, 0x03, 0xa9, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x03, 0xb1, 
+    0x03, 0xb2, 0x03, 0xb3, 0x03, 0xb4, 0x03, 0xb5, 
+    0x03, 0xb6, 0x03, 0xb7, 0x03, 0xb8, 0x03, 0xb9, 
+    0x03, 0xba, 0x03, 0xbb, 0x03, 0xbc, 0x03, 0xbd, 
+    0x03, 0xbe, 0x03, 0xbf, 0x03, 0xc0, 0x03, 0xc1, 
+    0x03, 0xc3, 0x03, 0xc4, 0x03, 0xc5, 0x03, 0xc6, 
+    0x03, 0xc7, 0x03, 0xc8, 0x03, 0xc9, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x04, 0x10, 0x04, 0x11, 0x04, 0x12, 0x04, 0x13, 
+    0x04, 0x14, 0x04, 0x15, 0x04, 0x01, 0x04, 0x16, 
+    0x04, 0x17, 0x04, 0x18, 0x04, 0x19, 0x04, 0x1a, 
+    0x04, 0x1b, 0x04, 0x1c, 0x04, 0x1d, 0x04, 0x1e, 
+    0x04, 0x1f, 0x04, 0x20, 0x04, 0x21, 0x04, 0x22, 
+    0x04, 0x23, 0x04, 0x24, 0x04, 0x25, 0x04, 0x26, 
+    0x04, 0x27, 0x04, 0x28, 0x04, 0x29, 0x04, 0x2a, 
+    0x04, 0x2b, 0x04, 0x2c, 0x04, 0x2d, 0x04, 0x2e, 
+    0x04, 0x2f, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x04, 0x30, 0x04, 0x31, 0x04, 0x32, 0x04, 0x33, 
+    0x04, 0x34, 0x04, 0x35, 0x04, 0x51, 0x04, 0x36, 
+    0x04, 0x37, 0x04, 0x38, 0x04, 0x39, 0x04, 0x3a, 
+    0x04, 0x3b, 0x04, 0x3c, 0x04, 0x3d, 0x00, 0x20, 
+    0x04, 0x3e, 0x04, 0x3f, 0x04, 0x40, 0x04, 0x41, 
+    0x04, 0x42, 0x04, 0x43, 0x04, 0x44, 0x04, 0x45, 
+    0x04, 0x46, 0x04, 0x47, 0x04, 0x48, 0x04, 0x49, 
+    0x04, 0x4a, 0x04, 0x4b, 0x04, 0x4c, 0x04, 0x4d, 
+    0x04, 0x4e, 0x04, 0x4f, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x25, 0x00, 
+    0x25, 0x02, 0x25, 0x0c, 0x25, 0x10, 0x25, 0x18, 
+    0x25, 0x14, 0x25, 0x1c, 0x25, 0x2c, 0x25, 0x24, 
+    0x25, 0x34, 0x25, 0x3c, 0x25, 0x01, 0x25, 0x03, 
+    0x25, 0x0f, 0x25, 0x13, 0x25, 0x1b, 0x25, 0x17, 
+    0x25, 0x23, 0x25, 0x33, 0x25, 0x2b, 0x25, 0x3b, 
+    0x25, 0x4b, 0x25, 0x20, 0x25, 0x2f, 0x25, 0x28, 
+    0x25, 0x37, 0x25, 0x3f, 0x25, 0x1d, 0x25, 0x30, 
+    0x25, 0x25, 0x25, 0x38, 0x25, 0x42, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x4e, 0x9c, 
+    0x55, 0x16, 0x5a, 0x03, 0x96, 0x3f, 0x54, 0xc0, 
+    0x61, 0x1b, 0x63, 0x28, 0x59, 0xf6, 0x90, 0x22, 
+    0x84, 0x75, 0x83, 0x1c, 0x7a, 0x50, 0x60, 0xaa, 
+    0x63, 0xe1, 0x6e, 0x25, 0x65, 0xed, 0x84, 0x66, 
+    0x82, 0xa6, 0x9b, 0xf5, 0x68, 0x93, 0x57, 0x27, 
+    0x65, 0xa1, 0x62, 0x71, 0x5b, 0x9b, 0x59, 0xd0, 
+    0x86, 0x7b, 0x98, 0xf4, 0x7d, 0x62, 0x7d, 0xbe, 
+    0x9b, 0x8e, 0x62, 0x16, 0x7c, 0x9f, 0x88, 0xb7, 
+    0x5b, 0x89, 0x5e, 0xb5, 0x63, 0x09, 0x66, 0x97, 
+    0x68, 0x48, 0x95, 0xc7, 0x97, 0x8d, 0x67, 0x4f, 
+    0x4e, 0xe5, 0x4f, 0x0a, 0x4f, 0x4d, 0x4f, 0x9d, 
+    0x50, 0x49, 0x56, 0xf2, 0x59, 0x37, 0x59, 0xd4, 
+    0x5a, 0x01, 0x5c, 0x09, 0x60, 0xdf, 0x61, 0x0f, 
+    0x61, 0x70, 0x66, 0x13, 0x69, 0x05, 0x70, 0xba, 
+    0x75, 0x4f, 0x75, 0x70, 0x79, 0xfb, 0x7d, 0xad, 
+    0x7d, 0xef, 0x80, 0xc3, 0x84, 0x0e, 0x88, 0x63, 
+    0x8b, 0x02, 0x90, 0x55, 0x90, 0x7a, 0x53, 0x3b, 
+    0x4e, 0x95, 0x4e, 0xa5, 0x57, 0xdf, 0x80, 0xb2, 
+    0x90, 0xc1, 0x78, 0xef, 0x4e, 0x00, 0x58, 0xf1, 
+    0x6e, 0xa2, 0x90, 0x38, 0x7a, 0x32, 0x83, 0x28, 
+    0x82, 0x8b, 0x9c, 0x2f, 0x51, 0x41, 0x53, 0x70, 
+    0x54, 0xbd, 0x54, 0xe1, 0x56, 0xe0, 0x59, 0xfb, 
+    0x5f, 0x15, 0x98, 0xf2, 0x6d, 0xeb, 0x80, 0xe4, 
+    0x85, 0x2d, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x96, 0x62, 0x96, 0x70, 0x96, 0xa0, 0x97, 0xfb, 
+    0x54, 0x0b, 0x53, 0xf3, 0x5b, 0x87, 0x70, 0xcf, 
+    0x7f, 0xbd, 0x8f, 0xc2, 0x96, 0xe8, 0x53, 0x6f, 
+    0x9d, 0x5c, 0x7a, 0xba, 0x4e, 0x11, 0x78, 0x93, 
+    0x81, 0xfc, 0x6e, 0x26, 0x56, 0x18, 0x55, 0x04, 
+    0x6b, 0x1d, 0x85, 0x1a, 0x9c, 0x3b, 0x59, 0xe5, 
+    0x53, 0xa9, 0x6d, 0x66, 0x74, 0xdc, 0x95, 0x8f, 
+    0x56, 0x42, 0x4e, 0x91, 0x90, 0x4b, 0x96, 0xf2, 
+    0x83, 0x4f, 0x99, 0x0c, 0x53, 0xe1, 0x55, 0xb6, 
+    0x5b, 0x30, 0x5f, 0x71, 0x66, 0x20, 0x66, 0xf3, 
+    0x68, 0x04, 0x6c, 0x38, 0x6c, 0xf3, 0x6d, 0x29, 
+    0x74, 0x5b, 0x76, 0xc8, 0x7a, 0x4e, 0x98, 0x34, 
+    0x82, 0xf1, 0x88, 0x5b, 0x8a, 0x60, 0x92, 0xed, 
+    0x6d, 0xb2, 0x75, 0xab, 0x76, 0xca, 0x99, 0xc5, 
+    0x60, 0xa6, 0x8b, 0x01, 0x8d, 0x8a, 0x95, 0xb2, 
+    0x69, 0x8e, 0x53, 0xad, 0x51, 0x86, 0x00, 0x20, 
+    0x57, 0x12, 0x58, 0x30, 0x59, 0x44, 0x5b, 0xb4, 
+    0x5e, 0xf6, 0x60, 0x28, 0x63, 0xa9, 0x63, 0xf4, 
+    0x6c, 0xbf, 0x6f, 0x14, 0x70, 0x8e, 0x71, 0x14, 
+    0x71, 0x59, 0x71, 0xd5, 0x73, 0x3f, 0x7e, 0x01, 
+    0x82, 0x76, 0x82, 0xd1, 0x85, 0x97, 0x90, 0x60, 
+    0x92, 0x5b, 0x9d, 0x1b, 0x58, 0x69, 0x65, 0xbc, 
+    0x6c, 0x5a, 0x75, 0x25, 0x51, 0xf9, 0x59, 0x2e, 
+    0x59, 0x65, 0x5f, 0x80, 0x5f, 0xdc, 0x62, 0xbc, 
+    0x65, 0xfa, 0x6a, 0x2a, 0x6b, 0x27, 0x6b, 0xb4, 
+    0x73, 0x8b, 0x7f, 0xc1, 0x89, 0x56, 0x9d, 0x2c, 
+    0x9d, 0x0e, 0x9e, 0xc4, 0x5c, 0xa1, 0x6c, 0x96, 
+    0x83, 0x7b, 0x51, 0x04, 0x5c, 0x4b, 0x61, 0xb6, 
+    0x81, 0xc6, 0x68, 0x76, 0x72, 0x61, 0x4e, 0x59, 
+    0x4f, 0xfa, 0x53, 0x78, 0x60, 0x69, 0x6e, 0x29, 
+    0x7a, 0x4f, 0x97, 0xf3, 0x4e, 0x0b, 0x53, 0x16, 
+    0x4e, 0xee, 0x4f, 0x55, 0x4f, 0x3d, 0x4f, 0xa1, 
+    0x4f, 0x73, 0x52, 0xa0, 0x53, 0xef, 0x56, 0x09, 
+    0x59, 0x0f, 0x5a, 0xc1, 0x5b, 0xb6, 0x5b, 0xe1, 
+    0x79, 0xd1, 0x66, 0x87, 0x67, 0x9c, 0x67, 0xb6, 
+    0x6b, 0x4c, 0x6c, 0xb3, 0x70, 0x6b, 0x73, 0xc2, 
+    0x79, 0x8d, 0x79, 0xbe, 0x7a, 0x3c, 0x7b, 0x87, 
+    0x82, 0xb1, 0x82, 0xdb, 0x83, 0x04, 0x83, 0x77, 
+    0x83, 0xef, 0x83, 0xd3, 0x87, 0x66, 0x8a, 0xb2, 
+    0x56, 0x29, 0x8c, 0xa8, 0x8f, 0xe6, 0x90, 0x4e, 
+    0x97, 0x1e, 0x86, 0x8a, 0x4f, 0xc4, 0x5c, 0xe8, 
+    0x62, 0x11, 0x72, 0x59, 0x75, 0x3b, 0x81, 0xe5, 
+    0x82, 0xbd, 0x86, 0xfe, 0x8c, 0xc0, 0x96, 0xc5, 
+    0x99, 0x13, 0x99, 0xd5, 0x4e, 0xcb, 0x4f, 0x1a, 
+    0x89, 0xe3, 0x56, 0xde, 0x58, 0x4a, 0x58, 0xca, 
+    0x5e, 0xfb, 0x5f, 0xeb, 0x60, 0x2a, 0x60, 0x94, 
+    0x60, 0x62, 0x61, 0xd0, 0x62, 0x12, 0x62, 0xd0, 
+    0x65, 0x39, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x9b, 0x41, 0x66, 0x66, 0x68, 0xb0, 0x6d, 0x77, 
+    0x70, 0x70, 0x75, 0x4c, 0x76, 0x86, 0x7d, 0x75, 
+    0x82, 0xa5, 0x87, 0xf9, 0x95, 0x8b, 0x96, 0x8e, 
+    0x8c, 0x9d, 0x51, 0xf1, 0x52, 0xbe, 0x59, 0x16, 
+    0x54, 0xb3, 0x5b, 0xb3, 0x5d, 0x16, 0x61, 0x68, 
+    0x69, 0x82, 0x6d, 0xaf, 0x78, 0x8d, 0x84, 0xcb, 
+    0x88, 0x57, 0x8a, 0x72, 0x93, 0xa7, 0x9a, 0xb8, 
+    0x6d, 0x6c, 0x99, 0xa8, 0x86, 0xd9, 0x57, 0xa3, 
+    0x67, 0xff, 0x86, 0xce, 0x92, 0x0e, 0x52, 0x83, 
+    0x56, 0x87, 0x54, 0x04, 0x5e, 0xd3, 0x62, 0xe1, 
+    0x64, 0xb9, 0x68, 0x3c, 0x68, 0x38, 0x6b, 0xbb, 
+    0x73, 0x72, 0x78, 0xba, 0x7a, 0x6b, 0x89, 0x9a, 
+    0x89, 0xd2, 0x8d, 0x6b, 0x8f, 0x03, 0x90, 0xed, 
+    0x95, 0xa3, 0x96, 0x94, 0x97, 0x69, 0x5b, 0x66, 
+    0x5c, 0xb3, 0x69, 0x7d, 0x98, 0x4d, 0x98, 0x4e, 
+    0x63, 0x9b, 0x7b, 0x20, 0x6a, 0x2b, 0x00, 0x20, 
+    0x6a, 0x7f, 0x68, 0xb6, 0x9c, 0x0d, 0x6f, 0x5f, 
+    0x52, 0x72, 0x55, 0x9d, 0x60, 0x70, 0x62, 0xec, 
+    0x6d, 0x3b, 0x6e, 0x07, 0x6e, 0xd1, 0x84, 0x5b, 
+    0x89, 0x10, 0x8f, 0x44, 0x4e, 0x14, 0x9c, 0x39, 
+    0x53, 0xf6, 0x69, 0x1b, 0x6a, 0x3a, 0x97, 0x84, 
+    0x68, 0x2a, 0x51, 0x5c, 0x7a, 0xc3, 0x84, 0xb2, 
+    0x91, 0xdc, 0x93, 0x8c, 0x56, 0x5b, 0x9d, 0x28, 
+    0x68, 0x22, 0x83, 0x05, 0x84, 0x31, 0x7c, 0xa5, 
+    0x52, 0x08, 0x82, 0xc5, 0x74, 0xe6, 0x4e, 0x7e, 
+    0x4f, 0x83, 0x51, 0xa0, 0x5b, 0xd2, 0x52, 0x0a, 
+    0x52, 0xd8, 0x52, 0xe7, 0x5d, 0xfb, 0x55, 0x9a, 
+    0x58, 0x2a, 0x59, 0xe6, 0x5b, 0x8c, 0x5b, 0x98, 
+    0x5b, 0xdb, 0x5e, 0x72, 0x5e, 0x79, 0x60, 0xa3, 
+    0x61, 0x1f, 0x61, 0x63, 0x61, 0xbe, 0x63, 0xdb, 
+    0x65, 0x62, 0x67, 0xd1, 0x68, 0x53, 0x68, 0xfa, 
+    0x6b, 0x3e, 0x6b, 0x53, 0x6c, 0x57, 0x6f, 0x22, 
+    0x6f, 0x97, 0x6f, 0x45, 0x74, 0xb0, 0x75, 0x18, 
+    0x76, 0xe3, 0x77, 0x0b, 0x7a, 0xff, 0x7b, 0xa1, 
+    0x7c, 0x21, 0x7d, 0xe9, 0x7f, 0x36, 0x7f, 0xf0, 
+    0x80, 0x9d, 0x82, 0x66, 0x83, 0x9e, 0x89, 0xb3, 
+    0x8a, 0xcc, 0x8c, 0xab, 0x90, 0x84, 0x94, 0x51, 
+    0x95, 0x93, 0x95, 0x91, 0x95, 0xa2, 0x96, 0x65, 
+    0x97, 0xd3, 0x99, 0x28, 0x82, 0x18, 0x4e, 0x38, 
+    0x54, 0x2b, 0x5c, 0xb8, 0x5d, 0xcc, 0x73, 0xa9, 
+    0x76, 0x4c, 0x77, 0x3c, 0x5c, 0xa9, 0x7f, 0xeb, 
+    0x8d, 0x0b, 0x96, 0xc1, 0x98, 0x11, 0x98, 0x54, 
+    0x98, 0x58, 0x4f, 0x01, 0x4f, 0x0e, 0x53, 0x71, 
+    0x55, 0x9c, 0x56, 0x68, 0x57, 0xfa, 0x59, 0x47, 
+    0x5b, 0x09, 0x5b, 0xc4, 0x5c, 0x90, 0x5e, 0x0c, 
+    0x5e, 0x7e, 0x5f, 0xcc, 0x63, 0xee, 0x67, 0x3a, 
+    0x65, 0xd7, 0x65, 0xe2, 0x67, 0x1f, 0x68, 0xcb, 
+    0x68, 0xc4, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x6a, 0x5f, 0x5e, 0x30, 0x6b, 0xc5, 0x6c, 0x17, 
+    0x6c, 0x7d, 0x75, 0x7f, 0x79, 0x48, 0x5b, 0x63, 
+    0x7a, 0x00, 0x7d, 0x00, 0x5f, 0xbd, 0x89, 0x8f, 
+    0x8a, 0x18, 0x8c, 0xb4, 0x8d, 0x77, 0x8e, 0xcc, 
+    0x8f, 0x1d, 0x98, 0xe2, 0x9a, 0x0e, 0x9b, 0x3c, 
+    0x4e, 0x80, 0x50, 0x7d, 0x51, 0x00, 0x59, 0x93, 
+    0x5b, 0x9c, 0x62, 0x2f, 0x62, 0x80, 0x64, 0xec, 
+    0x6b, 0x3a, 0x72, 0xa0, 0x75, 0x91, 0x79, 0x47, 
+    0x7f, 0xa9, 0x87, 0xfb, 0x8a, 0xbc, 0x8b, 0x70, 
+    0x63, 0xac, 0x83, 0xca, 0x97, 0xa0, 0x54, 0x09, 
+    0x54, 0x03, 0x55, 0xab, 0x68, 0x54, 0x6a, 0x58, 
+    0x8a, 0x70, 0x78, 0x27, 0x67, 0x75, 0x9e, 0xcd, 
+    0x53, 0x74, 0x5b, 0xa2, 0x81, 0x1a, 0x86, 0x50, 
+    0x90, 0x06, 0x4e, 0x18, 0x4e, 0x45, 0x4e, 0xc7, 
+    0x4f, 0x11, 0x53, 0xca, 0x54, 0x38, 0x5b, 0xae, 
+    0x5f, 0x13, 0x60, 0x25, 0x65, 0x51, 0x00, 0x20, 
+    0x67, 0x3d, 0x6c, 0x42, 0x6c, 0x72, 0x6c, 0xe3, 
+    0x70, 0x78, 0x74, 0x03, 0x7a, 0x76, 0x7a, 0xae, 
+    0x7b, 0x08, 0x7d, 0x1a, 0x7c, 0xfe, 0x7d, 0x66, 
+    0x65, 0xe7, 0x72, 0x5b, 0x53, 0xbb, 0x5c, 0x45, 
+    0x5d, 0xe8, 0x62, 0xd2, 0x62, 0xe0, 0x63, 0x19, 
+    0x6e, 0x20, 0x86, 0x5a, 0x8a, 0x31, 0x8d, 0xdd, 
+    0x92, 0xf8, 0x6f, 0x01, 0x79, 0xa6, 0x9b, 0x5a, 
+    0x4e, 0xa8, 0x4e, 0xab, 0x4e, 0xac, 0x4f, 0x9b, 
+    0x4f, 0xa0, 0x50, 0xd1, 0x51, 0x47, 0x7a, 0xf6, 
+    0x51, 0x71, 0x51, 0xf6, 0x53, 0x54, 0x53, 0x21, 
+    0x53, 0x7f, 0x53, 0xeb, 0x55, 0xac, 0x58, 0x83, 
+    0x5c, 0xe1, 0x5f, 0x37, 0x5f, 0x4a, 0x60, 0x2f, 
+    0x60, 0x50, 0x60, 0x6d, 0x63, 0x1f, 0x65, 0x59, 
+    0x6a, 0x4b, 0x6c, 0xc1, 0x72, 0xc2, 0x72, 0xed, 
+    0x77, 0xef, 0x80, 0xf8, 0x81, 0x05, 0x82, 0x08, 
+    0x85, 0x4e, 0x90, 0xf7, 0x93, 0xe1, 0x97, 0xff, 
+    0x99, 0x57, 0x9a, 0x5a, 0x4e, 0xf0, 0x51, 0xdd, 
+    0x5c, 0x2d, 0x66, 0x81, 0x69, 0x6d, 0x5c, 0x40, 
+    0x66, 0xf2, 0x69, 0x75, 0x73, 0x89, 0x68, 0x50, 
+    0x7c, 0x81, 0x50, 0xc5, 0x52, 0xe4, 0x57, 0x47, 
+    0x5d, 0xfe, 0x93, 0x26, 0x65, 0xa4, 0x6b, 0x23, 
+    0x6b, 0x3d, 0x74, 0x34, 0x79, 0x81, 0x79, 0xbd, 
+    0x7b, 0x4b, 0x7d, 0xca, 0x82, 0xb9, 0x83, 0xcc, 
+    0x88, 0x7f, 0x89, 0x5f, 0x8b, 0x39, 0x8f, 0xd1, 
+    0x91, 0xd1, 0x54, 0x1f, 0x92, 0x80, 0x4e, 0x5d, 
+    0x50, 0x36, 0x53, 0xe5, 0x53, 0x3a, 0x72, 0xd7, 
+    0x73, 0x96, 0x77, 0xe9, 0x82, 0xe6, 0x8e, 0xaf, 
+    0x99, 0xc6, 0x99, 0xc8, 0x99, 0xd2, 0x51, 0x77, 
+    0x61, 0x1a, 0x86, 0x5e, 0x55, 0xb0, 0x7a, 0x7a, 
+    0x50, 0x76, 0x5b, 0xd3, 0x90, 0x47, 0x96, 0x85, 
+    0x4e, 0x32, 0x6a, 0xdb, 0x91, 0xe7, 0x5c, 0x51, 
+    0x5c, 0x48, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x63, 0x98, 0x7a, 0x9f, 0x6c, 0x93, 0x97, 0x74, 
+    0x8f, 0x61, 0x7a, 0xaa, 0x71, 0x8a, 0x96, 0x88, 
+    0x7c, 0x82, 0x68, 0x17, 0x7e, 0x70, 0x68, 0x51, 
+    0x93, 0x6c, 0x52, 0xf2, 0x54, 0x1b, 0x85, 0xab, 
+    0x8a, 0x13, 0x7f, 0xa4, 0x8e, 0xcd, 0x90, 0xe1, 
+    0x53, 0x66, 0x88, 0x88, 0x79, 0x41, 0x4f, 0xc2, 
+    0x50, 0xbe, 0x52, 0x11, 0x51, 0x44, 0x55, 0x53, 
+    0x57, 0x2d, 0x73, 0xea, 0x57, 0x8b, 0x59, 0x51, 
+    0x5f, 0x62, 0x5f, 0x84, 0x60, 0x75, 0x61, 0x76, 
+    0x61, 0x67, 0x61, 0xa9, 0x63, 0xb2, 0x64, 0x3a, 
+    0x65, 0x6c, 0x66, 0x6f, 0x68, 0x42, 0x6e, 0x13, 
+    0x75, 0x66, 0x7a, 0x3d, 0x7c, 0xfb, 0x7d, 0x4c, 
+    0x7d, 0x99, 0x7e, 0x4b, 0x7f, 0x6b, 0x83, 0x0e, 
+    0x83, 0x4a, 0x86, 0xcd, 0x8a, 0x08, 0x8a, 0x63, 
+    0x8b, 0x66, 0x8e, 0xfd, 0x98, 0x1a, 0x9d, 0x8f, 
+    0x82, 0xb8, 0x8f, 0xce, 0x9b, 0xe8, 0x00, 0x20, 
+    0x52, 0x87, 0x62, 0x1f, 0x64, 0x83, 0x6f, 0xc0, 
+    0x96, 0x99, 0x68, 0x41, 0x50, 0x91, 0x6b, 0x20, 
+    0x6c, 0x7a, 0x6f, 0x54, 0x7a, 0x74, 0x7d, 0x50, 
+    0x88, 0x40, 0x8a, 0x23, 0x67, 0x08, 0x4e, 0xf6, 
+    0x50, 0x39, 0x50, 0x26, 0x50, 0x65, 0x51, 0x7c, 
+    0x52, 0x38, 0x52, 0x63, 0x55, 0xa7, 0x57, 0x0f, 
+    0x58, 0x05, 0x5a, 0xcc, 0x5e, 0xfa, 0x61, 0xb2, 
+    0x61, 0xf8, 0x62, 0xf3, 0x63, 0x72, 0x69, 0x1c, 
+    0x6a, 0x29, 0x72, 0x7d, 0x72, 0xac, 0x73, 0x2e, 
+    0x78, 0x14, 0x78, 0x6f, 0x7d, 0x79, 0x77, 0x0c, 
+    0x80, 0xa9, 0x89, 0x8b, 0x8b, 0x19, 0x8c, 0xe2, 
+    0x8e, 0xd2, 0x90, 0x63, 0x93, 0x75, 0x96, 0x7a, 
+    0x98, 0x55, 0x9a, 0x13, 0x9e, 0x78, 0x51, 0x43, 
+    0x53, 0x9f, 0x53, 0xb3, 0x5e, 0x7b, 0x5f, 0x26, 
+    0x6e, 0x1b, 0x6e, 0x90, 0x73, 0x84, 0x73, 0xfe, 
+    0x7d, 0x43, 0x82, 0x37, 0x8a, 0x00, 0x8a, 0xfa, 
+    0x96, 0x50, 0x4e, 0x4e, 0x50, 0x0b, 0x53, 0xe4, 
+    0x54, 0x7c, 0x56, 0xfa, 0x59, 0xd1, 0x5b, 0x64, 
+    0x5d, 0xf1, 0x5e, 0xab, 0x5f, 0x27, 0x62, 0x38, 
+    0x65, 0x45, 0x67, 0xaf, 0x6e, 0x56, 0x72, 0xd0, 
+    0x7c, 0xca, 0x88, 0xb4, 0x80, 0xa1, 0x80, 0xe1, 
+    0x83, 0xf0, 0x86, 0x4e, 0x8a, 0x87, 0x8d, 0xe8, 
+    0x92, 0x37, 0x96, 0xc7, 0x98, 0x67, 0x9f, 0x13, 
+    0x4e, 0x94, 0x4e, 0x92, 0x4f, 0x0d, 0x53, 0x48, 
+    0x54, 0x49, 0x54, 0x3e, 0x5a, 0x2f, 0x5f, 0x8c, 
+    0x5f, 0xa1, 0x60, 0x9f, 0x68, 0xa7, 0x6a, 0x8e, 
+    0x74, 0x5a, 0x78, 0x81, 0x8a, 0x9e, 0x8a, 0xa4, 
+    0x8b, 0x77, 0x91, 0x90, 0x4e, 0x5e, 0x9b, 0xc9, 
+    0x4e, 0xa4, 0x4f, 0x7c, 0x4f, 0xaf, 0x50, 0x19, 
+    0x50, 0x16, 0x51, 0x49, 0x51, 0x6c, 0x52, 0x9f, 
+    0x52, 0xb9, 0x52, 0xfe, 0x53, 0x9a, 0x53, 0xe3, 
+    0x54, 0x11, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x54, 0x0e, 0x55, 0x89, 0x57, 0x51, 0x57, 0xa2, 
+    0x59, 0x7d, 0x5b, 0x54, 0x5b, 0x5d, 0x5b, 0x8f, 
+    0x5d, 0xe5, 0x5d, 0xe7, 0x5d, 0xf7, 0x5e, 0x78, 
+    0x5e, 0x83, 0x5e, 0x9a, 0x5e, 0xb7, 0x5f, 0x18, 
+    0x60, 0x52, 0x61, 0x4c, 0x62, 0x97, 0x62, 0xd8, 
+    0x63, 0xa7, 0x65, 0x3b, 0x66, 0x02, 0x66, 0x43, 
+    0x66, 0xf4, 0x67, 0x6d, 0x68, 0x21, 0x68, 0x97, 
+    0x69, 0xcb, 0x6c, 0x5f, 0x6d, 0x2a, 0x6d, 0x69, 
+    0x6e, 0x2f, 0x6e, 0x9d, 0x75, 0x32, 0x76, 0x87, 
+    0x78, 0x6c, 0x7a, 0x3f, 0x7c, 0xe0, 0x7d, 0x05, 
+    0x7d, 0x18, 0x7d, 0x5e, 0x7d, 0xb1, 0x80, 0x15, 
+    0x80, 0x03, 0x80, 0xaf, 0x80, 0xb1, 0x81, 0x54, 
+    0x81, 0x8f, 0x82, 0x2a, 0x83, 0x52, 0x88, 0x4c, 
+    0x88, 0x61, 0x8b, 0x1b, 0x8c, 0xa2, 0x8c, 0xfc, 
+    0x90, 0xca, 0x91, 0x75, 0x92, 0x71, 0x78, 0x3f, 
+    0x92, 0xfc, 0x95, 0xa4, 0x96, 0x4d, 0x00, 0x20, 
+    0x98, 0x05, 0x99, 0x99, 0x9a, 0xd8, 0x9d, 0x3b, 
+    0x52, 0x5b, 0x52, 0xab, 0x53, 0xf7, 0x54, 0x08, 
+    0x58, 0xd5, 0x62, 0xf7, 0x6f, 0xe0, 0x8c, 0x6a, 
+    0x8f, 0x5f, 0x9e, 0xb9, 0x51, 0x4b, 0x52, 0x3b, 
+    0x54, 0x4a, 0x56, 0xfd, 0x7a, 0x40, 0x91, 0x77, 
+    0x9d, 0x60, 0x9e, 0xd2, 0x73, 0x44, 0x6f, 0x09, 
+    0x81, 0x70, 0x75, 0x11, 0x5f, 0xfd, 0x60, 0xda, 
+    0x9a, 0xa8, 0x72, 0xdb, 0x8f, 0xbc, 0x6b, 0x64, 
+    0x98, 0x03, 0x4e, 0xca, 0x56, 0xf0, 0x57, 0x64, 
+    0x58, 0xbe, 0x5a, 0x5a, 0x60, 0x68, 0x61, 0xc7, 
+    0x66, 0x0f, 0x66, 0x06, 0x68, 0x39, 0x68, 0xb1, 
+    0x6d, 0xf7, 0x75, 0xd5, 0x7d, 0x3a, 0x82, 0x6e, 
+    0x9b, 0x42, 0x4e, 0x9b, 0x4f, 0x50, 0x53, 0xc9, 
+    0x55, 0x06, 0x5d, 0x6f, 0x5d, 0xe6, 0x5d, 0xee, 
+    0x67, 0xfb, 0x6c, 0x99, 0x74, 0x73, 0x78, 0x02, 
+    0x8a, 0x50, 0x93, 0x96, 0x88, 0xdf, 0x57, 0x50, 
+    0x5e, 0xa7, 0x63, 0x2b, 0x50, 0xb5, 0x50, 0xac, 
+    0x51, 0x8d, 0x67, 0x00, 0x54, 0xc9, 0x58, 0x5e, 
+    0x59, 0xbb, 0x5b, 0xb0, 0x5f, 0x69, 0x62, 0x4d, 
+    0x63, 0xa1, 0x68, 0x3d, 0x6b, 0x73, 0x6e, 0x08, 
+    0x70, 0x7d, 0x91, 0xc7, 0x72, 0x80, 0x78, 0x15, 
+    0x78, 0x26, 0x79, 0x6d, 0x65, 0x8e, 0x7d, 0x30, 
+    0x83, 0xdc, 0x88, 0xc1, 0x8f, 0x09, 0x96, 0x9b, 
+    0x52, 0x64, 0x57, 0x28, 0x67, 0x50, 0x7f, 0x6a, 
+    0x8c, 0xa1, 0x51, 0xb4, 0x57, 0x42, 0x96, 0x2a, 
+    0x58, 0x3a, 0x69, 0x8a, 0x80, 0xb4, 0x54, 0xb2, 
+    0x5d, 0x0e, 0x57, 0xfc, 0x78, 0x95, 0x9d, 0xfa, 
+    0x4f, 0x5c, 0x52, 0x4a, 0x54, 0x8b, 0x64, 0x3e, 
+    0x66, 0x28, 0x67, 0x14, 0x67, 0xf5, 0x7a, 0x84, 
+    0x7b, 0x56, 0x7d, 0x22, 0x93, 0x2f, 0x68, 0x5c, 
+    0x9b, 0xad, 0x7b, 0x39, 0x53, 0x19, 0x51, 0x8a, 
+    0x52, 0x37, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x5b, 0xdf, 0x62, 0xf6, 0x64, 0xae, 0x64, 0xe6, 
+    0x67, 0x2d, 0x6b, 0xba, 0x85, 0xa9, 0x96, 0xd1, 
+    0x76, 0x90, 0x9b, 0xd6, 0x63, 0x4c, 0x93, 0x06, 
+    0x9b, 0xab, 0x76, 0xbf, 0x66, 0x52, 0x4e, 0x09, 
+    0x50, 0x98, 0x53, 0xc2, 0x5c, 0x71, 0x60, 0xe8, 
+    0x64, 0x92, 0x65, 0x63, 0x68, 0x5f, 0x71, 0xe6, 
+    0x73, 0xca, 0x75, 0x23, 0x7b, 0x97, 0x7e, 0x82, 
+    0x86, 0x95, 0x8b, 0x83, 0x8c, 0xdb, 0x91, 0x78, 
+    0x99, 0x10, 0x65, 0xac, 0x66, 0xab, 0x6b, 0x8b, 
+    0x4e, 0xd5, 0x4e, 0xd4, 0x4f, 0x3a, 0x4f, 0x7f, 
+    0x52, 0x3a, 0x53, 0xf8, 0x53, 0xf2, 0x55, 0xe3, 
+    0x56, 0xdb, 0x58, 0xeb, 0x59, 0xcb, 0x59, 0xc9, 
+    0x59, 0xff, 0x5b, 0x50, 0x5c, 0x4d, 0x5e, 0x02, 
+    0x5e, 0x2b, 0x5f, 0xd7, 0x60, 0x1d, 0x63, 0x07, 
+    0x65, 0x2f, 0x5b, 0x5c, 0x65, 0xaf, 0x65, 0xbd, 
+    0x65, 0xe8, 0x67, 0x9d, 0x6b, 0x62, 0x00, 0x20, 
+    0x6b, 0x7b, 0x6c, 0x0f, 0x73, 0x45, 0x79, 0x49, 
+    0x79, 0xc1, 0x7c, 0xf8, 0x7d, 0x19, 0x7d, 0x2b, 
+    0x80, 0xa2, 0x81, 0x02, 0x81, 0xf3, 0x89, 0x96, 
+    0x8a, 0x5e, 0x8a, 0x69, 0x8a, 0x66, 0x8a, 0x8c, 
+    0x8a, 0xee, 0x8c, 0xc7, 0x8c, 0xdc, 0x96, 0xcc, 
+    0x98, 0xfc, 0x6b, 0x6f, 0x4e, 0x8b, 0x4f, 0x3c, 
+    0x4f, 0x8d, 0x51, 0x50, 0x5b, 0x57, 0x5b, 0xfa, 
+    0x61, 0x48, 0x63, 0x01, 0x66, 0x42, 0x6b, 0x21, 
+    0x6e, 0xcb, 0x6c, 0xbb, 0x72, 0x3e, 0x74, 0xbd, 
+    0x75, 0xd4, 0x78, 0xc1, 0x79, 0x3a, 0x80, 0x0c, 
+    0x80, 0x33, 0x81, 0xea, 0x84, 0x94, 0x8f, 0x9e, 
+    0x6c, 0x50, 0x9e, 0x7f, 0x5f, 0x0f, 0x8b, 0x58, 
+    0x9d, 0x2b, 0x7a, 0xfa, 0x8e, 0xf8, 0x5b, 0x8d, 
+    0x96, 0xeb, 0x4e, 0x03, 0x53, 0xf1, 0x57, 0xf7, 
+    0x59, 0x31, 0x5a, 0xc9, 0x5b, 0xa4, 0x60, 0x89, 
+    0x6e, 0x7f, 0x6f, 0x06, 0x75, 0xbe, 0x8c, 0xea, 
+    0x5b, 0x9f, 0x85, 0x00, 0x7b, 0xe0, 0x50, 0x72, 
+    0x67, 0xf4, 0x82, 0x9d, 0x5c, 0x61, 0x85, 0x4a, 
+    0x7e, 0x1e, 0x82, 0x0e, 0x51, 0x99, 0x5c, 0x04, 
+    0x63, 0x68, 0x8d, 0x66, 0x65, 0x9c, 0x71, 0x6e, 
+    0x79, 0x3e, 0x7d, 0x17, 0x80, 0x05, 0x8b, 0x1d, 
+    0x8e, 0xca, 0x90, 0x6e, 0x86, 0xc7, 0x90, 0xaa, 
+    0x50, 0x1f, 0x52, 0xfa, 0x5c, 0x3a, 0x67, 0x53, 
+    0x70, 0x7c, 0x72, 0x35, 0x91, 0x4c, 0x91, 0xc8, 
+    0x93, 0x2b, 0x82, 0xe5, 0x5b, 0xc2, 0x5f, 0x31, 
+    0x60, 0xf9, 0x4e, 0x3b, 0x53, 0xd6, 0x5b, 0x88, 
+    0x62, 0x4b, 0x67, 0x31, 0x6b, 0x8a, 0x72, 0xe9, 
+    0x73, 0xe0, 0x7a, 0x2e, 0x81, 0x6b, 0x8d, 0xa3, 
+    0x91, 0x52, 0x99, 0x96, 0x51, 0x12, 0x53, 0xd7, 
+    0x54, 0x6a, 0x5b, 0xff, 0x63, 0x88, 0x6a, 0x39, 
+    0x7d, 0xac, 0x97, 0x00, 0x56, 0xda, 0x53, 0xce, 
+    0x54, 0x68, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x5b, 0x97, 0x5c, 0x31, 0x5d, 0xde, 0x4f, 0xee, 
+    0x61, 0x01, 0x62, 0xfe, 0x6d, 0x32, 0x79, 0xc0, 
+    0x79, 0xcb, 0x7d, 0x42, 0x7e, 0x4d, 0x7f, 0xd2, 
+    0x81, 0xed, 0x82, 0x1f, 0x84, 0x90, 0x88, 0x46, 
+    0x89, 0x72, 0x8b, 0x90, 0x8e, 0x74, 0x8f, 0x2f, 
+    0x90, 0x31, 0x91, 0x4b, 0x91, 0x6c, 0x96, 0xc6, 
+    0x91, 0x9c, 0x4e, 0xc0, 0x4f, 0x4f, 0x51, 0x45, 
+    0x53, 0x41, 0x5f, 0x93, 0x62, 0x0e, 0x67, 0xd4, 
+    0x6c, 0x41, 0x6e, 0x0b, 0x73, 0x63, 0x7e, 0x26, 
+    0x91, 0xcd, 0x92, 0x83, 0x53, 0xd4, 0x59, 0x19, 
+    0x5b, 0xbf, 0x6d, 0xd1, 0x79, 0x5d, 0x7e, 0x2e, 
+    0x7c, 0x9b, 0x58, 0x7e, 0x71, 0x9f, 0x51, 0xfa, 
+    0x88, 0x53, 0x8f, 0xf0, 0x4f, 0xca, 0x5c, 0xfb, 
+    0x66, 0x25, 0x77, 0xac, 0x7a, 0xe3, 0x82, 0x1c, 
+    0x99, 0xff, 0x51, 0xc6, 0x5f, 0xaa, 0x65, 0xec, 
+    0x69, 0x6f, 0x6b, 0x89, 0x6d, 0xf3, 0x00, 0x20, 
+    0x6e, 0x96, 0x6f, 0x64, 0x76, 0xfe, 0x7d, 0x14, 
+    0x5d, 0xe1, 0x90, 0x75, 0x91, 0x87, 0x98, 0x06, 
+    0x51, 0xe6, 0x52, 0x1d, 0x62, 0x40, 0x66, 0x91, 
+    0x66, 0xd9, 0x6e, 0x1a, 0x5e, 0xb6, 0x7d, 0xd2, 
+    0x7f, 0x72, 0x66, 0xf8, 0x85, 0xaf, 0x85, 0xf7, 
+    0x8a, 0xf8, 0x52, 0xa9, 0x53, 0xd9, 0x59, 0x73, 
+    0x5e, 0x8f, 0x5f, 0x90, 0x60, 0x55, 0x92, 0xe4, 
+    0x96, 0x64, 0x50, 0xb7, 0x51, 0x1f, 0x52, 0xdd, 
+    0x53, 0x20, 0x53, 0x47, 0x53, 0xec, 0x54, 0xe8, 
+    0x55, 0x46, 0x55, 0x31, 0x56, 0x17, 0x59, 0x68, 
+    0x59, 0xbe, 0x5a, 0x3c, 0x5b, 0xb5, 0x5c, 0x06, 
+    0x5c, 0x0f, 0x5c, 0x11, 0x5c, 0x1a, 0x5e, 0x84, 
+    0x5e, 0x8a, 0x5e, 0xe0, 0x5f, 0x70, 0x62, 0x7f, 
+    0x62, 0x84, 0x62, 0xdb, 0x63, 0x8c, 0x63, 0x77, 
+    0x66, 0x07, 0x66, 0x0c, 0x66, 0x2d, 0x66, 0x76, 
+    0x67, 0x7e, 0x68, 0xa2, 0x6a, 0x1f, 0x6a, 0x35, 
+    0x6c, 0xbc, 0x6d, 0x88, 0x6e, 0x09, 0x6e, 0x58, 
+    0x71, 0x3c, 0x71, 0x26, 0x71, 0x67, 0x75, 0xc7, 
+    0x77, 0x01, 0x78, 0x5d, 0x79, 0x01, 0x79, 0x65, 
+    0x79, 0xf0, 0x7a, 0xe0, 0x7b, 0x11, 0x7c, 0xa7, 
+    0x7d, 0x39, 0x80, 0x96, 0x83, 0xd6, 0x84, 0x8b, 
+    0x85, 0x49, 0x88, 0x5d, 0x88, 0xf3, 0x8a, 0x1f, 
+    0x8a, 0x3c, 0x8a, 0x54, 0x8a, 0x73, 0x8c, 0x61, 
+    0x8c, 0xde, 0x91, 0xa4, 0x92, 0x66, 0x93, 0x7e, 
+    0x94, 0x18, 0x96, 0x9c, 0x97, 0x98, 0x4e, 0x0a, 
+    0x4e, 0x08, 0x4e, 0x1e, 0x4e, 0x57, 0x51, 0x97, 
+    0x52, 0x70, 0x57, 0xce, 0x58, 0x34, 0x58, 0xcc, 
+    0x5b, 0x22, 0x5e, 0x38, 0x60, 0xc5, 0x64, 0xfe, 
+    0x67, 0x61, 0x67, 0x56, 0x6d, 0x44, 0x72, 0xb6, 
+    0x75, 0x73, 0x7a, 0x63, 0x84, 0xb8, 0x8b, 0x72, 
+    0x91, 0xb8, 0x93, 0x20, 0x56, 0x31, 0x57, 0xf4, 
+    0x98, 0xfe, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x62, 0xed, 0x69, 0x0d, 0x6b, 0x96, 0x71, 0xed, 
+    0x7e, 0x54, 0x80, 0x77, 0x82, 0x72, 0x89, 0xe6, 
+    0x98, 0xdf, 0x87, 0x55, 0x8f, 0xb1, 0x5c, 0x3b, 
+    0x4f, 0x38, 0x4f, 0xe1, 0x4f, 0xb5, 0x55, 0x07, 
+    0x5a, 0x20, 0x5b, 0xdd, 0x5b, 0xe9, 0x5f, 0xc3, 
+    0x61, 0x4e, 0x63, 0x2f, 0x65, 0xb0, 0x66, 0x4b, 
+    0x68, 0xee, 0x69, 0x9b, 0x6d, 0x78, 0x6d, 0xf1, 
+    0x75, 0x33, 0x75, 0xb9, 0x77, 0x1f, 0x79, 0x5e, 
+    0x79, 0xe6, 0x7d, 0x33, 0x81, 0xe3, 0x82, 0xaf, 
+    0x85, 0xaa, 0x89, 0xaa, 0x8a, 0x3a, 0x8e, 0xab, 
+    0x8f, 0x9b, 0x90, 0x32, 0x91, 0xdd, 0x97, 0x07, 
+    0x4e, 0xba, 0x4e, 0xc1, 0x52, 0x03, 0x58, 0x75, 
+    0x58, 0xec, 0x5c, 0x0b, 0x75, 0x1a, 0x5c, 0x3d, 
+    0x81, 0x4e, 0x8a, 0x0a, 0x8f, 0xc5, 0x96, 0x63, 
+    0x97, 0x6d, 0x7b, 0x25, 0x8a, 0xcf, 0x98, 0x08, 
+    0x91, 0x62, 0x56, 0xf3, 0x53, 0xa8, 0x00, 0x20, 
+    0x90, 0x17, 0x54, 0x39, 0x57, 0x82, 0x5e, 0x25, 
+    0x63, 0xa8, 0x6c, 0x34, 0x70, 0x8a, 0x77, 0x61, 
+    0x7c, 0x8b, 0x7f, 0xe0, 0x88, 0x70, 0x90, 0x42, 
+    0x91, 0x54, 0x93, 0x10, 0x93, 0x18, 0x96, 0x8f, 
+    0x74, 0x5e, 0x9a, 0xc4, 0x5d, 0x07, 0x5d, 0x69, 
+    0x65, 0x70, 0x67, 0xa2, 0x8d, 0xa8, 0x96, 0xdb, 
+    0x63, 0x6e, 0x67, 0x49, 0x69, 0x19, 0x83, 0xc5, 
+    0x98, 0x17, 0x96, 0xc0, 0x88, 0xfe, 0x6f, 0x84, 
+    0x64, 0x7a, 0x5b, 0xf8, 0x4e, 0x16, 0x70, 0x2c, 
+    0x75, 0x5d, 0x66, 0x2f, 0x51, 0xc4, 0x52, 0x36, 
+    0x52, 0xe2, 0x59, 0xd3, 0x5f, 0x81, 0x60, 0x27, 
+    0x62, 0x10, 0x65, 0x3f, 0x65, 0x74, 0x66, 0x1f, 
+    0x66, 0x74, 0x68, 0xf2, 0x68, 0x16, 0x6b, 0x63, 
+    0x6e, 0x05, 0x72, 0x72, 0x75, 0x1f, 0x76, 0xdb, 
+    0x7c, 0xbe, 0x80, 0x56, 0x58, 0xf0, 0x88, 0xfd, 
+    0x89, 0x7f, 0x8a, 0xa0, 0x8a, 0x93, 0x8a, 0xcb, 
+    0x90, 0x1d, 0x91, 0x92, 0x97, 0x52, 0x97, 0x59, 
+    0x65, 0x89, 0x7a, 0x0e, 0x81, 0x06, 0x96, 0xbb, 
+    0x5e, 0x2d, 0x60, 0xdc, 0x62, 0x1a, 0x65, 0xa5, 
+    0x66, 0x14, 0x67, 0x90, 0x77, 0xf3, 0x7a, 0x4d, 
+    0x7c, 0x4d, 0x7e, 0x3e, 0x81, 0x0a, 0x8c, 0xac, 
+    0x8d, 0x64, 0x8d, 0xe1, 0x8e, 0x5f, 0x78, 0xa9, 
+    0x52, 0x07, 0x62, 0xd9, 0x63, 0xa5, 0x64, 0x42, 
+    0x62, 0x98, 0x8a, 0x2d, 0x7a, 0x83, 0x7b, 0xc0, 
+    0x8a, 0xac, 0x96, 0xea, 0x7d, 0x76, 0x82, 0x0c, 
+    0x87, 0x49, 0x4e, 0xd9, 0x51, 0x48, 0x53, 0x43, 
+    0x53, 0x60, 0x5b, 0xa3, 0x5c, 0x02, 0x5c, 0x16, 
+    0x5d, 0xdd, 0x62, 0x26, 0x62, 0x47, 0x64, 0xb0, 
+    0x68, 0x13, 0x68, 0x34, 0x6c, 0xc9, 0x6d, 0x45, 
+    0x6d, 0x17, 0x67, 0xd3, 0x6f, 0x5c, 0x71, 0x4e, 
+    0x71, 0x7d, 0x65, 0xcb, 0x7a, 0x7f, 0x7b, 0xad, 
+    0x7d, 0xda, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x7e, 0x4a, 0x7f, 0xa8, 0x81, 0x7a, 0x82, 0x1b, 
+    0x82, 0x39, 0x85, 0xa6, 0x8a, 0x6e, 0x8c, 0xce, 
+    0x8d, 0xf5, 0x90, 0x78, 0x90, 0x77, 0x92, 0xad, 
+    0x92, 0x91, 0x95, 0x83, 0x9b, 0xae, 0x52, 0x4d, 
+    0x55, 0x84, 0x6f, 0x38, 0x71, 0x36, 0x51, 0x68, 
+    0x79, 0x85, 0x7e, 0x55, 0x81, 0xb3, 0x7c, 0xce, 
+    0x56, 0x4c, 0x58, 0x51, 0x5c, 0xa8, 0x63, 0xaa, 
+    0x66, 0xfe, 0x66, 0xfd, 0x69, 0x5a, 0x72, 0xd9, 
+    0x75, 0x8f, 0x75, 0x8e, 0x79, 0x0e, 0x79, 0x56, 
+    0x79, 0xdf, 0x7c, 0x97, 0x7d, 0x20, 0x7d, 0x44, 
+    0x86, 0x07, 0x8a, 0x34, 0x96, 0x3b, 0x90, 0x61, 
+    0x9f, 0x20, 0x50, 0xe7, 0x52, 0x75, 0x53, 0xcc, 
+    0x53, 0xe2, 0x50, 0x09, 0x55, 0xaa, 0x58, 0xee, 
+    0x59, 0x4f, 0x72, 0x3d, 0x5b, 0x8b, 0x5c, 0x64, 
+    0x53, 0x1d, 0x60, 0xe3, 0x60, 0xf3, 0x63, 0x5c, 
+    0x63, 0x83, 0x63, 0x3f, 0x63, 0xbb, 0x00, 0x20, 
+    0x64, 0xcd, 0x65, 0xe9, 0x66, 0xf9, 0x5d, 0xe3, 
+    0x69, 0xcd, 0x69, 0xfd, 0x6f, 0x15, 0x71, 0xe5, 
+    0x4e, 0x89, 0x75, 0xe9, 0x76, 0xf8, 0x7a, 0x93, 
+    0x7c, 0xdf, 0x7d, 0xcf, 0x7d, 0x9c, 0x80, 0x61, 
+    0x83, 0x49, 0x83, 0x58, 0x84, 0x6c, 0x84, 0xbc, 
+    0x85, 0xfb, 0x88, 0xc5, 0x8d, 0x70, 0x90, 0x01, 
+    0x90, 0x6d, 0x93, 0x97, 0x97, 0x1c, 0x9a, 0x12, 
+    0x50, 0xcf, 0x58, 0x97, 0x61, 0x8e, 0x81, 0xd3, 
+    0x85, 0x35, 0x8d, 0x08, 0x90, 0x20, 0x4f, 0xc3, 
+    0x50, 0x74, 0x52, 0x47, 0x53, 0x73, 0x60, 0x6f, 
+    0x63, 0x49, 0x67, 0x5f, 0x6e, 0x2c, 0x8d, 0xb3, 
+    0x90, 0x1f, 0x4f, 0xd7, 0x5c, 0x5e, 0x8c, 0xca, 
+    0x65, 0xcf, 0x7d, 0x9a, 0x53, 0x52, 0x88, 0x96, 
+    0x51, 0x76, 0x63, 0xc3, 0x5b, 0x58, 0x5b, 0x6b, 
+    0x5c, 0x0a, 0x64, 0x0d, 0x67, 0x51, 0x90, 0x5c, 
+    0x4e, 0xd6, 0x59, 0x1a, 0x59, 0x2a, 0x6c, 0x70, 
+    0x8a, 0x51, 0x55, 0x3e, 0x58, 0x15, 0x59, 0xa5, 
+    0x60, 0xf0, 0x62, 0x53, 0x67, 0xc1, 0x82, 0x35, 
+    0x69, 0x55, 0x96, 0x40, 0x99, 0xc4, 0x9a, 0x28, 
+    0x4f, 0x53, 0x58, 0x06, 0x5b, 0xfe, 0x80, 0x10, 
+    0x5c, 0xb1, 0x5e, 0x2f, 0x5f, 0x85, 0x60, 0x20, 
+    0x61, 0x4b, 0x62, 0x34, 0x66, 0xff, 0x6c, 0xf0, 
+    0x6e, 0xde, 0x80, 0xce, 0x81, 0x7f, 0x82, 0xd4, 
+    0x88, 0x8b, 0x8c, 0xb8, 0x90, 0x00, 0x90, 0x2e, 
+    0x96, 0x8a, 0x9e, 0xdb, 0x9b, 0xdb, 0x4e, 0xe3, 
+    0x53, 0xf0, 0x59, 0x27, 0x7b, 0x2c, 0x91, 0x8d, 
+    0x98, 0x4c, 0x9d, 0xf9, 0x6e, 0xdd, 0x70, 0x27, 
+    0x53, 0x53, 0x55, 0x44, 0x5b, 0x85, 0x62, 0x58, 
+    0x62, 0x9e, 0x62, 0xd3, 0x6c, 0xa2, 0x6f, 0xef, 
+    0x74, 0x22, 0x8a, 0x17, 0x94, 0x38, 0x6f, 0xc1, 
+    0x8a, 0xfe, 0x83, 0x38, 0x51, 0xe7, 0x86, 0xf8, 
+    0x53, 0xea, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x53, 0xe9, 0x4f, 0x46, 0x90, 0x54, 0x8f, 0xb0, 
+    0x59, 0x6a, 0x81, 0x31, 0x5d, 0xfd, 0x7a, 0xea, 
+    0x8f, 0xbf, 0x68, 0xda, 0x8c, 0x37, 0x72, 0xf8, 
+    0x9c, 0x48, 0x6a, 0x3d, 0x8a, 0xb0, 0x4e, 0x39, 
+    0x53, 0x58, 0x56, 0x06, 0x57, 0x66, 0x62, 0xc5, 
+    0x63, 0xa2, 0x65, 0xe6, 0x6b, 0x4e, 0x6d, 0xe1, 
+    0x6e, 0x5b, 0x70, 0xad, 0x77, 0xed, 0x7a, 0xef, 
+    0x7b, 0xaa, 0x7d, 0xbb, 0x80, 0x3d, 0x80, 0xc6, 
+    0x86, 0xcb, 0x8a, 0x95, 0x93, 0x5b, 0x56, 0xe3, 
+    0x58, 0xc7, 0x5f, 0x3e, 0x65, 0xad, 0x66, 0x96, 
+    0x6a, 0x80, 0x6b, 0xb5, 0x75, 0x37, 0x8a, 0xc7, 
+    0x50, 0x24, 0x77, 0xe5, 0x57, 0x30, 0x5f, 0x1b, 
+    0x60, 0x65, 0x66, 0x7a, 0x6c, 0x60, 0x75, 0xf4, 
+    0x7a, 0x1a, 0x7f, 0x6e, 0x81, 0xf4, 0x87, 0x18, 
+    0x90, 0x45, 0x99, 0xb3, 0x7b, 0xc9, 0x75, 0x5c, 
+    0x7a, 0xf9, 0x7b, 0x51, 0x84, 0xc4, 0x00, 0x20, 
+    0x90, 0x10, 0x79, 0xe9, 0x7a, 0x92, 0x83, 0x36, 
+    0x5a, 0xe1, 0x77, 0x40, 0x4e, 0x2d, 0x4e, 0xf2, 
+    0x5b, 0x99, 0x5f, 0xe0, 0x62, 0xbd, 0x66, 0x3c, 
+    0x67, 0xf1, 0x6c, 0xe8, 0x86, 0x6b, 0x88, 0x77, 
+    0x8a, 0x3b, 0x91, 0x4e, 0x92, 0xf3, 0x99, 0xd0, 
+    0x6a, 0x17, 0x70, 0x26, 0x73, 0x2a, 0x82, 0xe7, 
+    0x84, 0x57, 0x8c, 0xaf, 0x4e, 0x01, 0x51, 0x46, 
+    0x51, 0xcb, 0x55, 0x8b, 0x5b, 0xf5, 0x5e, 0x16, 
+    0x5e, 0x33, 0x5e, 0x81, 0x5f, 0x14, 0x5f, 0x35, 
+    0x5f, 0x6b, 0x5f, 0xb4, 0x61, 0xf2, 0x63, 0x11, 
+    0x66, 0xa2, 0x67, 0x1d, 0x6f, 0x6e, 0x72, 0x52, 
+    0x75, 0x3a, 0x77, 0x3a, 0x80, 0x74, 0x81, 0x39, 
+    0x81, 0x78, 0x87, 0x76, 0x8a, 0xbf, 0x8a, 0xdc, 
+    0x8d, 0x85, 0x8d, 0xf3, 0x92, 0x9a, 0x95, 0x77, 
+    0x98, 0x02, 0x9c, 0xe5, 0x52, 0xc5, 0x63, 0x57, 
+    0x76, 0xf4, 0x67, 0x15, 0x6c, 0x88, 0x73, 0xcd, 
+    0x8c, 0xc3, 0x93, 0xae, 0x96, 0x73, 0x6d, 0x25, 
+    0x58, 0x9c, 0x69, 0x0e, 0x69, 0xcc, 0x8f, 0xfd, 
+    0x93, 0x9a, 0x75, 0xdb, 0x90, 0x1a, 0x58, 0x5a, 
+    0x68, 0x02, 0x63, 0xb4, 0x69, 0xfb, 0x4f, 0x43, 
+    0x6f, 0x2c, 0x67, 0xd8, 0x8f, 0xbb, 0x85, 0x26, 
+    0x7d, 0xb4, 0x93, 0x54, 0x69, 0x3f, 0x6f, 0x70, 
+    0x57, 0x6a, 0x58, 0xf7, 0x5b, 0x2c, 0x7d, 0x2c, 
+    0x72, 0x2a, 0x54, 0x0a, 0x91, 0xe3, 0x9d, 0xb4, 
+    0x4e, 0xad, 0x4f, 0x4e, 0x50, 0x5c, 0x50, 0x75, 
+    0x52, 0x43, 0x8c, 0x9e, 0x54, 0x48, 0x58, 0x24, 
+    0x5b, 0x9a, 0x5e, 0x1d, 0x5e, 0x95, 0x5e, 0xad, 
+    0x5e, 0xf7, 0x5f, 0x1f, 0x60, 0x8c, 0x62, 0xb5, 
+    0x63, 0x3a, 0x63, 0xd0, 0x68, 0xaf, 0x6c, 0x40, 
+    0x78, 0x87, 0x79, 0x8e, 0x7a, 0x0b, 0x7d, 0xe0, 
+    0x82, 0x47, 0x8a, 0x02, 0x8a, 0xe6, 0x8e, 0x44, 
+    0x90, 0x13, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x90, 0xb8, 0x91, 0x2d, 0x91, 0xd8, 0x9f, 0x0e, 
+    0x6c, 0xe5, 0x64, 0x58, 0x64, 0xe2, 0x65, 0x75, 
+    0x6e, 0xf4, 0x76, 0x84, 0x7b, 0x1b, 0x90, 0x69, 
+    0x93, 0xd1, 0x6e, 0xba, 0x54, 0xf2, 0x5f, 0xb9, 
+    0x64, 0xa4, 0x8f, 0x4d, 0x8f, 0xed, 0x92, 0x44, 
+    0x51, 0x78, 0x58, 0x6b, 0x59, 0x29, 0x5c, 0x55, 
+    0x5e, 0x97, 0x6d, 0xfb, 0x7e, 0x8f, 0x75, 0x1c, 
+    0x8c, 0xbc, 0x8e, 0xe2, 0x98, 0x5b, 0x70, 0xb9, 
+    0x4f, 0x1d, 0x6b, 0xbf, 0x6f, 0xb1, 0x75, 0x30, 
+    0x96, 0xfb, 0x51, 0x4e, 0x54, 0x10, 0x58, 0x35, 
+    0x58, 0x57, 0x59, 0xac, 0x5c, 0x60, 0x5f, 0x92, 
+    0x65, 0x97, 0x67, 0x5c, 0x6e, 0x21, 0x76, 0x7b, 
+    0x83, 0xdf, 0x8c, 0xed, 0x90, 0x14, 0x90, 0xfd, 
+    0x93, 0x4d, 0x78, 0x25, 0x78, 0x3a, 0x52, 0xaa, 
+    0x5e, 0xa6, 0x57, 0x1f, 0x59, 0x74, 0x60, 0x12, 
+    0x50, 0x12, 0x51, 0x5a, 0x51, 0xac, 0x00, 0x20, 
+    0x51, 0xcd, 0x52, 0x00, 0x55, 0x10, 0x58, 0x54, 
+    0x58, 0x58, 0x59, 0x57, 0x5b, 0x95, 0x5c, 0xf6, 
+    0x5d, 0x8b, 0x60, 0xbc, 0x62, 0x95, 0x64, 0x2d, 
+    0x67, 0x71, 0x68, 0x43, 0x68, 0xbc, 0x68, 0xdf, 
+    0x76, 0xd7, 0x6d, 0xd8, 0x6e, 0x6f, 0x6d, 0x9b, 
+    0x70, 0x6f, 0x71, 0xc8, 0x5f, 0x53, 0x75, 0xd8, 
+    0x79, 0x77, 0x7b, 0x49, 0x7b, 0x54, 0x7b, 0x52, 
+    0x7c, 0xd6, 0x7d, 0x71, 0x52, 0x30, 0x84, 0x63, 
+    0x85, 0x69, 0x85, 0xe4, 0x8a, 0x0e, 0x8b, 0x04, 
+    0x8c, 0x46, 0x8e, 0x0f, 0x90, 0x03, 0x90, 0x0f, 
+    0x94, 0x19, 0x96, 0x76, 0x98, 0x2d, 0x9a, 0x30, 
+    0x95, 0xd8, 0x50, 0xcd, 0x52, 0xd5, 0x54, 0x0c, 
+    0x58, 0x02, 0x5c, 0x0e, 0x61, 0xa7, 0x64, 0x9e, 
+    0x6d, 0x1e, 0x77, 0xb3, 0x7a, 0xe5, 0x80, 0xf4, 
+    0x84, 0x04, 0x90, 0x53, 0x92, 0x85, 0x5c, 0xe0, 
+    0x9d, 0x07, 0x53, 0x3f, 0x5f, 0x97, 0x5f, 0xb3, 
+    0x6d, 0x9c, 0x72, 0x79, 0x77, 0x63, 0x79, 0xbf, 
+    0x7b, 0xe4, 0x6b, 0xd2, 0x72, 0xec, 0x8a, 0xad, 
+    0x68, 0x03, 0x6a, 0x61, 0x51, 0xf8, 0x7a, 0x81, 
+    0x69, 0x34, 0x5c, 0x4a, 0x9c, 0xf6, 0x82, 0xeb, 
+    0x5b, 0xc5, 0x91, 0x49, 0x70, 0x1e, 0x56, 0x78, 
+    0x5c, 0x6f, 0x60, 0xc7, 0x65, 0x66, 0x6c, 0x8c, 
+    0x8c, 0x5a, 0x90, 0x41, 0x98, 0x13, 0x54, 0x51, 
+    0x66, 0xc7, 0x92, 0x0d, 0x59, 0x48, 0x90, 0xa3, 
+    0x51, 0x85, 0x4e, 0x4d, 0x51, 0xea, 0x85, 0x99, 
+    0x8b, 0x0e, 0x70, 0x58, 0x63, 0x7a, 0x93, 0x4b, 
+    0x69, 0x62, 0x99, 0xb4, 0x7e, 0x04, 0x75, 0x77, 
+    0x53, 0x57, 0x69, 0x60, 0x8e, 0xdf, 0x96, 0xe3, 
+    0x6c, 0x5d, 0x4e, 0x8c, 0x5c, 0x3c, 0x5f, 0x10, 
+    0x8f, 0xe9, 0x53, 0x02, 0x8c, 0xd1, 0x80, 0x89, 
+    0x86, 0x79, 0x5e, 0xff, 0x65, 0xe5, 0x4e, 0x73, 
+    0x51, 0x65, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x59, 0x82, 0x5c, 0x3f, 0x97, 0xee, 0x4e, 0xfb, 
+    0x59, 0x8a, 0x5f, 0xcd, 0x8a, 0x8d, 0x6f, 0xe1, 
+    0x79, 0xb0, 0x79, 0x62, 0x5b, 0xe7, 0x84, 0x71, 
+    0x73, 0x2b, 0x71, 0xb1, 0x5e, 0x74, 0x5f, 0xf5, 
+    0x63, 0x7b, 0x64, 0x9a, 0x71, 0xc3, 0x7c, 0x98, 
+    0x4e, 0x43, 0x5e, 0xfc, 0x4e, 0x4b, 0x57, 0xdc, 
+    0x56, 0xa2, 0x60, 0xa9, 0x6f, 0xc3, 0x7d, 0x0d, 
+    0x80, 0xfd, 0x81, 0x33, 0x81, 0xbf, 0x8f, 0xb2, 
+    0x89, 0x97, 0x86, 0xa4, 0x5d, 0xf4, 0x62, 0x8a, 
+    0x64, 0xad, 0x89, 0x87, 0x67, 0x77, 0x6c, 0xe2, 
+    0x6d, 0x3e, 0x74, 0x36, 0x78, 0x34, 0x5a, 0x46, 
+    0x7f, 0x75, 0x82, 0xad, 0x99, 0xac, 0x4f, 0xf3, 
+    0x5e, 0xc3, 0x62, 0xdd, 0x63, 0x92, 0x65, 0x57, 
+    0x67, 0x6f, 0x76, 0xc3, 0x72, 0x4c, 0x80, 0xcc, 
+    0x80, 0xba, 0x8f, 0x29, 0x91, 0x4d, 0x50, 0x0d, 
+    0x57, 0xf9, 0x5a, 0x92, 0x68, 0x85, 0x00, 0x20, 
+    0x69, 0x73, 0x71, 0x64, 0x72, 0xfd, 0x8c, 0xb7, 
+    0x58, 0xf2, 0x8c, 0xe0, 0x96, 0x6a, 0x90, 0x19, 
+    0x87, 0x7f, 0x79, 0xe4, 0x77, 0xe7, 0x84, 0x29, 
+    0x4f, 0x2f, 0x52, 0x65, 0x53, 0x5a, 0x62, 0xcd, 
+    0x67, 0xcf, 0x6c, 0xca, 0x76, 0x7d, 0x7b, 0x94, 
+    0x7c, 0x95, 0x82, 0x36, 0x85, 0x84, 0x8f, 0xeb, 
+    0x66, 0xdd, 0x6f, 0x20, 0x72, 0x06, 0x7e, 0x1b, 
+    0x83, 0xab, 0x99, 0xc1, 0x9e, 0xa6, 0x51, 0xfd, 
+    0x7b, 0xb1, 0x78, 0x72, 0x7b, 0xb8, 0x80, 0x87, 
+    0x7b, 0x48, 0x6a, 0xe8, 0x5e, 0x61, 0x80, 0x8c, 
+    0x75, 0x51, 0x75, 0x60, 0x51, 0x6b, 0x92, 0x62, 
+    0x6e, 0x8c, 0x76, 0x7a, 0x91, 0x97, 0x9a, 0xea, 
+    0x4f, 0x10, 0x7f, 0x70, 0x62, 0x9c, 0x7b, 0x4f, 
+    0x95, 0xa5, 0x9c, 0xe9, 0x56, 0x7a, 0x58, 0x59, 
+    0x86, 0xe4, 0x96, 0xbc, 0x4f, 0x34, 0x52, 0x24, 
+    0x53, 0x4a, 0x53, 0xcd, 0x53, 0xdb, 0x5e, 0x06, 
+    0x64, 0x2c, 0x65, 0x91, 0x67, 0x7f, 0x6c, 0x3e, 
+    0x6c, 0x4e, 0x72, 0x48, 0x72, 0xaf, 0x73, 0xed, 
+    0x75, 0x54, 0x7e, 0x41, 0x82, 0x2c, 0x85, 0xe9, 
+    0x8c, 0xa9, 0x7b, 0xc4, 0x91, 0xc6, 0x71, 0x69, 
+    0x98, 0x12, 0x98, 0xef, 0x63, 0x3d, 0x66, 0x69, 
+    0x75, 0x6a, 0x76, 0xe4, 0x78, 0xd0, 0x85, 0x43, 
+    0x86, 0xee, 0x53, 0x2a, 0x53, 0x51, 0x54, 0x26, 
+    0x59, 0x83, 0x5e, 0x87, 0x5f, 0x7c, 0x60, 0xb2, 
+    0x62, 0x49, 0x62, 0x79, 0x62, 0xab, 0x65, 0x90, 
+    0x6b, 0xd4, 0x6c, 0xcc, 0x75, 0xb2, 0x76, 0xae, 
+    0x78, 0x91, 0x79, 0xd8, 0x7d, 0xcb, 0x7f, 0x77, 
+    0x80, 0xa5, 0x88, 0xab, 0x8a, 0xb9, 0x8c, 0xbb, 
+    0x90, 0x7f, 0x97, 0x5e, 0x98, 0xdb, 0x6a, 0x0b, 
+    0x7c, 0x38, 0x50, 0x99, 0x5c, 0x3e, 0x5f, 0xae, 
+    0x67, 0x87, 0x6b, 0xd8, 0x74, 0x35, 0x77, 0x09, 
+    0x7f, 0x8e, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x9f, 0x3b, 0x67, 0xca, 0x7a, 0x17, 0x53, 0x39, 
+    0x75, 0x8b, 0x9a, 0xed, 0x5f, 0x66, 0x81, 0x9d, 
+    0x83, 0xf1, 0x80, 0x98, 0x5f, 0x3c, 0x5f, 0xc5, 
+    0x75, 0x62, 0x7b, 0x46, 0x90, 0x3c, 0x68, 0x67, 
+    0x59, 0xeb, 0x5a, 0x9b, 0x7d, 0x10, 0x76, 0x7e, 
+    0x8b, 0x2c, 0x4f, 0xf5, 0x5f, 0x6a, 0x6a, 0x19, 
+    0x6c, 0x37, 0x6f, 0x02, 0x74, 0xe2, 0x79, 0x68, 
+    0x88, 0x68, 0x8a, 0x55, 0x8c, 0x79, 0x5e, 0xdf, 
+    0x63, 0xcf, 0x75, 0xc5, 0x79, 0xd2, 0x82, 0xd7, 
+    0x93, 0x28, 0x92, 0xf2, 0x84, 0x9c, 0x86, 0xed, 
+    0x9c, 0x2d, 0x54, 0xc1, 0x5f, 0x6c, 0x65, 0x8c, 
+    0x6d, 0x5c, 0x70, 0x15, 0x8c, 0xa7, 0x8c, 0xd3, 
+    0x98, 0x3b, 0x65, 0x4f, 0x74, 0xf6, 0x4e, 0x0d, 
+    0x4e, 0xd8, 0x57, 0xe0, 0x59, 0x2b, 0x5a, 0x66, 
+    0x5b, 0xcc, 0x51, 0xa8, 0x5e, 0x03, 0x5e, 0x9c, 
+    0x60, 0x16, 0x62, 0x76, 0x65, 0x77, 0x00, 0x20, 
+    0x65, 0xa7, 0x66, 0x6e, 0x6d, 0x6e, 0x72, 0x36, 
+    0x7b, 0x26, 0x81, 0x50, 0x81, 0x9a, 0x82, 0x99, 
+    0x8b, 0x5c, 0x8c, 0xa0, 0x8c, 0xe6, 0x8d, 0x74, 
+    0x96, 0x1c, 0x96, 0x44, 0x4f, 0xae, 0x64, 0xab, 
+    0x6b, 0x66, 0x82, 0x1e, 0x84, 0x61, 0x85, 0x6a, 
+    0x90, 0xe8, 0x5c, 0x01, 0x69, 0x53, 0x98, 0xa8, 
+    0x84, 0x7a, 0x85, 0x57, 0x4f, 0x0f, 0x52, 0x6f, 
+    0x5f, 0xa9, 0x5e, 0x45, 0x67, 0x0d, 0x79, 0x8f, 
+    0x81, 0x79, 0x89, 0x07, 0x89, 0x86, 0x6d, 0xf5, 
+    0x5f, 0x17, 0x62, 0x55, 0x6c, 0xb8, 0x4e, 0xcf, 
+    0x72, 0x69, 0x9b, 0x92, 0x52, 0x06, 0x54, 0x3b, 
+    0x56, 0x74, 0x58, 0xb3, 0x61, 0xa4, 0x62, 0x6e, 
+    0x71, 0x1a, 0x59, 0x6e, 0x7c, 0x89, 0x7c, 0xde, 
+    0x7d, 0x1b, 0x96, 0xf0, 0x65, 0x87, 0x80, 0x5e, 
+    0x4e, 0x19, 0x4f, 0x75, 0x51, 0x75, 0x58, 0x40, 
+    0x5e, 0x63, 0x5e, 0x73, 0x5f, 0x0a, 0x67, 0xc4, 
+    0x4e, 0x26, 0x85, 0x3d, 0x95, 0x89, 0x96, 0x5b, 
+    0x7c, 0x73, 0x98, 0x01, 0x50, 0xfb, 0x58, 0xc1, 
+    0x76, 0x56, 0x78, 0xa7, 0x52, 0x25, 0x77, 0xa5, 
+    0x85, 0x11, 0x7b, 0x86, 0x50, 0x4f, 0x59, 0x09, 
+    0x72, 0x47, 0x7b, 0xc7, 0x7d, 0xe8, 0x8f, 0xba, 
+    0x8f, 0xd4, 0x90, 0x4d, 0x4f, 0xbf, 0x52, 0xc9, 
+    0x5a, 0x29, 0x5f, 0x01, 0x97, 0xad, 0x4f, 0xdd, 
+    0x82, 0x17, 0x92, 0xea, 0x57, 0x03, 0x63, 0x55, 
+    0x6b, 0x69, 0x75, 0x2b, 0x88, 0xdc, 0x8f, 0x14, 
+    0x7a, 0x42, 0x52, 0xdf, 0x58, 0x93, 0x61, 0x55, 
+    0x62, 0x0a, 0x66, 0xae, 0x6b, 0xcd, 0x7c, 0x3f, 
+    0x83, 0xe9, 0x50, 0x23, 0x4f, 0xf8, 0x53, 0x05, 
+    0x54, 0x46, 0x58, 0x31, 0x59, 0x49, 0x5b, 0x9d, 
+    0x5c, 0xf0, 0x5c, 0xef, 0x5d, 0x29, 0x5e, 0x96, 
+    0x62, 0xb1, 0x63, 0x67, 0x65, 0x3e, 0x65, 0xb9, 
+    0x67, 0x0b, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x6c, 0xd5, 0x6c, 0xe1, 0x70, 0xf9, 0x78, 0x32, 
+    0x7e, 0x2b, 0x80, 0xde, 0x82, 0xb3, 0x84, 0x0c, 
+    0x84, 0xec, 0x87, 0x02, 0x89, 0x12, 0x8a, 0x2a, 
+    0x8c, 0x4a, 0x90, 0xa6, 0x92, 0xd2, 0x98, 0xfd, 
+    0x9c, 0xf3, 0x9d, 0x6c, 0x4e, 0x4f, 0x4e, 0xa1, 
+    0x50, 0x8d, 0x52, 0x56, 0x57, 0x4a, 0x59, 0xa8, 
+    0x5e, 0x3d, 0x5f, 0xd8, 0x5f, 0xd9, 0x62, 0x3f, 
+    0x66, 0xb4, 0x67, 0x1b, 0x67, 0xd0, 0x68, 0xd2, 
+    0x51, 0x92, 0x7d, 0x21, 0x80, 0xaa, 0x81, 0xa8, 
+    0x8b, 0x00, 0x8c, 0x8c, 0x8c, 0xbf, 0x92, 0x7e, 
+    0x96, 0x32, 0x54, 0x20, 0x98, 0x2c, 0x53, 0x17, 
+    0x50, 0xd5, 0x53, 0x5c, 0x58, 0xa8, 0x64, 0xb2, 
+    0x67, 0x34, 0x72, 0x67, 0x77, 0x66, 0x7a, 0x46, 
+    0x91, 0xe6, 0x52, 0xc3, 0x6c, 0xa1, 0x6b, 0x86, 
+    0x58, 0x00, 0x5e, 0x4c, 0x59, 0x54, 0x67, 0x2c, 
+    0x7f, 0xfb, 0x51, 0xe1, 0x76, 0xc6, 0x00, 0x20, 
+    0x64, 0x69, 0x78, 0xe8, 0x9b, 0x54, 0x9e, 0xbb, 
+    0x57, 0xcb, 0x59, 0xb9, 0x66, 0x27, 0x67, 0x9a, 
+    0x6b, 0xce, 0x54, 0xe9, 0x69, 0xd9, 0x5e, 0x55, 
+    0x81, 0x9c, 0x67, 0x95, 0x9b, 0xaa, 0x67, 0xfe, 
+    0x9c, 0x52, 0x68, 0x5d, 0x4e, 0xa6, 0x4f, 0xe3, 
+    0x53, 0xc8, 0x62, 0xb9, 0x67, 0x2b, 0x6c, 0xab, 
+    0x8f, 0xc4, 0x4f, 0xad, 0x7e, 0x6d, 0x9e, 0xbf, 
+    0x4e, 0x07, 0x61, 0x62, 0x6e, 0x80, 0x6f, 0x2b, 
+    0x85, 0x13, 0x54, 0x73, 0x67, 0x2a, 0x9b, 0x45, 
+    0x5d, 0xf3, 0x7b, 0x95, 0x5c, 0xac, 0x5b, 0xc6, 
+    0x87, 0x1c, 0x6e, 0x4a, 0x84, 0xd1, 0x7a, 0x14, 
+    0x81, 0x08, 0x59, 0x99, 0x7c, 0x8d, 0x6c, 0x11, 
+    0x77, 0x20, 0x52, 0xd9, 0x59, 0x22, 0x71, 0x21, 
+    0x72, 0x5f, 0x77, 0xdb, 0x97, 0x27, 0x9d, 0x61, 
+    0x69, 0x0b, 0x5a, 0x7f, 0x5a, 0x18, 0x51, 0xa5, 
+    0x54, 0x0d, 0x54, 0x7d, 0x66, 0x0e, 0x76, 0xdf, 
+    0x8f, 0xf7, 0x92, 0x98, 0x9c, 0xf4, 0x59, 0xea, 
+    0x72, 0x5d, 0x6e, 0xc5, 0x51, 0x4d, 0x68, 0xc9, 
+    0x7d, 0xbf, 0x7d, 0xec, 0x97, 0x62, 0x9e, 0xba, 
+    0x64, 0x78, 0x6a, 0x21, 0x83, 0x02, 0x59, 0x84, 
+    0x5b, 0x5f, 0x6b, 0xdb, 0x73, 0x1b, 0x76, 0xf2, 
+    0x7d, 0xb2, 0x80, 0x17, 0x84, 0x99, 0x51, 0x32, 
+    0x67, 0x28, 0x9e, 0xd9, 0x76, 0xee, 0x67, 0x62, 
+    0x52, 0xff, 0x99, 0x05, 0x5c, 0x24, 0x62, 0x3b, 
+    0x7c, 0x7e, 0x8c, 0xb0, 0x55, 0x4f, 0x60, 0xb6, 
+    0x7d, 0x0b, 0x95, 0x80, 0x53, 0x01, 0x4e, 0x5f, 
+    0x51, 0xb6, 0x59, 0x1c, 0x72, 0x3a, 0x80, 0x36, 
+    0x91, 0xce, 0x5f, 0x25, 0x77, 0xe2, 0x53, 0x84, 
+    0x5f, 0x79, 0x7d, 0x04, 0x85, 0xac, 0x8a, 0x33, 
+    0x8e, 0x8d, 0x97, 0x56, 0x67, 0xf3, 0x85, 0xae, 
+    0x94, 0x53, 0x61, 0x09, 0x61, 0x08, 0x6c, 0xb9, 
+    0x76, 0x52, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x8a, 0xed, 0x8f, 0x38, 0x55, 0x2f, 0x4f, 0x51, 
+    0x51, 0x2a, 0x52, 0xc7, 0x53, 0xcb, 0x5b, 0xa5, 
+    0x5e, 0x7d, 0x60, 0xa0, 0x61, 0x82, 0x63, 0xd6, 
+    0x67, 0x09, 0x67, 0xda, 0x6e, 0x67, 0x6d, 0x8c, 
+    0x73, 0x36, 0x73, 0x37, 0x75, 0x31, 0x79, 0x50, 
+    0x88, 0xd5, 0x8a, 0x98, 0x90, 0x4a, 0x90, 0x91, 
+    0x90, 0xf5, 0x96, 0xc4, 0x87, 0x8d, 0x59, 0x15, 
+    0x4e, 0x88, 0x4f, 0x59, 0x4e, 0x0e, 0x8a, 0x89, 
+    0x8f, 0x3f, 0x98, 0x10, 0x50, 0xad, 0x5e, 0x7c, 
+    0x59, 0x96, 0x5b, 0xb9, 0x5e, 0xb8, 0x63, 0xda, 
+    0x63, 0xfa, 0x64, 0xc1, 0x66, 0xdc, 0x69, 0x4a, 
+    0x69, 0xd8, 0x6d, 0x0b, 0x6e, 0xb6, 0x71, 0x94, 
+    0x75, 0x28, 0x7a, 0xaf, 0x7f, 0x8a, 0x80, 0x00, 
+    0x84, 0x49, 0x84, 0xc9, 0x89, 0x81, 0x8b, 0x21, 
+    0x8e, 0x0a, 0x90, 0x65, 0x96, 0x7d, 0x99, 0x0a, 
+    0x61, 0x7e, 0x62, 0x91, 0x6b, 0x32, 0x00, 0x20, 
+    0x6c, 0x83, 0x6d, 0x74, 0x7f, 0xcc, 0x7f, 0xfc, 
+    0x6d, 0xc0, 0x7f, 0x85, 0x87, 0xba, 0x88, 0xf8, 
+    0x67, 0x65, 0x83, 0xb1, 0x98, 0x3c, 0x96, 0xf7, 
+    0x6d, 0x1b, 0x7d, 0x61, 0x84, 0x3d, 0x91, 0x6a, 
+    0x4e, 0x71, 0x53, 0x75, 0x5d, 0x50, 0x6b, 0x04, 
+    0x6f, 0xeb, 0x85, 0xcd, 0x86, 0x2d, 0x89, 0xa7, 
+    0x52, 0x29, 0x54, 0x0f, 0x5c, 0x65, 0x67, 0x4e, 
+    0x68, 0xa8, 0x74, 0x06, 0x74, 0x83, 0x75, 0xe2, 
+    0x88, 0xcf, 0x88, 0xe1, 0x91, 0xcc, 0x96, 0xe2, 
+    0x96, 0x78, 0x5f, 0x8b, 0x73, 0x87, 0x7a, 0xcb, 
+    0x84, 0x4e, 0x63, 0xa0, 0x75, 0x65, 0x52, 0x89, 
+    0x6d, 0x41, 0x6e, 0x9c, 0x74, 0x09, 0x75, 0x59, 
+    0x78, 0x6b, 0x7c, 0x92, 0x96, 0x86, 0x7a, 0xdc, 
+    0x9f, 0x8d, 0x4f, 0xb6, 0x61, 0x6e, 0x65, 0xc5, 
+    0x86, 0x5c, 0x4e, 0x86, 0x4e, 0xae, 0x50, 0xda, 
+    0x4e, 0x21, 0x51, 0xcc, 0x5b, 0xee, 0x65, 0x99, 
+    0x68, 0x81, 0x6d, 0xbc, 0x73, 0x1f, 0x76, 0x42, 
+    0x77, 0xad, 0x7a, 0x1c, 0x7c, 0xe7, 0x82, 0x6f, 
+    0x8a, 0xd2, 0x90, 0x7c, 0x91, 0xcf, 0x96, 0x75, 
+    0x98, 0x18, 0x52, 0x9b, 0x7d, 0xd1, 0x50, 0x2b, 
+    0x53, 0x98, 0x67, 0x97, 0x6d, 0xcb, 0x71, 0xd0, 
+    0x74, 0x33, 0x81, 0xe8, 0x8f, 0x2a, 0x96, 0xa3, 
+    0x9c, 0x57, 0x9e, 0x9f, 0x74, 0x60, 0x58, 0x41, 
+    0x6d, 0x99, 0x7d, 0x2f, 0x98, 0x5e, 0x4e, 0xe4, 
+    0x4f, 0x36, 0x4f, 0x8b, 0x51, 0xb7, 0x52, 0xb1, 
+    0x5d, 0xba, 0x60, 0x1c, 0x73, 0xb2, 0x79, 0x3c, 
+    0x82, 0xd3, 0x92, 0x34, 0x96, 0xb7, 0x96, 0xf6, 
+    0x97, 0x0a, 0x9e, 0x97, 0x9f, 0x62, 0x66, 0xa6, 
+    0x6b, 0x74, 0x52, 0x17, 0x52, 0xa3, 0x70, 0xc8, 
+    0x88, 0xc2, 0x5e, 0xc9, 0x60, 0x4b, 0x61, 0x90, 
+    0x6f, 0x23, 0x71, 0x49, 0x7c, 0x3e, 0x7d, 0xf4, 
+    0x80, 0x6f, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x84, 0xee, 0x90, 0x23, 0x93, 0x2c, 0x54, 0x42, 
+    0x9b, 0x6f, 0x6a, 0xd3, 0x70, 0x89, 0x8c, 0xc2, 
+    0x8d, 0xef, 0x97, 0x32, 0x52, 0xb4, 0x5a, 0x41, 
+    0x5e, 0xca, 0x5f, 0x04, 0x67, 0x17, 0x69, 0x7c, 
+    0x69, 0x94, 0x6d, 0x6a, 0x6f, 0x0f, 0x72, 0x62, 
+    0x72, 0xfc, 0x7b, 0xed, 0x80, 0x01, 0x80, 0x7e, 
+    0x87, 0x4b, 0x90, 0xce, 0x51, 0x6d, 0x9e, 0x93, 
+    0x79, 0x84, 0x80, 0x8b, 0x93, 0x32, 0x8a, 0xd6, 
+    0x50, 0x2d, 0x54, 0x8c, 0x8a, 0x71, 0x6b, 0x6a, 
+    0x8c, 0xc4, 0x81, 0x07, 0x60, 0xd1, 0x67, 0xa0, 
+    0x9d, 0xf2, 0x4e, 0x99, 0x4e, 0x98, 0x9c, 0x10, 
+    0x8a, 0x6b, 0x85, 0xc1, 0x85, 0x68, 0x69, 0x00, 
+    0x6e, 0x7e, 0x78, 0x97, 0x81, 0x55, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x5f, 0x0c, 
+    0x4e, 0x10, 0x4e, 0x15, 0x4e, 0x2a, 0x4e, 0x31, 
+    0x4e, 0x36, 0x4e, 0x3c, 0x4e, 0x3f, 0x4e, 0x42, 
+    0x4e, 0x56, 0x4e, 0x58, 0x4e, 0x82, 0x4e, 0x85, 
+    0x8c, 0x6b, 0x4e, 0x8a, 0x82, 0x12, 0x5f, 0x0d, 
+    0x4e, 0x8e, 0x4e, 0x9e, 0x4e, 0x9f, 0x4e, 0xa0, 
+    0x4e, 0xa2, 0x4e, 0xb0, 0x4e, 0xb3, 0x4e, 0xb6, 
+    0x4e, 0xce, 0x4e, 0xcd, 0x4e, 0xc4, 0x4e, 0xc6, 
+    0x4e, 0xc2, 0x4e, 0xd7, 0x4e, 0xde, 0x4e, 0xed, 
+    0x4e, 0xdf, 0x4e, 0xf7, 0x4f, 0x09, 0x4f, 0x5a, 
+    0x4f, 0x30, 0x4f, 0x5b, 0x4f, 0x5d, 0x4f, 0x57, 
+    0x4f, 0x47, 0x4f, 0x76, 0x4f, 0x88, 0x4f, 0x8f, 
+    0x4f, 0x98, 0x4f, 0x7b, 0x4f, 0x69, 0x4f, 0x70, 
+    0x4f, 0x91, 0x4f, 0x6f, 0x4f, 0x86, 0x4f, 0x96, 
+    0x51, 0x18, 0x4f, 0xd4, 0x4f, 0xdf, 0x4f, 0xce, 
+    0x4f, 0xd8, 0x4f, 0xdb, 0x4f, 0xd1, 0x4f, 0xda, 
+    0x4f, 0xd0, 0x4f, 0xe4, 0x4f, 0xe5, 0x50, 0x1a, 
+    0x50, 0x28, 0x50, 0x14, 0x50, 0x2a, 0x50, 0x25, 
+    0x50, 0x05, 0x4f, 0x1c, 0x4f, 0xf6, 0x50, 0x21, 
+    0x50, 0x29, 0x50, 0x2c, 0x4f, 0xfe, 0x4f, 0xef, 
+    0x50, 0x11, 0x50, 0x06, 0x50, 0x43, 0x50, 0x47, 
+    0x67, 0x03, 0x50, 0x55, 0x50, 0x50, 0x50, 0x48, 
+    0x50, 0x5a, 0x50, 0x56, 0x50, 0x6c, 0x50, 0x78, 
+    0x50, 0x80, 0x50, 0x9a, 0x50, 0x85, 0x50, 0xb4, 
+    0x50, 0xb2, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x50, 0xc9, 0x50, 0xca, 0x50, 0xb3, 0x50, 0xc2, 
+    0x50, 0xd6, 0x50, 0xde, 0x50, 0xe5, 0x50, 0xed, 
+    0x50, 0xe3, 0x50, 0xee, 0x50, 0xf9, 0x50, 0xf5, 
+    0x51, 0x09, 0x51, 0x01, 0x51, 0x02, 0x51, 0x16, 
+    0x51, 0x15, 0x51, 0x14, 0x51, 0x1a, 0x51, 0x21, 
+    0x51, 0x3a, 0x51, 0x37, 0x51, 0x3c, 0x51, 0x3b, 
+    0x51, 0x3f, 0x51, 0x40, 0x51, 0x52, 0x51, 0x4c, 
+    0x51, 0x54, 0x51, 0x62, 0x7a, 0xf8, 0x51, 0x69, 
+    0x51, 0x6a, 0x51, 0x6e, 0x51, 0x80, 0x51, 0x82, 
+    0x56, 0xd8, 0x51, 0x8c, 0x51, 0x89, 0x51, 0x8f, 
+    0x51, 0x91, 0x51, 0x93, 0x51, 0x95, 0x51, 0x96, 
+    0x51, 0xa4, 0x51, 0xa6, 0x51, 0xa2, 0x51, 0xa9, 
+    0x51, 0xaa, 0x51, 0xab, 0x51, 0xb3, 0x51, 0xb1, 
+    0x51, 0xb2, 0x51, 0xb0, 0x51, 0xb5, 0x51, 0xbd, 
+    0x51, 0xc5, 0x51, 0xc9, 0x51, 0xdb, 0x51, 0xe0, 
+    0x86, 0x55, 0x51, 0xe9, 0x51, 0xed, 0x00, 0x20, 
+    0x51, 0xf0, 0x51, 0xf5, 0x51, 0xfe, 0x52, 0x04, 
+    0x52, 0x0b, 0x52, 0x14, 0x52, 0x0e, 0x52, 0x27, 
+    0x52, 0x2a, 0x52, 0x2e, 0x52, 0x33, 0x52, 0x39, 
+    0x52, 0x4f, 0x52, 0x44, 0x52, 0x4b, 0x52, 0x4c, 
+    0x52, 0x5e, 0x52, 0x54, 0x52, 0x6a, 0x52, 0x74, 
+    0x52, 0x69, 0x52, 0x73, 0x52, 0x7f, 0x52, 0x7d, 
+    0x52, 0x8d, 0x52, 0x94, 0x52, 0x92, 0x52, 0x71, 
+    0x52, 0x88, 0x52, 0x91, 0x8f, 0xa8, 0x8f, 0xa7, 
+    0x52, 0xac, 0x52, 0xad, 0x52, 0xbc, 0x52, 0xb5, 
+    0x52, 0xc1, 0x52, 0xcd, 0x52, 0xd7, 0x52, 0xde, 
+    0x52, 0xe3, 0x52, 0xe6, 0x98, 0xed, 0x52, 0xe0, 
+    0x52, 0xf3, 0x52, 0xf5, 0x52, 0xf8, 0x52, 0xf9, 
+    0x53, 0x06, 0x53, 0x08, 0x75, 0x38, 0x53, 0x0d, 
+    0x53, 0x10, 0x53, 0x0f, 0x53, 0x15, 0x53, 0x1a, 
+    0x53, 0x23, 0x53, 0x2f, 0x53, 0x31, 0x53, 0x33, 
+    0x53, 0x38, 0x53, 0x40, 0x53, 0x46, 0x53, 0x45, 
+    0x4e, 0x17, 0x53, 0x49, 0x53, 0x4d, 0x51, 0xd6, 
+    0x53, 0x5e, 0x53, 0x69, 0x53, 0x6e, 0x59, 0x18, 
+    0x53, 0x7b, 0x53, 0x77, 0x53, 0x82, 0x53, 0x96, 
+    0x53, 0xa0, 0x53, 0xa6, 0x53, 0xa5, 0x53, 0xae, 
+    0x53, 0xb0, 0x53, 0xb6, 0x53, 0xc3, 0x7c, 0x12, 
+    0x96, 0xd9, 0x53, 0xdf, 0x66, 0xfc, 0x71, 0xee, 
+    0x53, 0xee, 0x53, 0xe8, 0x53, 0xed, 0x53, 0xfa, 
+    0x54, 0x01, 0x54, 0x3d, 0x54, 0x40, 0x54, 0x2c, 
+    0x54, 0x2d, 0x54, 0x3c, 0x54, 0x2e, 0x54, 0x36, 
+    0x54, 0x29, 0x54, 0x1d, 0x54, 0x4e, 0x54, 0x8f, 
+    0x54, 0x75, 0x54, 0x8e, 0x54, 0x5f, 0x54, 0x71, 
+    0x54, 0x77, 0x54, 0x70, 0x54, 0x92, 0x54, 0x7b, 
+    0x54, 0x80, 0x54, 0x76, 0x54, 0x84, 0x54, 0x90, 
+    0x54, 0x86, 0x54, 0xc7, 0x54, 0xa2, 0x54, 0xb8, 
+    0x54, 0xa5, 0x54, 0xac, 0x54, 0xc4, 0x54, 0xc8, 
+    0x54, 0xa8, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x54, 0xab, 0x54, 0xc2, 0x54, 0xa4, 0x54, 0xbe, 
+    0x54, 0xbc, 0x54, 0xd8, 0x54, 0xe5, 0x54, 0xe6, 
+    0x55, 0x0f, 0x55, 0x14, 0x54, 0xfd, 0x54, 0xee, 
+    0x54, 0xed, 0x54, 0xfa, 0x54, 0xe2, 0x55, 0x39, 
+    0x55, 0x40, 0x55, 0x63, 0x55, 0x4c, 0x55, 0x2e, 
+    0x55, 0x5c, 0x55, 0x45, 0x55, 0x56, 0x55, 0x57, 
+    0x55, 0x38, 0x55, 0x33, 0x55, 0x5d, 0x55, 0x99, 
+    0x55, 0x80, 0x54, 0xaf, 0x55, 0x8a, 0x55, 0x9f, 
+    0x55, 0x7b, 0x55, 0x7e, 0x55, 0x98, 0x55, 0x9e, 
+    0x55, 0xae, 0x55, 0x7c, 0x55, 0x83, 0x55, 0xa9, 
+    0x55, 0x87, 0x55, 0xa8, 0x55, 0xda, 0x55, 0xc5, 
+    0x55, 0xdf, 0x55, 0xc4, 0x55, 0xdc, 0x55, 0xe4, 
+    0x55, 0xd4, 0x56, 0x14, 0x55, 0xf7, 0x56, 0x16, 
+    0x55, 0xfe, 0x55, 0xfd, 0x56, 0x1b, 0x55, 0xf9, 
+    0x56, 0x4e, 0x56, 0x50, 0x71, 0xdf, 0x56, 0x34, 
+    0x56, 0x36, 0x56, 0x32, 0x56, 0x38, 0x00, 0x20, 
+    0x56, 0x6b, 0x56, 0x64, 0x56, 0x2f, 0x56, 0x6c, 
+    0x56, 0x6a, 0x56, 0x86, 0x56, 0x80, 0x56, 0x8a, 
+    0x56, 0xa0, 0x56, 0x94, 0x56, 0x8f, 0x56, 0xa5, 
+    0x56, 0xae, 0x56, 0xb6, 0x56, 0xb4, 0x56, 0xc2, 
+    0x56, 0xbc, 0x56, 0xc1, 0x56, 0xc3, 0x56, 0xc0, 
+    0x56, 0xc8, 0x56, 0xce, 0x56, 0xd1, 0x56, 0xd3, 
+    0x56, 0xd7, 0x56, 0xee, 0x56, 0xf9, 0x57, 0x00, 
+    0x56, 0xff, 0x57, 0x04, 0x57, 0x09, 0x57, 0x08, 
+    0x57, 0x0b, 0x57, 0x0d, 0x57, 0x13, 0x57, 0x18, 
+    0x57, 0x16, 0x55, 0xc7, 0x57, 0x1c, 0x57, 0x26, 
+    0x57, 0x37, 0x57, 0x38, 0x57, 0x4e, 0x57, 0x3b, 
+    0x57, 0x40, 0x57, 0x4f, 0x57, 0x69, 0x57, 0xc0, 
+    0x57, 0x88, 0x57, 0x61, 0x57, 0x7f, 0x57, 0x89, 
+    0x57, 0x93, 0x57, 0xa0, 0x57, 0xb3, 0x57, 0xa4, 
+    0x57, 0xaa, 0x57, 0xb0, 0x57, 0xc3, 0x57, 0xc6, 
+    0x57, 0xd4, 0x57, 0xd2, 0x57, 0xd3, 0x58, 0x0a, 
+    0x57, 0xd6, 0x57, 0xe3, 0x58, 0x0b, 0x58, 0x19, 
+    0x58, 0x1d, 0x58, 0x72, 0x58, 0x21, 0x58, 0x62, 
+    0x58, 0x4b, 0x58, 0x70, 0x6b, 0xc0, 0x58, 0x52, 
+    0x58, 0x3d, 0x58, 0x79, 0x58, 0x85, 0x58, 0xb9, 
+    0x58, 0x9f, 0x58, 0xab, 0x58, 0xba, 0x58, 0xde, 
+    0x58, 0xbb, 0x58, 0xb8, 0x58, 0xae, 0x58, 0xc5, 
+    0x58, 0xd3, 0x58, 0xd1, 0x58, 0xd7, 0x58, 0xd9, 
+    0x58, 0xd8, 0x58, 0xe5, 0x58, 0xdc, 0x58, 0xe4, 
+    0x58, 0xdf, 0x58, 0xef, 0x58, 0xfa, 0x58, 0xf9, 
+    0x58, 0xfb, 0x58, 0xfc, 0x58, 0xfd, 0x59, 0x02, 
+    0x59, 0x0a, 0x59, 0x10, 0x59, 0x1b, 0x68, 0xa6, 
+    0x59, 0x25, 0x59, 0x2c, 0x59, 0x2d, 0x59, 0x32, 
+    0x59, 0x38, 0x59, 0x3e, 0x7a, 0xd2, 0x59, 0x55, 
+    0x59, 0x50, 0x59, 0x4e, 0x59, 0x5a, 0x59, 0x58, 
+    0x59, 0x62, 0x59, 0x60, 0x59, 0x67, 0x59, 0x6c, 
+    0x59, 0x69, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x59, 0x78, 0x59, 0x81, 0x59, 0x9d, 0x4f, 0x5e, 
+    0x4f, 0xab, 0x59, 0xa3, 0x59, 0xb2, 0x59, 0xc6, 
+    0x59, 0xe8, 0x59, 0xdc, 0x59, 0x8d, 0x59, 0xd9, 
+    0x59, 0xda, 0x5a, 0x25, 0x5a, 0x1f, 0x5a, 0x11, 
+    0x5a, 0x1c, 0x5a, 0x09, 0x5a, 0x1a, 0x5a, 0x40, 
+    0x5a, 0x6c, 0x5a, 0x49, 0x5a, 0x35, 0x5a, 0x36, 
+    0x5a, 0x62, 0x5a, 0x6a, 0x5a, 0x9a, 0x5a, 0xbc, 
+    0x5a, 0xbe, 0x5a, 0xcb, 0x5a, 0xc2, 0x5a, 0xbd, 
+    0x5a, 0xe3, 0x5a, 0xd7, 0x5a, 0xe6, 0x5a, 0xe9, 
+    0x5a, 0xd6, 0x5a, 0xfa, 0x5a, 0xfb, 0x5b, 0x0c, 
+    0x5b, 0x0b, 0x5b, 0x16, 0x5b, 0x32, 0x5a, 0xd0, 
+    0x5b, 0x2a, 0x5b, 0x36, 0x5b, 0x3e, 0x5b, 0x43, 
+    0x5b, 0x45, 0x5b, 0x40, 0x5b, 0x51, 0x5b, 0x55, 
+    0x5b, 0x5a, 0x5b, 0x5b, 0x5b, 0x65, 0x5b, 0x69, 
+    0x5b, 0x70, 0x5b, 0x73, 0x5b, 0x75, 0x5b, 0x78, 
+    0x65, 0x88, 0x5b, 0x7a, 0x5b, 0x80, 0x00, 0x20, 
+    0x5b, 0x83, 0x5b, 0xa6, 0x5b, 0xb8, 0x5b, 0xc3, 
+    0x5b, 0xc7, 0x5b, 0xc9, 0x5b, 0xd4, 0x5b, 0xd0, 
+    0x5b, 0xe4, 0x5b, 0xe6, 0x5b, 0xe2, 0x5b, 0xde, 
+    0x5b, 0xe5, 0x5b, 0xeb, 0x5b, 0xf0, 0x5b, 0xf6, 
+    0x5b, 0xf3, 0x5c, 0x05, 0x5c, 0x07, 0x5c, 0x08, 
+    0x5c, 0x0d, 0x5c, 0x13, 0x5c, 0x20, 0x5c, 0x22, 
+    0x5c, 0x28, 0x5c, 0x38, 0x5c, 0x39, 0x5c, 0x41, 
+    0x5c, 0x46, 0x5c, 0x4e, 0x5c, 0x53, 0x5c, 0x50, 
+    0x5c, 0x4f, 0x5b, 0x71, 0x5c, 0x6c, 0x5c, 0x6e, 
+    0x4e, 0x62, 0x5c, 0x76, 0x5c, 0x79, 0x5c, 0x8c, 
+    0x5c, 0x91, 0x5c, 0x94, 0x59, 0x9b, 0x5c, 0xab, 
+    0x5c, 0xbb, 0x5c, 0xb6, 0x5c, 0xbc, 0x5c, 0xb7, 
+    0x5c, 0xc5, 0x5c, 0xbe, 0x5c, 0xc7, 0x5c, 0xd9, 
+    0x5c, 0xe9, 0x5c, 0xfd, 0x5c, 0xfa, 0x5c, 0xed, 
+    0x5d, 0x8c, 0x5c, 0xea, 0x5d, 0x0b, 0x5d, 0x15, 
+    0x5d, 0x17, 0x5d, 0x5c, 0x5d, 0x1f, 0x5d, 0x1b, 
+    0x5d, 0x11, 0x5d, 0x14, 0x5d, 0x22, 0x5d, 0x1a, 
+    0x5d, 0x19, 0x5d, 0x18, 0x5d, 0x4c, 0x5d, 0x52, 
+    0x5d, 0x4e, 0x5d, 0x4b, 0x5d, 0x6c, 0x5d, 0x73, 
+    0x5d, 0x76, 0x5d, 0x87, 0x5d, 0x84, 0x5d, 0x82, 
+    0x5d, 0xa2, 0x5d, 0x9d, 0x5d, 0xac, 0x5d, 0xae, 
+    0x5d, 0xbd, 0x5d, 0x90, 0x5d, 0xb7, 0x5d, 0xbc, 
+    0x5d, 0xc9, 0x5d, 0xcd, 0x5d, 0xd3, 0x5d, 0xd2, 
+    0x5d, 0xd6, 0x5d, 0xdb, 0x5d, 0xeb, 0x5d, 0xf2, 
+    0x5d, 0xf5, 0x5e, 0x0b, 0x5e, 0x1a, 0x5e, 0x19, 
+    0x5e, 0x11, 0x5e, 0x1b, 0x5e, 0x36, 0x5e, 0x37, 
+    0x5e, 0x44, 0x5e, 0x43, 0x5e, 0x40, 0x5e, 0x4e, 
+    0x5e, 0x57, 0x5e, 0x54, 0x5e, 0x5f, 0x5e, 0x62, 
+    0x5e, 0x64, 0x5e, 0x47, 0x5e, 0x75, 0x5e, 0x76, 
+    0x5e, 0x7a, 0x9e, 0xbc, 0x5e, 0x7f, 0x5e, 0xa0, 
+    0x5e, 0xc1, 0x5e, 0xc2, 0x5e, 0xc8, 0x5e, 0xd0, 
+    0x5e, 0xcf, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x5e, 0xd6, 0x5e, 0xe3, 0x5e, 0xdd, 0x5e, 0xda, 
+    0x5e, 0xdb, 0x5e, 0xe2, 0x5e, 0xe1, 0x5e, 0xe8, 
+    0x5e, 0xe9, 0x5e, 0xec, 0x5e, 0xf1, 0x5e, 0xf3, 
+    0x5e, 0xf0, 0x5e, 0xf4, 0x5e, 0xf8, 0x5e, 0xfe, 
+    0x5f, 0x03, 0x5f, 0x09, 0x5f, 0x5d, 0x5f, 0x5c, 
+    0x5f, 0x0b, 0x5f, 0x11, 0x5f, 0x16, 0x5f, 0x29, 
+    0x5f, 0x2d, 0x5f, 0x38, 0x5f, 0x41, 0x5f, 0x48, 
+    0x5f, 0x4c, 0x5f, 0x4e, 0x5f, 0x2f, 0x5f, 0x51, 
+    0x5f, 0x56, 0x5f, 0x57, 0x5f, 0x59, 0x5f, 0x61, 
+    0x5f, 0x6d, 0x5f, 0x73, 0x5f, 0x77, 0x5f, 0x83, 
+    0x5f, 0x82, 0x5f, 0x7f, 0x5f, 0x8a, 0x5f, 0x88, 
+    0x5f, 0x91, 0x5f, 0x87, 0x5f, 0x9e, 0x5f, 0x99, 
+    0x5f, 0x98, 0x5f, 0xa0, 0x5f, 0xa8, 0x5f, 0xad, 
+    0x5f, 0xbc, 0x5f, 0xd6, 0x5f, 0xfb, 0x5f, 0xe4, 
+    0x5f, 0xf8, 0x5f, 0xf1, 0x5f, 0xdd, 0x60, 0xb3, 
+    0x5f, 0xff, 0x60, 0x21, 0x60, 0x60, 0x00, 0x20, 
+    0x60, 0x19, 0x60, 0x10, 0x60, 0x29, 0x60, 0x0e, 
+    0x60, 0x31, 0x60, 0x1b, 0x60, 0x15, 0x60, 0x2b, 
+    0x60, 0x26, 0x60, 0x0f, 0x60, 0x3a, 0x60, 0x5a, 
+    0x60, 0x41, 0x60, 0x6a, 0x60, 0x77, 0x60, 0x5f, 
+    0x60, 0x4a, 0x60, 0x46, 0x60, 0x4d, 0x60, 0x63, 
+    0x60, 0x43, 0x60, 0x64, 0x60, 0x42, 0x60, 0x6c, 
+    0x60, 0x6b, 0x60, 0x59, 0x60, 0x81, 0x60, 0x8d, 
+    0x60, 0xe7, 0x60, 0x83, 0x60, 0x9a, 0x60, 0x84, 
+    0x60, 0x9b, 0x60, 0x96, 0x60, 0x97, 0x60, 0x92, 
+    0x60, 0xa7, 0x60, 0x8b, 0x60, 0xe1, 0x60, 0xb8, 
+    0x60, 0xe0, 0x60, 0xd3, 0x60, 0xb4, 0x5f, 0xf0, 
+    0x60, 0xbd, 0x60, 0xc6, 0x60, 0xb5, 0x60, 0xd8, 
+    0x61, 0x4d, 0x61, 0x15, 0x61, 0x06, 0x60, 0xf6, 
+    0x60, 0xf7, 0x61, 0x00, 0x60, 0xf4, 0x60, 0xfa, 
+    0x61, 0x03, 0x61, 0x21, 0x60, 0xfb, 0x60, 0xf1, 
+    0x61, 0x0d, 0x61, 0x0e, 0x61, 0x47, 0x61, 0x3e, 
+    0x61, 0x28, 0x61, 0x27, 0x61, 0x4a, 0x61, 0x3f, 
+    0x61, 0x3c, 0x61, 0x2c, 0x61, 0x34, 0x61, 0x3d, 
+    0x61, 0x42, 0x61, 0x44, 0x61, 0x73, 0x61, 0x77, 
+    0x61, 0x58, 0x61, 0x59, 0x61, 0x5a, 0x61, 0x6b, 
+    0x61, 0x74, 0x61, 0x6f, 0x61, 0x65, 0x61, 0x71, 
+    0x61, 0x5f, 0x61, 0x5d, 0x61, 0x53, 0x61, 0x75, 
+    0x61, 0x99, 0x61, 0x96, 0x61, 0x87, 0x61, 0xac, 
+    0x61, 0x94, 0x61, 0x9a, 0x61, 0x8a, 0x61, 0x91, 
+    0x61, 0xab, 0x61, 0xae, 0x61, 0xcc, 0x61, 0xca, 
+    0x61, 0xc9, 0x61, 0xf7, 0x61, 0xc8, 0x61, 0xc3, 
+    0x61, 0xc6, 0x61, 0xba, 0x61, 0xcb, 0x7f, 0x79, 
+    0x61, 0xcd, 0x61, 0xe6, 0x61, 0xe3, 0x61, 0xf6, 
+    0x61, 0xfa, 0x61, 0xf4, 0x61, 0xff, 0x61, 0xfd, 
+    0x61, 0xfc, 0x61, 0xfe, 0x62, 0x00, 0x62, 0x08, 
+    0x62, 0x09, 0x62, 0x0d, 0x62, 0x0c, 0x62, 0x14, 
+    0x62, 0x1b, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x62, 0x1e, 0x62, 0x21, 0x62, 0x2a, 0x62, 0x2e, 
+    0x62, 0x30, 0x62, 0x32, 0x62, 0x33, 0x62, 0x41, 
+    0x62, 0x4e, 0x62, 0x5e, 0x62, 0x63, 0x62, 0x5b, 
+    0x62, 0x60, 0x62, 0x68, 0x62, 0x7c, 0x62, 0x82, 
+    0x62, 0x89, 0x62, 0x7e, 0x62, 0x92, 0x62, 0x93, 
+    0x62, 0x96, 0x62, 0xd4, 0x62, 0x83, 0x62, 0x94, 
+    0x62, 0xd7, 0x62, 0xd1, 0x62, 0xbb, 0x62, 0xcf, 
+    0x62, 0xff, 0x62, 0xc6, 0x64, 0xd4, 0x62, 0xc8, 
+    0x62, 0xdc, 0x62, 0xcc, 0x62, 0xca, 0x62, 0xc2, 
+    0x62, 0xc7, 0x62, 0x9b, 0x62, 0xc9, 0x63, 0x0c, 
+    0x62, 0xee, 0x62, 0xf1, 0x63, 0x27, 0x63, 0x02, 
+    0x63, 0x08, 0x62, 0xef, 0x62, 0xf5, 0x63, 0x50, 
+    0x63, 0x3e, 0x63, 0x4d, 0x64, 0x1c, 0x63, 0x4f, 
+    0x63, 0x96, 0x63, 0x8e, 0x63, 0x80, 0x63, 0xab, 
+    0x63, 0x76, 0x63, 0xa3, 0x63, 0x8f, 0x63, 0x89, 
+    0x63, 0x9f, 0x63, 0xb5, 0x63, 0x6b, 0x00, 0x20, 
+    0x63, 0x69, 0x63, 0xbe, 0x63, 0xe9, 0x63, 0xc0, 
+    0x63, 0xc6, 0x63, 0xe3, 0x63, 0xc9, 0x63, 0xd2, 
+    0x63, 0xf6, 0x63, 0xc4, 0x64, 0x16, 0x64, 0x34, 
+    0x64, 0x06, 0x64, 0x13, 0x64, 0x26, 0x64, 0x36, 
+    0x65, 0x1d, 0x64, 0x17, 0x64, 0x28, 0x64, 0x0f, 
+    0x64, 0x67, 0x64, 0x6f, 0x64, 0x76, 0x64, 0x4e, 
+    0x65, 0x2a, 0x64, 0x95, 0x64, 0x93, 0x64, 0xa5, 
+    0x64, 0xa9, 0x64, 0x88, 0x64, 0xbc, 0x64, 0xda, 
+    0x64, 0xd2, 0x64, 0xc5, 0x64, 0xc7, 0x64, 0xbb, 
+    0x64, 0xd8, 0x64, 0xc2, 0x64, 0xf1, 0x64, 0xe7, 
+    0x82, 0x09, 0x64, 0xe0, 0x64, 0xe1, 0x62, 0xac, 
+    0x64, 0xe3, 0x64, 0xef, 0x65, 0x2c, 0x64, 0xf6, 
+    0x64, 0xf4, 0x64, 0xf2, 0x64, 0xfa, 0x65, 0x00, 
+    0x64, 0xfd, 0x65, 0x18, 0x65, 0x1c, 0x65, 0x05, 
+    0x65, 0x24, 0x65, 0x23, 0x65, 0x2b, 0x65, 0x34, 
+    0x65, 0x35, 0x65, 0x37, 0x65, 0x36, 0x65, 0x38, 
+    0x75, 0x4b, 0x65, 0x48, 0x65, 0x56, 0x65, 0x55, 
+    0x65, 0x4d, 0x65, 0x58, 0x65, 0x5e, 0x65, 0x5d, 
+    0x65, 0x72, 0x65, 0x78, 0x65, 0x82, 0x65, 0x83, 
+    0x8b, 0x8a, 0x65, 0x9b, 0x65, 0x9f, 0x65, 0xab, 
+    0x65, 0xb7, 0x65, 0xc3, 0x65, 0xc6, 0x65, 0xc1, 
+    0x65, 0xc4, 0x65, 0xcc, 0x65, 0xd2, 0x65, 0xdb, 
+    0x65, 0xd9, 0x65, 0xe0, 0x65, 0xe1, 0x65, 0xf1, 
+    0x67, 0x72, 0x66, 0x0a, 0x66, 0x03, 0x65, 0xfb, 
+    0x67, 0x73, 0x66, 0x35, 0x66, 0x36, 0x66, 0x34, 
+    0x66, 0x1c, 0x66, 0x4f, 0x66, 0x44, 0x66, 0x49, 
+    0x66, 0x41, 0x66, 0x5e, 0x66, 0x5d, 0x66, 0x64, 
+    0x66, 0x67, 0x66, 0x68, 0x66, 0x5f, 0x66, 0x62, 
+    0x66, 0x70, 0x66, 0x83, 0x66, 0x88, 0x66, 0x8e, 
+    0x66, 0x89, 0x66, 0x84, 0x66, 0x98, 0x66, 0x9d, 
+    0x66, 0xc1, 0x66, 0xb9, 0x66, 0xc9, 0x66, 0xbe, 
+    0x66, 0xbc, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x66, 0xc4, 0x66, 0xb8, 0x66, 0xd6, 0x66, 0xda, 
+    0x66, 0xe0, 0x66, 0x3f, 0x66, 0xe6, 0x66, 0xe9, 
+    0x66, 0xf0, 0x66, 0xf5, 0x66, 0xf7, 0x67, 0x0f, 
+    0x67, 0x16, 0x67, 0x1e, 0x67, 0x26, 0x67, 0x27, 
+    0x97, 0x38, 0x67, 0x2e, 0x67, 0x3f, 0x67, 0x36, 
+    0x67, 0x41, 0x67, 0x38, 0x67, 0x37, 0x67, 0x46, 
+    0x67, 0x5e, 0x67, 0x60, 0x67, 0x59, 0x67, 0x63, 
+    0x67, 0x64, 0x67, 0x89, 0x67, 0x70, 0x67, 0xa9, 
+    0x67, 0x7c, 0x67, 0x6a, 0x67, 0x8c, 0x67, 0x8b, 
+    0x67, 0xa6, 0x67, 0xa1, 0x67, 0x85, 0x67, 0xb7, 
+    0x67, 0xef, 0x67, 0xb4, 0x67, 0xec, 0x67, 0xb3, 
+    0x67, 0xe9, 0x67, 0xb8, 0x67, 0xe4, 0x67, 0xde, 
+    0x67, 0xdd, 0x67, 0xe2, 0x67, 0xee, 0x67, 0xb9, 
+    0x67, 0xce, 0x67, 0xc6, 0x67, 0xe7, 0x6a, 0x9c, 
+    0x68, 0x1e, 0x68, 0x46, 0x68, 0x29, 0x68, 0x40, 
+    0x68, 0x4d, 0x68, 0x32, 0x68, 0x4e, 0x00, 0x20, 
+    0x68, 0xb3, 0x68, 0x2b, 0x68, 0x59, 0x68, 0x63, 
+    0x68, 0x77, 0x68, 0x7f, 0x68, 0x9f, 0x68, 0x8f, 
+    0x68, 0xad, 0x68, 0x94, 0x68, 0x9d, 0x68, 0x9b, 
+    0x68, 0x83, 0x6a, 0xae, 0x68, 0xb9, 0x68, 0x74, 
+    0x68, 0xb5, 0x68, 0xa0, 0x68, 0xba, 0x69, 0x0f, 
+    0x68, 0x8d, 0x68, 0x7e, 0x69, 0x01, 0x68, 0xca, 
+    0x69, 0x08, 0x68, 0xd8, 0x69, 0x22, 0x69, 0x26, 
+    0x68, 0xe1, 0x69, 0x0c, 0x68, 0xcd, 0x68, 0xd4, 
+    0x68, 0xe7, 0x68, 0xd5, 0x69, 0x36, 0x69, 0x12, 
+    0x69, 0x04, 0x68, 0xd7, 0x68, 0xe3, 0x69, 0x25, 
+    0x68, 0xf9, 0x68, 0xe0, 0x68, 0xef, 0x69, 0x28, 
+    0x69, 0x2a, 0x69, 0x1a, 0x69, 0x23, 0x69, 0x21, 
+    0x68, 0xc6, 0x69, 0x79, 0x69, 0x77, 0x69, 0x5c, 
+    0x69, 0x78, 0x69, 0x6b, 0x69, 0x54, 0x69, 0x7e, 
+    0x69, 0x6e, 0x69, 0x39, 0x69, 0x74, 0x69, 0x3d, 
+    0x69, 0x59, 0x69, 0x30, 0x69, 0x61, 0x69, 0x5e, 
+    0x69, 0x5d, 0x69, 0x81, 0x69, 0x6a, 0x69, 0xb2, 
+    0x69, 0xae, 0x69, 0xd0, 0x69, 0xbf, 0x69, 0xc1, 
+    0x69, 0xd3, 0x69, 0xbe, 0x69, 0xce, 0x5b, 0xe8, 
+    0x69, 0xca, 0x69, 0xdd, 0x69, 0xbb, 0x69, 0xc3, 
+    0x69, 0xa7, 0x6a, 0x2e, 0x69, 0x91, 0x69, 0xa0, 
+    0x69, 0x9c, 0x69, 0x95, 0x69, 0xb4, 0x69, 0xde, 
+    0x69, 0xe8, 0x6a, 0x02, 0x6a, 0x1b, 0x69, 0xff, 
+    0x6b, 0x0a, 0x69, 0xf9, 0x69, 0xf2, 0x69, 0xe7, 
+    0x6a, 0x05, 0x69, 0xb1, 0x6a, 0x1e, 0x69, 0xed, 
+    0x6a, 0x14, 0x69, 0xeb, 0x6a, 0x0a, 0x6a, 0x12, 
+    0x6a, 0xc1, 0x6a, 0x23, 0x6a, 0x13, 0x6a, 0x44, 
+    0x6a, 0x0c, 0x6a, 0x72, 0x6a, 0x36, 0x6a, 0x78, 
+    0x6a, 0x47, 0x6a, 0x62, 0x6a, 0x59, 0x6a, 0x66, 
+    0x6a, 0x48, 0x6a, 0x38, 0x6a, 0x22, 0x6a, 0x90, 
+    0x6a, 0x8d, 0x6a, 0xa0, 0x6a, 0x84, 0x6a, 0xa2, 
+    0x6a, 0xa3, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x6a, 0x97, 0x86, 0x17, 0x6a, 0xbb, 0x6a, 0xc3, 
+    0x6a, 0xc2, 0x6a, 0xb8, 0x6a, 0xb3, 0x6a, 0xac, 
+    0x6a, 0xde, 0x6a, 0xd1, 0x6a, 0xdf, 0x6a, 0xaa, 
+    0x6a, 0xda, 0x6a, 0xea, 0x6a, 0xfb, 0x6b, 0x05, 
+    0x86, 0x16, 0x6a, 0xfa, 0x6b, 0x12, 0x6b, 0x16, 
+    0x9b, 0x31, 0x6b, 0x1f, 0x6b, 0x38, 0x6b, 0x37, 
+    0x76, 0xdc, 0x6b, 0x39, 0x98, 0xee, 0x6b, 0x47, 
+    0x6b, 0x43, 0x6b, 0x49, 0x6b, 0x50, 0x6b, 0x59, 
+    0x6b, 0x54, 0x6b, 0x5b, 0x6b, 0x5f, 0x6b, 0x61, 
+    0x6b, 0x78, 0x6b, 0x79, 0x6b, 0x7f, 0x6b, 0x80, 
+    0x6b, 0x84, 0x6b, 0x83, 0x6b, 0x8d, 0x6b, 0x98, 
+    0x6b, 0x95, 0x6b, 0x9e, 0x6b, 0xa4, 0x6b, 0xaa, 
+    0x6b, 0xab, 0x6b, 0xaf, 0x6b, 0xb2, 0x6b, 0xb1, 
+    0x6b, 0xb3, 0x6b, 0xb7, 0x6b, 0xbc, 0x6b, 0xc6, 
+    0x6b, 0xcb, 0x6b, 0xd3, 0x6b, 0xdf, 0x6b, 0xec, 
+    0x6b, 0xeb, 0x6b, 0xf3, 0x6b, 0xef, 0x00, 0x20, 
+    0x9e, 0xbe, 0x6c, 0x08, 0x6c, 0x13, 0x6c, 0x14, 
+    0x6c, 0x1b, 0x6c, 0x24, 0x6c, 0x23, 0x6c, 0x5e, 
+    0x6c, 0x55, 0x6c, 0x62, 0x6c, 0x6a, 0x6c, 0x82, 
+    0x6c, 0x8d, 0x6c, 0x9a, 0x6c, 0x81, 0x6c, 0x9b, 
+    0x6c, 0x7e, 0x6c, 0x68, 0x6c, 0x73, 0x6c, 0x92, 
+    0x6c, 0x90, 0x6c, 0xc4, 0x6c, 0xf1, 0x6c, 0xd3, 
+    0x6c, 0xbd, 0x6c, 0xd7, 0x6c, 0xc5, 0x6c, 0xdd, 
+    0x6c, 0xae, 0x6c, 0xb1, 0x6c, 0xbe, 0x6c, 0xba, 
+    0x6c, 0xdb, 0x6c, 0xef, 0x6c, 0xd9, 0x6c, 0xea, 
+    0x6d, 0x1f, 0x88, 0x4d, 0x6d, 0x36, 0x6d, 0x2b, 
+    0x6d, 0x3d, 0x6d, 0x38, 0x6d, 0x19, 0x6d, 0x35, 
+    0x6d, 0x33, 0x6d, 0x12, 0x6d, 0x0c, 0x6d, 0x63, 
+    0x6d, 0x93, 0x6d, 0x64, 0x6d, 0x5a, 0x6d, 0x79, 
+    0x6d, 0x59, 0x6d, 0x8e, 0x6d, 0x95, 0x6f, 0xe4, 
+    0x6d, 0x85, 0x6d, 0xf9, 0x6e, 0x15, 0x6e, 0x0a, 
+    0x6d, 0xb5, 0x6d, 0xc7, 0x6d, 0xe6, 0x6d, 0xb8, 
+    0x6d, 0xc6, 0x6d, 0xec, 0x6d, 0xde, 0x6d, 0xcc, 
+    0x6d, 0xe8, 0x6d, 0xd2, 0x6d, 0xc5, 0x6d, 0xfa, 
+    0x6d, 0xd9, 0x6d, 0xe4, 0x6d, 0xd5, 0x6d, 0xea, 
+    0x6d, 0xee, 0x6e, 0x2d, 0x6e, 0x6e, 0x6e, 0x2e, 
+    0x6e, 0x19, 0x6e, 0x72, 0x6e, 0x5f, 0x6e, 0x3e, 
+    0x6e, 0x23, 0x6e, 0x6b, 0x6e, 0x2b, 0x6e, 0x76, 
+    0x6e, 0x4d, 0x6e, 0x1f, 0x6e, 0x43, 0x6e, 0x3a, 
+    0x6e, 0x4e, 0x6e, 0x24, 0x6e, 0xff, 0x6e, 0x1d, 
+    0x6e, 0x38, 0x6e, 0x82, 0x6e, 0xaa, 0x6e, 0x98, 
+    0x6e, 0xc9, 0x6e, 0xb7, 0x6e, 0xd3, 0x6e, 0xbd, 
+    0x6e, 0xaf, 0x6e, 0xc4, 0x6e, 0xb2, 0x6e, 0xd4, 
+    0x6e, 0xd5, 0x6e, 0x8f, 0x6e, 0xa5, 0x6e, 0xc2, 
+    0x6e, 0x9f, 0x6f, 0x41, 0x6f, 0x11, 0x70, 0x4c, 
+    0x6e, 0xec, 0x6e, 0xf8, 0x6e, 0xfe, 0x6f, 0x3f, 
+    0x6e, 0xf2, 0x6f, 0x31, 0x6e, 0xef, 0x6f, 0x32, 
+    0x6e, 0xcc, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x6f, 0x3e, 0x6f, 0x13, 0x6e, 0xf7, 0x6f, 0x86, 
+    0x6f, 0x7a, 0x6f, 0x78, 0x6f, 0x81, 0x6f, 0x80, 
+    0x6f, 0x6f, 0x6f, 0x5b, 0x6f, 0xf3, 0x6f, 0x6d, 
+    0x6f, 0x82, 0x6f, 0x7c, 0x6f, 0x58, 0x6f, 0x8e, 
+    0x6f, 0x91, 0x6f, 0xc2, 0x6f, 0x66, 0x6f, 0xb3, 
+    0x6f, 0xa3, 0x6f, 0xa1, 0x6f, 0xa4, 0x6f, 0xb9, 
+    0x6f, 0xc6, 0x6f, 0xaa, 0x6f, 0xdf, 0x6f, 0xd5, 
+    0x6f, 0xec, 0x6f, 0xd4, 0x6f, 0xd8, 0x6f, 0xf1, 
+    0x6f, 0xee, 0x6f, 0xdb, 0x70, 0x09, 0x70, 0x0b, 
+    0x6f, 0xfa, 0x70, 0x11, 0x70, 0x01, 0x70, 0x0f, 
+    0x6f, 0xfe, 0x70, 0x1b, 0x70, 0x1a, 0x6f, 0x74, 
+    0x70, 0x1d, 0x70, 0x18, 0x70, 0x1f, 0x70, 0x30, 
+    0x70, 0x3e, 0x70, 0x32, 0x70, 0x51, 0x70, 0x63, 
+    0x70, 0x99, 0x70, 0x92, 0x70, 0xaf, 0x70, 0xf1, 
+    0x70, 0xac, 0x70, 0xb8, 0x70, 0xb3, 0x70, 0xae, 
+    0x70, 0xdf, 0x70, 0xcb, 0x70, 0xdd, 0x00, 0x20, 
+    0x70, 0xd9, 0x71, 0x09, 0x70, 0xfd, 0x71, 0x1c, 
+    0x71, 0x19, 0x71, 0x65, 0x71, 0x55, 0x71, 0x88, 
+    0x71, 0x66, 0x71, 0x62, 0x71, 0x4c, 0x71, 0x56, 
+    0x71, 0x6c, 0x71, 0x8f, 0x71, 0xfb, 0x71, 0x84, 
+    0x71, 0x95, 0x71, 0xa8, 0x71, 0xac, 0x71, 0xd7, 
+    0x71, 0xb9, 0x71, 0xbe, 0x71, 0xd2, 0x71, 0xc9, 
+    0x71, 0xd4, 0x71, 0xce, 0x71, 0xe0, 0x71, 0xec, 
+    0x71, 0xe7, 0x71, 0xf5, 0x71, 0xfc, 0x71, 0xf9, 
+    0x71, 0xff, 0x72, 0x0d, 0x72, 0x10, 0x72, 0x1b, 
+    0x72, 0x28, 0x72, 0x2d, 0x72, 0x2c, 0x72, 0x30, 
+    0x72, 0x32, 0x72, 0x3b, 0x72, 0x3c, 0x72, 0x3f, 
+    0x72, 0x40, 0x72, 0x46, 0x72, 0x4b, 0x72, 0x58, 
+    0x72, 0x74, 0x72, 0x7e, 0x72, 0x82, 0x72, 0x81, 
+    0x72, 0x87, 0x72, 0x92, 0x72, 0x96, 0x72, 0xa2, 
+    0x72, 0xa7, 0x72, 0xb9, 0x72, 0xb2, 0x72, 0xc3, 
+    0x72, 0xc6, 0x72, 0xc4, 0x72, 0xce, 0x72, 0xd2, 
+    0x72, 0xe2, 0x72, 0xe0, 0x72, 0xe1, 0x72, 0xf9, 
+    0x72, 0xf7, 0x50, 0x0f, 0x73, 0x17, 0x73, 0x0a, 
+    0x73, 0x1c, 0x73, 0x16, 0x73, 0x1d, 0x73, 0x34, 
+    0x73, 0x2f, 0x73, 0x29, 0x73, 0x25, 0x73, 0x3e, 
+    0x73, 0x4e, 0x73, 0x4f, 0x9e, 0xd8, 0x73, 0x57, 
+    0x73, 0x6a, 0x73, 0x68, 0x73, 0x70, 0x73, 0x78, 
+    0x73, 0x75, 0x73, 0x7b, 0x73, 0x7a, 0x73, 0xc8, 
+    0x73, 0xb3, 0x73, 0xce, 0x73, 0xbb, 0x73, 0xc0, 
+    0x73, 0xe5, 0x73, 0xee, 0x73, 0xde, 0x74, 0xa2, 
+    0x74, 0x05, 0x74, 0x6f, 0x74, 0x25, 0x73, 0xf8, 
+    0x74, 0x32, 0x74, 0x3a, 0x74, 0x55, 0x74, 0x3f, 
+    0x74, 0x5f, 0x74, 0x59, 0x74, 0x41, 0x74, 0x5c, 
+    0x74, 0x69, 0x74, 0x70, 0x74, 0x63, 0x74, 0x6a, 
+    0x74, 0x76, 0x74, 0x7e, 0x74, 0x8b, 0x74, 0x9e, 
+    0x74, 0xa7, 0x74, 0xca, 0x74, 0xcf, 0x74, 0xd4, 
+    0x73, 0xf1, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x74, 0xe0, 0x74, 0xe3, 0x74, 0xe7, 0x74, 0xe9, 
+    0x74, 0xee, 0x74, 0xf2, 0x74, 0xf0, 0x74, 0xf1, 
+    0x74, 0xf8, 0x74, 0xf7, 0x75, 0x04, 0x75, 0x03, 
+    0x75, 0x05, 0x75, 0x0c, 0x75, 0x0e, 0x75, 0x0d, 
+    0x75, 0x15, 0x75, 0x13, 0x75, 0x1e, 0x75, 0x26, 
+    0x75, 0x2c, 0x75, 0x3c, 0x75, 0x44, 0x75, 0x4d, 
+    0x75, 0x4a, 0x75, 0x49, 0x75, 0x5b, 0x75, 0x46, 
+    0x75, 0x5a, 0x75, 0x69, 0x75, 0x64, 0x75, 0x67, 
+    0x75, 0x6b, 0x75, 0x6d, 0x75, 0x78, 0x75, 0x76, 
+    0x75, 0x86, 0x75, 0x87, 0x75, 0x74, 0x75, 0x8a, 
+    0x75, 0x89, 0x75, 0x82, 0x75, 0x94, 0x75, 0x9a, 
+    0x75, 0x9d, 0x75, 0xa5, 0x75, 0xa3, 0x75, 0xc2, 
+    0x75, 0xb3, 0x75, 0xc3, 0x75, 0xb5, 0x75, 0xbd, 
+    0x75, 0xb8, 0x75, 0xbc, 0x75, 0xb1, 0x75, 0xcd, 
+    0x75, 0xca, 0x75, 0xd2, 0x75, 0xd9, 0x75, 0xe3, 
+    0x75, 0xde, 0x75, 0xfe, 0x75, 0xff, 0x00, 0x20, 
+    0x75, 0xfc, 0x76, 0x01, 0x75, 0xf0, 0x75, 0xfa, 
+    0x75, 0xf2, 0x75, 0xf3, 0x76, 0x0b, 0x76, 0x0d, 
+    0x76, 0x09, 0x76, 0x1f, 0x76, 0x27, 0x76, 0x20, 
+    0x76, 0x21, 0x76, 0x22, 0x76, 0x24, 0x76, 0x34, 
+    0x76, 0x30, 0x76, 0x3b, 0x76, 0x47, 0x76, 0x48, 
+    0x76, 0x46, 0x76, 0x5c, 0x76, 0x58, 0x76, 0x61, 
+    0x76, 0x62, 0x76, 0x68, 0x76, 0x69, 0x76, 0x6a, 
+    0x76, 0x67, 0x76, 0x6c, 0x76, 0x70, 0x76, 0x72, 
+    0x76, 0x76, 0x76, 0x78, 0x76, 0x7c, 0x76, 0x80, 
+    0x76, 0x83, 0x76, 0x88, 0x76, 0x8b, 0x76, 0x8e, 
+    0x76, 0x96, 0x76, 0x93, 0x76, 0x99, 0x76, 0x9a, 
+    0x76, 0xb0, 0x76, 0xb4, 0x76, 0xb8, 0x76, 0xb9, 
+    0x76, 0xba, 0x76, 0xc2, 0x76, 0xcd, 0x76, 0xd6, 
+    0x76, 0xd2, 0x76, 0xde, 0x76, 0xe1, 0x76, 0xe5, 
+    0x76, 0xe7, 0x76, 0xea, 0x86, 0x2f, 0x76, 0xfb, 
+    0x77, 0x08, 0x77, 0x07, 0x77, 0x04, 0x77, 0x29, 
+    0x77, 0x24, 0x77, 0x1e, 0x77, 0x25, 0x77, 0x26, 
+    0x77, 0x1b, 0x77, 0x37, 0x77, 0x38, 0x77, 0x47, 
+    0x77, 0x5a, 0x77, 0x68, 0x77, 0x6b, 0x77, 0x5b, 
+    0x77, 0x65, 0x77, 0x7f, 0x77, 0x7e, 0x77, 0x79, 
+    0x77, 0x8e, 0x77, 0x8b, 0x77, 0x91, 0x77, 0xa0, 
+    0x77, 0x9e, 0x77, 0xb0, 0x77, 0xb6, 0x77, 0xb9, 
+    0x77, 0xbf, 0x77, 0xbc, 0x77, 0xbd, 0x77, 0xbb, 
+    0x77, 0xc7, 0x77, 0xcd, 0x77, 0xd7, 0x77, 0xda, 
+    0x77, 0xdc, 0x77, 0xe3, 0x77, 0xee, 0x77, 0xfc, 
+    0x78, 0x0c, 0x78, 0x12, 0x79, 0x26, 0x78, 0x20, 
+    0x79, 0x2a, 0x78, 0x45, 0x78, 0x8e, 0x78, 0x74, 
+    0x78, 0x86, 0x78, 0x7c, 0x78, 0x9a, 0x78, 0x8c, 
+    0x78, 0xa3, 0x78, 0xb5, 0x78, 0xaa, 0x78, 0xaf, 
+    0x78, 0xd1, 0x78, 0xc6, 0x78, 0xcb, 0x78, 0xd4, 
+    0x78, 0xbe, 0x78, 0xbc, 0x78, 0xc5, 0x78, 0xca, 
+    0x78, 0xec, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x78, 0xe7, 0x78, 0xda, 0x78, 0xfd, 0x78, 0xf4, 
+    0x79, 0x07, 0x79, 0x12, 0x79, 0x11, 0x79, 0x19, 
+    0x79, 0x2c, 0x79, 0x2b, 0x79, 0x40, 0x79, 0x60, 
+    0x79, 0x57, 0x79, 0x5f, 0x79, 0x5a, 0x79, 0x55, 
+    0x79, 0x53, 0x79, 0x7a, 0x79, 0x7f, 0x79, 0x8a, 
+    0x79, 0x9d, 0x79, 0xa7, 0x9f, 0x4b, 0x79, 0xaa, 
+    0x79, 0xae, 0x79, 0xb3, 0x79, 0xb9, 0x79, 0xba, 
+    0x79, 0xc9, 0x79, 0xd5, 0x79, 0xe7, 0x79, 0xec, 
+    0x79, 0xe1, 0x79, 0xe3, 0x7a, 0x08, 0x7a, 0x0d, 
+    0x7a, 0x18, 0x7a, 0x19, 0x7a, 0x20, 0x7a, 0x1f, 
+    0x79, 0x80, 0x7a, 0x31, 0x7a, 0x3b, 0x7a, 0x3e, 
+    0x7a, 0x37, 0x7a, 0x43, 0x7a, 0x57, 0x7a, 0x49, 
+    0x7a, 0x61, 0x7a, 0x62, 0x7a, 0x69, 0x9f, 0x9d, 
+    0x7a, 0x70, 0x7a, 0x79, 0x7a, 0x7d, 0x7a, 0x88, 
+    0x7a, 0x97, 0x7a, 0x95, 0x7a, 0x98, 0x7a, 0x96, 
+    0x7a, 0xa9, 0x7a, 0xc8, 0x7a, 0xb0, 0x00, 0x20, 
+    0x7a, 0xb6, 0x7a, 0xc5, 0x7a, 0xc4, 0x7a, 0xbf, 
+    0x90, 0x83, 0x7a, 0xc7, 0x7a, 0xca, 0x7a, 0xcd, 
+    0x7a, 0xcf, 0x7a, 0xd5, 0x7a, 0xd3, 0x7a, 0xd9, 
+    0x7a, 0xda, 0x7a, 0xdd, 0x7a, 0xe1, 0x7a, 0xe2, 
+    0x7a, 0xe6, 0x7a, 0xed, 0x7a, 0xf0, 0x7b, 0x02, 
+    0x7b, 0x0f, 0x7b, 0x0a, 0x7b, 0x06, 0x7b, 0x33, 
+    0x7b, 0x18, 0x7b, 0x19, 0x7b, 0x1e, 0x7b, 0x35, 
+    0x7b, 0x28, 0x7b, 0x36, 0x7b, 0x50, 0x7b, 0x7a, 
+    0x7b, 0x04, 0x7b, 0x4d, 0x7b, 0x0b, 0x7b, 0x4c, 
+    0x7b, 0x45, 0x7b, 0x75, 0x7b, 0x65, 0x7b, 0x74, 
+    0x7b, 0x67, 0x7b, 0x70, 0x7b, 0x71, 0x7b, 0x6c, 
+    0x7b, 0x6e, 0x7b, 0x9d, 0x7b, 0x98, 0x7b, 0x9f, 
+    0x7b, 0x8d, 0x7b, 0x9c, 0x7b, 0x9a, 0x7b, 0x8b, 
+    0x7b, 0x92, 0x7b, 0x8f, 0x7b, 0x5d, 0x7b, 0x99, 
+    0x7b, 0xcb, 0x7b, 0xc1, 0x7b, 0xcc, 0x7b, 0xcf, 
+    0x7b, 0xb4, 0x7b, 0xc6, 0x7b, 0xdd, 0x7b, 0xe9, 
+    0x7c, 0x11, 0x7c, 0x14, 0x7b, 0xe6, 0x7b, 0xe5, 
+    0x7c, 0x60, 0x7c, 0x00, 0x7c, 0x07, 0x7c, 0x13, 
+    0x7b, 0xf3, 0x7b, 0xf7, 0x7c, 0x17, 0x7c, 0x0d, 
+    0x7b, 0xf6, 0x7c, 0x23, 0x7c, 0x27, 0x7c, 0x2a, 
+    0x7c, 0x1f, 0x7c, 0x37, 0x7c, 0x2b, 0x7c, 0x3d, 
+    0x7c, 0x4c, 0x7c, 0x43, 0x7c, 0x54, 0x7c, 0x4f, 
+    0x7c, 0x40, 0x7c, 0x50, 0x7c, 0x58, 0x7c, 0x5f, 
+    0x7c, 0x64, 0x7c, 0x56, 0x7c, 0x65, 0x7c, 0x6c, 
+    0x7c, 0x75, 0x7c, 0x83, 0x7c, 0x90, 0x7c, 0xa4, 
+    0x7c, 0xad, 0x7c, 0xa2, 0x7c, 0xab, 0x7c, 0xa1, 
+    0x7c, 0xa8, 0x7c, 0xb3, 0x7c, 0xb2, 0x7c, 0xb1, 
+    0x7c, 0xae, 0x7c, 0xb9, 0x7c, 0xbd, 0x7c, 0xc0, 
+    0x7c, 0xc5, 0x7c, 0xc2, 0x7c, 0xd8, 0x7c, 0xd2, 
+    0x7c, 0xdc, 0x7c, 0xe2, 0x9b, 0x3b, 0x7c, 0xef, 
+    0x7c, 0xf2, 0x7c, 0xf4, 0x7c, 0xf6, 0x7c, 0xfa, 
+    0x7d, 0x06, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x7d, 0x02, 0x7d, 0x1c, 0x7d, 0x15, 0x7d, 0x0a, 
+    0x7d, 0x45, 0x7d, 0x4b, 0x7d, 0x2e, 0x7d, 0x32, 
+    0x7d, 0x3f, 0x7d, 0x35, 0x7d, 0x46, 0x7d, 0x73, 
+    0x7d, 0x56, 0x7d, 0x4e, 0x7d, 0x72, 0x7d, 0x68, 
+    0x7d, 0x6e, 0x7d, 0x4f, 0x7d, 0x63, 0x7d, 0x93, 
+    0x7d, 0x89, 0x7d, 0x5b, 0x7d, 0x8f, 0x7d, 0x7d, 
+    0x7d, 0x9b, 0x7d, 0xba, 0x7d, 0xae, 0x7d, 0xa3, 
+    0x7d, 0xb5, 0x7d, 0xc7, 0x7d, 0xbd, 0x7d, 0xab, 
+    0x7e, 0x3d, 0x7d, 0xa2, 0x7d, 0xaf, 0x7d, 0xdc, 
+    0x7d, 0xb8, 0x7d, 0x9f, 0x7d, 0xb0, 0x7d, 0xd8, 
+    0x7d, 0xdd, 0x7d, 0xe4, 0x7d, 0xde, 0x7d, 0xfb, 
+    0x7d, 0xf2, 0x7d, 0xe1, 0x7e, 0x05, 0x7e, 0x0a, 
+    0x7e, 0x23, 0x7e, 0x21, 0x7e, 0x12, 0x7e, 0x31, 
+    0x7e, 0x1f, 0x7e, 0x09, 0x7e, 0x0b, 0x7e, 0x22, 
+    0x7e, 0x46, 0x7e, 0x66, 0x7e, 0x3b, 0x7e, 0x35, 
+    0x7e, 0x39, 0x7e, 0x43, 0x7e, 0x37, 0x00, 0x20, 
+    0x7e, 0x32, 0x7e, 0x3a, 0x7e, 0x67, 0x7e, 0x5d, 
+    0x7e, 0x56, 0x7e, 0x5e, 0x7e, 0x59, 0x7e, 0x5a, 
+    0x7e, 0x79, 0x7e, 0x6a, 0x7e, 0x69, 0x7e, 0x7c, 
+    0x7e, 0x7b, 0x7e, 0x83, 0x7d, 0xd5, 0x7e, 0x7d, 
+    0x8f, 0xae, 0x7e, 0x7f, 0x7e, 0x88, 0x7e, 0x89, 
+    0x7e, 0x8c, 0x7e, 0x92, 0x7e, 0x90, 0x7e, 0x93, 
+    0x7e, 0x94, 0x7e, 0x96, 0x7e, 0x8e, 0x7e, 0x9b, 
+    0x7e, 0x9c, 0x7f, 0x38, 0x7f, 0x3a, 0x7f, 0x45, 
+    0x7f, 0x4c, 0x7f, 0x4d, 0x7f, 0x4e, 0x7f, 0x50, 
+    0x7f, 0x51, 0x7f, 0x55, 0x7f, 0x54, 0x7f, 0x58, 
+    0x7f, 0x5f, 0x7f, 0x60, 0x7f, 0x68, 0x7f, 0x69, 
+    0x7f, 0x67, 0x7f, 0x78, 0x7f, 0x82, 0x7f, 0x86, 
+    0x7f, 0x83, 0x7f, 0x88, 0x7f, 0x87, 0x7f, 0x8c, 
+    0x7f, 0x94, 0x7f, 0x9e, 0x7f, 0x9d, 0x7f, 0x9a, 
+    0x7f, 0xa3, 0x7f, 0xaf, 0x7f, 0xb2, 0x7f, 0xb9, 
+    0x7f, 0xae, 0x7f, 0xb6, 0x7f, 0xb8, 0x8b, 0x71, 
+    0x7f, 0xc5, 0x7f, 0xc6, 0x7f, 0xca, 0x7f, 0xd5, 
+    0x7f, 0xd4, 0x7f, 0xe1, 0x7f, 0xe6, 0x7f, 0xe9, 
+    0x7f, 0xf3, 0x7f, 0xf9, 0x98, 0xdc, 0x80, 0x06, 
+    0x80, 0x04, 0x80, 0x0b, 0x80, 0x12, 0x80, 0x18, 
+    0x80, 0x19, 0x80, 0x1c, 0x80, 0x21, 0x80, 0x28, 
+    0x80, 0x3f, 0x80, 0x3b, 0x80, 0x4a, 0x80, 0x46, 
+    0x80, 0x52, 0x80, 0x58, 0x80, 0x5a, 0x80, 0x5f, 
+    0x80, 0x62, 0x80, 0x68, 0x80, 0x73, 0x80, 0x72, 
+    0x80, 0x70, 0x80, 0x76, 0x80, 0x79, 0x80, 0x7d, 
+    0x80, 0x7f, 0x80, 0x84, 0x80, 0x86, 0x80, 0x85, 
+    0x80, 0x9b, 0x80, 0x93, 0x80, 0x9a, 0x80, 0xad, 
+    0x51, 0x90, 0x80, 0xac, 0x80, 0xdb, 0x80, 0xe5, 
+    0x80, 0xd9, 0x80, 0xdd, 0x80, 0xc4, 0x80, 0xda, 
+    0x80, 0xd6, 0x81, 0x09, 0x80, 0xef, 0x80, 0xf1, 
+    0x81, 0x1b, 0x81, 0x29, 0x81, 0x23, 0x81, 0x2f, 
+    0x81, 0x4b, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x96, 0x8b, 0x81, 0x46, 0x81, 0x3e, 0x81, 0x53, 
+    0x81, 0x51, 0x80, 0xfc, 0x81, 0x71, 0x81, 0x6e, 
+    0x81, 0x65, 0x81, 0x66, 0x81, 0x74, 0x81, 0x83, 
+    0x81, 0x88, 0x81, 0x8a, 0x81, 0x80, 0x81, 0x82, 
+    0x81, 0xa0, 0x81, 0x95, 0x81, 0xa4, 0x81, 0xa3, 
+    0x81, 0x5f, 0x81, 0x93, 0x81, 0xa9, 0x81, 0xb0, 
+    0x81, 0xb5, 0x81, 0xbe, 0x81, 0xb8, 0x81, 0xbd, 
+    0x81, 0xc0, 0x81, 0xc2, 0x81, 0xba, 0x81, 0xc9, 
+    0x81, 0xcd, 0x81, 0xd1, 0x81, 0xd9, 0x81, 0xd8, 
+    0x81, 0xc8, 0x81, 0xda, 0x81, 0xdf, 0x81, 0xe0, 
+    0x81, 0xe7, 0x81, 0xfa, 0x81, 0xfb, 0x81, 0xfe, 
+    0x82, 0x01, 0x82, 0x02, 0x82, 0x05, 0x82, 0x07, 
+    0x82, 0x0a, 0x82, 0x0d, 0x82, 0x10, 0x82, 0x16, 
+    0x82, 0x29, 0x82, 0x2b, 0x82, 0x38, 0x82, 0x33, 
+    0x82, 0x40, 0x82, 0x59, 0x82, 0x58, 0x82, 0x5d, 
+    0x82, 0x5a, 0x82, 0x5f, 0x82, 0x64, 0x00, 0x20, 
+    0x82, 0x62, 0x82, 0x68, 0x82, 0x6a, 0x82, 0x6b, 
+    0x82, 0x2e, 0x82, 0x71, 0x82, 0x77, 0x82, 0x78, 
+    0x82, 0x7e, 0x82, 0x8d, 0x82, 0x92, 0x82, 0xab, 
+    0x82, 0x9f, 0x82, 0xbb, 0x82, 0xac, 0x82, 0xe1, 
+    0x82, 0xe3, 0x82, 0xdf, 0x82, 0xd2, 0x82, 0xf4, 
+    0x82, 0xf3, 0x82, 0xfa, 0x83, 0x93, 0x83, 0x03, 
+    0x82, 0xfb, 0x82, 0xf9, 0x82, 0xde, 0x83, 0x06, 
+    0x82, 0xdc, 0x83, 0x09, 0x82, 0xd9, 0x83, 0x35, 
+    0x83, 0x34, 0x83, 0x16, 0x83, 0x32, 0x83, 0x31, 
+    0x83, 0x40, 0x83, 0x39, 0x83, 0x50, 0x83, 0x45, 
+    0x83, 0x2f, 0x83, 0x2b, 0x83, 0x17, 0x83, 0x18, 
+    0x83, 0x85, 0x83, 0x9a, 0x83, 0xaa, 0x83, 0x9f, 
+    0x83, 0xa2, 0x83, 0x96, 0x83, 0x23, 0x83, 0x8e, 
+    0x83, 0x87, 0x83, 0x8a, 0x83, 0x7c, 0x83, 0xb5, 
+    0x83, 0x73, 0x83, 0x75, 0x83, 0xa0, 0x83, 0x89, 
+    0x83, 0xa8, 0x83, 0xf4, 0x84, 0x13, 0x83, 0xeb, 
+    0x83, 0xce, 0x83, 0xfd, 0x84, 0x03, 0x83, 0xd8, 
+    0x84, 0x0b, 0x83, 0xc1, 0x83, 0xf7, 0x84, 0x07, 
+    0x83, 0xe0, 0x83, 0xf2, 0x84, 0x0d, 0x84, 0x22, 
+    0x84, 0x20, 0x83, 0xbd, 0x84, 0x38, 0x85, 0x06, 
+    0x83, 0xfb, 0x84, 0x6d, 0x84, 0x2a, 0x84, 0x3c, 
+    0x85, 0x5a, 0x84, 0x84, 0x84, 0x77, 0x84, 0x6b, 
+    0x84, 0xad, 0x84, 0x6e, 0x84, 0x82, 0x84, 0x69, 
+    0x84, 0x46, 0x84, 0x2c, 0x84, 0x6f, 0x84, 0x79, 
+    0x84, 0x35, 0x84, 0xca, 0x84, 0x62, 0x84, 0xb9, 
+    0x84, 0xbf, 0x84, 0x9f, 0x84, 0xd9, 0x84, 0xcd, 
+    0x84, 0xbb, 0x84, 0xda, 0x84, 0xd0, 0x84, 0xc1, 
+    0x84, 0xc6, 0x84, 0xd6, 0x84, 0xa1, 0x85, 0x21, 
+    0x84, 0xff, 0x84, 0xf4, 0x85, 0x17, 0x85, 0x18, 
+    0x85, 0x2c, 0x85, 0x1f, 0x85, 0x15, 0x85, 0x14, 
+    0x84, 0xfc, 0x85, 0x40, 0x85, 0x63, 0x85, 0x58, 
+    0x85, 0x48, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x85, 0x41, 0x86, 0x02, 0x85, 0x4b, 0x85, 0x55, 
+    0x85, 0x80, 0x85, 0xa4, 0x85, 0x88, 0x85, 0x91, 
+    0x85, 0x8a, 0x85, 0xa8, 0x85, 0x6d, 0x85, 0x94, 
+    0x85, 0x9b, 0x85, 0xea, 0x85, 0x87, 0x85, 0x9c, 
+    0x85, 0x77, 0x85, 0x7e, 0x85, 0x90, 0x85, 0xc9, 
+    0x85, 0xba, 0x85, 0xcf, 0x85, 0xb9, 0x85, 0xd0, 
+    0x85, 0xd5, 0x85, 0xdd, 0x85, 0xe5, 0x85, 0xdc, 
+    0x85, 0xf9, 0x86, 0x0a, 0x86, 0x13, 0x86, 0x0b, 
+    0x85, 0xfe, 0x85, 0xfa, 0x86, 0x06, 0x86, 0x22, 
+    0x86, 0x1a, 0x86, 0x30, 0x86, 0x3f, 0x86, 0x4d, 
+    0x4e, 0x55, 0x86, 0x54, 0x86, 0x5f, 0x86, 0x67, 
+    0x86, 0x71, 0x86, 0x93, 0x86, 0xa3, 0x86, 0xa9, 
+    0x86, 0xaa, 0x86, 0x8b, 0x86, 0x8c, 0x86, 0xb6, 
+    0x86, 0xaf, 0x86, 0xc4, 0x86, 0xc6, 0x86, 0xb0, 
+    0x86, 0xc9, 0x88, 0x23, 0x86, 0xab, 0x86, 0xd4, 
+    0x86, 0xde, 0x86, 0xe9, 0x86, 0xec, 0x00, 0x20, 
+    0x86, 0xdf, 0x86, 0xdb, 0x86, 0xef, 0x87, 0x12, 
+    0x87, 0x06, 0x87, 0x08, 0x87, 0x00, 0x87, 0x03, 
+    0x86, 0xfb, 0x87, 0x11, 0x87, 0x09, 0x87, 0x0d, 
+    0x86, 0xf9, 0x87, 0x0a, 0x87, 0x34, 0x87, 0x3f, 
+    0x87, 0x37, 0x87, 0x3b, 0x87, 0x25, 0x87, 0x29, 
+    0x87, 0x1a, 0x87, 0x60, 0x87, 0x5f, 0x87, 0x78, 
+    0x87, 0x4c, 0x87, 0x4e, 0x87, 0x74, 0x87, 0x57, 
+    0x87, 0x68, 0x87, 0x6e, 0x87, 0x59, 0x87, 0x53, 
+    0x87, 0x63, 0x87, 0x6a, 0x88, 0x05, 0x87, 0xa2, 
+    0x87, 0x9f, 0x87, 0x82, 0x87, 0xaf, 0x87, 0xcb, 
+    0x87, 0xbd, 0x87, 0xc0, 0x87, 0xd0, 0x96, 0xd6, 
+    0x87, 0xab, 0x87, 0xc4, 0x87, 0xb3, 0x87, 0xc7, 
+    0x87, 0xc6, 0x87, 0xbb, 0x87, 0xef, 0x87, 0xf2, 
+    0x87, 0xe0, 0x88, 0x0f, 0x88, 0x0d, 0x87, 0xfe, 
+    0x87, 0xf6, 0x87, 0xf7, 0x88, 0x0e, 0x87, 0xd2, 
+    0x88, 0x11, 0x88, 0x16, 0x88, 0x15, 0x88, 0x22, 
+    0x88, 0x21, 0x88, 0x31, 0x88, 0x36, 0x88, 0x39, 
+    0x88, 0x27, 0x88, 0x3b, 0x88, 0x44, 0x88, 0x42, 
+    0x88, 0x52, 0x88, 0x59, 0x88, 0x5e, 0x88, 0x62, 
+    0x88, 0x6b, 0x88, 0x81, 0x88, 0x7e, 0x88, 0x9e, 
+    0x88, 0x75, 0x88, 0x7d, 0x88, 0xb5, 0x88, 0x72, 
+    0x88, 0x82, 0x88, 0x97, 0x88, 0x92, 0x88, 0xae, 
+    0x88, 0x99, 0x88, 0xa2, 0x88, 0x8d, 0x88, 0xa4, 
+    0x88, 0xb0, 0x88, 0xbf, 0x88, 0xb1, 0x88, 0xc3, 
+    0x88, 0xc4, 0x88, 0xd4, 0x88, 0xd8, 0x88, 0xd9, 
+    0x88, 0xdd, 0x88, 0xf9, 0x89, 0x02, 0x88, 0xfc, 
+    0x88, 0xf4, 0x88, 0xe8, 0x88, 0xf2, 0x89, 0x04, 
+    0x89, 0x0c, 0x89, 0x0a, 0x89, 0x13, 0x89, 0x43, 
+    0x89, 0x1e, 0x89, 0x25, 0x89, 0x2a, 0x89, 0x2b, 
+    0x89, 0x41, 0x89, 0x44, 0x89, 0x3b, 0x89, 0x36, 
+    0x89, 0x38, 0x89, 0x4c, 0x89, 0x1d, 0x89, 0x60, 
+    0x89, 0x5e, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x89, 0x66, 0x89, 0x64, 0x89, 0x6d, 0x89, 0x6a, 
+    0x89, 0x6f, 0x89, 0x74, 0x89, 0x77, 0x89, 0x7e, 
+    0x89, 0x83, 0x89, 0x88, 0x89, 0x8a, 0x89, 0x93, 
+    0x89, 0x98, 0x89, 0xa1, 0x89, 0xa9, 0x89, 0xa6, 
+    0x89, 0xac, 0x89, 0xaf, 0x89, 0xb2, 0x89, 0xba, 
+    0x89, 0xbd, 0x89, 0xbf, 0x89, 0xc0, 0x89, 0xda, 
+    0x89, 0xdc, 0x89, 0xdd, 0x89, 0xe7, 0x89, 0xf4, 
+    0x89, 0xf8, 0x8a, 0x03, 0x8a, 0x16, 0x8a, 0x10, 
+    0x8a, 0x0c, 0x8a, 0x1b, 0x8a, 0x1d, 0x8a, 0x25, 
+    0x8a, 0x36, 0x8a, 0x41, 0x8a, 0x5b, 0x8a, 0x52, 
+    0x8a, 0x46, 0x8a, 0x48, 0x8a, 0x7c, 0x8a, 0x6d, 
+    0x8a, 0x6c, 0x8a, 0x62, 0x8a, 0x85, 0x8a, 0x82, 
+    0x8a, 0x84, 0x8a, 0xa8, 0x8a, 0xa1, 0x8a, 0x91, 
+    0x8a, 0xa5, 0x8a, 0xa6, 0x8a, 0x9a, 0x8a, 0xa3, 
+    0x8a, 0xc4, 0x8a, 0xcd, 0x8a, 0xc2, 0x8a, 0xda, 
+    0x8a, 0xeb, 0x8a, 0xf3, 0x8a, 0xe7, 0x00, 0x20, 
+    0x8a, 0xe4, 0x8a, 0xf1, 0x8b, 0x14, 0x8a, 0xe0, 
+    0x8a, 0xe2, 0x8a, 0xf7, 0x8a, 0xde, 0x8a, 0xdb, 
+    0x8b, 0x0c, 0x8b, 0x07, 0x8b, 0x1a, 0x8a, 0xe1, 
+    0x8b, 0x16, 0x8b, 0x10, 0x8b, 0x17, 0x8b, 0x20, 
+    0x8b, 0x33, 0x97, 0xab, 0x8b, 0x26, 0x8b, 0x2b, 
+    0x8b, 0x3e, 0x8b, 0x28, 0x8b, 0x41, 0x8b, 0x4c, 
+    0x8b, 0x4f, 0x8b, 0x4e, 0x8b, 0x49, 0x8b, 0x56, 
+    0x8b, 0x5b, 0x8b, 0x5a, 0x8b, 0x6b, 0x8b, 0x5f, 
+    0x8b, 0x6c, 0x8b, 0x6f, 0x8b, 0x74, 0x8b, 0x7d, 
+    0x8b, 0x80, 0x8b, 0x8c, 0x8b, 0x8e, 0x8b, 0x92, 
+    0x8b, 0x93, 0x8b, 0x96, 0x8b, 0x99, 0x8b, 0x9a, 
+    0x8c, 0x3a, 0x8c, 0x41, 0x8c, 0x3f, 0x8c, 0x48, 
+    0x8c, 0x4c, 0x8c, 0x4e, 0x8c, 0x50, 0x8c, 0x55, 
+    0x8c, 0x62, 0x8c, 0x6c, 0x8c, 0x78, 0x8c, 0x7a, 
+    0x8c, 0x82, 0x8c, 0x89, 0x8c, 0x85, 0x8c, 0x8a, 
+    0x8c, 0x8d, 0x8c, 0x8e, 0x8c, 0x94, 0x8c, 0x7c, 
+    0x8c, 0x98, 0x62, 0x1d, 0x8c, 0xad, 0x8c, 0xaa, 
+    0x8c, 0xbd, 0x8c, 0xb2, 0x8c, 0xb3, 0x8c, 0xae, 
+    0x8c, 0xb6, 0x8c, 0xc8, 0x8c, 0xc1, 0x8c, 0xe4, 
+    0x8c, 0xe3, 0x8c, 0xda, 0x8c, 0xfd, 0x8c, 0xfa, 
+    0x8c, 0xfb, 0x8d, 0x04, 0x8d, 0x05, 0x8d, 0x0a, 
+    0x8d, 0x07, 0x8d, 0x0f, 0x8d, 0x0d, 0x8d, 0x10, 
+    0x9f, 0x4e, 0x8d, 0x13, 0x8c, 0xcd, 0x8d, 0x14, 
+    0x8d, 0x16, 0x8d, 0x67, 0x8d, 0x6d, 0x8d, 0x71, 
+    0x8d, 0x73, 0x8d, 0x81, 0x8d, 0x99, 0x8d, 0xc2, 
+    0x8d, 0xbe, 0x8d, 0xba, 0x8d, 0xcf, 0x8d, 0xda, 
+    0x8d, 0xd6, 0x8d, 0xcc, 0x8d, 0xdb, 0x8d, 0xcb, 
+    0x8d, 0xea, 0x8d, 0xeb, 0x8d, 0xdf, 0x8d, 0xe3, 
+    0x8d, 0xfc, 0x8e, 0x08, 0x8e, 0x09, 0x8d, 0xff, 
+    0x8e, 0x1d, 0x8e, 0x1e, 0x8e, 0x10, 0x8e, 0x1f, 
+    0x8e, 0x42, 0x8e, 0x35, 0x8e, 0x30, 0x8e, 0x34, 
+    0x8e, 0x4a, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x8e, 0x47, 0x8e, 0x49, 0x8e, 0x4c, 0x8e, 0x50, 
+    0x8e, 0x48, 0x8e, 0x59, 0x8e, 0x64, 0x8e, 0x60, 
+    0x8e, 0x2a, 0x8e, 0x63, 0x8e, 0x55, 0x8e, 0x76, 
+    0x8e, 0x72, 0x8e, 0x7c, 0x8e, 0x81, 0x8e, 0x87, 
+    0x8e, 0x85, 0x8e, 0x84, 0x8e, 0x8b, 0x8e, 0x8a, 
+    0x8e, 0x93, 0x8e, 0x91, 0x8e, 0x94, 0x8e, 0x99, 
+    0x8e, 0xaa, 0x8e, 0xa1, 0x8e, 0xac, 0x8e, 0xb0, 
+    0x8e, 0xc6, 0x8e, 0xb1, 0x8e, 0xbe, 0x8e, 0xc5, 
+    0x8e, 0xc8, 0x8e, 0xcb, 0x8e, 0xdb, 0x8e, 0xe3, 
+    0x8e, 0xfc, 0x8e, 0xfb, 0x8e, 0xeb, 0x8e, 0xfe, 
+    0x8f, 0x0a, 0x8f, 0x05, 0x8f, 0x15, 0x8f, 0x12, 
+    0x8f, 0x19, 0x8f, 0x13, 0x8f, 0x1c, 0x8f, 0x1f, 
+    0x8f, 0x1b, 0x8f, 0x0c, 0x8f, 0x26, 0x8f, 0x33, 
+    0x8f, 0x3b, 0x8f, 0x39, 0x8f, 0x45, 0x8f, 0x42, 
+    0x8f, 0x3e, 0x8f, 0x4c, 0x8f, 0x49, 0x8f, 0x46, 
+    0x8f, 0x4e, 0x8f, 0x57, 0x8f, 0x5c, 0x00, 0x20, 
+    0x8f, 0x62, 0x8f, 0x63, 0x8f, 0x64, 0x8f, 0x9c, 
+    0x8f, 0x9f, 0x8f, 0xa3, 0x8f, 0xad, 0x8f, 0xaf, 
+    0x8f, 0xb7, 0x8f, 0xda, 0x8f, 0xe5, 0x8f, 0xe2, 
+    0x8f, 0xea, 0x8f, 0xef, 0x90, 0x87, 0x8f, 0xf4, 
+    0x90, 0x05, 0x8f, 0xf9, 0x8f, 0xfa, 0x90, 0x11, 
+    0x90, 0x15, 0x90, 0x21, 0x90, 0x0d, 0x90, 0x1e, 
+    0x90, 0x16, 0x90, 0x0b, 0x90, 0x27, 0x90, 0x36, 
+    0x90, 0x35, 0x90, 0x39, 0x8f, 0xf8, 0x90, 0x4f, 
+    0x90, 0x50, 0x90, 0x51, 0x90, 0x52, 0x90, 0x0e, 
+    0x90, 0x49, 0x90, 0x3e, 0x90, 0x56, 0x90, 0x58, 
+    0x90, 0x5e, 0x90, 0x68, 0x90, 0x6f, 0x90, 0x76, 
+    0x96, 0xa8, 0x90, 0x72, 0x90, 0x82, 0x90, 0x7d, 
+    0x90, 0x81, 0x90, 0x80, 0x90, 0x8a, 0x90, 0x89, 
+    0x90, 0x8f, 0x90, 0xa8, 0x90, 0xaf, 0x90, 0xb1, 
+    0x90, 0xb5, 0x90, 0xe2, 0x90, 0xe4, 0x62, 0x48, 
+    0x90, 0xdb, 0x91, 0x02, 0x91, 0x12, 0x91, 0x19, 
+    0x91, 0x32, 0x91, 0x30, 0x91, 0x4a, 0x91, 0x56, 
+    0x91, 0x58, 0x91, 0x63, 0x91, 0x65, 0x91, 0x69, 
+    0x91, 0x73, 0x91, 0x72, 0x91, 0x8b, 0x91, 0x89, 
+    0x91, 0x82, 0x91, 0xa2, 0x91, 0xab, 0x91, 0xaf, 
+    0x91, 0xaa, 0x91, 0xb5, 0x91, 0xb4, 0x91, 0xba, 
+    0x91, 0xc0, 0x91, 0xc1, 0x91, 0xc9, 0x91, 0xcb, 
+    0x91, 0xd0, 0x91, 0xd6, 0x91, 0xdf, 0x91, 0xe1, 
+    0x91, 0xdb, 0x91, 0xfc, 0x91, 0xf5, 0x91, 0xf6, 
+    0x92, 0x1e, 0x91, 0xff, 0x92, 0x14, 0x92, 0x2c, 
+    0x92, 0x15, 0x92, 0x11, 0x92, 0x5e, 0x92, 0x57, 
+    0x92, 0x45, 0x92, 0x49, 0x92, 0x64, 0x92, 0x48, 
+    0x92, 0x95, 0x92, 0x3f, 0x92, 0x4b, 0x92, 0x50, 
+    0x92, 0x9c, 0x92, 0x96, 0x92, 0x93, 0x92, 0x9b, 
+    0x92, 0x5a, 0x92, 0xcf, 0x92, 0xb9, 0x92, 0xb7, 
+    0x92, 0xe9, 0x93, 0x0f, 0x92, 0xfa, 0x93, 0x44, 
+    0x93, 0x2e, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x93, 0x19, 0x93, 0x22, 0x93, 0x1a, 0x93, 0x23, 
+    0x93, 0x3a, 0x93, 0x35, 0x93, 0x3b, 0x93, 0x5c, 
+    0x93, 0x60, 0x93, 0x7c, 0x93, 0x6e, 0x93, 0x56, 
+    0x93, 0xb0, 0x93, 0xac, 0x93, 0xad, 0x93, 0x94, 
+    0x93, 0xb9, 0x93, 0xd6, 0x93, 0xd7, 0x93, 0xe8, 
+    0x93, 0xe5, 0x93, 0xd8, 0x93, 0xc3, 0x93, 0xdd, 
+    0x93, 0xd0, 0x93, 0xc8, 0x93, 0xe4, 0x94, 0x1a, 
+    0x94, 0x14, 0x94, 0x13, 0x94, 0x03, 0x94, 0x07, 
+    0x94, 0x10, 0x94, 0x36, 0x94, 0x2b, 0x94, 0x35, 
+    0x94, 0x21, 0x94, 0x3a, 0x94, 0x41, 0x94, 0x52, 
+    0x94, 0x44, 0x94, 0x5b, 0x94, 0x60, 0x94, 0x62, 
+    0x94, 0x5e, 0x94, 0x6a, 0x92, 0x29, 0x94, 0x70, 
+    0x94, 0x75, 0x94, 0x77, 0x94, 0x7d, 0x94, 0x5a, 
+    0x94, 0x7c, 0x94, 0x7e, 0x94, 0x81, 0x94, 0x7f, 
+    0x95, 0x82, 0x95, 0x87, 0x95, 0x8a, 0x95, 0x94, 
+    0x95, 0x96, 0x95, 0x98, 0x95, 0x99, 0x00, 0x20, 
+    0x95, 0xa0, 0x95, 0xa8, 0x95, 0xa7, 0x95, 0xad, 
+    0x95, 0xbc, 0x95, 0xbb, 0x95, 0xb9, 0x95, 0xbe, 
+    0x95, 0xca, 0x6f, 0xf6, 0x95, 0xc3, 0x95, 0xcd, 
+    0x95, 0xcc, 0x95, 0xd5, 0x95, 0xd4, 0x95, 0xd6, 
+    0x95, 0xdc, 0x95, 0xe1, 0x95, 0xe5, 0x95, 0xe2, 
+    0x96, 0x21, 0x96, 0x28, 0x96, 0x2e, 0x96, 0x2f, 
+    0x96, 0x42, 0x96, 0x4c, 0x96, 0x4f, 0x96, 0x4b, 
+    0x96, 0x77, 0x96, 0x5c, 0x96, 0x5e, 0x96, 0x5d, 
+    0x96, 0x5f, 0x96, 0x66, 0x96, 0x72, 0x96, 0x6c, 
+    0x96, 0x8d, 0x96, 0x98, 0x96, 0x95, 0x96, 0x97, 
+    0x96, 0xaa, 0x96, 0xa7, 0x96, 0xb1, 0x96, 0xb2, 
+    0x96, 0xb0, 0x96, 0xb4, 0x96, 0xb6, 0x96, 0xb8, 
+    0x96, 0xb9, 0x96, 0xce, 0x96, 0xcb, 0x96, 0xc9, 
+    0x96, 0xcd, 0x89, 0x4d, 0x96, 0xdc, 0x97, 0x0d, 
+    0x96, 0xd5, 0x96, 0xf9, 0x97, 0x04, 0x97, 0x06, 
+    0x97, 0x08, 0x97, 0x13, 0x97, 0x0e, 0x97, 0x11, 
+    0x97, 0x0f, 0x97, 0x16, 0x97, 0x19, 0x97, 0x24, 
+    0x97, 0x2a, 0x97, 0x30, 0x97, 0x39, 0x97, 0x3d, 
+    0x97, 0x3e, 0x97, 0x44, 0x97, 0x46, 0x97, 0x48, 
+    0x97, 0x42, 0x97, 0x49, 0x97, 0x5c, 0x97, 0x60, 
+    0x97, 0x64, 0x97, 0x66, 0x97, 0x68, 0x52, 0xd2, 
+    0x97, 0x6b, 0x97, 0x71, 0x97, 0x79, 0x97, 0x85, 
+    0x97, 0x7c, 0x97, 0x81, 0x97, 0x7a, 0x97, 0x86, 
+    0x97, 0x8b, 0x97, 0x8f, 0x97, 0x90, 0x97, 0x9c, 
+    0x97, 0xa8, 0x97, 0xa6, 0x97, 0xa3, 0x97, 0xb3, 
+    0x97, 0xb4, 0x97, 0xc3, 0x97, 0xc6, 0x97, 0xc8, 
+    0x97, 0xcb, 0x97, 0xdc, 0x97, 0xed, 0x9f, 0x4f, 
+    0x97, 0xf2, 0x7a, 0xdf, 0x97, 0xf6, 0x97, 0xf5, 
+    0x98, 0x0f, 0x98, 0x0c, 0x98, 0x38, 0x98, 0x24, 
+    0x98, 0x21, 0x98, 0x37, 0x98, 0x3d, 0x98, 0x46, 
+    0x98, 0x4f, 0x98, 0x4b, 0x98, 0x6b, 0x98, 0x6f, 
+    0x98, 0x70, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x98, 0x71, 0x98, 0x74, 0x98, 0x73, 0x98, 0xaa, 
+    0x98, 0xaf, 0x98, 0xb1, 0x98, 0xb6, 0x98, 0xc4, 
+    0x98, 0xc3, 0x98, 0xc6, 0x98, 0xe9, 0x98, 0xeb, 
+    0x99, 0x03, 0x99, 0x09, 0x99, 0x12, 0x99, 0x14, 
+    0x99, 0x18, 0x99, 0x21, 0x99, 0x1d, 0x99, 0x1e, 
+    0x99, 0x24, 0x99, 0x20, 0x99, 0x2c, 0x99, 0x2e, 
+    0x99, 0x3d, 0x99, 0x3e, 0x99, 0x42, 0x99, 0x49, 
+    0x99, 0x45, 0x99, 0x50, 0x99, 0x4b, 0x99, 0x51, 
+    0x99, 0x52, 0x99, 0x4c, 0x99, 0x55, 0x99, 0x97, 
+    0x99, 0x98, 0x99, 0xa5, 0x99, 0xad, 0x99, 0xae, 
+    0x99, 0xbc, 0x99, 0xdf, 0x99, 0xdb, 0x99, 0xdd, 
+    0x99, 0xd8, 0x99, 0xd1, 0x99, 0xed, 0x99, 0xee, 
+    0x99, 0xf1, 0x99, 0xf2, 0x99, 0xfb, 0x99, 0xf8, 
+    0x9a, 0x01, 0x9a, 0x0f, 0x9a, 0x05, 0x99, 0xe2, 
+    0x9a, 0x19, 0x9a, 0x2b, 0x9a, 0x37, 0x9a, 0x45, 
+    0x9a, 0x42, 0x9a, 0x40, 0x9a, 0x43, 0x00, 0x20, 
+    0x9a, 0x3e, 0x9a, 0x55, 0x9a, 0x4d, 0x9a, 0x5b, 
+    0x9a, 0x57, 0x9a, 0x5f, 0x9a, 0x62, 0x9a, 0x65, 
+    0x9a, 0x64, 0x9a, 0x69, 0x9a, 0x6b, 0x9a, 0x6a, 
+    0x9a, 0xad, 0x9a, 0xb0, 0x9a, 0xbc, 0x9a, 0xc0, 
+    0x9a, 0xcf, 0x9a, 0xd1, 0x9a, 0xd3, 0x9a, 0xd4, 
+    0x9a, 0xde, 0x9a, 0xdf, 0x9a, 0xe2, 0x9a, 0xe3, 
+    0x9a, 0xe6, 0x9a, 0xef, 0x9a, 0xeb, 0x9a, 0xee, 
+    0x9a, 0xf4, 0x9a, 0xf1, 0x9a, 0xf7, 0x9a, 0xfb, 
+    0x9b, 0x06, 0x9b, 0x18, 0x9b, 0x1a, 0x9b, 0x1f, 
+    0x9b, 0x22, 0x9b, 0x23, 0x9b, 0x25, 0x9b, 0x27, 
+    0x9b, 0x28, 0x9b, 0x29, 0x9b, 0x2a, 0x9b, 0x2e, 
+    0x9b, 0x2f, 0x9b, 0x32, 0x9b, 0x44, 0x9b, 0x43, 
+    0x9b, 0x4f, 0x9b, 0x4d, 0x9b, 0x4e, 0x9b, 0x51, 
+    0x9b, 0x58, 0x9b, 0x74, 0x9b, 0x93, 0x9b, 0x83, 
+    0x9b, 0x91, 0x9b, 0x96, 0x9b, 0x97, 0x9b, 0x9f, 
+    0x9b, 0xa0, 0x9b, 0xa8, 0x9b, 0xb4, 0x9b, 0xc0, 
+    0x9b, 0xca, 0x9b, 0xb9, 0x9b, 0xc6, 0x9b, 0xcf, 
+    0x9b, 0xd1, 0x9b, 0xd2, 0x9b, 0xe3, 0x9b, 0xe2, 
+    0x9b, 0xe4, 0x9b, 0xd4, 0x9b, 0xe1, 0x9c, 0x3a, 
+    0x9b, 0xf2, 0x9b, 0xf1, 0x9b, 0xf0, 0x9c, 0x15, 
+    0x9c, 0x14, 0x9c, 0x09, 0x9c, 0x13, 0x9c, 0x0c, 
+    0x9c, 0x06, 0x9c, 0x08, 0x9c, 0x12, 0x9c, 0x0a, 
+    0x9c, 0x04, 0x9c, 0x2e, 0x9c, 0x1b, 0x9c, 0x25, 
+    0x9c, 0x24, 0x9c, 0x21, 0x9c, 0x30, 0x9c, 0x47, 
+    0x9c, 0x32, 0x9c, 0x46, 0x9c, 0x3e, 0x9c, 0x5a, 
+    0x9c, 0x60, 0x9c, 0x67, 0x9c, 0x76, 0x9c, 0x78, 
+    0x9c, 0xe7, 0x9c, 0xec, 0x9c, 0xf0, 0x9d, 0x09, 
+    0x9d, 0x08, 0x9c, 0xeb, 0x9d, 0x03, 0x9d, 0x06, 
+    0x9d, 0x2a, 0x9d, 0x26, 0x9d, 0xaf, 0x9d, 0x23, 
+    0x9d, 0x1f, 0x9d, 0x44, 0x9d, 0x15, 0x9d, 0x12, 
+    0x9d, 0x41, 0x9d, 0x3f, 0x9d, 0x3e, 0x9d, 0x46, 
+    0x9d, 0x48, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x9d, 0x5d, 0x9d, 0x5e, 0x9d, 0x64, 0x9d, 0x51, 
+    0x9d, 0x50, 0x9d, 0x59, 0x9d, 0x72, 0x9d, 0x89, 
+    0x9d, 0x87, 0x9d, 0xab, 0x9d, 0x6f, 0x9d, 0x7a, 
+    0x9d, 0x9a, 0x9d, 0xa4, 0x9d, 0xa9, 0x9d, 0xb2, 
+    0x9d, 0xc4, 0x9d, 0xc1, 0x9d, 0xbb, 0x9d, 0xb8, 
+    0x9d, 0xba, 0x9d, 0xc6, 0x9d, 0xcf, 0x9d, 0xc2, 
+    0x9d, 0xd9, 0x9d, 0xd3, 0x9d, 0xf8, 0x9d, 0xe6, 
+    0x9d, 0xed, 0x9d, 0xef, 0x9d, 0xfd, 0x9e, 0x1a, 
+    0x9e, 0x1b, 0x9e, 0x1e, 0x9e, 0x75, 0x9e, 0x79, 
+    0x9e, 0x7d, 0x9e, 0x81, 0x9e, 0x88, 0x9e, 0x8b, 
+    0x9e, 0x8c, 0x9e, 0x92, 0x9e, 0x95, 0x9e, 0x91, 
+    0x9e, 0x9d, 0x9e, 0xa5, 0x9e, 0xa9, 0x9e, 0xb8, 
+    0x9e, 0xaa, 0x9e, 0xad, 0x97, 0x61, 0x9e, 0xcc, 
+    0x9e, 0xce, 0x9e, 0xcf, 0x9e, 0xd0, 0x9e, 0xd4, 
+    0x9e, 0xdc, 0x9e, 0xde, 0x9e, 0xdd, 0x9e, 0xe0, 
+    0x9e, 0xe5, 0x9e, 0xe8, 0x9e, 0xef, 0x00, 0x20, 
+    0x9e, 0xf4, 0x9e, 0xf6, 0x9e, 0xf7, 0x9e, 0xf9, 
+    0x9e, 0xfb, 0x9e, 0xfc, 0x9e, 0xfd, 0x9f, 0x07, 
+    0x9f, 0x08, 0x76, 0xb7, 0x9f, 0x15, 0x9f, 0x21, 
+    0x9f, 0x2c, 0x9f, 0x3e, 0x9f, 0x4a, 0x9f, 0x52, 
+    0x9f, 0x54, 0x9f, 0x63, 0x9f, 0x5f, 0x9f, 0x60, 
+    0x9f, 0x61, 0x9f, 0x66, 0x9f, 0x67, 0x9f, 0x6c, 
+    0x9f, 0x6a, 0x9f, 0x77, 0x9f, 0x72, 0x9f, 0x76, 
+    0x9f, 0x95, 0x9f, 0x9c, 0x9f, 0xa0, 0x58, 0x2f, 
+    0x69, 0xc7, 0x90, 0x59, 0x74, 0x64, 0x51, 0xdc, 
+    0x71, 0x99, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+    0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 0x00, 0x20, 
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+/*
+  x86 SIMD kernels are compiled with per function target attributes
+  and picked at runtime, so the rest of the build stays generic and
+  the binary still runs on CPUs without the extensions.
+  Every kernel must have a scalar version for other platforms.
+*/
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+# define HAS_X86_SIMD
+# include <immintrin.h>
+# define TARGET_SSE2   __attribute__((target("sse2")))
+# define TARGET_AVX2   __attribute__((target("avx2")))
+# define TARGET_PCLMUL __attribute__((target("pclmul,sse2")))
+
+inline bool cpu_has_sse2() { return __builtin_cpu_supports("sse2"); }
+inline bool cpu_has_avx2() { return __builtin_cpu_supports("avx2"); }
+inline bool cpu_has_pclmul() { return __builtin_cpu_supports("pclmul"); }
+#endif
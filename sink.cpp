@@ -0,0 +1,56 @@
+#include "sink.h"
+
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+# include <errno.h>
+# include <unistd.h>
+# define HAS_WRITE
+#endif
+
+static FILE* sink_file(const Sink* sink) {
+  return sink->file != NULL ? sink->file : stdout;
+}
+
+bool sink_open(Sink* sink, const char* path) {
+  sink->size = 0;
+  sink->file = fopen(path, "w");
+  return sink->file != NULL;
+}
+
+void sink_flush(Sink* sink) {
+  FILE* file = sink_file(sink);
+#ifdef HAS_WRITE
+  // anything already in the stdio buffer goes first
+  fflush(file);
+  const int fd = fileno(file);
+  size_t done = 0;
+  while (done < sink->size) {
+    const ssize_t n = write(fd, sink->data + done, sink->size - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    done += n;
+  }
+#else
+  fwrite(sink->data, 1, sink->size, file);
+#endif
+  sink->size = 0;
+}
+
+void sink_close(Sink* sink) {
+  sink_flush(sink);
+  if (sink->file != NULL) fclose(sink->file);
+  sink->file = NULL;
+}
+
+void sink_write(Sink* sink, const char* data, size_t size) {
+  while (size > 0) {
+    if (sink->size == SINK_CAPACITY) sink_flush(sink);
+    size_t n = SINK_CAPACITY - sink->size;
+    if (n > size) n = size;
+    memcpy(sink->data + sink->size, data, n);
+    sink->size += n;
+    data += n;
+    size -= n;
+  }
+}
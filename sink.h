@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+  Buffered text output. Lines are formatted straight into the buffer,
+  which goes to the file in large writes (write(2) where available)
+  instead of one stdio call per line.
+  A sink without a file writes to stdout.
+*/
+
+static const size_t SINK_CAPACITY = 1 << 16;
+
+struct Sink {
+  FILE* file;
+  size_t size;
+  char data[SINK_CAPACITY];
+};
+
+// Falls back to stdout if path can't be created.
+bool sink_open(Sink* sink, const char* path);
+void sink_flush(Sink* sink);
+// Flush and close the file, the sink goes back to stdout.
+void sink_close(Sink* sink);
+void sink_write(Sink* sink, const char* data, size_t size);
+
+// Room for at least size bytes, size must be under SINK_CAPACITY.
+inline char* sink_reserve(Sink* sink, const size_t size) {
+  if (sink->size + size > SINK_CAPACITY) sink_flush(sink);
+  return sink->data + sink->size;
+}
+
+inline void sink_commit(Sink* sink, const size_t size) {
+  sink->size += size;
+}
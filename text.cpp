@@ -0,0 +1,226 @@
+#include "text.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shift_js.h"
+#include "simd.h"
+
+// byte classes, a trail byte can be anything valid after a lead
+static const uint8_t CLASS_BREAK = 0;
+static const uint8_t CLASS_SINGLE = 1;
+static const uint8_t CLASS_LEAD = 2;
+
+struct ByteClasses {
+  uint8_t klass[256];
+  bool trail[256];
+};
+
+static ByteClasses build_classes() {
+  ByteClasses classes;
+  for (int c = 0; c < 256; ++c) {
+    // printable ASCII and half width katakana
+    if ((c >= 0x20 && c <= 0x7E) || c == '\n' || (c >= 0xA1 && c <= 0xDF)) {
+      classes.klass[c] = CLASS_SINGLE;
+    } else if ((c >= 0x81 && c <= 0x9F) || (c >= 0xE0 && c <= 0xEF)) {
+      classes.klass[c] = CLASS_LEAD;
+    } else {
+      classes.klass[c] = CLASS_BREAK;
+    }
+    classes.trail[c] = c >= 0x40 && c <= 0xFC && c != 0x7F;
+  }
+  return classes;
+}
+
+static const ByteClasses byte_classes = build_classes();
+
+// punctuation, full width alphanumerics, kana and the level 1 kanji,
+// what most of a game's text is made of
+static inline bool common_lead(const byte lead) {
+  return lead <= 0x83 || (lead >= 0x88 && lead <= 0x98);
+}
+
+/*
+  A run can only start after a byte that isn't text, and needs a lead
+  byte. Returns the position after the last break before the first lead
+  byte from from, to if there isn't any lead.
+*/
+static uint32_t next_candidate_scalar(const byte* data, const uint32_t from, const uint32_t to,
+                                      uint32_t start) {
+  for (uint32_t at = from; at < to; ++at) {
+    const uint8_t klass = byte_classes.klass[data[at]];
+    if (klass == CLASS_LEAD) return start;
+    if (klass == CLASS_BREAK) start = at + 1;
+  }
+  return to;
+}
+
+#ifdef HAS_X86_SIMD
+// unsigned lo <= x <= hi on each byte
+TARGET_AVX2 static inline __m256i in_range(const __m256i x, const byte lo, const byte hi) {
+  const __m256i shifted = _mm256_sub_epi8(x, _mm256_set1_epi8((char) lo));
+  const __m256i span = _mm256_set1_epi8((char) (hi - lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, span), shifted);
+}
+
+// 32 bytes per iteration, the scalar loop does the tail
+TARGET_AVX2 static uint32_t next_candidate_avx2(const byte* data, const uint32_t from,
+                                                const uint32_t to) {
+  uint32_t start = from;
+  uint32_t at = from;
+  for (; at + 32 <= to; at += 32) {
+    const __m256i bytes = _mm256_loadu_si256((const __m256i*) &data[at]);
+    const __m256i lead = _mm256_or_si256(in_range(bytes, 0x81, 0x9F), in_range(bytes, 0xE0, 0xEF));
+    const __m256i single = _mm256_or_si256(
+        _mm256_or_si256(in_range(bytes, 0x20, 0x7E), in_range(bytes, 0xA1, 0xDF)),
+        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+    const uint32_t leads = (uint32_t) _mm256_movemask_epi8(lead);
+    uint32_t breaks = ~((uint32_t) _mm256_movemask_epi8(_mm256_or_si256(lead, single)));
+    // only the breaks before the first lead matter
+    if (leads != 0) breaks &= (leads & -leads) - 1;
+    if (breaks != 0) start = at + 32 - __builtin_clz(breaks);
+    if (leads != 0) return start;
+  }
+  return next_candidate_scalar(data, at, to, start);
+}
+#endif
+
+static uint32_t next_candidate(const byte* data, const uint32_t from, const uint32_t to) {
+#ifdef HAS_X86_SIMD
+  if (cpu_has_avx2()) return next_candidate_avx2(data, from, to);
+#endif
+  return next_candidate_scalar(data, from, to, from);
+}
+
+bool text_find_run(const byte* data, const uint32_t from, const uint32_t to, TextRun* run) {
+  uint32_t at = from;
+  while ((at = next_candidate(data, at, to)) < to) {
+    const uint32_t start = at;
+    uint32_t chars = 0;
+    uint32_t wide = 0;
+    uint32_t common = 0;
+    while (at < to) {
+      const byte c = data[at];
+      const uint8_t klass = byte_classes.klass[c];
+      if (klass == CLASS_BREAK) break;
+      const uint32_t size = klass == CLASS_LEAD ? 2 : 1;
+      if (size == 2 && (at + 1 >= to || !byte_classes.trail[data[at + 1]])) break;
+      if (at + size - start > TEXT_MAX_RUN) break;
+      ++chars;
+      wide += size == 2;
+      common += size == 2 && common_lead(c);
+      at += size;
+    }
+    if (chars >= TEXT_MIN_CHARS && wide >= TEXT_MIN_WIDE && wide * 2 >= chars) {
+      run->start = start;
+      run->size = at - start;
+      run->score = (float) common / chars;
+      return true;
+    }
+    // the text after an ascii prefix can still pass, drop characters from
+    // the start while enough wide ones are left
+    uint32_t rest = start;
+    while (chars >= TEXT_MIN_CHARS && wide >= TEXT_MIN_WIDE) {
+      if (wide * 2 >= chars) {
+        run->start = rest;
+        run->size = at - rest;
+        run->score = (float) common / chars;
+        return true;
+      }
+      const byte c = data[rest];
+      const bool lead = byte_classes.klass[c] == CLASS_LEAD;
+      --chars;
+      wide -= lead;
+      common -= lead && common_lead(c);
+      rest += lead ? 2 : 1;
+    }
+    if (at == start) ++at;
+  }
+  return false;
+}
+
+// "0x%08X " then the text, with "\n" for the newlines
+static void write_run(Sink* sink, const byte* data, const TextRun& run, char* utf8) {
+  // sj2utf8 doesn't terminate a full output and looks one byte past it
+  utf8[3 * run.size] = '\0';
+  sj2utf8(&data[run.start], run.size, utf8);
+  const size_t size = strlen(utf8);
+
+  char* out = sink_reserve(sink, 12 + 2 * size);
+  char* p = out;
+  *p++ = '0';
+  *p++ = 'x';
+  for (int shift = 28; shift >= 0; shift -= 4) *p++ = "0123456789ABCDEF"[(run.start >> shift) & 0xF];
+  *p++ = ' ';
+  for (size_t i = 0; i < size; ++i) {
+    if (utf8[i] == '\n') {
+      *p++ = '\\';
+      *p++ = 'n';
+    } else {
+      *p++ = utf8[i];
+    }
+  }
+  *p++ = '\n';
+  sink_commit(sink, p - out);
+}
+
+static void write_comment(Sink* sink, const char* text, const uint32_t offset) {
+  char* out = sink_reserve(sink, 64);
+  sink_commit(sink, snprintf(out, 64, "# %s 0x%08X\n", text, offset));
+}
+
+size_t text_dump(Sink* sink, const byte* data, const uint32_t from, const uint32_t to,
+                 const PointerTables* tables) {
+  // sj2utf8 needs 3 bytes per input byte
+  char* utf8 = (char*) malloc(3 * TEXT_MAX_RUN + 1);
+  if (utf8 == NULL) return 0;
+  // the strings written through a table, as a bitmap of their offset
+  byte* written = NULL;
+  if (tables != NULL && tables->size > 0) {
+    written = (byte*) calloc(to / 8 + 1, 1);
+    if (written == NULL) {
+      free(utf8);
+      return 0;
+    }
+  }
+
+  size_t count = 0;
+  TextRun run;
+  for (size_t i = 0; written != NULL && i < tables->size; ++i) {
+    const PointerTable& table = tables->items[i];
+    write_comment(sink, "table", table.offset);
+    for (uint32_t entry = 0; entry < table.count; ++entry) {
+      const uint32_t string = tables->strings[table.first + entry];
+      // the run found from a string is the same one, unless it was cut
+      if (!text_find_run(data, string, to, &run) || run.start != string) continue;
+      write_run(sink, data, run, utf8);
+      written[string / 8] |= 1 << (string % 8);
+      ++count;
+    }
+  }
+  if (written != NULL) write_comment(sink, "runs from", from);
+  for (uint32_t at = from; text_find_run(data, at, to, &run); at = run.start + run.size) {
+    if (written != NULL && (written[run.start / 8] >> (run.start % 8) & 1)) continue;
+    write_run(sink, data, run, utf8);
+    ++count;
+  }
+  free(written);
+  free(utf8);
+  return count;
+}
+
+bool text_runs_write(const byte* data, const uint32_t from, const uint32_t to, const char* path,
+                     size_t* count) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) return false;
+  *count = 0;
+  TextRun run;
+  for (uint32_t at = from; text_find_run(data, at, to, &run); at = run.start + run.size) {
+    fprintf(file, "0x%08X 0x%04X %.2f\n", run.start, run.size, run.score);
+    ++*count;
+  }
+  const bool written = ferror(file) == 0;
+  return fclose(file) == 0 && written;
+}
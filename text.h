@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defs.h"
+#include "pointers.h"
+#include "sink.h"
+
+/*
+  Text extraction, a streaming pipeline over the data of the ROM:
+  the locator finds the next run of Shift JIS text, the run is
+  converted to UTF-8 with sj2utf8 and written to a sink, which goes
+  to the file every SINK_CAPACITY bytes. Only one run is held at a
+  time, so the memory doesn't grow with the amount of text.
+
+  A run is a sequence of printable ASCII, half width katakana and
+  two bytes characters (lead 0x81-0x9F or 0xE0-0xEF, valid trail byte)
+  with at least TEXT_MIN_CHARS characters. At least TEXT_MIN_WIDE and
+  half of them must be two bytes ones, Japanese text is mostly made of
+  them while the bytes of code and tables look like ASCII and kana.
+  A run that fails the test keeps its longest end that passes, the
+  Japanese text after an ASCII prefix.
+*/
+
+static const uint32_t TEXT_MIN_CHARS = 4;
+static const uint32_t TEXT_MIN_WIDE = 2;
+// longer runs are cut in several lines
+static const uint32_t TEXT_MAX_RUN = 4096;
+
+struct TextRun {
+  uint32_t start;
+  uint32_t size;
+  // plausibility in [0, 1], the share of the characters that are common
+  // two bytes ones (punctuation, kana, level 1 kanji)
+  float score;
+};
+
+// First run of text in data[from, to), false if there is none.
+// The bytes that can't start a run are skipped 32 at a time with AVX2.
+bool text_find_run(const byte* data, const uint32_t from, const uint32_t to, TextRun* run);
+// Write the strings of tables to sink, a "# table 0xOFFSET" line then
+// one line per pointer, then every run of data[from, to) no table
+// reaches, one "0xOFFSET text" line per string with the newlines
+// escaped. Returns the number of strings.
+size_t text_dump(Sink* sink, const byte* data, const uint32_t from, const uint32_t to,
+                 const PointerTables* tables = NULL);
+// One "0xOFFSET 0xSIZE score" line per run of data[from, to)
+bool text_runs_write(const byte* data, const uint32_t from, const uint32_t to, const char* path,
+                     size_t* count);
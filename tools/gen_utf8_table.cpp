@@ -0,0 +1,81 @@
+// Write shift_js_utf8.h, the Shift JIS to UTF-8 table of sj2utf8, from
+// the Unicode code points of shift_js_table.h.
+// gen_utf8_table OUTPUT
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "shift_js_table.h"
+
+// the lead bytes of the two bytes characters
+static bool is_lead(const int byte) {
+  const int section = byte >> 4;
+  return section == 0x8 || section == 0x9 || section == 0xE;
+}
+
+// index of the code point in shiftJIS_convTable
+static size_t table_index(const int lead, const int byte) {
+  size_t offset = 0;
+  if (lead >= 0) {
+    const int section = lead >> 4;
+    offset = section == 0x8 ? 0x100 : section == 0x9 ? 0x1100 : 0x2100;
+    offset += (lead & 0xF) << 8;
+  }
+  return (offset + byte) * 2;
+}
+
+static void write_char(FILE* file, const size_t index) {
+  const uint16_t unicode = shiftJIS_convTable[index] << 8 | shiftJIS_convTable[index + 1];
+  uint8_t bytes[3] = {0, 0, 0};
+  int size;
+  if (unicode < 0x80) {
+    bytes[0] = unicode;
+    size = 1;
+  } else if (unicode < 0x800) {
+    bytes[0] = 0xC0 | (unicode >> 6);
+    bytes[1] = 0x80 | (unicode & 0x3F);
+    size = 2;
+  } else {
+    bytes[0] = 0xE0 | (unicode >> 12);
+    bytes[1] = 0x80 | ((unicode & 0xFFF) >> 6);
+    bytes[2] = 0x80 | (unicode & 0x3F);
+    size = 3;
+  }
+  fprintf(file, "{{0x%02X, 0x%02X, 0x%02X}, %d},", bytes[0], bytes[1], bytes[2], size);
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    printf("usage: %s OUTPUT\n", argv[0]);
+    return -1;
+  }
+  FILE* file = fopen(argv[1], "w");
+  if (file == NULL) {
+    printf("Couldn't open %s\n", argv[1]);
+    return -1;
+  }
+
+  fprintf(file, "// Generated by tools/gen_utf8_table.cpp from shift_js_table.h, don't edit.\n");
+  fprintf(file, "#pragma once\n\n");
+  int pages = 1;
+  fprintf(file, "static const uint8_t sjis_lead_page[256] = {");
+  for (int byte = 0; byte < 256; ++byte) {
+    if (byte % 16 == 0) fprintf(file, "\n ");
+    fprintf(file, " %d,", is_lead(byte) ? pages++ : 0);
+  }
+  fprintf(file, "\n};\n\n");
+
+  fprintf(file, "static const SjisUtf8 sjis_utf8[%d][256] = {\n", pages);
+  for (int lead = -1; lead < 256; ++lead) {
+    if (lead >= 0 && !is_lead(lead)) continue;
+    if (lead < 0) fprintf(file, "  // one byte\n  {");
+    else fprintf(file, "  // lead 0x%02X\n  {", lead);
+    for (int byte = 0; byte < 256; ++byte) {
+      if (byte % 4 == 0) fprintf(file, "\n    ");
+      write_char(file, table_index(lead, byte));
+    }
+    fprintf(file, "\n  },\n");
+  }
+  fprintf(file, "};\n");
+  return fclose(file) == 0 ? 0 : -1;
+}
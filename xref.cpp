@@ -0,0 +1,406 @@
+#include "xref.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mips.h"
+
+static int compare_by_source(const void* a, const void* b) {
+  const XrefEdge* edge_a = (const XrefEdge*) a;
+  const XrefEdge* edge_b = (const XrefEdge*) b;
+  if (edge_a->from != edge_b->from) return edge_a->from < edge_b->from ? -1 : 1;
+  return edge_a->to < edge_b->to ? -1 : edge_a->to > edge_b->to;
+}
+
+static int compare_by_target(const void* a, const void* b) {
+  const XrefEdge* edge_a = (const XrefEdge*) a;
+  const XrefEdge* edge_b = (const XrefEdge*) b;
+  if (edge_a->to != edge_b->to) return edge_a->to < edge_b->to ? -1 : 1;
+  return edge_a->from < edge_b->from ? -1 : edge_a->from > edge_b->from;
+}
+
+// CSR rows of edges sorted by their node, the source or the target
+static bool build_rows(const XrefEdge* edges, const size_t count, const bool by_target,
+                       size_t* node_count, uint32_t** nodes, uint32_t** offsets, Xref** refs) {
+  *node_count = 0;
+  // one more so an empty index still allocates
+  *nodes = (uint32_t*) malloc((count + 1) * sizeof(uint32_t));
+  *offsets = (uint32_t*) malloc((count + 1) * sizeof(uint32_t));
+  *refs = (Xref*) malloc((count + 1) * sizeof(Xref));
+  if (*nodes == NULL || *offsets == NULL || *refs == NULL) return false;
+
+  for (size_t i = 0; i < count; ++i) {
+    const uint32_t node = by_target ? edges[i].to : edges[i].from;
+    if (*node_count == 0 || (*nodes)[*node_count - 1] != node) {
+      (*nodes)[*node_count] = node;
+      (*offsets)[*node_count] = i;
+      ++*node_count;
+    }
+    (*refs)[i].pc = by_target ? edges[i].from : edges[i].to;
+    (*refs)[i].kind = edges[i].kind;
+  }
+  (*offsets)[*node_count] = count;
+  return true;
+}
+
+bool xref_index_build(XrefIndex* index, const XrefEdges& edges) {
+  bool ok = false;
+  memset(index, 0, sizeof(XrefIndex));
+
+  XrefEdge* sorted = (XrefEdge*) malloc((edges.size + 1) * sizeof(XrefEdge));
+  if (sorted == NULL) goto cleanup;
+  memcpy(sorted, edges.items, edges.size * sizeof(XrefEdge));
+
+  qsort(sorted, edges.size, sizeof(XrefEdge), compare_by_source);
+  if (!build_rows(sorted, edges.size, false, &index->source_count, &index->sources,
+                  &index->out_offsets, &index->out)) goto cleanup;
+
+  qsort(sorted, edges.size, sizeof(XrefEdge), compare_by_target);
+  if (!build_rows(sorted, edges.size, true, &index->target_count, &index->targets,
+                  &index->in_offsets, &index->in)) goto cleanup;
+  ok = true;
+
+cleanup:
+  free(sorted);
+  if (!ok) xref_index_free(index);
+  return ok;
+}
+
+void xref_index_free(XrefIndex* index) {
+  free(index->sources);
+  free(index->out_offsets);
+  free(index->out);
+  free(index->targets);
+  free(index->in_offsets);
+  free(index->in);
+  memset(index, 0, sizeof(XrefIndex));
+}
+
+// first node not lower than pc
+static size_t lower_bound(const uint32_t* nodes, const size_t count, const uint32_t pc) {
+  size_t low = 0;
+  size_t high = count;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    if (nodes[mid] < pc) low = mid + 1;
+    else high = mid;
+  }
+  return low;
+}
+
+static size_t find_row(const uint32_t* nodes, const uint32_t* offsets, const Xref* refs,
+                       const size_t count, const uint32_t pc, const Xref** out) {
+  const size_t row = lower_bound(nodes, count, pc);
+  if (row == count || nodes[row] != pc) {
+    *out = NULL;
+    return 0;
+  }
+  *out = &refs[offsets[row]];
+  return offsets[row + 1] - offsets[row];
+}
+
+size_t xref_to(const XrefIndex& index, const uint32_t pc, const Xref** refs) {
+  return find_row(index.targets, index.in_offsets, index.in, index.target_count, pc, refs);
+}
+
+size_t xref_from(const XrefIndex& index, const uint32_t pc, const Xref** refs) {
+  return find_row(index.sources, index.out_offsets, index.out, index.source_count, pc, refs);
+}
+
+struct Call {
+  uint32_t caller;
+  uint32_t callee;
+};
+
+static int compare_by_caller(const void* a, const void* b) {
+  const Call* call_a = (const Call*) a;
+  const Call* call_b = (const Call*) b;
+  if (call_a->caller != call_b->caller) return call_a->caller < call_b->caller ? -1 : 1;
+  return call_a->callee < call_b->callee ? -1 : call_a->callee > call_b->callee;
+}
+
+static int compare_by_callee(const void* a, const void* b) {
+  const Call* call_a = (const Call*) a;
+  const Call* call_b = (const Call*) b;
+  if (call_a->callee != call_b->callee) return call_a->callee < call_b->callee ? -1 : 1;
+  return call_a->caller < call_b->caller ? -1 : call_a->caller > call_b->caller;
+}
+
+// CSR rows over all the functions, calls sorted by caller or callee
+static bool build_call_rows(const Call* calls, const size_t count, const size_t function_count,
+                            const bool by_callee, uint32_t** offsets, uint32_t** ends) {
+  *offsets = (uint32_t*) calloc(function_count + 1, sizeof(uint32_t));
+  *ends = (uint32_t*) malloc((count + 1) * sizeof(uint32_t));
+  if (*offsets == NULL || *ends == NULL) return false;
+
+  for (size_t i = 0; i < count; ++i) {
+    ++(*offsets)[(by_callee ? calls[i].callee : calls[i].caller) + 1];
+    (*ends)[i] = by_callee ? calls[i].caller : calls[i].callee;
+  }
+  for (size_t f = 0; f < function_count; ++f) (*offsets)[f + 1] += (*offsets)[f];
+  return true;
+}
+
+bool call_graph_build(CallGraph* graph, const XrefIndex& xrefs, const FunctionIndex& functions) {
+  bool ok = false;
+  size_t count = 0;
+  memset(graph, 0, sizeof(CallGraph));
+  graph->function_count = functions.count;
+
+  const size_t edge_count = xrefs.source_count > 0 ? xrefs.out_offsets[xrefs.source_count] : 0;
+  Call* calls = (Call*) malloc((edge_count + 1) * sizeof(Call));
+  if (calls == NULL) goto cleanup;
+
+  // the calls made from inside each function, the sources are sorted
+  for (size_t f = 0; f < functions.count; ++f) {
+    const size_t first = lower_bound(xrefs.sources, xrefs.source_count, functions.start[f]);
+    const size_t last = lower_bound(xrefs.sources, xrefs.source_count, functions.end[f]);
+    for (size_t row = first; row < last; ++row) {
+      for (uint32_t e = xrefs.out_offsets[row]; e < xrefs.out_offsets[row + 1]; ++e) {
+        if (xrefs.out[e].kind != XREF_CALL) continue;
+        const long callee = function_index_find(functions, xrefs.out[e].pc);
+        if (callee < 0) continue;
+        calls[count].caller = f;
+        calls[count].callee = callee;
+        ++count;
+      }
+    }
+  }
+
+  qsort(calls, count, sizeof(Call), compare_by_caller);
+  {
+    size_t unique = 0;
+    for (size_t i = 0; i < count; ++i) {
+      if (unique > 0 && calls[unique - 1].caller == calls[i].caller &&
+          calls[unique - 1].callee == calls[i].callee) continue;
+      calls[unique++] = calls[i];
+    }
+    count = unique;
+  }
+  if (!build_call_rows(calls, count, functions.count, false, &graph->callee_offsets,
+                       &graph->callees)) goto cleanup;
+
+  qsort(calls, count, sizeof(Call), compare_by_callee);
+  if (!build_call_rows(calls, count, functions.count, true, &graph->caller_offsets,
+                       &graph->callers)) goto cleanup;
+  ok = true;
+
+cleanup:
+  free(calls);
+  if (!ok) call_graph_free(graph);
+  return ok;
+}
+
+void call_graph_free(CallGraph* graph) {
+  free(graph->callee_offsets);
+  free(graph->callees);
+  free(graph->caller_offsets);
+  free(graph->callers);
+  memset(graph, 0, sizeof(CallGraph));
+}
+
+bool call_graph_write_dot(const CallGraph& graph, const FunctionIndex& functions, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) return false;
+  fprintf(file, "digraph calls {\n");
+  for (size_t f = 0; f < graph.function_count; ++f) {
+    const uint32_t* callees;
+    const size_t count = call_graph_callees(graph, f, &callees);
+    for (size_t i = 0; i < count; ++i) {
+      fprintf(file, "  func_%08X -> func_%08X;\n", functions.start[f], functions.start[callees[i]]);
+    }
+  }
+  fprintf(file, "}\n");
+  const bool written = ferror(file) == 0;
+  return fclose(file) == 0 && written;
+}
+
+static const uint32_t REG_ZERO = 0;
+// preserved across calls: $s0-$s7, $gp, $sp, $fp
+static const uint32_t SAVED_REGS = 0xFF << 16 | 0x7 << 28;
+
+struct AddressList {
+  AddressRef* items;
+  size_t size;
+  size_t capacity;
+};
+
+static bool address_push(AddressList* list, const uint32_t address, const DecodedInstruction& inst) {
+  if (list->size == list->capacity) {
+    const size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+    AddressRef* items = (AddressRef*) realloc(list->items, capacity * sizeof(AddressRef));
+    if (items == NULL) return false;
+    list->items = items;
+    list->capacity = capacity;
+  }
+  AddressRef* ref = &list->items[list->size++];
+  ref->address = address;
+  ref->pc = inst.pc;
+  ref->mnemonic = inst.mnemonic;
+  return true;
+}
+
+static inline bool is_store(const uint8_t mnemonic) {
+  switch (mnemonic) {
+    case MN_SB:
+    case MN_SH:
+    case MN_SWL:
+    case MN_SW:
+    case MN_SDL:
+    case MN_SDR:
+    case MN_SWR:
+    case MN_SD:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// general purpose register written by the instruction, REG_ZERO if none
+static uint32_t written_reg(const DecodedInstruction& inst) {
+  switch (inst.format) {
+    case FMT_SHIFT:
+    case FMT_SHIFT_HEX:
+    case FMT_SHIFTV:
+    case FMT_RD:
+    case FMT_RD_RS:
+    case FMT_RD_RS_RT:
+      return inst.rd;
+    case FMT_RT_RS_SIMM:
+    case FMT_RT_RS_UIMM:
+    case FMT_RT_RS_PCREL:
+    case FMT_LUI:
+      return inst.rt;
+    case FMT_MEM:
+      return is_store(inst.mnemonic) ? REG_ZERO : inst.rt;
+    case FMT_MOVE_COP0:
+    case FMT_MOVE_COP:
+      switch (inst.mnemonic) {
+        case MN_MFC0:
+        case MN_DMFC0:
+        case MN_MFC1:
+        case MN_CFC1:
+        case MN_MFC2:
+        case MN_CFC2:
+          return inst.rt;
+        default:
+          return REG_ZERO;
+      }
+    default:
+      return REG_ZERO;
+  }
+}
+
+static int compare_by_address(const void* a, const void* b) {
+  const AddressRef* ref_a = (const AddressRef*) a;
+  const AddressRef* ref_b = (const AddressRef*) b;
+  if (ref_a->address != ref_b->address) return ref_a->address < ref_b->address ? -1 : 1;
+  return ref_a->pc < ref_b->pc ? -1 : ref_a->pc > ref_b->pc;
+}
+
+bool address_refs_build(AddressRefs* refs, const byte* data, const CodeMap& map,
+                        const FunctionIndex& functions, const int options) {
+  bool ok = false;
+  AddressList list = {NULL, 0, 0};
+  memset(refs, 0, sizeof(AddressRefs));
+
+  for (size_t f = 0; f < functions.count; ++f) {
+    // registers holding a lui value, and the values
+    uint32_t known = 0;
+    uint32_t upper[32];
+    // the callee clobbers the registers after the delay slot
+    bool call_pending = false;
+
+    for (uint32_t pc = functions.start[f]; pc < functions.end[f]; pc += 4) {
+      const uint32_t index = (pc - map.base_pc) / 4;
+      if (!code_map_reachable(map, index)) continue;
+      const byte* at = &data[map.start + index * 4];
+      DecodedInstruction inst;
+      mips_decode(pc, at[0] << 24 | at[1] << 16 | at[2] << 8 | at[3], &inst, options);
+
+      const bool base_known = (known >> inst.rs) & 1;
+      switch (inst.format) {
+        case FMT_RT_RS_SIMM:
+          if (base_known && (inst.mnemonic == MN_ADDIU || inst.mnemonic == MN_ADDI)) {
+            if (!address_push(&list, upper[inst.rs] + inst.imm, inst)) goto cleanup;
+          }
+          break;
+        case FMT_RT_RS_UIMM:
+          if (base_known && inst.mnemonic == MN_ORI) {
+            if (!address_push(&list, upper[inst.rs] | inst.imm, inst)) goto cleanup;
+          }
+          break;
+        case FMT_MEM:
+        case FMT_FMEM:
+          if (base_known) {
+            if (!address_push(&list, upper[inst.rs] + inst.imm, inst)) goto cleanup;
+          }
+          break;
+        default:
+          break;
+      }
+
+      const uint32_t written = written_reg(inst);
+      if (inst.mnemonic == MN_LUI) {
+        upper[inst.rt] = (uint32_t) inst.imm << 16;
+        known |= 1u << inst.rt;
+      } else if (written != REG_ZERO) {
+        known &= ~(1u << written);
+      }
+      if (call_pending) known &= SAVED_REGS;
+      call_pending = (inst.flags & MIPS_LINK) != 0;
+      known &= ~1u;
+    }
+  }
+
+  refs->count = list.size;
+  refs->by_pc = list.items;
+  list.items = NULL;
+  refs->by_address = (AddressRef*) malloc((refs->count + 1) * sizeof(AddressRef));
+  if (refs->by_address == NULL) goto cleanup;
+  memcpy(refs->by_address, refs->by_pc, refs->count * sizeof(AddressRef));
+  qsort(refs->by_address, refs->count, sizeof(AddressRef), compare_by_address);
+  ok = true;
+
+cleanup:
+  free(list.items);
+  if (!ok) address_refs_free(refs);
+  return ok;
+}
+
+void address_refs_free(AddressRefs* refs) {
+  free(refs->by_pc);
+  free(refs->by_address);
+  memset(refs, 0, sizeof(AddressRefs));
+}
+
+size_t address_refs_find(const AddressRefs& refs, const uint32_t address, const AddressRef** first) {
+  size_t low = 0;
+  size_t high = refs.count;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    if (refs.by_address[mid].address < address) low = mid + 1;
+    else high = mid;
+  }
+  *first = &refs.by_address[low];
+  size_t count = 0;
+  while (low + count < refs.count && refs.by_address[low + count].address == address) ++count;
+  return count;
+}
+
+bool address_refs_write(const AddressRefs& refs, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) return false;
+  for (size_t i = 0; i < refs.count; ++i) {
+    const AddressRef& ref = refs.by_address[i];
+    if (i == 0 || refs.by_address[i - 1].address != ref.address) {
+      if (i > 0) fprintf(file, "\n");
+      fprintf(file, "0x%08X:", ref.address);
+    }
+    fprintf(file, " 0x%08X", ref.pc);
+  }
+  if (refs.count > 0) fprintf(file, "\n");
+  const bool written = ferror(file) == 0;
+  return fclose(file) == 0 && written;
+}
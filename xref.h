@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "analysis.h"
+
+/*
+  Cross references and call graph, built from the edges collected by
+  code_map_build() so the ROM isn't decoded again.
+
+  Both are compressed sparse rows: the nodes are sorted, and the edges
+  of node i are the ones in [offsets[i], offsets[i + 1]).
+*/
+
+// The other end of an edge
+struct Xref {
+  uint32_t pc;
+  uint8_t kind;
+};
+
+struct XrefIndex {
+  // by source address, to the targets
+  size_t source_count;
+  uint32_t* sources;
+  uint32_t* out_offsets;
+  Xref* out;
+  // by target address, to the sources
+  size_t target_count;
+  uint32_t* targets;
+  uint32_t* in_offsets;
+  Xref* in;
+};
+
+bool xref_index_build(XrefIndex* index, const XrefEdges& edges);
+void xref_index_free(XrefIndex* index);
+// References to pc, returns their count and points refs to the first
+size_t xref_to(const XrefIndex& index, const uint32_t pc, const Xref** refs);
+// References made by the instruction at pc
+size_t xref_from(const XrefIndex& index, const uint32_t pc, const Xref** refs);
+
+// Calls between the functions of a FunctionIndex, by function number.
+// Each caller/callee pair is listed once.
+struct CallGraph {
+  size_t function_count;
+  uint32_t* callee_offsets;
+  uint32_t* callees;
+  uint32_t* caller_offsets;
+  uint32_t* callers;
+};
+
+bool call_graph_build(CallGraph* graph, const XrefIndex& xrefs, const FunctionIndex& functions);
+void call_graph_free(CallGraph* graph);
+
+inline size_t call_graph_callees(const CallGraph& graph, const size_t function, const uint32_t** callees) {
+  *callees = &graph.callees[graph.callee_offsets[function]];
+  return graph.callee_offsets[function + 1] - graph.callee_offsets[function];
+}
+
+inline size_t call_graph_callers(const CallGraph& graph, const size_t function, const uint32_t** callers) {
+  *callers = &graph.callers[graph.caller_offsets[function]];
+  return graph.caller_offsets[function + 1] - graph.caller_offsets[function];
+}
+
+// Graphviz export of the call graph
+bool call_graph_write_dot(const CallGraph& graph, const FunctionIndex& functions, const char* path);
+
+/*
+  Full addresses built in two halves, `lui` then `addiu`, `ori` or the
+  offset of a load/store on the same register. Each function is read
+  in order keeping the last `lui` value of every register, a register
+  loses it when it is written by anything else or clobbered by a call.
+  The control flow isn't followed, this is meant for the usual pairs a
+  few instructions apart.
+*/
+
+struct AddressRef {
+  uint32_t address;
+  // the instruction completing the address
+  uint32_t pc;
+  uint8_t mnemonic;
+};
+
+struct AddressRefs {
+  size_t count;
+  AddressRef* by_pc;
+  AddressRef* by_address;
+};
+
+bool address_refs_build(AddressRefs* refs, const byte* data, const CodeMap& map,
+                        const FunctionIndex& functions, const int options);
+void address_refs_free(AddressRefs* refs);
+// Instructions referencing address, returns their count and points to the first
+size_t address_refs_find(const AddressRefs& refs, const uint32_t address, const AddressRef** first);
+// Listing by address, one line per address with the instructions using it
+bool address_refs_write(const AddressRefs& refs, const char* path);